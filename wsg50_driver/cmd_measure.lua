@@ -2,12 +2,26 @@
 -- Command-and-measure script
 -- Works with extended wsg_50 ROS package
 -- Tests showed about 20Hz rate
+-- 0xB3 returns a batch of samples taken at a fixed period in one frame.
+-- Commands are not processed while a batch is being recorded.
+-- 0xB4 with a period starts pushing 0xB4 measurement frames on our own;
+-- commands are still accepted in between (period 0 stops).
+-- 0xB5 sets a set-point. While streaming, it is followed by speed control,
+-- so a new set-point changes the motion without stopping it.
 
 cmd.register(0xB0); -- Measure only
 cmd.register(0xB1); -- Position control
 cmd.register(0xB2); -- Speed control
+cmd.register(0xB3); -- Measure batch
+cmd.register(0xB4); -- Stream measurements
+cmd.register(0xB5); -- Set-point
+BATCH_MAX = 32;     -- Must match SCRIPT_BATCH_MAX_SAMPLES of the driver
 def_speed = 5;
 is_speed = false;
+stream_period = 0;  -- ms between pushed frames, 0: off
+TRACK_GAIN = 10;    -- Speed in mm/s per mm to go when following a set-point
+TRACK_DEADBAND = 0.2; -- mm
+track = false; track_pos = 0; track_speed = 0;
 
 -- Get number of FMF fingers
 nfin = 0;
@@ -24,8 +38,85 @@ function hasbit(x, p)
   return x % (p + p) >= p       
 end
 
+-- Gripper time in ms; falls back to counting periods without os.clock()
+clock_ms = 0;
+function now_ms(period)
+    if os and os.clock then
+        return math.floor(os.clock() * 1000);
+    end
+    clock_ms = clock_ms + period;
+    return clock_ms;
+end
+
+-- Integer to little endian bytes
+function itob(x, n)
+    b = {};
+    for i = 1,n do
+        b[i] = x % 256;
+        x = math.floor(x / 256);
+    end
+    return b;
+end
+
+-- Batch of measurements:
+-- payload[1]: # of samples, payload[2..3]: period in ms
+-- Reply: # of samples, uint32 time of first sample in ms, then per sample
+-- uint16 ms since first sample, state (lowest byte), pos, speed, force, force_l, force_r
+function measure_batch(payload)
+    n = payload[1];
+    period = payload[2] + payload[3] * 256;
+    if n < 1 or n > BATCH_MAX then
+        cmd.send(0xB3, etob(E_RANGE_ERROR));
+        return;
+    end
+
+    out = {};
+    t0 = 0;
+    for i = 1,n do
+        if i > 1 then
+            sleep(period);
+        end
+        t = now_ms(period);
+        if i == 1 then t0 = t; end
+        force_l = math.nan; force_r = math.nan;
+        if nfin >= 1 then force_l = finger.data(0) end
+        if nfin >= 2 then force_r = finger.data(1) end
+        table.insert(out, itob((t - t0) % 65536, 2));
+        table.insert(out, {gripper.state() % 256});
+        table.insert(out, ntob(mc.position()));
+        table.insert(out, ntob(mc.speed()));
+        table.insert(out, ntob(mc.aforce()));
+        table.insert(out, ntob(force_l));
+        table.insert(out, ntob(force_r));
+    end
+
+    if cmd.online() then
+        cmd.send(0xB3, etob(E_SUCCESS), n, itob(t0 % 4294967296, 4), out);
+    end
+end
+
 function process()
-    id, payload = cmd.read();
+    -- While streaming, only wait for commands until the next frame is due
+    push = false;
+    if stream_period > 0 and cmd.available() == 0 then
+        sleep(stream_period);
+        id = 0xB4; push = true;
+    else
+        id, payload = cmd.read();
+    end
+
+    if id == 0xB3 then
+        measure_batch(payload);
+        return;
+    end
+    -- payload[1..2]: period in ms; acknowledged without measurement
+    if id == 0xB4 and not push then
+        stream_period = payload[1] + payload[2] * 256;
+        -- Nobody follows the set-point without the stream
+        if stream_period == 0 and track then mc.stop(); track = false; end
+        cmd.send(0xB4, etob(E_SUCCESS));
+        return;
+    end
     -- ==== Measurements (1) ====
     busy = mc.busy()
     blocked = mc.blocked()
@@ -37,6 +128,7 @@ function process()
         cmd_speed = bton({payload[6],payload[7],payload[8],payload[9]});
         -- printf("Got command %f, %f\n", cmd_width, cmd_speed)
         print("set_pos");
+        track = false;
         if busy then mc.stop(); end
         mc.move(cmd_width, math.abs(cmd_speed), 0)
     -- Velocity control
@@ -44,13 +136,35 @@ function process()
         -- do_speed = hasbit(payload[1], 0x02);
         cmd_speed = bton({payload[6],payload[7],payload[8],payload[9]});
         print("set_speed");
+        track = false;
         is_speed = true;
         def_speed = cmd_speed;
         mc.speed(cmd_speed);
+    -- Set-point
+    elseif id == 0xB5 then
+        track_pos = bton({payload[2],payload[3],payload[4],payload[5]});
+        track_speed = math.abs(bton({payload[6],payload[7],payload[8],payload[9]}));
+        if stream_period > 0 then
+            track = true; is_speed = false;
+        else
+            if busy then mc.stop(); end
+            mc.move(track_pos, track_speed, 0)
+        end
     end
         
        
     -- ==== Actions ====
+    -- Follow the set-point, slowing down when getting close
+    if track then
+        err = track_pos - pos;
+        if math.abs(err) <= TRACK_DEADBAND or blocked then
+            mc.stop(); track = false;
+        else
+            v = math.min(track_speed, TRACK_GAIN * math.abs(err));
+            if err < 0 then v = -v; end
+            mc.speed(v);
+        end
+    end
     -- Stop if in speed mode
     -- print(blocked, is_speed, pos);
     if blocked and is_speed and pos <= 50 and def_speed < 0 then
@@ -0,0 +1,83 @@
+//======================================================================
+/**
+ *  @file
+ *  can.h
+ *
+ *  @section can.h_general General file information
+ *
+ *  @brief
+ *  SocketCAN interface (Header file)
+ *
+ *  The gripper's byte stream is carried in the data bytes of CAN frames,
+ *  up to 8 bytes per frame. Commands are sent with one identifier, the
+ *  answers arrive with another one.
+ */
+//======================================================================
+
+
+#ifndef CAN_H_
+#define CAN_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <time.h>
+#include <sys/uio.h>
+#include <linux/can.h>
+
+#include "common.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define CAN_FRAME_DLEN		8			// Data bytes of a classic CAN frame
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef struct
+{
+	const char *device;				// Network interface, e.g. can0
+	unsigned int tx_id;				// Identifier of the frames sent to the gripper
+	unsigned int rx_id;				// Identifier of the gripper's frames; identifiers above 0x7FF are extended ones
+} can_params_t;
+
+
+typedef struct
+{
+	int sock;
+	canid_t tx_id;
+	unsigned char rest[CAN_FRAME_DLEN];	// Data of a frame that did not fit into the last read
+	unsigned int rest_pos, rest_len;
+	struct timespec rx_time;		// Kernel receive time of the last frame read
+	bool rx_time_valid;
+} can_conn_t;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+int can_open( void *conn, const void *params );
+void can_close( void *conn );
+int can_read( void *conn, unsigned char *buf, unsigned int len );
+int can_write( void *conn, unsigned char *buf, unsigned int len );
+int can_get_bytes_count( void *conn );
+int can_writev( void *conn, const struct iovec *iov, unsigned int iovcnt );
+int can_get_fd( void *conn );
+int can_get_rx_time( void *conn, struct timespec *ts );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAN_H_ */
@@ -58,6 +58,9 @@ extern "C" {
 //------------------------------------------------------------------------
 
 unsigned short checksum_update_crc16( unsigned char *data, unsigned int size, unsigned short crc );
+unsigned short checksum_update_crc16_bytewise( unsigned char *data, unsigned int size, unsigned short crc );
+unsigned short checksum_update_crc16_slice4( unsigned char *data, unsigned int size, unsigned short crc );
+unsigned short checksum_update_crc16_slice8( unsigned char *data, unsigned int size, unsigned short crc );
 unsigned short checksum_crc16( unsigned char *data, unsigned int size );
 
 #ifdef __cplusplus
@@ -32,12 +32,14 @@
 //------------------------------------------------------------------------
 
 #include "common.h"
+#include "msg.h"
 
 
 //------------------------------------------------------------------------
 // Macros
 //------------------------------------------------------------------------
 
+#define CMD_RESPONSE_BUFSIZE	1024		// Max. response payload size of the allocating functions
 
 
 #ifdef __cplusplus
@@ -48,6 +50,29 @@ extern "C" {
 // Typedefs, enums, structs
 //------------------------------------------------------------------------
 
+typedef struct
+{
+	unsigned char id;				// Command ID
+	unsigned char *payload;			// Payload data
+	unsigned int len;				// Payload length
+	bool pending;					// CMD_PENDING is allowed as intermediate status
+} cmd_request_t;
+
+
+struct dispatcher_conn;
+struct tcp_options;
+struct serial_options;
+
+// Connection to one gripper. A thread's cmd_* calls use the connection it
+// has selected with cmd_select(), by default one that exists statically.
+typedef struct
+{
+	msg_link_t link;
+	bool connected;						// Written on (dis)connect, read by every thread sending; accessed atomically
+	bool failed;						// Link broke while connected, see cmd_mark_failed()
+	struct dispatcher_conn *dispatch;	// Response queues and subscribers, NULL if the dispatcher is not running
+} cmd_conn_t;
+
 
 //------------------------------------------------------------------------
 // Global variables
@@ -58,19 +83,40 @@ extern "C" {
 // Function declaration
 //------------------------------------------------------------------------
 
+cmd_conn_t *cmd_conn_create( void );
+void cmd_conn_destroy( cmd_conn_t *conn );
+void cmd_select( cmd_conn_t *conn );
+cmd_conn_t *cmd_selected( void );
+
 int cmd_connect_tcp( const char *addr, unsigned short port );
+int cmd_connect_tcp_options( const char *addr, unsigned short port, const struct tcp_options *options );
 int cmd_connect_udp( unsigned short local_port, const char *addr, unsigned short remote_port );
 int cmd_connect_serial( const char *device, unsigned int bitrate );
+int cmd_connect_serial_options( const char *device, unsigned int bitrate, const struct serial_options *options );
+int cmd_connect_can( const char *device, unsigned int tx_id, unsigned int rx_id );
+int cmd_connect_replay( const char *path, double speed );
 
 void cmd_disconnect( void );
 bool cmd_is_connected( void );
+void cmd_mark_failed( cmd_conn_t *conn );
+bool cmd_link_ok( void );
 status_t cmd_get_response_status( unsigned char *response );
 
 int cmd_submit( unsigned char id, unsigned char *payload, unsigned int len,
  			    bool pending, unsigned char **response, unsigned int *response_len );
+int cmd_submit_into( unsigned char id, unsigned char *payload, unsigned int len,
+					 bool pending, unsigned char *response, unsigned int size );
+int cmd_submit_retry_into( unsigned char id, unsigned char *payload, unsigned int len,
+						   bool pending, unsigned char *response, unsigned int size );
+int cmd_submit_urgent_into( unsigned char id, unsigned char *payload, unsigned int len,
+							bool pending, unsigned char *response, unsigned int size );
+
+int cmd_submit_batch( const cmd_request_t *cmds, unsigned int count, status_t *status );
 
 int cmd_submit_async( unsigned char id, unsigned char *payload, unsigned int len);
 int cmd_recv_ack( unsigned char id, unsigned char **response, unsigned int *response_len);
+int cmd_recv_ack_into( unsigned char id, unsigned char *response, unsigned int size, unsigned int *response_len );
+int cmd_wait_ack_into( unsigned char id, unsigned char *response, unsigned int size, unsigned int *response_len, int timeout_ms );
 
 #ifdef __cplusplus
 }
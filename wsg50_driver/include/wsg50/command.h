@@ -0,0 +1,286 @@
+//======================================================================
+/**
+ *  @file
+ *  command.h
+ *
+ *  @section command.h_general General file information
+ *
+ *  @brief
+ *  Compile-time descriptors of the gripper commands
+ *
+ *  A command is described once by its ID and the fields of its request
+ *  and response payload, e.g.
+ *
+ *      typedef command<0x21, fields<uint8_t, float, float>> cmd_move;
+ *
+ *  The payload sizes follow from the field types at compile time, so the
+ *  request is encoded into and the response decoded from buffers on the
+ *  stack, and the response length is checked against a constant. Sync
+ *  (call()) and async (submit_async(), send()) variants all come from the
+ *  same descriptor, as do those taking the priority lane (call_urgent(),
+ *  send_urgent()). All fields are little endian, as on the wire. Settings
+ *  and queries are idempotent: call() sends them again if their response
+ *  is overdue, see cmd_submit_retry_into().
+ */
+//======================================================================
+
+
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "cmd.h"
+#include "dispatcher.h"
+#include "msg.h"
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// Encoding of a single field
+template <typename T> struct le_field;
+
+template <> struct le_field<uint8_t>
+{
+	static constexpr unsigned int size = 1;
+	static void put( unsigned char *p, uint8_t v ) { p[0] = v; }
+	static uint8_t get( const unsigned char *p ) { return p[0]; }
+};
+
+template <> struct le_field<uint16_t>
+{
+	static constexpr unsigned int size = 2;
+	static void put( unsigned char *p, uint16_t v ) { p[0] = (unsigned char) v; p[1] = (unsigned char) ( v >> 8 ); }
+	static uint16_t get( const unsigned char *p ) { return (uint16_t) ( p[0] | ( p[1] << 8 ) ); }
+};
+
+template <> struct le_field<uint32_t>
+{
+	static constexpr unsigned int size = 4;
+	static void put( unsigned char *p, uint32_t v ) { for ( unsigned int i = 0; i < 4; i++ ) p[i] = (unsigned char) ( v >> ( 8 * i ) ); }
+	static uint32_t get( const unsigned char *p )
+	{
+		return (uint32_t) p[0] | ( (uint32_t) p[1] << 8 ) | ( (uint32_t) p[2] << 16 ) | ( (uint32_t) p[3] << 24 );
+	}
+};
+
+// IEEE 754 single precision; the copy of the bit pattern compiles to a register move
+template <> struct le_field<float>
+{
+	static constexpr unsigned int size = 4;
+	static void put( unsigned char *p, float v ) { uint32_t u; memcpy( &u, &v, 4 ); le_field<uint32_t>::put( p, u ); }
+	static float get( const unsigned char *p ) { uint32_t u = le_field<uint32_t>::get( p ); float v; memcpy( &v, &u, 4 ); return v; }
+};
+
+
+// Sequence of fields, packed without gaps
+template <typename... T> struct fields;
+
+template <> struct fields<>
+{
+	static constexpr unsigned int size = 0;
+	static void put( unsigned char * ) {}
+	static void get( const unsigned char * ) {}
+};
+
+template <typename T, typename... R> struct fields<T, R...>
+{
+	static constexpr unsigned int size = le_field<T>::size + fields<R...>::size;
+
+	static void put( unsigned char *p, T v, R... r )
+	{
+		le_field<T>::put( p, v );
+		fields<R...>::put( p + le_field<T>::size, r... );
+	}
+
+	static void get( const unsigned char *p, T &v, R &... r )
+	{
+		v = le_field<T>::get( p );
+		fields<R...>::get( p + le_field<T>::size, r... );
+	}
+};
+
+
+// Command with the given ID; the response payload starts with the status
+// (2 bytes) followed by the response fields
+template <unsigned char Id, typename Request, typename Response = fields<>> struct command;
+
+template <unsigned char Id, typename... Req, typename... Resp>
+struct command<Id, fields<Req...>, fields<Resp...>>
+{
+	typedef fields<Req...> request;
+	typedef fields<Resp...> response;
+
+	static constexpr unsigned char id = Id;
+	static constexpr unsigned int request_len = request::size;
+	static constexpr unsigned int response_len = 2 + response::size;
+
+	// Sending it twice does no harm: settings (0x30 - 0x36), state (0x40 - 0x45),
+	// system information and finger data (0x63, 0x73). Not the motions, stops and scripts.
+	static constexpr bool idempotent = ( Id >= 0x30 && Id <= 0x36 ) || ( Id >= 0x40 && Id <= 0x45 ) ||
+									   Id == 0x50 || Id == 0x63 || Id == 0x73;
+
+	static_assert( response_len <= CMD_RESPONSE_BUFSIZE, "response does not fit into the receive buffer" );
+
+	/**
+	 * Encode the request payload, e.g. for cmd_submit_batch()
+	 *
+	 * @param *payload		At least request_len bytes
+	 *
+	 * @return Length of the payload
+	 */
+	static unsigned int encode( unsigned char *payload, Req... in )
+	{
+		request::put( payload, in... );
+		return request_len;
+	}
+
+	/**
+	 * Send the command and wait for its response. Error responses carry
+	 * the status only; a successful one must have all response fields.
+	 *
+	 * @param pending		E_CMD_PENDING is allowed as intermediate status
+	 * @param *status		Status of the response
+	 * @param in, out		Request fields, then the response fields
+	 *
+	 * @return 0 if the response has status E_SUCCESS (or E_CMD_PENDING when
+	 *         pending is set), -1 on failure; *status tells why
+	 *         (E_READ_ERROR if no response was received)
+	 */
+	static int call( bool pending, status_t *status, Req... in, Resp &... out )
+	{
+		return call_via( idempotent ? &cmd_submit_retry_into : &cmd_submit_into, pending, status, in..., out... );
+	}
+
+	/**
+	 * As call(), but the command overtakes all commands other threads are
+	 * waiting to send, see dispatcher_send_urgent(). For stops.
+	 */
+	static int call_urgent( bool pending, status_t *status, Req... in, Resp &... out )
+	{
+		static_assert( request_len <= MSG_URGENT_LEN, "request does not fit into the priority lane" );
+		return call_via( &cmd_submit_urgent_into, pending, status, in..., out... );
+	}
+
+	typedef int ( *submit_fn )( unsigned char, unsigned char *, unsigned int, bool, unsigned char *, unsigned int );
+
+	static int call_via( submit_fn submit, bool pending, status_t *status, Req... in, Resp &... out )
+	{
+		unsigned char payload[request_len + 1];			// Never empty
+		unsigned char resp[response_len];
+		int res;
+
+		request::put( payload, in... );
+		res = submit( id, payload, request_len, pending, resp, sizeof( resp ) );
+		if ( res < 2 )
+		{
+			dbgPrint( "Command 0x%02X: no valid response (%d)\n", id, res );
+			*status = E_READ_ERROR;
+			return -1;
+		}
+
+		*status = cmd_get_response_status( resp );
+		if ( *status != E_SUCCESS && !( pending && *status == E_CMD_PENDING ) ) return -1;
+
+		if ( (unsigned int) res != response_len )
+		{
+			dbgPrint( "Response payload length doesn't match (is %d, expected %u)\n", res, response_len );
+			*status = E_CMD_FORMAT_ERROR;
+			return -1;
+		}
+
+		response::get( &resp[2], out... );
+		return 0;
+	}
+
+	/**
+	 * Send the command; its response is taken later with cmd_wait_ack_into()
+	 *
+	 * @return 0 on success, -1 on error
+	 */
+	static int submit_async( Req... in )
+	{
+		unsigned char payload[request_len + 1];
+		request::put( payload, in... );
+		return cmd_submit_async( id, payload, request_len ) < 0 ? -1 : 0;
+	}
+
+	/**
+	 * Send the command without expecting the response, e.g. because a
+	 * dispatcher subscription handles it
+	 *
+	 * @return 0 on success, -1 on error
+	 */
+	static int send( Req... in )
+	{
+		unsigned char payload[request_len + 1];
+		msg_t msg;
+
+		request::put( payload, in... );
+		msg.id = id;
+		msg.len = request_len;
+		msg.data = payload;
+		return msg_send( &cmd_selected()->link, &msg ) > 0 ? 0 : -1;
+	}
+
+	/**
+	 * As send(), but through the priority lane
+	 *
+	 * @return 0 on success, -1 on error
+	 */
+	static int send_urgent( Req... in )
+	{
+		static_assert( request_len <= MSG_URGENT_LEN, "request does not fit into the priority lane" );
+		unsigned char payload[request_len + 1];
+		msg_t msg;
+
+		request::put( payload, in... );
+		msg.id = id;
+		msg.len = request_len;
+		msg.data = payload;
+		return dispatcher_send_urgent( &msg );
+	}
+};
+
+
+// Commands of the gripper, see the WSG command set reference
+typedef command<0x20, fields<uint8_t>> cmd_homing;										// direction
+typedef command<0x21, fields<uint8_t, float, float>> cmd_move;							// flags, width, speed
+typedef command<0x22, fields<>> cmd_stop;
+typedef command<0x23, fields<>> cmd_fast_stop;
+typedef command<0x24, fields<uint8_t, uint8_t, uint8_t>> cmd_ack_fault;					// "ack"
+typedef command<0x25, fields<float, float>> cmd_grasp;									// width, speed
+typedef command<0x26, fields<float, float>> cmd_release;								// width, speed
+typedef command<0x30, fields<float>> cmd_set_acceleration;
+typedef command<0x31, fields<>, fields<float>> cmd_get_acceleration;
+typedef command<0x32, fields<float>> cmd_set_force_limit;
+typedef command<0x33, fields<>, fields<float>> cmd_get_force_limit;
+typedef command<0x34, fields<float, float>> cmd_set_soft_limits;						// minus, plus
+typedef command<0x35, fields<>, fields<float, float>> cmd_get_soft_limits;
+typedef command<0x36, fields<>> cmd_clear_soft_limits;
+typedef command<0x40, fields<uint8_t, uint16_t>, fields<uint32_t>> cmd_system_state;		// update flags, period; SF_xxx flags
+typedef command<0x41, fields<uint8_t, uint16_t>, fields<uint8_t>> cmd_grasping_state;	// update flags, period; state
+typedef command<0x43, fields<uint8_t, uint16_t>, fields<float>> cmd_get_opening;		// update flags, period; width
+typedef command<0x44, fields<uint8_t, uint16_t>, fields<float>> cmd_get_speed;
+typedef command<0x45, fields<uint8_t, uint16_t>, fields<float>> cmd_get_force;
+typedef command<0x50, fields<>, fields<uint8_t, uint8_t, uint16_t, uint32_t>> cmd_system_info;	// type, hw rev., fw version, s/n
+typedef command<0x63, fields<>, fields<float>> cmd_get_finger1_data;					// force of an FMF finger
+typedef command<0x73, fields<>, fields<float>> cmd_get_finger2_data;
+
+// Sample of the measure script: state (lowest byte), position, speed,
+// motor force and forces of finger 0 and 1
+typedef fields<uint8_t, float, float, float, float, float> script_measurement;
+// Commands of the measure script (0xB0 - 0xB2, 0xB5): flag, width, speed
+template <unsigned char Id> using script_command = command<Id, fields<uint8_t, float, float>, script_measurement>;
+typedef command<0xB3, fields<uint8_t, uint16_t>> cmd_script_batch;						// count, period in ms; variable response
+typedef command<0xB4, fields<uint16_t>> cmd_script_stream;								// period in ms
+
+#endif /* COMMAND_H_ */
@@ -43,6 +43,27 @@
 
 #define ASSERT( cond )				assert( cond )
 
+// System state flags (response of command 0x40, see getStateValues())
+#define SF_REFERENCED				0x00000001	// D0: Fingers referenced
+#define SF_MOVING					0x00000002	// D1: Fingers are currently moving
+#define SF_BLOCKED_MINUS			0x00000004	// D2: Axis blocked in negative moving direction
+#define SF_BLOCKED_PLUS				0x00000008	// D3: Axis blocked in positive moving direction
+#define SF_SOFT_LIMIT_MINUS			0x00000010	// D4: Negative direction soft limit reached
+#define SF_SOFT_LIMIT_PLUS			0x00000020	// D5: Positive direction soft limit reached
+#define SF_AXIS_STOPPED				0x00000040	// D6: Axis stopped
+#define SF_TARGET_POS_REACHED		0x00000080	// D7: Target position reached
+#define SF_OVERDRIVE_MODE			0x00000100	// D8: Overdrive mode
+#define SF_FORCECNTL_MODE			0x00000200	// D9: Force control mode
+#define SF_FAST_STOP				0x00001000	// D12: Fast stop
+#define SF_TEMP_WARNING				0x00002000	// D13: Temperature warning
+#define SF_TEMP_FAULT				0x00004000	// D14: Temperature error
+#define SF_POWER_FAULT				0x00008000	// D15: Power error
+#define SF_CURR_FAULT				0x00010000	// D16: Engine current error
+#define SF_FINGER_FAULT				0x00020000	// D17: Finger fault
+#define SF_CMD_FAILURE				0x00040000	// D18: Command error
+#define SF_SCRIPT_RUNNING			0x00080000	// D19: A script is currently running
+#define SF_SCRIPT_FAILURE			0x00100000	// D20: Script error
+
 //! Macro for detecting errors and exiting using the error code:
 #define EXIT_ON_ERROR( error_code, msg ) \
 	do { \
@@ -0,0 +1,72 @@
+//======================================================================
+/**
+ *  @file
+ *  dispatcher.h
+ *
+ *  @section dispatcher.h_general General file information
+ *
+ *  @brief
+ *  Response dispatcher: a single reader thread owns the gripper links
+ *  and routes incoming messages by ID (Header file)
+ */
+//======================================================================
+
+
+#ifndef DISPATCHER_H_
+#define DISPATCHER_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include "common.h"
+#include "msg.h"
+#include "rt.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define DISPATCHER_QUEUE_LEN		8			// Queued responses per command ID; the oldest is dropped on overflow
+#define DISPATCHER_RX_BUFSIZE		1024		// Max. payload size accepted by the reader thread
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+/**
+ * Subscriber callback. Called from the reader thread for every message
+ * with the subscribed ID; msg->data is only valid during the call.
+ */
+typedef void ( *dispatcher_cb_t ) ( const msg_t *msg, void *arg );
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+int dispatcher_start( void );
+void dispatcher_stop( void );
+void dispatcher_release( struct dispatcher_conn *dc );
+bool dispatcher_is_running( void );
+void dispatcher_set_thread_options( const rt_options_t *options );
+
+int dispatcher_subscribe( unsigned char id, dispatcher_cb_t cb, void *arg );
+void dispatcher_unsubscribe( unsigned char id );
+bool dispatcher_is_subscribed( unsigned char id );
+
+int dispatcher_send_urgent( const msg_t *msg );
+int dispatcher_receive( unsigned char id, msg_t *msg, unsigned char *buf, unsigned int size, int timeout_ms );
+void dispatcher_flush( unsigned char id );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISPATCHER_H_ */
@@ -28,6 +28,7 @@
 #define FUNCTIONS_H_
 
  #include <string>
+ #include <atomic>
 
 //------------------------------------------------------------------------
 // Includes
@@ -38,6 +39,9 @@
 // Macros
 //------------------------------------------------------------------------
 
+#define SEQUENCE_MAX_STEPS	32	// Max. number of steps of execute_sequence()
+#define SCRIPT_BATCH_MAX_SAMPLES		32	// Max. samples per frame of script_measure_batch(), see cmd_measure.lua
+#define SCRIPT_BATCH_MAX_DURATION_MS	500	// Max. time the script may take for one batch
 
 
 /*#ifdef __cplusplus
@@ -53,8 +57,32 @@ typedef struct {
 	float position, speed, acceleration;
 	float f_motor, f_finger0, f_finger1;
 	std::string state_text;
+	double t;				// Gripper time of the sample in s, see script_measure_batch()
 } gripper_response;
 
+typedef struct {
+	unsigned char type;			// Device type
+	unsigned char hw_rev;		// Hardware revision
+	unsigned short fw_version;	// Firmware version
+	unsigned int sn;			// Serial number
+} system_info;
+
+// Step types of execute_sequence(); the values match wsg50_common/Primitive
+typedef enum {
+	SEQUENCE_SET_ACCELERATION = 0,
+	SEQUENCE_SET_FORCE = 1,
+	SEQUENCE_MOVE = 2,
+	SEQUENCE_GRASP = 3,
+	SEQUENCE_RELEASE = 4,
+	SEQUENCE_HOMING = 5
+} sequence_type_t;
+
+typedef struct {
+	sequence_type_t type;
+	float width, speed;		// MOVE, GRASP, RELEASE
+	float val;				// SET_ACCELERATION, SET_FORCE
+} sequence_step;
+
 //------------------------------------------------------------------------
 // Global variables
 //------------------------------------------------------------------------
@@ -69,6 +97,7 @@ float convert(unsigned char *b);
 int homing( void );
 int move(float width, float speed, bool stop_on_block, bool ignore_response = false);
 int stop( bool ignore_response = false );
+int fast_stop( void );
 int grasp( float objWidth, float speed );
 int release( float width, float speed );
 int ack_fault( void );
@@ -78,20 +107,39 @@ int move_async(float width, float speed, bool stop_on_block);
 int grasp_async(float objWidth, float speed);
 int release_async(float objWidth, float speed);
 int recv_ack ( unsigned char id, status_t* status );
+int recv_ack_wait ( unsigned char id, status_t* status, int timeout_ms );
 
 
 int setAcceleration( float acc );
 int setGraspingForceLimit( float force );
+int setSoftLimits( float limit_minus, float limit_plus );
+int clearSoftLimits( void );
 
 const char * systemState( void );
+int getSystemStateFlags( unsigned int *flags );
+int ping( int timeout_ms );
 int graspingState( void );
 float getOpening(int auto_update = 0);
 float getForce(int auto_update = 0);
 float getSpeed(int auto_update = 0);
+int setAutoUpdate(int interval_ms);
 int getAcceleration( void );
 int getGraspingForceLimit( void );
+int getSoftLimits( float *limit_minus, float *limit_plus );
+int getSystemInfo( system_info *info );
+int getFingerForces( float *force0, float *force1, status_t *status );
+
+void invalidateSettingsCache( void );
+int restoreSettings( void );
+
+int execute_sequence( const sequence_step *steps, unsigned int count, status_t *status,
+                      const std::atomic<bool> *abort, void (*after_motion)( void * ), void *arg );
 
 int script_measure_move (unsigned char cmd_type, float cmd_width, float cmd_speed, gripper_response & info);
+int script_measure_batch (unsigned int count, unsigned int period_ms, gripper_response *samples);
+int script_stream (unsigned int period_ms);
+int script_stream_decode (unsigned char *data, unsigned int len, gripper_response & info);
+int script_command_async (unsigned char cmd_type, float cmd_width, float cmd_speed);
 
 //void getStateValues(); //(unsigned char *);
 
@@ -0,0 +1,123 @@
+//======================================================================
+/**
+ *  @file
+ *  gcl.h
+ *
+ *  @section gcl.h_general General file information
+ *
+ *  @brief
+ *  Link layer of the GCL text protocol (Header file)
+ *
+ *  Commands are lines like "MOVE(10.0,50.0)" or "POS?", answered by lines
+ *  like "ACK MOVE", "FIN MOVE", "ERR MOVE E_AXIS_BLOCKED" or "POS=10.0".
+ *  AUTOSEND makes the gripper push "@POS=10.0" lines on its own.
+ */
+//======================================================================
+
+
+#ifndef GCL_H_
+#define GCL_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <pthread.h>
+#include <time.h>
+
+#include "common.h"
+#include "interface.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define GCL_LINE_MAX			256			// Longer lines are skipped
+#define GCL_RX_BUFSIZE			4096		// Receive buffer; the reads go straight into it
+#define GCL_NAME_LEN			16			// Max. length of a command name or value key
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef enum
+{
+	GCL_LINE_ACK,					// Command accepted; the final reply of all but the motion commands
+	GCL_LINE_FIN,					// Motion command finished
+	GCL_LINE_ERR,					// Command failed, see status
+	GCL_LINE_VALUE,					// Reply to a query, "KEY=value"
+	GCL_LINE_UPDATE,				// Pushed by AUTOSEND, "@KEY=value"
+	GCL_LINE_OTHER					// Anything else, e.g. a greeting
+} gcl_line_type_t;
+
+// A line taken apart by gcl_parse(); all pointers point into the line
+typedef struct
+{
+	gcl_line_type_t type;
+	const char *name;				// Command name or value key, e.g. "MOVE" or "POS"; not terminated
+	unsigned int name_len;			// 0 if the line has none
+	const char *value;				// Text after "=", NULL if there is none; terminated by the end of the line
+	double number;					// value as number
+	bool has_number;
+	status_t status;				// GCL_LINE_ERR: error code, else E_SUCCESS
+} gcl_line_t;
+
+// Splits the received stream into lines without copying them. Data is
+// read into gcl_tokenizer_space() and the complete lines are handed out
+// in place by gcl_tokenizer_next(). Only the partial line at the end is
+// moved, and only when the buffer runs out of space.
+typedef struct
+{
+	char buf[GCL_RX_BUFSIZE];
+	unsigned int start;				// First byte not handed out yet
+	unsigned int scan;				// bytes up to here hold no line end
+	unsigned int end;				// End of the received data
+	bool skipping;					// Dropping the rest of an overlong line
+	unsigned long overlong;			// Lines dropped for being longer than GCL_LINE_MAX
+} gcl_tokenizer_t;
+
+// Connection to a gripper speaking GCL, over any byte stream interface
+typedef struct
+{
+	const interface_t *iface;
+	void *conn;						// Connection state of iface, allocated by gcl_open()
+	pthread_mutex_t tx_lock;		// Serializes the lines of several sending threads
+	gcl_tokenizer_t rx;				// Only used by the receiving thread
+	struct timespec rx_time;		// CLOCK_REALTIME reception of the data read last
+} gcl_link_t;
+
+// Called by gcl_receive() for every line; line is valid during the call only
+typedef void ( *gcl_line_cb_t ) ( const char *line, const gcl_line_t *parsed, void *arg );
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+void gcl_tokenizer_init( gcl_tokenizer_t *t );
+char * gcl_tokenizer_space( gcl_tokenizer_t *t, unsigned int *len );
+void gcl_tokenizer_commit( gcl_tokenizer_t *t, unsigned int len );
+const char * gcl_tokenizer_next( gcl_tokenizer_t *t, unsigned int *len );
+
+int gcl_parse( const char *line, unsigned int len, gcl_line_t *parsed );
+bool gcl_name_is( const gcl_line_t *parsed, const char *name );
+status_t gcl_status_from_str( const char *str, unsigned int len );
+
+int gcl_open( gcl_link_t *link, const interface_t *iface, const void *params );
+void gcl_close( gcl_link_t *link );
+bool gcl_is_open( const gcl_link_t *link );
+int gcl_get_fd( const gcl_link_t *link );
+int gcl_send( gcl_link_t *link, const char *fmt, ... ) __attribute__(( format( printf, 2, 3 ) ));
+int gcl_receive( gcl_link_t *link, gcl_line_cb_t cb, void *arg );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GCL_H_ */
@@ -0,0 +1,103 @@
+//======================================================================
+/**
+ *  @file
+ *  gcl_client.h
+ *
+ *  @section gcl_client.h_general General file information
+ *
+ *  @brief
+ *  Commands and automatic updates of a gripper speaking GCL (Header file)
+ */
+//======================================================================
+
+
+#ifndef GCL_CLIENT_H_
+#define GCL_CLIENT_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include "common.h"
+#include "gcl.h"
+#include "rt.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define GCL_CLIENT_PENDING_MAX		8		// Commands waiting for their reply at the same time
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// Reply a command waits for
+typedef enum
+{
+	GCL_WAIT_NONE,					// Only sent
+	GCL_WAIT_ACK,					// "ACK <name>", for all but the motion commands
+	GCL_WAIT_FIN,					// "FIN <name>", the end of a motion
+	GCL_WAIT_VALUE					// "<name>=value", the reply to a query
+} gcl_wait_t;
+
+// Values pushed by AUTOSEND
+typedef enum
+{
+	GCL_VALUE_POS,
+	GCL_VALUE_SPEED,
+	GCL_VALUE_FORCE,
+	GCL_VALUE_GRIPSTATE
+} gcl_value_t;
+
+// Latest values received, see gcl_client_state()
+typedef struct
+{
+	bool valid;						// false until the first position
+	float position;					// mm
+	float speed;					// mm/s
+	float force;					// N
+	int grip_state;					// 0: idle, 1: grasping, 2: no part, 3: part lost, 4: holding, 5: releasing,
+									// 6: positioning, 7: error; -1: not received yet
+	struct timespec stamp;			// CLOCK_REALTIME reception of the position
+} gcl_state_t;
+
+/**
+ * Update callback. Called from the reader thread for every value pushed
+ * by AUTOSEND, with the state including it.
+ */
+typedef void ( *gcl_update_cb_t ) ( gcl_value_t value, const gcl_state_t *state, void *arg );
+
+struct gcl_client;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+struct gcl_client * gcl_client_create( void );
+void gcl_client_destroy( struct gcl_client *c );
+void gcl_client_set_thread_options( struct gcl_client *c, const rt_options_t *options );
+void gcl_client_set_update_cb( struct gcl_client *c, gcl_update_cb_t cb, void *arg );
+
+int gcl_client_connect( struct gcl_client *c, const interface_t *iface, const void *params );
+void gcl_client_disconnect( struct gcl_client *c );
+bool gcl_client_link_ok( struct gcl_client *c );
+int gcl_client_rx_age_ms( struct gcl_client *c );
+
+int gcl_client_command( struct gcl_client *c, gcl_wait_t wait, int timeout_ms, status_t *status,
+						const char *fmt, ... ) __attribute__(( format( printf, 5, 6 ) ));
+int gcl_client_query( struct gcl_client *c, const char *key, double *value, int timeout_ms );
+void gcl_client_state( struct gcl_client *c, gcl_state_t *state );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GCL_CLIENT_H_ */
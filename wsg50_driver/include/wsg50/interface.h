@@ -31,6 +31,8 @@
 // Includes
 //------------------------------------------------------------------------
 
+#include <sys/uio.h>
+#include <time.h>
 
 
 #ifdef __cplusplus
@@ -46,14 +48,21 @@ extern "C" {
 // Typedefs, enums, structs
 //------------------------------------------------------------------------
 
+// Transports keep their state in a connection struct of conn_size bytes that
+// the caller allocates zeroed and passes to every call, so one process can
+// hold several connections over the same transport.
 typedef struct
 {
 	const char *name;
-	int ( *open ) ( const void *params );
-	void ( *close ) ( void );
-	int ( *read ) ( unsigned char *, unsigned int );
-	int ( *write ) ( unsigned char *, unsigned int );
-	int ( *get_bytes_count ) ( void );
+	unsigned int conn_size;
+	int ( *open ) ( void *conn, const void *params );
+	void ( *close ) ( void *conn );
+	int ( *read ) ( void *conn, unsigned char *, unsigned int );
+	int ( *write ) ( void *conn, unsigned char *, unsigned int );
+	int ( *get_bytes_count ) ( void *conn );
+	int ( *writev ) ( void *conn, const struct iovec *, unsigned int );		// Optional: gather write of a whole message
+	int ( *get_fd ) ( void *conn );										// Optional: descriptor that becomes readable when data arrives
+	int ( *get_rx_time ) ( void *conn, struct timespec * );				// Optional: kernel receive time of the data returned by the last read
 } interface_t;
 
 
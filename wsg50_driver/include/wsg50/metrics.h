@@ -0,0 +1,86 @@
+//======================================================================
+/**
+ *  @file
+ *  metrics.h
+ *
+ *  @section metrics.h_general General file information
+ *
+ *  @brief
+ *  Counters and latency histograms of the command path (Header file)
+ */
+//======================================================================
+
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <time.h>
+
+#include "common.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define METRICS_HIST_SUB_BUCKETS	8			// Buckets per power of two, i.e. values are exact to 1/8
+#define METRICS_HIST_BUCKETS		256			// Covers 0 to about 2^34 us
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// Metrics of one connection, see metrics_create(). NULL stands for the
+// metrics of the default connection (see cmd_selected()).
+typedef struct metrics metrics_t;
+
+typedef struct
+{
+	unsigned long count;
+	double mean_us;
+	unsigned long p50_us, p90_us, p99_us, max_us;
+} metrics_summary_t;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+metrics_t *metrics_create( void );
+void metrics_destroy( metrics_t *m );
+
+void metrics_cmd_sent( metrics_t *m, unsigned char id );
+void metrics_cmd_response( metrics_t *m, unsigned char id );
+void metrics_cmd_resent( metrics_t *m, unsigned char id );
+void metrics_frame_received( metrics_t *m, unsigned char id );
+void metrics_queue_dropped( metrics_t *m, unsigned char id );
+void metrics_crc_error( metrics_t *m );
+void metrics_resync( metrics_t *m, unsigned int bytes );
+void metrics_publish_latency( metrics_t *m, const struct timespec *stamp );
+void metrics_urgent_written( metrics_t *m, const struct timespec *posted );
+
+int metrics_rtt_summary( const metrics_t *m, unsigned char id, metrics_summary_t *summary );
+unsigned int metrics_rtt_timeout_ms( const metrics_t *m, unsigned char id, unsigned int min_ms, unsigned int max_ms );
+int metrics_publish_summary( const metrics_t *m, metrics_summary_t *summary );
+int metrics_urgent_summary( const metrics_t *m, metrics_summary_t *summary );
+unsigned long metrics_frames( const metrics_t *m, unsigned char id );
+unsigned long metrics_drops( const metrics_t *m, unsigned char id );
+unsigned long metrics_crc_errors( const metrics_t *m );
+unsigned long metrics_resync_bytes( const metrics_t *m );
+
+int metrics_write_prometheus( const char *path, const metrics_t *const *m, const char *const *names, unsigned int count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H_ */
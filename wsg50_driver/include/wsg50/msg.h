@@ -31,6 +31,10 @@
 // Includes
 //------------------------------------------------------------------------
 
+#include <pthread.h>
+#include <sys/uio.h>
+#include <time.h>
+
 #include "common.h"
 #include "interface.h"
 
@@ -41,6 +45,15 @@
 
 #define MSG_PREAMBLE_BYTE		0xaa
 #define MSG_PREAMBLE_LEN		3
+#define MSG_IOV_MAX				8		// Max. number of payload chunks for msg_send_iov()
+#define MSG_RX_BUFSIZE			4096	// Size of receive buffer. This is the maximum size a received message may have, including preamble etc.
+#define MSG_URGENT_LEN			8		// Max. payload of a frame in the priority lane
+
+// State of the priority lane, see msg_post_urgent()
+#define MSG_URGENT_EMPTY		0
+#define MSG_URGENT_FILLING		1		// Being posted
+#define MSG_URGENT_READY		2		// Waiting for the link
+#define MSG_URGENT_WRITING		3
 
 // Combine bytes to different types
 #define make_short( lowbyte, highbyte )				( (unsigned short)lowbyte | ( (unsigned short)highbyte << 8 ) )
@@ -66,9 +79,48 @@ typedef struct
 	unsigned char id;
 	unsigned int len;
 	unsigned char *data;
+	struct timespec stamp;			// Received messages: arrival of the last byte (CLOCK_REALTIME)
 } msg_t;
 
 
+typedef struct
+{
+	unsigned char buf[MSG_RX_BUFSIZE];
+	unsigned int head;					// First byte not yet processed
+	unsigned int tail;					// End of valid data
+	struct timespec stamp;				// Arrival of the data read last
+} msg_rx_buf_t;
+
+
+struct recorder;
+struct metrics;
+
+// Frame posted to the priority lane of a link; it is written before any
+// other frame waiting for the link
+typedef struct
+{
+	int state;							// MSG_URGENT_xxx
+	unsigned char id;
+	unsigned char len;
+	unsigned char payload[MSG_URGENT_LEN];
+	struct timespec posted;				// CLOCK_MONOTONIC
+} msg_urgent_t;
+
+// Connection to one gripper: the interface with its connection state and
+// the receive buffer. Sending is serialized, so several threads may send
+// on a link; receiving is up to one thread at a time.
+typedef struct
+{
+	const interface_t *iface;
+	void *conn;							// Connection state of the interface, allocated on open
+	msg_rx_buf_t rx;
+	pthread_mutex_t tx_lock;
+	struct recorder *rec;				// Records the traffic if set, see msg_set_recorder()
+	msg_urgent_t urgent;				// Priority lane, written under tx_lock
+	struct metrics *metrics;			// Round trips and counters of this link, see metrics.h
+} msg_link_t;
+
+
 //------------------------------------------------------------------------
 // Global variables
 //------------------------------------------------------------------------
@@ -78,13 +130,25 @@ typedef struct
 // Function declaration
 //------------------------------------------------------------------------
 
-int msg_open( const interface_t *iface, const void *params );
-void msg_close( void );
-int msg_change_interface( const interface_t *iface );
-int msg_send( msg_t *msg );
-int msg_receive( msg_t *msg );
+int msg_link_init( msg_link_t *link );
+void msg_link_destroy( msg_link_t *link );
+int msg_open( msg_link_t *link, const interface_t *iface, const void *params );
+void msg_close( msg_link_t *link );
+int msg_change_interface( msg_link_t *link, const interface_t *iface );
+int msg_send( msg_link_t *link, msg_t *msg );
+int msg_send_iov( msg_link_t *link, unsigned char id, const struct iovec *iov, unsigned int iovcnt );
+int msg_post_urgent( msg_link_t *link, const msg_t *msg );
+int msg_flush_urgent( msg_link_t *link );
+bool msg_urgent_pending( msg_link_t *link );
+int msg_receive( msg_link_t *link, msg_t *msg );
+int msg_receive_into( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int size );
 void msg_free( msg_t *msg );
-int msg_receive_async( msg_t *msg );
+int msg_receive_async( msg_link_t *link, msg_t *msg );
+int msg_receive_async_into( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int size );
+int msg_receive_fill( msg_link_t *link );
+int msg_receive_buffered_into( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int size );
+int msg_get_fd( msg_link_t *link );
+void msg_set_recorder( msg_link_t *link, struct recorder *rec );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,67 @@
+//======================================================================
+/**
+ *  @file
+ *  reactor.h
+ *
+ *  @section reactor.h_general General file information
+ *
+ *  @brief
+ *  Event loop primitive: sleeps until one of the gripper links has data
+ *  or another thread wakes it up (Header file)
+ */
+//======================================================================
+
+
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include "common.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define REACTOR_READABLE		0x01		// At least one link descriptor has data
+#define REACTOR_WAKEUP			0x02		// reactor_wakeup() was called
+
+#define REACTOR_MAX_EVENTS		16			// Max. number of descriptors reported by one reactor_wait() call
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef struct
+{
+	int epfd;				// epoll instance
+	int wake_fd;			// eventfd, written by reactor_wakeup()
+} reactor_t;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+int reactor_open( reactor_t *r );
+void reactor_close( reactor_t *r );
+
+int reactor_add( reactor_t *r, int fd, void *ptr );
+int reactor_remove( reactor_t *r, int fd );
+
+int reactor_wait( reactor_t *r, int timeout_ms, void **ready, unsigned int *count );
+void reactor_wakeup( reactor_t *r );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REACTOR_H_ */
@@ -0,0 +1,100 @@
+//======================================================================
+/**
+ *  @file
+ *  recorder.h
+ *
+ *  @section recorder.h_general General file information
+ *
+ *  @brief
+ *  Recorder of the link traffic (Header file)
+ *
+ *  The bytes read from and the messages written to a link are appended
+ *  to a memory-mapped file with their CLOCK_MONOTONIC time, in records of
+ *  a fixed size. The file is a ring: once it is full, the oldest records
+ *  are overwritten. See the replay interface for playing it back.
+ */
+//======================================================================
+
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define RECORDER_MAGIC			"WSG50REC"
+#define RECORDER_VERSION		1
+#define RECORDER_DATA_LEN		104			// Data bytes per record; longer chunks take several records
+
+#define RECORDER_RX				0			// Record direction: bytes returned by a read
+#define RECORDER_TX				1			// Record direction: message written
+
+#define RECORDER_MORE			0x01		// The chunk continues in the next record
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// File header, followed by capacity records
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t capacity;					// Records in the file
+	uint64_t count;						// Records written so far; record i is at index i % capacity
+	int64_t realtime_offset_ns;			// CLOCK_REALTIME - CLOCK_MONOTONIC when the recording started
+	uint8_t reserved[24];
+} recorder_header_t;
+
+typedef struct
+{
+	uint64_t seq;						// Number of the record + 1; written last, so 0 or another number marks a record being written or overwritten
+	uint64_t t_ns;						// CLOCK_MONOTONIC
+	uint16_t len;						// Data bytes used
+	uint8_t dir;						// RECORDER_RX, RECORDER_TX
+	uint8_t flags;						// RECORDER_MORE
+	uint32_t reserved;
+	uint8_t data[RECORDER_DATA_LEN];
+} recorder_record_t;
+
+typedef struct recorder
+{
+	int fd;
+	recorder_header_t *hdr;
+	recorder_record_t *rec;
+	size_t map_size;
+} recorder_t;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+int recorder_open( recorder_t *rec, const char *path, size_t size );
+int recorder_map( recorder_t *rec, const char *path );
+void recorder_close( recorder_t *rec );
+void recorder_write( recorder_t *rec, unsigned int dir, const struct iovec *iov, unsigned int iovcnt );
+uint64_t recorder_first( const recorder_t *rec );
+const recorder_record_t * recorder_get( const recorder_t *rec, uint64_t i );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDER_H_ */
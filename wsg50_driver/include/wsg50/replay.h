@@ -0,0 +1,80 @@
+//======================================================================
+/**
+ *  @file
+ *  replay.h
+ *
+ *  @section replay.h_general General file information
+ *
+ *  @brief
+ *  Replay interface (Header file)
+ *
+ *  Plays a recording of the link traffic (see recorder.h) back as if it
+ *  came from a gripper: reads return the recorded data at the recorded
+ *  times, scaled by the speed. Writes are accepted and dropped.
+ */
+//======================================================================
+
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "common.h"
+#include "recorder.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef struct
+{
+	const char *path;				// Recording
+	double speed;					// 1: original timing, 2: twice as fast, ...; 0: as fast as possible
+} replay_params_t;
+
+
+typedef struct
+{
+	recorder_t file;
+	uint64_t next;					// Record to be read next
+	unsigned int pos;				// Bytes of it read already
+	uint64_t t0_ns;					// Recorded time of the first record
+	uint64_t start_ns;				// Start of the replay (CLOCK_MONOTONIC)
+	double speed;
+	struct timespec rx_time;		// Recorded receive time of the data read last
+	bool rx_time_valid;
+	unsigned long long rx_bytes, tx_bytes;
+	bool finished;					// All data has been read
+} replay_conn_t;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+int replay_open( void *conn, const void *params );
+void replay_close( void *conn );
+int replay_read( void *conn, unsigned char *buf, unsigned int len );
+int replay_write( void *conn, unsigned char *buf, unsigned int len );
+int replay_get_bytes_count( void *conn );
+int replay_writev( void *conn, const struct iovec *iov, unsigned int iovcnt );
+int replay_get_rx_time( void *conn, struct timespec *ts );
+bool replay_finished( void *conn );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,66 @@
+//======================================================================
+/**
+ *  @file
+ *  rt.h
+ *
+ *  @section rt.h_general General file information
+ *
+ *  @brief
+ *  Real-time settings of the driver's threads and the process
+ *  (Header file)
+ *
+ *  What the system does not grant (e.g. SCHED_FIFO without CAP_SYS_NICE
+ *  or an rtprio limit) is reported and left at its default; the driver
+ *  runs either way.
+ */
+//======================================================================
+
+
+#ifndef RT_H_
+#define RT_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include "common.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define RT_CPUS_LEN				64			// Max. length of a CPU list
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// Scheduling of a thread, see rt_options_default()
+typedef struct rt_options
+{
+	int priority;					// SCHED_FIFO priority (1 - 99), 0: default scheduling
+	char cpus[RT_CPUS_LEN];			// CPUs the thread may run on, e.g. "2" or "2-3,6"; empty: all
+	unsigned int stack_prefault_kb;	// Stack touched when the thread starts, 0: none
+} rt_options_t;
+
+
+//------------------------------------------------------------------------
+// Function declaration
+//------------------------------------------------------------------------
+
+void rt_options_default( rt_options_t *options );
+bool rt_options_set( const rt_options_t *options );
+int rt_apply_thread( const rt_options_t *options, const char *name );
+int rt_lock_memory( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RT_H_ */
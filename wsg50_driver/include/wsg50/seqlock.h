@@ -0,0 +1,106 @@
+//======================================================================
+/**
+ *  @file
+ *  seqlock.h
+ *
+ *  @section seqlock.h_general General file information
+ *
+ *  @brief
+ *  Sequence lock for sharing a small, trivially copyable state struct
+ *  between threads
+ *
+ *  Readers never block writers and never take a lock: they copy the
+ *  value and retry if a write happened meanwhile, so every read returns
+ *  one consistent snapshot. Concurrent writers are serialized by the
+ *  sequence counter itself. The value is copied word by word through
+ *  atomics, which keeps the copy free of data races.
+ */
+//======================================================================
+
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+template <typename T>
+class seqlock
+{
+	static_assert( std::is_trivially_copyable<T>::value, "seqlock values must be trivially copyable" );
+
+	static const unsigned int WORDS = ( sizeof( T ) + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t );
+
+public:
+	explicit seqlock( const T &initial = T() ) { store( initial ); }
+
+	seqlock( const seqlock & ) = delete;
+	seqlock &operator=( const seqlock & ) = delete;
+
+	/**
+	 * Replace the value
+	 */
+	void store( const T &value )
+	{
+		uint32_t buf[WORDS] = { 0 };
+		memcpy( buf, &value, sizeof( T ) );
+
+		// Odd while written; wait for another writer to finish
+		unsigned long s = seq.load( std::memory_order_relaxed );
+		while ( ( s & 1 ) || !seq.compare_exchange_weak( s, s + 1, std::memory_order_relaxed ) )
+			s = seq.load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+
+		for ( unsigned int i = 0; i < WORDS; i++ ) word[i].store( buf[i], std::memory_order_relaxed );
+		seq.store( s + 2, std::memory_order_release );
+	}
+
+	/**
+	 * Get a consistent copy of the value
+	 */
+	T load( void ) const
+	{
+		uint32_t buf[WORDS];
+		unsigned long s;
+		T value;
+
+		for ( ;; )
+		{
+			s = seq.load( std::memory_order_acquire );
+			if ( s & 1 ) continue;
+
+			for ( unsigned int i = 0; i < WORDS; i++ ) buf[i] = word[i].load( std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_acquire );
+
+			if ( seq.load( std::memory_order_relaxed ) == s ) break;
+		}
+
+		memcpy( &value, buf, sizeof( T ) );
+		return value;
+	}
+
+	/**
+	 * Number of stores so far; changes whenever the value is replaced
+	 */
+	unsigned long version( void ) const
+	{
+		return seq.load( std::memory_order_acquire ) / 2;
+	}
+
+private:
+	std::atomic<unsigned long> seq{ 0 };
+	std::atomic<uint32_t> word[WORDS];
+};
+
+#endif /* SEQLOCK_H_ */
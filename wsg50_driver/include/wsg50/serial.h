@@ -31,6 +31,9 @@
 // Includes
 //------------------------------------------------------------------------
 
+#include <sys/uio.h>
+
+#include "common.h"
 
 
 #ifdef __cplusplus
@@ -46,16 +49,29 @@ extern "C" {
 // Typedefs, enums, structs
 //------------------------------------------------------------------------
 
+// Line options of a connection, see serial_options_default()
+typedef struct serial_options
+{
+	bool low_latency;				// ASYNC_LOW_LATENCY, e.g. 1 ms instead of 16 ms latency timer on FTDI adapters
+	unsigned int vmin;				// VMIN: bytes a read waits for once data is there, 0: take what has arrived
+	unsigned int vtime_ms;			// VTIME: max. gap between bytes while waiting for vmin bytes (0.1 s steps)
+	unsigned int recv_timeout_ms;	// Time a read waits for the first byte
+} serial_options_t;
+
+
 typedef struct
 {
 	const char *device;
 	unsigned int bitrate;
+	const serial_options_t *options;	// NULL: serial_options_default()
 } ser_params_t;
 
 
 typedef struct
 {
 	int fd;
+	unsigned int recv_timeout_ms;
+	bool low_latency_set;			// ASYNC_LOW_LATENCY was set by us and is cleared on close
 } ser_conn_t;
 
 
@@ -63,11 +79,15 @@ typedef struct
 // Function declaration
 //------------------------------------------------------------------------
 
-int serial_open( const void *params );
-void serial_close( void );
-int serial_read( unsigned char *buf, unsigned int len );
-int serial_write( unsigned char *buf, unsigned int len );
-int serial_get_bytes_count( void );
+void serial_options_default( serial_options_t *options );
+
+int serial_open( void *conn, const void *params );
+void serial_close( void *conn );
+int serial_read( void *conn, unsigned char *buf, unsigned int len );
+int serial_write( void *conn, unsigned char *buf, unsigned int len );
+int serial_get_bytes_count( void *conn );
+int serial_writev( void *conn, const struct iovec *iov, unsigned int iovcnt );
+int serial_get_fd( void *conn );
 
 
 #ifdef __cplusplus
@@ -0,0 +1,145 @@
+//======================================================================
+/**
+ *  @file
+ *  spsc_ring.h
+ *
+ *  @section spsc_ring.h_general General file information
+ *
+ *  @brief
+ *  Lock-free single producer / single consumer ring for handing
+ *  decoded samples from the dispatcher thread to a publisher thread
+ *
+ *  The producer never waits: if the consumer falls behind, the oldest
+ *  samples are overwritten and counted as overruns. Every slot carries
+ *  a sequence number, so the consumer detects a slot that is overwritten
+ *  while it is copied and skips it (see seqlock). Elements must be
+ *  trivially copyable; they are copied word by word through atomics.
+ */
+//======================================================================
+
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <errno.h>
+#include <semaphore.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+template <typename T, unsigned int N>
+class spsc_ring
+{
+	static_assert( std::is_trivially_copyable<T>::value, "spsc_ring elements must be trivially copyable" );
+	static_assert( N > 0 && ( N & ( N - 1 ) ) == 0, "spsc_ring length must be a power of two" );
+
+	static const unsigned int WORDS = ( sizeof( T ) + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t );
+
+	struct slot
+	{
+		std::atomic<unsigned long> seq{ 0 };		// 2 * index + 1 while written, 2 * index + 2 when done
+		std::atomic<uint32_t> word[WORDS];
+	};
+
+public:
+	spsc_ring( void ) { sem_init( &ready, 0, 0 ); }
+	~spsc_ring( void ) { sem_destroy( &ready ); }
+
+	spsc_ring( const spsc_ring & ) = delete;
+	spsc_ring &operator=( const spsc_ring & ) = delete;
+
+	/**
+	 * Add a sample; producer only. Never blocks.
+	 */
+	void push( const T &value )
+	{
+		uint32_t buf[WORDS] = { 0 };
+		unsigned long h = head.load( std::memory_order_relaxed );
+		slot &s = slots[h & ( N - 1 )];
+
+		memcpy( buf, &value, sizeof( T ) );
+
+		s.seq.store( 2 * h + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+		for ( unsigned int i = 0; i < WORDS; i++ ) s.word[i].store( buf[i], std::memory_order_relaxed );
+		s.seq.store( 2 * h + 2, std::memory_order_release );
+
+		head.store( h + 1, std::memory_order_release );
+		sem_post( &ready );
+	}
+
+	/**
+	 * Take the next sample; consumer only
+	 *
+	 * @param *value	Receives the oldest sample still available
+	 *
+	 * @return true if a sample was taken, false if the ring is empty
+	 */
+	bool pop( T *value )
+	{
+		uint32_t buf[WORDS];
+
+		for ( ;; )
+		{
+			unsigned long h = head.load( std::memory_order_acquire );
+			if ( tail == h ) return false;
+
+			// The producer has lapped us: these samples are gone
+			if ( h - tail > N )
+			{
+				overrun_cnt.fetch_add( h - N - tail, std::memory_order_relaxed );
+				tail = h - N;
+			}
+
+			slot &s = slots[tail & ( N - 1 )];
+			unsigned long seq = s.seq.load( std::memory_order_acquire );
+			for ( unsigned int i = 0; i < WORDS; i++ ) buf[i] = s.word[i].load( std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_acquire );
+
+			// Retry if the slot has been overwritten meanwhile
+			if ( seq != 2 * tail + 2 || s.seq.load( std::memory_order_relaxed ) != seq ) continue;
+
+			memcpy( value, buf, sizeof( T ) );
+			tail++;
+			return true;
+		}
+	}
+
+	/**
+	 * Sleep until samples may be available or wakeup() is called; consumer only
+	 */
+	void wait( void )
+	{
+		while ( sem_wait( &ready ) != 0 && errno == EINTR );
+
+		// One wakeup covers all samples pushed so far
+		while ( sem_trywait( &ready ) == 0 );
+	}
+
+	/**
+	 * Wake up the consumer, e.g. to let it shut down
+	 */
+	void wakeup( void ) { sem_post( &ready ); }
+
+	/** Samples lost because the consumer fell behind */
+	unsigned long overruns( void ) const { return overrun_cnt.load( std::memory_order_relaxed ); }
+
+private:
+	slot slots[N];
+	std::atomic<unsigned long> head{ 0 };		// Number of samples pushed
+	unsigned long tail = 0;						// Number of samples consumed or dropped; consumer only
+	std::atomic<unsigned long> overrun_cnt{ 0 };
+	sem_t ready;
+};
+
+#endif /* SPSC_RING_H_ */
@@ -41,9 +41,11 @@
 	#include <sys/types.h>
 	#include <sys/socket.h>
 	#include <sys/ioctl.h>
+	#include <sys/uio.h>
 	#include <sys/select.h>
 	#include <arpa/inet.h>
 	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 #endif
 
 #include "common.h"
@@ -62,10 +64,25 @@ extern "C" {
 // Typedefs, enums, structs
 //------------------------------------------------------------------------
 
+// Socket options of a connection, see tcp_options_default()
+typedef struct tcp_options
+{
+	bool nodelay;					// TCP_NODELAY: send small frames right away
+	bool quickack;					// TCP_QUICKACK: acknowledge right away; re-armed after every read
+	int rcvbuf;						// SO_RCVBUF in bytes, 0: kernel default
+	int priority;					// SO_PRIORITY (0 - 6), -1: not set
+	int dscp;						// DSCP of the packets sent (0 - 63), -1: not set
+	int busy_poll_us;				// SO_BUSY_POLL, 0: off
+	unsigned int connect_timeout_ms;	// 0: kernel default
+	unsigned int recv_timeout_ms;		// SO_RCVTIMEO of blocking reads, 0: none
+} tcp_options_t;
+
+
 typedef struct
 {
 	ip_addr_t addr;
 	unsigned short port;
+	const tcp_options_t *options;	// NULL: tcp_options_default()
 } tcp_params_t;
 
 
@@ -74,6 +91,9 @@ typedef struct
 	int sock;
 	struct sockaddr_in si_server;
 	ip_addr_t server;
+	struct timespec rx_time;		// Kernel receive time of the last read
+	bool rx_time_valid;
+	bool quickack;
 } tcp_conn_t;
 
 
@@ -81,11 +101,16 @@ typedef struct
 // Function declaration
 //------------------------------------------------------------------------
 
-int tcp_open( const void *params );
-void tcp_close( void );
-int tcp_read( unsigned char *buf, unsigned int len );
-int tcp_write( unsigned char *buf, unsigned int len );
-int tcp_get_bytes_count( void );
+void tcp_options_default( tcp_options_t *options );
+
+int tcp_open( void *conn, const void *params );
+void tcp_close( void *conn );
+int tcp_read( void *conn, unsigned char *buf, unsigned int len );
+int tcp_write( void *conn, unsigned char *buf, unsigned int len );
+int tcp_get_bytes_count( void *conn );
+int tcp_writev( void *conn, const struct iovec *iov, unsigned int iovcnt );
+int tcp_get_fd( void *conn );
+int tcp_get_rx_time( void *conn, struct timespec *ts );
 
 
 #ifdef __cplusplus
@@ -41,6 +41,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/select.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -57,7 +58,7 @@ extern "C" {
 // Macros
 //------------------------------------------------------------------------
 
-#define UDP_RCV_BUFSIZE		1024		// Size of UDP receive buffer. This is the maximum size a command message may have, including preamble etc.
+#define UDP_RCV_BUFSIZE		1024		// Space per datagram in udp_read(). This is the maximum size a command message may have, including preamble etc.
 										// Minimum is 8 (3 bytes preamble, 1 byte command id, 2 bytes size, 2 bytes checksum)
 
 
@@ -76,13 +77,11 @@ typedef struct
 typedef struct
 {
 	int sock;
-	unsigned char rcv_buf[UDP_RCV_BUFSIZE];
-	unsigned int rcv_bufptr;
-	unsigned int rcv_bufsize;
 	struct sockaddr_in si_listen;
 	struct sockaddr_in si_server;
-	struct sockaddr_in si_incoming;
 	ip_addr_t server;
+	struct timespec rx_time;		// Kernel receive time of the last datagram read
+	bool rx_time_valid;
 } udp_conn_t;
 
 
@@ -90,11 +89,14 @@ typedef struct
 // Function declaration
 //------------------------------------------------------------------------
 
-int udp_open( const void *params );
-void udp_close( void );
-int udp_read( unsigned char *buf, unsigned int len );
-int udp_write( unsigned char *buf, unsigned int len );
-int udp_get_bytes_count( void );
+int udp_open( void *conn, const void *params );
+void udp_close( void *conn );
+int udp_read( void *conn, unsigned char *buf, unsigned int len );
+int udp_write( void *conn, unsigned char *buf, unsigned int len );
+int udp_get_bytes_count( void *conn );
+int udp_writev( void *conn, const struct iovec *iov, unsigned int iovcnt );
+int udp_get_fd( void *conn );
+int udp_get_rx_time( void *conn, struct timespec *ts );
 
 #ifdef __cplusplus
 }
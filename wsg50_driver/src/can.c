@@ -0,0 +1,470 @@
+//======================================================================
+/**
+ *  @file
+ *  can.c
+ *
+ *  @section can.c_general General file information
+ *
+ *  @brief
+ *  SocketCAN interface
+ *
+ *  A raw CAN socket bound to one network interface. The kernel filters
+ *  the frames by the gripper's identifier, so several grippers can share
+ *  a bus, each with its own connection. Reads hand the data bytes of the
+ *  received frames on as a stream; the message layer puts the frames of
+ *  a message back together, just as for a serial line.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE							// recvmmsg(), sendmmsg()
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can/raw.h>
+
+#include "wsg50/interface.h"
+#include "wsg50/can.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define CAN_RCV_TIMEOUT_SEC					1
+#define CAN_RCV_BATCH						32		// Max. frames taken per read
+#define CAN_SND_BATCH						32		// Max. frames handed to the kernel at once
+#define CAN_SND_TIMEOUT_MS					1000	// Max. time to wait for room in the device queue
+#define CAN_SND_RETRY_US					200
+#define CAN_SOCKET_BUFSIZE					( 64 * 1024 )
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+const interface_t can =
+{
+	.name = "can",
+	.conn_size = sizeof( can_conn_t ),
+	.open = &can_open,
+	.close = &can_close,
+	.read = &can_read,
+	.write = &can_write,
+	.get_bytes_count = &can_get_bytes_count,
+	.writev = &can_writev,
+	.get_fd = &can_get_fd,
+	.get_rx_time = &can_get_rx_time
+};
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+static canid_t can_make_id( unsigned int id );
+static int can_send_frames( can_conn_t *conn, struct can_frame *frames, unsigned int count );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+/**
+ * Turn a numeric identifier into a CAN identifier: identifiers that do
+ * not fit into 11 bits are sent as extended (29 bit) ones
+ */
+
+static canid_t can_make_id( unsigned int id )
+{
+	if ( id > CAN_SFF_MASK ) return ( id & CAN_EFF_MASK ) | CAN_EFF_FLAG;
+	return id;
+}
+
+
+/**
+ * Open CAN socket
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ * @param *params		Connection parameters (can_params_t)
+ *
+ * @return 0 on success, else -1
+ */
+
+int can_open( void *ctx, const void *params )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	can_params_t *p = (can_params_t *) params;
+	struct sockaddr_can addr;
+	struct can_filter filter;
+	unsigned int ifindex;
+	int val;
+
+	ifindex = if_nametoindex( p->device );
+	if ( ifindex == 0 )
+	{
+		fprintf( stderr, "Unknown CAN interface '%s'\n", p->device );
+		return -1;
+	}
+
+	conn->sock = socket( PF_CAN, SOCK_RAW, CAN_RAW );
+	if ( conn->sock < 0 )
+	{
+		fprintf( stderr, "Cannot open CAN socket: %s\n", strerror( errno ) );
+		conn->sock = 0;
+		return -1;
+	}
+
+	conn->tx_id = can_make_id( p->tx_id );
+	conn->rest_pos = conn->rest_len = 0;
+
+	// Only the gripper's data frames; no error or remote frames
+	filter.can_id = can_make_id( p->rx_id );
+	filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | ( ( filter.can_id & CAN_EFF_FLAG ) ? CAN_EFF_MASK : CAN_SFF_MASK );
+	if ( setsockopt( conn->sock, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof( filter ) ) < 0 )
+		fprintf( stderr, "Unable to set CAN filter: %s\n", strerror( errno ) );
+
+	// Room for the automatic updates queued while the reader is busy
+	val = CAN_SOCKET_BUFSIZE;
+	setsockopt( conn->sock, SOL_SOCKET, SO_RCVBUF, (void *) &val, (socklen_t) sizeof( val ) );
+
+	// A read waits this long for the first frame
+	struct timeval timeout = { .tv_sec = CAN_RCV_TIMEOUT_SEC, .tv_usec = 0 };
+	setsockopt( conn->sock, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, (socklen_t) sizeof( timeout ) );
+
+	// Kernel receive time of each frame
+	val = 1;
+	conn->rx_time_valid = false;
+	setsockopt( conn->sock, SOL_SOCKET, SO_TIMESTAMPNS, (void *) &val, (socklen_t) sizeof( val ) );
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = (int) ifindex;
+	if ( bind( conn->sock, (struct sockaddr *) &addr, sizeof( addr ) ) < 0 )
+	{
+		fprintf( stderr, "Cannot bind CAN socket to '%s': %s\n", p->device, strerror( errno ) );
+		close( conn->sock );
+		conn->sock = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Close CAN socket
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ */
+
+void can_close( void *ctx )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	close( conn->sock );
+	conn->sock = 0;
+}
+
+
+/**
+ * Get file descriptor, e.g. to wait for incoming data with poll/epoll
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ *
+ * @return Descriptor of the open socket, -1 if not open
+ */
+
+int can_get_fd( void *ctx )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	return conn->sock > 0 ? conn->sock : -1;
+}
+
+
+/**
+ * Get kernel receive time of the frame read last
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ * @param *ts		Receive time in CLOCK_REALTIME
+ *
+ * @return 0 on success, -1 if no time stamp is available
+ */
+
+int can_get_rx_time( void *ctx, struct timespec *ts )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	if ( !conn->rx_time_valid ) return -1;
+	*ts = conn->rx_time;
+	return 0;
+}
+
+
+/**
+ * Get the number of bytes that can be read without blocking
+ *
+ * Raw CAN sockets do not report their queue length, so a pending frame
+ * counts as CAN_FRAME_DLEN bytes: a read of this size returns at least
+ * part of it.
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ *
+ * @return Number of bytes, 0 if nothing is pending, -1 on error
+ */
+
+int can_get_bytes_count( void *ctx )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	struct pollfd pfd = { .fd = conn->sock, .events = POLLIN, .revents = 0 };
+	int res;
+
+	if ( conn->sock <= 0 ) return -1;
+	if ( conn->rest_pos < conn->rest_len ) return (int) ( conn->rest_len - conn->rest_pos );
+
+	res = poll( &pfd, 1, 0 );
+	if ( res < 0 ) return errno == EINTR ? 0 : -1;
+	if ( pfd.revents & ( POLLERR | POLLNVAL ) ) return -1;
+	return res > 0 ? CAN_FRAME_DLEN : 0;
+}
+
+
+/**
+ * Read from CAN socket
+ *
+ * Takes up to CAN_RCV_BATCH frames with a single recvmmsg() call and
+ * copies their data bytes to the buffer, in the order they arrived.
+ * Waits up to CAN_RCV_TIMEOUT_SEC for the first frame; frames behind it
+ * are only taken if they have arrived already.
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ * @param *buf		Pointer to input buffer
+ * @param len		Size of buffer
+ *
+ * @return Number of bytes read, 0 if no frame arrived
+ *         within CAN_RCV_TIMEOUT_SEC, -1 on error
+ */
+
+int can_read( void *ctx, unsigned char *buf, unsigned int len )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	struct can_frame frames[CAN_RCV_BATCH];
+	struct mmsghdr hdr[CAN_RCV_BATCH];
+	struct iovec iov[CAN_RCV_BATCH];
+	char control[CAN_RCV_BATCH][CMSG_SPACE( sizeof( struct timespec ) )];
+	struct cmsghdr *cmsg;
+	unsigned int count, i, n, dlc, total = 0;
+	int res;
+
+	if ( conn->sock <= 0 || buf == NULL )
+	{
+		fprintf( stderr, "Parameter error (sock=%d, buf=%p)\n", conn->sock, buf );
+		return -1;
+	}
+
+	// Data left over from the last read comes first
+	if ( conn->rest_pos < conn->rest_len )
+	{
+		n = conn->rest_len - conn->rest_pos;
+		if ( n > len ) n = len;
+		memcpy( buf, &conn->rest[conn->rest_pos], n );
+		conn->rest_pos += n;
+		total = n;
+	}
+	if ( total == len ) return (int) total;
+
+	// Only as many frames as surely fit; a short buffer takes one
+	count = ( len - total ) / CAN_FRAME_DLEN;
+	if ( count == 0 ) count = 1;
+	if ( count > CAN_RCV_BATCH ) count = CAN_RCV_BATCH;
+
+	memset( hdr, 0, sizeof( hdr[0] ) * count );
+	for ( i = 0; i < count; i++ )
+	{
+		iov[i].iov_base = &frames[i];
+		iov[i].iov_len = sizeof( frames[i] );
+		hdr[i].msg_hdr.msg_iov = &iov[i];
+		hdr[i].msg_hdr.msg_iovlen = 1;
+		hdr[i].msg_hdr.msg_control = control[i];
+		hdr[i].msg_hdr.msg_controllen = sizeof( control[i] );
+	}
+
+	// Do not wait if there is something to return already
+	res = recvmmsg( conn->sock, hdr, count, total > 0 ? MSG_DONTWAIT : MSG_WAITFORONE, NULL );
+	if ( res < 0 )
+	{
+		if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) return (int) total;
+		fprintf( stderr, "Failed to read from CAN socket: %s\n", strerror( errno ) );
+		return -1;
+	}
+
+	for ( i = 0; i < (unsigned int) res; i++ )
+	{
+		if ( hdr[i].msg_len != sizeof( struct can_frame ) ) continue;
+
+		dlc = frames[i].can_dlc;
+		if ( dlc > CAN_FRAME_DLEN ) dlc = CAN_FRAME_DLEN;
+
+		n = dlc;
+		if ( n > len - total ) n = len - total;
+		memcpy( &buf[total], frames[i].data, n );
+		total += n;
+
+		// Only possible with a buffer shorter than one frame
+		if ( n < dlc )
+		{
+			memcpy( conn->rest, &frames[i].data[n], dlc - n );
+			conn->rest_pos = 0;
+			conn->rest_len = dlc - n;
+		}
+
+		// The data is stamped with the arrival of the last frame
+		conn->rx_time_valid = false;
+		for ( cmsg = CMSG_FIRSTHDR( &hdr[i].msg_hdr ); cmsg; cmsg = CMSG_NXTHDR( &hdr[i].msg_hdr, cmsg ) )
+		{
+			if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+			{
+				memcpy( &conn->rx_time, CMSG_DATA( cmsg ), sizeof( struct timespec ) );
+				conn->rx_time_valid = true;
+			}
+		}
+	}
+
+	return (int) total;
+}
+
+
+/**
+ * Hand frames to the kernel, waiting for room in the device queue
+ *
+ * @param *conn		Connection state
+ * @param *frames	Frames to send
+ * @param count		Number of frames
+ *
+ * @return 0 on success, -1 on error
+ */
+
+static int can_send_frames( can_conn_t *conn, struct can_frame *frames, unsigned int count )
+{
+	struct mmsghdr hdr[CAN_SND_BATCH];
+	struct iovec iov[CAN_SND_BATCH];
+	unsigned int i, sent = 0, waited_us = 0;
+	int res;
+
+	memset( hdr, 0, sizeof( hdr[0] ) * count );
+	for ( i = 0; i < count; i++ )
+	{
+		iov[i].iov_base = &frames[i];
+		iov[i].iov_len = sizeof( frames[i] );
+		hdr[i].msg_hdr.msg_iov = &iov[i];
+		hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while ( sent < count )
+	{
+		res = sendmmsg( conn->sock, &hdr[sent], count - sent, MSG_NOSIGNAL );
+		if ( res > 0 )
+		{
+			sent += (unsigned int) res;
+			continue;
+		}
+
+		// The queue of CAN devices is short; it drains at bus speed
+		if ( res < 0 && ( errno == ENOBUFS || errno == EAGAIN || errno == EINTR ) && waited_us < CAN_SND_TIMEOUT_MS * 1000 )
+		{
+			usleep( CAN_SND_RETRY_US );
+			waited_us += CAN_SND_RETRY_US;
+			continue;
+		}
+
+		fprintf( stderr, "Failed to write to CAN socket: %s\n", res < 0 ? strerror( errno ) : "nothing sent" );
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Write to CAN socket from several buffers at once
+ *
+ * The data is cut into frames of CAN_FRAME_DLEN bytes; the last frame
+ * carries the rest.
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ * @param *iov		Buffers that hold the data to be sent
+ * @param iovcnt	Number of buffers
+ *
+ * @return Number of bytes written, -1 on error
+ */
+
+int can_writev( void *ctx, const struct iovec *iov, unsigned int iovcnt )
+{
+	can_conn_t *conn = (can_conn_t *) ctx;
+	struct can_frame frames[CAN_SND_BATCH];
+	unsigned int i, pos, n, count = 0, total = 0;
+	const unsigned char *src;
+
+	if ( conn->sock <= 0 ) return -1;
+
+	memset( frames, 0, sizeof( frames ) );
+	for ( i = 0; i < iovcnt; i++ )
+	{
+		src = (const unsigned char *) iov[i].iov_base;
+		for ( pos = 0; pos < iov[i].iov_len; pos += n )
+		{
+			struct can_frame *f = &frames[count];
+
+			n = CAN_FRAME_DLEN - f->can_dlc;
+			if ( n > iov[i].iov_len - pos ) n = (unsigned int) ( iov[i].iov_len - pos );
+			memcpy( &f->data[f->can_dlc], &src[pos], n );
+			f->can_id = conn->tx_id;
+			f->can_dlc += n;
+			total += n;
+
+			if ( f->can_dlc == CAN_FRAME_DLEN && ++count == CAN_SND_BATCH )
+			{
+				if ( can_send_frames( conn, frames, count ) < 0 ) return -1;
+				memset( frames, 0, sizeof( frames ) );
+				count = 0;
+			}
+		}
+	}
+
+	// Last, partly filled frame
+	if ( count < CAN_SND_BATCH && frames[count].can_dlc > 0 ) count++;
+	if ( count > 0 && can_send_frames( conn, frames, count ) < 0 ) return -1;
+
+	return (int) total;
+}
+
+
+/**
+ * Write to CAN socket
+ *
+ * @param *ctx		Connection state (can_conn_t)
+ * @param *buf		Pointer to buffer that holds data to be sent
+ * @param len		Number of bytes to send
+ *
+ * @return Number of bytes written, -1 on error
+ */
+
+int can_write( void *ctx, unsigned char *buf, unsigned int len )
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	return can_writev( ctx, &iov, 1 );
+}
+
+
+//------------------------------------------------------------------------
+// Test implementation
+//------------------------------------------------------------------------
@@ -110,6 +110,34 @@ static const unsigned short CRC_TABLE_CCITT16[256] = {
 };
 
 
+/*
+ * Lookup tables for slicing-by-4/8
+ *
+ * t[k][x] is the checksum update caused by byte x followed by k zero
+ * bytes; t[0] is CRC_TABLE_CCITT16. The update is linear, so the
+ * contributions of 8 bytes can be combined by XOR.
+ */
+
+static struct crc_slice_tables
+{
+	unsigned short t[8][256];
+
+	crc_slice_tables()
+	{
+		unsigned int i, k;
+
+		for ( i = 0; i < 256; i++ ) t[0][i] = CRC_TABLE_CCITT16[i];
+		for ( k = 1; k < 8; k++ )
+		{
+			for ( i = 0; i < 256; i++ )
+			{
+				t[k][i] = CRC_TABLE_CCITT16[ t[k - 1][i] & 0x00FF ] ^ ( t[k - 1][i] >> 8 );
+			}
+		}
+	}
+} const slice_tables;
+
+
 //------------------------------------------------------------------------
 // Unit testing
 //------------------------------------------------------------------------
@@ -127,6 +155,7 @@ static const unsigned short CRC_TABLE_CCITT16[256] = {
 /**
  * Calculates the CRC16 checksum of an array by using a table.
  * The crc16 polynomial is 0x1021 ( x^16 + x^12 + x^5 + 1 ).
+ * Reference implementation, processing one byte at a time.
  *
  * Note: The checksum generated by this function is NOT according
  * to CCITT standard!
@@ -140,7 +169,7 @@ static const unsigned short CRC_TABLE_CCITT16[256] = {
  * @return CRC16 checksum
  */
 
-unsigned short checksum_update_crc16( unsigned char *data, unsigned int size, unsigned short crc )
+unsigned short checksum_update_crc16_bytewise( unsigned char *data, unsigned int size, unsigned short crc )
 {
     unsigned long c;
 
@@ -153,6 +182,90 @@ unsigned short checksum_update_crc16( unsigned char *data, unsigned int size, un
 }
 
 
+/**
+ * Same as checksum_update_crc16_bytewise(), but processes 4 bytes
+ * per iteration (slicing-by-4).
+ *
+ * @param *data       Points to the byte array from which checksum should
+ *                    be calculated
+ * @param size        Size of the byte array
+ * @param crc         Value calculated over another array and start value
+ *                    of the crc16 calculation
+ *
+ * @return CRC16 checksum
+ */
+
+unsigned short checksum_update_crc16_slice4( unsigned char *data, unsigned int size, unsigned short crc )
+{
+	const unsigned short (*t)[256] = slice_tables.t;
+
+	while ( size >= 4 )
+	{
+		crc = t[3][ data[0] ^ ( crc & 0xff ) ] ^ t[2][ data[1] ^ ( crc >> 8 ) ]
+			^ t[1][ data[2] ] ^ t[0][ data[3] ];
+		data += 4;
+		size -= 4;
+	}
+
+	return checksum_update_crc16_bytewise( data, size, crc );
+}
+
+
+/**
+ * Same as checksum_update_crc16_bytewise(), but processes 8 bytes
+ * per iteration (slicing-by-8).
+ *
+ * @param *data       Points to the byte array from which checksum should
+ *                    be calculated
+ * @param size        Size of the byte array
+ * @param crc         Value calculated over another array and start value
+ *                    of the crc16 calculation
+ *
+ * @return CRC16 checksum
+ */
+
+unsigned short checksum_update_crc16_slice8( unsigned char *data, unsigned int size, unsigned short crc )
+{
+	const unsigned short (*t)[256] = slice_tables.t;
+
+	while ( size >= 8 )
+	{
+		crc = t[7][ data[0] ^ ( crc & 0xff ) ] ^ t[6][ data[1] ^ ( crc >> 8 ) ]
+			^ t[5][ data[2] ] ^ t[4][ data[3] ]
+			^ t[3][ data[4] ] ^ t[2][ data[5] ]
+			^ t[1][ data[6] ] ^ t[0][ data[7] ];
+		data += 8;
+		size -= 8;
+	}
+
+	return checksum_update_crc16_slice4( data, size, crc );
+}
+
+
+/**
+ * Calculates the CRC16 checksum of an array by using a table.
+ * The crc16 polynomial is 0x1021 ( x^16 + x^12 + x^5 + 1 ).
+ * Uses slicing-by-8, which is the fastest variant already for
+ * 8 byte messages (see test/checksum_bench.cpp).
+ *
+ * Note: The checksum generated by this function is NOT according
+ * to CCITT standard!
+ *
+ * @param *data       Points to the byte array from which checksum should
+ *                    be calculated
+ * @param size        Size of the byte array
+ * @param crc         Value calculated over another array and start value
+ *                    of the crc16 calculation
+ *
+ * @return CRC16 checksum
+ */
+
+unsigned short checksum_update_crc16( unsigned char *data, unsigned int size, unsigned short crc )
+{
+	return checksum_update_crc16_slice8( data, size, crc );
+}
+
+
 /**
  * Calculates the CRC16 checksum of an array by using a table.
  * The crc16 polynomial is 0x1021 ( x^16 + x^12 + x^5 + 1 ).
@@ -53,20 +53,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "wsg50/common.h"
 #include "wsg50/msg.h"
 #include "wsg50/cmd.h"
+#include "wsg50/dispatcher.h"
+#include "wsg50/metrics.h"
 
 #include "wsg50/tcp.h"
 #include "wsg50/udp.h"
 #include "wsg50/serial.h"
+#include "wsg50/can.h"
+#include "wsg50/replay.h"
 
 
 //------------------------------------------------------------------------
 // Local macros
 //------------------------------------------------------------------------
 
+#define CMD_RESPONSE_TIMEOUT_MS		1000		// Max. time until the first response arrives (dispatcher only)
+#define CMD_PENDING_TIMEOUT_MS		30000		// Max. time a pending command may take to finish (dispatcher only)
+#define CMD_RETRY_TIMEOUT_MIN_MS	20			// Min. time to wait for a response before sending the command again
+#define CMD_RETRIES					2			// Times a command that may be repeated is sent again
+
 
 //------------------------------------------------------------------------
 // Typedefs, enums, structs
@@ -77,7 +87,15 @@
 // Global variables
 //------------------------------------------------------------------------
 
-static bool connected = false;
+static cmd_conn_t default_conn =
+{
+	.link = { .tx_lock = PTHREAD_MUTEX_INITIALIZER },	// metrics NULL: the default ones of metrics.cpp
+	.connected = false,
+	.failed = false,
+	.dispatch = NULL
+};
+
+static __thread cmd_conn_t *selected = NULL;		// Connection of the calling thread, NULL: default_conn
 
 
 //------------------------------------------------------------------------
@@ -89,29 +107,199 @@ static bool connected = false;
 // Local function prototypes
 //------------------------------------------------------------------------
 
+static bool cmd_check_link( cmd_conn_t *conn );
+static int cmd_receive_response( unsigned char id, msg_t *msg, unsigned char *response, unsigned int size, int timeout_ms );
+static int cmd_submit_via( unsigned char id, unsigned char *payload, unsigned int len,
+						   bool pending, unsigned char *response, unsigned int size, bool urgent, int retries );
+
 
 //------------------------------------------------------------------------
 // Function implementation
 //------------------------------------------------------------------------
 
 /**
- * Send command and wait for answer
+ * Create a connection to another gripper
  *
- * @param id		Command ID
- * @param len		Payload length
- * @param *payload	Payload data
- * @param pending	Flag indicating whether CMD_PENDING
- * 					is allowed return status
+ * The connection is used by the cmd_* functions of a thread after it has
+ * been selected by that thread with cmd_select().
  *
- * @return Number of bytes received. -1 on error.
+ * @return New connection, NULL on error
  */
 
-int cmd_submit( unsigned char id, unsigned char *payload, unsigned int len,
-			    bool pending, unsigned char **response, unsigned int *response_len )
+cmd_conn_t *cmd_conn_create( void )
+{
+	cmd_conn_t *conn = calloc( 1, sizeof( cmd_conn_t ) );
+	if ( !conn ) return NULL;
+
+	if ( msg_link_init( &conn->link ) < 0 )
+	{
+		free( conn );
+		return NULL;
+	}
+
+	return conn;
+}
+
+
+/**
+ * Release a connection created with cmd_conn_create(). It has to be
+ * disconnected already.
+ *
+ * @param *conn		Connection
+ */
+
+void cmd_conn_destroy( cmd_conn_t *conn )
+{
+	if ( !conn || conn == &default_conn ) return;
+
+	if ( selected == conn ) selected = NULL;
+	dispatcher_release( conn->dispatch );
+	msg_link_destroy( &conn->link );
+	free( conn );
+}
+
+
+/**
+ * Select the connection the cmd_* functions of the calling thread use
+ *
+ * Each thread starts with the default connection, so single gripper
+ * programs never need to select one.
+ *
+ * @param *conn		Connection, NULL for the default connection
+ */
+
+void cmd_select( cmd_conn_t *conn )
+{
+	selected = conn;
+}
+
+
+/**
+ * Get the connection the cmd_* functions of the calling thread use
+ *
+ * @return Selected connection
+ */
+
+cmd_conn_t *cmd_selected( void )
 {
+	return selected ? selected : &default_conn;
+}
+
+
+/**
+ * Mark the link of a connection as broken
+ *
+ * Called when sending to or receiving from the gripper fails. Commands
+ * fail right away from then on, until the connection has been
+ * disconnected and connected again, e.g. by a supervisor.
+ *
+ * @param *conn		Connection
+ */
+
+void cmd_mark_failed( cmd_conn_t *conn )
+{
+	if ( !conn ) return;
+	__atomic_store_n( &conn->failed, true, __ATOMIC_RELEASE );
+}
+
+
+/**
+ * Check whether the link of the selected connection is usable
+ *
+ * @return true if connected and not marked broken, else false
+ */
+
+bool cmd_link_ok( void )
+{
+	cmd_conn_t *conn = cmd_selected();
+	return __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) && !__atomic_load_n( &conn->failed, __ATOMIC_ACQUIRE );
+}
+
+
+/**
+ * Check the link before a command is sent
+ *
+ * @param *conn		Connection
+ *
+ * @return true if the command may be sent, else false
+ */
+
+static bool cmd_check_link( cmd_conn_t *conn )
+{
+	if ( !__atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) )
+	{
+		fprintf( stderr, "Interface not connected\n" );
+		return false;
+	}
+	if ( __atomic_load_n( &conn->failed, __ATOMIC_ACQUIRE ) )
+	{
+		fprintf( stderr, "Link to the gripper is broken\n" );
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Receive the response to a command
+ *
+ * If the dispatcher is running, this waits for the next message with the
+ * given ID, so messages with other IDs don't get in the way. Otherwise the
+ * next message on the link is taken, which must then be the response.
+ *
+ * @param id			Command ID
+ * @param *msg			Message struct
+ * @param *response		Buffer for response payload
+ * @param size			Size of response buffer
+ * @param timeout_ms	Max. time to wait (dispatcher only)
+ *
+ * @return 1 if a response with the given ID was received, 0 if none arrived
+ *         within timeout_ms, else -1
+ */
+
+static int cmd_receive_response( unsigned char id, msg_t *msg, unsigned char *response, unsigned int size, int timeout_ms )
+{
+	cmd_conn_t *conn = cmd_selected();
 	int res;
+
+	if ( dispatcher_is_running() )
+	{
+		res = dispatcher_receive( id, msg, response, size, timeout_ms );
+		return res > 0 ? 1 : res == 0 ? 0 : -1;
+	}
+
+	res = msg_receive_into( &conn->link, msg, response, size );
+	if ( res <= 0 ) return -1;
+
+	// Check response ID
+	if ( msg->id != id )
+	{
+		fprintf( stderr, "Response ID (%2x) does not match submitted command ID (%2x)\n", msg->id, id );
+		return -1;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Send command and wait for answer, see cmd_submit_into()
+ *
+ * @param urgent	Send through the priority lane, see dispatcher_send_urgent()
+ * @param retries	Times the command is sent again if its response does not
+ * 					arrive within the measured round-trip time (dispatcher only)
+ */
+
+static int cmd_submit_via( unsigned char id, unsigned char *payload, unsigned int len,
+						   bool pending, unsigned char *response, unsigned int size, bool urgent, int retries )
+{
+	cmd_conn_t *conn = cmd_selected();
+	int res, timeout_ms;
 	status_t status;
 
+	// Without the dispatcher, a late response would be taken for the one of the next command
+	if ( !dispatcher_is_running() ) retries = 0;
+
 	// Assemble message struct
 	msg_t msg =
 	{
@@ -121,41 +309,47 @@ int cmd_submit( unsigned char id, unsigned char *payload, unsigned int len,
 	};
 
 	// Check if we're connected
-	if ( !connected )
-	{
-		fprintf( stderr, "Interface not connected\n" );
-		return -1;
-	}
-
-	// Send command
-	res = msg_send( &msg );
-	if ( res < 0 )
-	{
-		fprintf( stderr, "Message send failed\n" );
-		return -1;
-	}
+	if ( !cmd_check_link( conn ) ) return -1;
 
-	// Reuse message struct to receive response
-	memset( &msg, 0, sizeof( msg ) );
+	// Forget late responses of an earlier command with this ID
+	if ( dispatcher_is_running() ) dispatcher_flush( id );
 
-	// Receive response. Repeat if pending.
-	do
+	for ( ;; )
 	{
-		// Free response
-		msg_free( &msg );
-
-		// Receive response data
-		res = msg_receive( &msg );
+		// Send command
+		res = urgent ? dispatcher_send_urgent( &msg ) : msg_send( &conn->link, &msg );
 		if ( res < 0 )
 		{
-			fprintf( stderr, "Message receive failed\n" );
+			fprintf( stderr, "Message send failed\n" );
+			cmd_mark_failed( conn );
 			return -1;
 		}
 
-		// Check response ID
-		if ( msg.id != id )
+		// A command that may be repeated is given up early, as soon as its response is overdue
+		timeout_ms = retries > 0 ? (int) metrics_rtt_timeout_ms( conn->link.metrics, id, CMD_RETRY_TIMEOUT_MIN_MS, CMD_RESPONSE_TIMEOUT_MS )
+								 : CMD_RESPONSE_TIMEOUT_MS;
+		res = cmd_receive_response( id, &msg, response, size, timeout_ms );
+		if ( res != 0 ) break;
+
+		if ( retries-- <= 0 || !cmd_link_ok() )
 		{
-			fprintf( stderr, "Response ID (%2x) does not match submitted command ID (%2x)\n", msg.id, id );
+			fprintf( stderr, "No response to command %2x within %d ms\n", id, timeout_ms );
+			return -1;
+		}
+
+		// A late response to the first attempt answers the next one just as well
+		fprintf( stderr, "No response to command %2x within %d ms, sending it again\n", id, timeout_ms );
+		metrics_cmd_resent( conn->link.metrics, id );
+		msg.len = len;
+		msg.data = payload;
+	}
+
+	// Receive response. Repeat if pending.
+	for ( ;; )
+	{
+		if ( res < 0 )
+		{
+			fprintf( stderr, "Message receive failed\n" );
 			return -1;
 		}
 
@@ -169,18 +363,197 @@ int cmd_submit( unsigned char id, unsigned char *payload, unsigned int len,
 
 			status = (status_t) make_short( msg.data[0], msg.data[1] );
 		}
+		if ( !pending || status != E_CMD_PENDING ) break;
+
+		res = cmd_receive_response( id, &msg, response, size, CMD_PENDING_TIMEOUT_MS );
+		if ( res == 0 )
+		{
+			fprintf( stderr, "No response to command %2x within %d ms\n", id, CMD_PENDING_TIMEOUT_MS );
+			return -1;
+		}
 	}
-	while( pending && status == E_CMD_PENDING );
+
+	return (int) msg.len;
+}
+
+
+/**
+ * Send command and wait for answer, using a caller-supplied response buffer
+ *
+ * @param id		Command ID
+ * @param len		Payload length
+ * @param *payload	Payload data
+ * @param pending	Flag indicating whether CMD_PENDING
+ * 					is allowed return status
+ * @param *response	Buffer for response payload
+ * @param size		Size of response buffer
+ *
+ * @return Number of bytes received. -1 on error.
+ */
+
+int cmd_submit_into( unsigned char id, unsigned char *payload, unsigned int len,
+					 bool pending, unsigned char *response, unsigned int size )
+{
+	return cmd_submit_via( id, payload, len, pending, response, size, false, 0 );
+}
 
 
+/**
+ * Send a command that may be repeated and wait for answer, e.g. a setting
+ * or a query. Parameters as cmd_submit_into().
+ *
+ * The response is only waited for as long as the round-trip time measured
+ * for the command on the selected connection suggests (see
+ * metrics_rtt_timeout_ms()); then the command
+ * is sent again, up to CMD_RETRIES times. A lost frame thus costs a few
+ * round trips instead of CMD_RESPONSE_TIMEOUT_MS. Must not be used for
+ * commands whose effect adds up, e.g. motions.
+ *
+ * @return Number of bytes received. -1 on error.
+ */
+
+int cmd_submit_retry_into( unsigned char id, unsigned char *payload, unsigned int len,
+						   bool pending, unsigned char *response, unsigned int size )
+{
+	return cmd_submit_via( id, payload, len, pending, response, size, false, CMD_RETRIES );
+}
+
+
+/**
+ * Send command through the priority lane and wait for answer, e.g. a stop:
+ * it is written before all commands other threads are waiting to send.
+ * Parameters as cmd_submit_into(); the payload must not be longer than
+ * MSG_URGENT_LEN.
+ *
+ * @return Number of bytes received. -1 on error.
+ */
+
+int cmd_submit_urgent_into( unsigned char id, unsigned char *payload, unsigned int len,
+							bool pending, unsigned char *response, unsigned int size )
+{
+	return cmd_submit_via( id, payload, len, pending, response, size, true, 0 );
+}
+
+
+/**
+ * Send command and wait for answer
+ *
+ * @param id		Command ID
+ * @param len		Payload length
+ * @param *payload	Payload data
+ * @param pending	Flag indicating whether CMD_PENDING
+ * 					is allowed return status
+ * @param **response		Response payload; must be freed by the caller
+ * @param *response_len		Response payload length
+ *
+ * @return Number of bytes received. -1 on error.
+ */
+
+int cmd_submit( unsigned char id, unsigned char *payload, unsigned int len,
+			    bool pending, unsigned char **response, unsigned int *response_len )
+{
+	unsigned char buf[CMD_RESPONSE_BUFSIZE];
+	int res;
+
+	res = cmd_submit_into( id, payload, len, pending, buf, sizeof( buf ) );
+	if ( res < 0 ) return -1;
+
 	// Return payload
-	*response_len = msg.len;
-	if ( msg.len > 0 ) *response = msg.data;
-	else *response = 0;
+	*response_len = (unsigned int) res;
+	*response = 0;
+	if ( res > 0 )
+	{
+		*response = malloc( res );
+		if ( !*response ) return -1;
+		memcpy( *response, buf, res );
+	}
 
-	return (int) msg.len;
+	return res;
+}
+
+/**
+ * Send several commands back to back and collect the responses afterwards
+ *
+ * All messages are written before the first response is read, so the
+ * whole batch costs a single round trip instead of one per command. The
+ * responses are evaluated in order; evaluation stops at the first command
+ * that does not succeed. Responses of the commands after that one are
+ * not read.
+ *
+ * Note: The gripper executes only one motion at a time, so a batch should
+ * not contain more than one motion command.
+ *
+ * @param *cmds		Commands
+ * @param count		Number of commands
+ * @param *status	Status of the last response evaluated
+ *
+ * @return Number of commands that succeeded (count if all did). -1 on error.
+ */
+
+int cmd_submit_batch( const cmd_request_t *cmds, unsigned int count, status_t *status )
+{
+	cmd_conn_t *conn = cmd_selected();
+	unsigned char response[CMD_RESPONSE_BUFSIZE];
+	unsigned int i;
+	int res, timeout_ms;
+	msg_t msg;
+
+	*status = E_SUCCESS;
+
+	// Check if we're connected
+	if ( !cmd_check_link( conn ) ) return -1;
+
+	// Forget late responses of earlier commands with these IDs
+	if ( dispatcher_is_running() ) for ( i = 0; i < count; i++ ) dispatcher_flush( cmds[i].id );
+
+	// Send all commands
+	for ( i = 0; i < count; i++ )
+	{
+		msg.id = cmds[i].id;
+		msg.len = cmds[i].len;
+		msg.data = cmds[i].payload;
+
+		res = msg_send( &conn->link, &msg );
+		if ( res < 0 )
+		{
+			fprintf( stderr, "Message send failed\n" );
+			cmd_mark_failed( conn );
+			return -1;
+		}
+	}
+
+	// Collect responses in order. Repeat for each command while pending.
+	for ( i = 0; i < count; i++ )
+	{
+		timeout_ms = CMD_RESPONSE_TIMEOUT_MS;
+		do
+		{
+			res = cmd_receive_response( cmds[i].id, &msg, response, sizeof( response ), timeout_ms );
+			if ( res == 0 ) fprintf( stderr, "No response to command %2x within %d ms\n", cmds[i].id, timeout_ms );
+			if ( res <= 0 )
+			{
+				fprintf( stderr, "Message receive failed\n" );
+				return -1;
+			}
+			timeout_ms = CMD_PENDING_TIMEOUT_MS;
+
+			if ( msg.len < 2 )
+			{
+				fprintf( stderr, "No status code received\n" );
+				return -1;
+			}
+
+			*status = cmd_get_response_status( msg.data );
+		}
+		while( cmds[i].pending && *status == E_CMD_PENDING );
+
+		if ( *status != E_SUCCESS ) return (int) i;
+	}
+
+	return (int) count;
 }
 
+
 /**
  * Send command and return immediately (do not read response)
  *
@@ -193,6 +566,7 @@ int cmd_submit( unsigned char id, unsigned char *payload, unsigned int len,
 
 int cmd_submit_async( unsigned char id, unsigned char *payload, unsigned int len)
 {
+	cmd_conn_t *conn = cmd_selected();
 	int res;
 	status_t status;
 
@@ -205,15 +579,16 @@ int cmd_submit_async( unsigned char id, unsigned char *payload, unsigned int len
 	};
 
 	// Check if we're connected
-	if ( !connected ) {
-		fprintf( stderr, "Interface not connected\n" );
-		return -1;
-	}
+	if ( !cmd_check_link( conn ) ) return -1;
+
+	// Forget late responses of an earlier command with this ID
+	if ( dispatcher_is_running() ) dispatcher_flush( id );
 
 	// Send command
-	res = msg_send( &msg );
+	res = msg_send( &conn->link, &msg );
 	if ( res < 0 ) {
 		fprintf( stderr, "Message send failed\n" );
+		cmd_mark_failed( conn );
 		return -1;
 	}
 
@@ -221,15 +596,23 @@ int cmd_submit_async( unsigned char id, unsigned char *payload, unsigned int len
 }
 
 /*
- * Receive response of a previously sent command
+ * Wait for the response of a previously sent command
+ *
+ * The calling thread sleeps until the response arrives or the timeout
+ * expires. Waiting requires the dispatcher; without it, this only checks
+ * for a response that has already been received.
  *
  * @param id				Original Command ID
+ * @param *response			Buffer for response payload
+ * @param size				Size of response buffer
  * @param *response_len		Response length
- * @param **response	    Response data
+ * @param timeout_ms		Max. time to wait; 0 returns immediately, < 0 waits forever
  *
  * returns 0 when no msg available, 1 when msg is available and correct, -1 on error
  */
-int cmd_recv_ack ( unsigned char id, unsigned char **response, unsigned int *response_len){
+int cmd_wait_ack_into( unsigned char id, unsigned char *response, unsigned int size, unsigned int *response_len, int timeout_ms )
+{
+	cmd_conn_t *conn = cmd_selected();
 	int res;
 	msg_t msg;
 
@@ -237,41 +620,88 @@ int cmd_recv_ack ( unsigned char id, unsigned char **response, unsigned int *res
 	memset( &msg, 0, sizeof( msg ) );
 
 	// Check if we're connected
-	if ( !connected ) {
-		fprintf( stderr, "Interface not connected\n" );
-		return -1;
-	}
+	if ( !cmd_check_link( conn ) ) return -1;
 
-	// Receive response data
-	res = msg_receive_async( &msg );
-	if ( res == 0 ) return 0;
-	if ( res < 0 ) return -1;
-
-	// Check response ID
-	if ( msg.id != id && msg.id != 0x22) {
-		fprintf( stderr, "Response ID (%2x) does not match submitted command ID (%2x)\n", msg.id, id );
-		return -1;
-	} 
-	// Ignore asyncronous responses of the stop command
-	if (msg.id != id && msg.id == 0x22) {
-		// Reuse message struct to receive response
-		memset( &msg, 0, sizeof( msg ) );
-		
-		// Retry to receive response data
-		res = msg_receive_async( &msg );
+	// Receive response data. The dispatcher queues the response by ID,
+	// so messages of other commands (e.g. stop) are not in the way.
+	if ( dispatcher_is_running() )
+	{
+		res = dispatcher_receive( id, &msg, response, size, timeout_ms );
+		if ( res <= 0 ) return res;
+	}
+	else
+	{
+		res = msg_receive_async_into( &conn->link, &msg, response, size );
 		if ( res == 0 ) return 0;
 		if ( res < 0 ) return -1;
 
-		if ( msg.id != id ) {
-		fprintf( stderr, "Response ID (%2x) does not match submitted command ID (%2x)\n", msg.id, id );
-		return -1;
-	} 
+		// Check response ID
+		if ( msg.id != id && msg.id != 0x22) {
+			fprintf( stderr, "Response ID (%2x) does not match submitted command ID (%2x)\n", msg.id, id );
+			return -1;
+		}
+		// Ignore asyncronous responses of the stop command
+		if (msg.id != id && msg.id == 0x22) {
+			// Reuse message struct to receive response
+			memset( &msg, 0, sizeof( msg ) );
+
+			// Retry to receive response data
+			res = msg_receive_async_into( &conn->link, &msg, response, size );
+			if ( res == 0 ) return 0;
+			if ( res < 0 ) return -1;
+
+			if ( msg.id != id ) {
+				fprintf( stderr, "Response ID (%2x) does not match submitted command ID (%2x)\n", msg.id, id );
+				return -1;
+			}
+		}
 	}
 
-	// Return payload
+	// Return payload length
 	*response_len = msg.len;
-	if ( msg.len > 0 ) *response = msg.data;
-	else *response = 0;
+
+	return 1;
+}
+
+/*
+ * Receive response of a previously sent command into a caller-supplied buffer
+ *
+ * @param id				Original Command ID
+ * @param *response			Buffer for response payload
+ * @param size				Size of response buffer
+ * @param *response_len		Response length
+ *
+ * returns 0 when no msg available, 1 when msg is available and correct, -1 on error
+ */
+int cmd_recv_ack_into( unsigned char id, unsigned char *response, unsigned int size, unsigned int *response_len )
+{
+	return cmd_wait_ack_into( id, response, size, response_len, 0 );
+}
+
+/*
+ * Receive response of a previously sent command
+ *
+ * @param id				Original Command ID
+ * @param *response_len		Response length
+ * @param **response	    Response data; must be freed by the caller
+ *
+ * returns 0 when no msg available, 1 when msg is available and correct, -1 on error
+ */
+int cmd_recv_ack ( unsigned char id, unsigned char **response, unsigned int *response_len){
+	unsigned char buf[CMD_RESPONSE_BUFSIZE];
+	int res;
+
+	res = cmd_recv_ack_into( id, buf, sizeof( buf ), response_len );
+	if ( res <= 0 ) return res;
+
+	// Return payload
+	*response = 0;
+	if ( *response_len > 0 )
+	{
+		*response = malloc( *response_len );
+		if ( !*response ) return -1;
+		memcpy( *response, buf, *response_len );
+	}
 
 	return 1;
 }
@@ -287,6 +717,22 @@ int cmd_recv_ack ( unsigned char id, unsigned char **response, unsigned int *res
 
 int cmd_connect_tcp( const char *addr, unsigned short port )
 {
+	return cmd_connect_tcp_options( addr, port, NULL );
+}
+
+/**
+ * Open TCP connection with the given socket options
+ *
+ * @param *addr				String containing IP address
+ * @param port				Port number (remote)
+ * @param *options			Socket options, NULL for tcp_options_default()
+ *
+ * @return 0 on success, else -1
+ */
+
+int cmd_connect_tcp_options( const char *addr, unsigned short port, const tcp_options_t *options )
+{
+	cmd_conn_t *conn = cmd_selected();
 	int res;
 	tcp_params_t params;
 	const interface_t *iface;
@@ -295,7 +741,7 @@ int cmd_connect_tcp( const char *addr, unsigned short port )
 	if ( !addr ) return -1;
 
 	// If already connected, return error
-	if ( connected ) return -1;
+	if ( __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) ) return -1;
 
 	// Get interface with the given name
 	iface = interface_get( "tcp" );
@@ -304,13 +750,15 @@ int cmd_connect_tcp( const char *addr, unsigned short port )
 	// Create parameter struct
 	params.addr = str_to_ipaddr( addr );
 	params.port = port;
+	params.options = options;
 
 	// Open connection
-	res = msg_open( iface, &params );
+	res = msg_open( &conn->link, iface, &params );
 	if ( res < 0 ) return -1;
 
 	// Set connected flag
-	connected = true;
+	__atomic_store_n( &conn->failed, false, __ATOMIC_RELEASE );
+	__atomic_store_n( &conn->connected, true, __ATOMIC_RELEASE );
 
 	//printf( "TCP connection established. \n" );
 
@@ -329,6 +777,7 @@ int cmd_connect_tcp( const char *addr, unsigned short port )
 
 int cmd_connect_udp( unsigned short local_port, const char *addr, unsigned short remote_port )
 {
+	cmd_conn_t *conn = cmd_selected();
 	int res;
 	udp_params_t params;
 	const interface_t *iface;
@@ -337,7 +786,7 @@ int cmd_connect_udp( unsigned short local_port, const char *addr, unsigned short
 	if ( !addr ) return -1;
 
 	// If already connected, return error
-	if ( connected ) return -1;
+	if ( __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) ) return -1;
 
 	// Get interface with the given name
 	iface = interface_get( "udp" );
@@ -349,11 +798,12 @@ int cmd_connect_udp( unsigned short local_port, const char *addr, unsigned short
 	params.remote_port = remote_port;
 
 	// Open connection
-	res = msg_open( iface, &params );
+	res = msg_open( &conn->link, iface, &params );
 	if ( res < 0 ) return -1;
 
 	// Set connected flag
-	connected = true;
+	__atomic_store_n( &conn->failed, false, __ATOMIC_RELEASE );
+	__atomic_store_n( &conn->connected, true, __ATOMIC_RELEASE );
 
 	printf( "UDP connection established\n" );
 
@@ -365,12 +815,29 @@ int cmd_connect_udp( unsigned short local_port, const char *addr, unsigned short
  * Open up serial connection
  *
  * @param *device		Device string
+ * @param bitrate		Bitrate in baud
  *
  * @return 0 on success, else -1
  */
 
 int cmd_connect_serial( const char *device, unsigned int bitrate )
 {
+	return cmd_connect_serial_options( device, bitrate, NULL );
+}
+
+/**
+ * Open up serial connection with the given line options
+ *
+ * @param *device		Device string
+ * @param bitrate		Bitrate in baud
+ * @param *options		Line options, NULL for serial_options_default()
+ *
+ * @return 0 on success, else -1
+ */
+
+int cmd_connect_serial_options( const char *device, unsigned int bitrate, const serial_options_t *options )
+{
+	cmd_conn_t *conn = cmd_selected();
 	int res;
 	ser_params_t params;
 	const interface_t *iface;
@@ -381,20 +848,22 @@ int cmd_connect_serial( const char *device, unsigned int bitrate )
 	// Set connection parameters
 	params.device = device;
 	params.bitrate = bitrate;
+	params.options = options;
 
 	// If already connected, return error
-	if ( connected ) return -1;
+	if ( __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) ) return -1;
 
 	// Get interface with the given name
 	iface = interface_get( "serial" );
 	if ( !iface ) return -1;
 
 	// Open connection
-	res = msg_open( iface, (void *) &params );
+	res = msg_open( &conn->link, iface, (void *) &params );
 	if ( res < 0 ) return -1;
 
 	// Set connected flag
-	connected = true;
+	__atomic_store_n( &conn->failed, false, __ATOMIC_RELEASE );
+	__atomic_store_n( &conn->connected, true, __ATOMIC_RELEASE );
 
 	printf( "Serial connection established\n" );
 
@@ -402,12 +871,102 @@ int cmd_connect_serial( const char *device, unsigned int bitrate )
 }
 
 
+/**
+ * Open up SocketCAN connection
+ *
+ * @param *device		Network interface, e.g. can0
+ * @param tx_id			Identifier of the frames sent to the gripper
+ * @param rx_id			Identifier of the gripper's answers
+ *
+ * @return 0 on success, else -1
+ */
+
+int cmd_connect_can( const char *device, unsigned int tx_id, unsigned int rx_id )
+{
+	cmd_conn_t *conn = cmd_selected();
+	int res;
+	can_params_t params;
+	const interface_t *iface;
+
+	// Device parameter must be given
+	if ( !device ) return -1;
+
+	// If already connected, return error
+	if ( __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) ) return -1;
+
+	// Get interface with the given name
+	iface = interface_get( "can" );
+	if ( !iface ) return -1;
+
+	// Set connection parameters
+	params.device = device;
+	params.tx_id = tx_id;
+	params.rx_id = rx_id;
+
+	// Open connection
+	res = msg_open( &conn->link, iface, (void *) &params );
+	if ( res < 0 ) return -1;
+
+	// Set connected flag
+	__atomic_store_n( &conn->failed, false, __ATOMIC_RELEASE );
+	__atomic_store_n( &conn->connected, true, __ATOMIC_RELEASE );
+
+	printf( "CAN connection established\n" );
+
+	return 0;
+}
+
+
+/**
+ * Play a recording of the link traffic back instead of connecting to a
+ * gripper, see recorder.h
+ *
+ * @param *path			Recording
+ * @param speed			1: recorded timing, 2: twice as fast, ...; 0: as fast as possible
+ *
+ * @return 0 on success, else -1
+ */
+
+int cmd_connect_replay( const char *path, double speed )
+{
+	cmd_conn_t *conn = cmd_selected();
+	int res;
+	replay_params_t params;
+	const interface_t *iface;
+
+	// Recording must be given
+	if ( !path ) return -1;
+
+	// If already connected, return error
+	if ( __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE ) ) return -1;
+
+	// Get interface with the given name
+	iface = interface_get( "replay" );
+	if ( !iface ) return -1;
+
+	// Set connection parameters
+	params.path = path;
+	params.speed = speed;
+
+	// Open connection
+	res = msg_open( &conn->link, iface, (void *) &params );
+	if ( res < 0 ) return -1;
+
+	// Set connected flag
+	__atomic_store_n( &conn->failed, false, __ATOMIC_RELEASE );
+	__atomic_store_n( &conn->connected, true, __ATOMIC_RELEASE );
+
+	return 0;
+}
+
+
 /**
  * Disconnect
  */
 
 void cmd_disconnect( void )
 {
+	cmd_conn_t *conn = cmd_selected();
 	status_t status;
 	int res;
 	unsigned char *resp;
@@ -415,18 +974,25 @@ void cmd_disconnect( void )
 
 	printf( "Closing connection\n" );
 
-	res = cmd_submit( 0x07, NULL, 0, false, &resp, &resp_len);
-	if ( res != 2 ) printf( "Disconnect announcement failed: Response payload length doesn't match (is %d, expected 2)\n", res );
-	else
+	// Nobody would answer on a broken link
+	if ( cmd_link_ok() )
 	{
-		// Check response status
-		status = cmd_get_response_status( resp );
-		if ( status != E_SUCCESS ) printf( "Command ANNOUNCE DISCONNECT not successful: %s\n", status_to_str( status ) );
-	}
+		res = cmd_submit( 0x07, NULL, 0, false, &resp, &resp_len);
+		if ( res != 2 ) printf( "Disconnect announcement failed: Response payload length doesn't match (is %d, expected 2)\n", res );
+		else
+		{
+			// Check response status
+			status = cmd_get_response_status( resp );
+			if ( status != E_SUCCESS ) printf( "Command ANNOUNCE DISCONNECT not successful: %s\n", status_to_str( status ) );
+		}
 
-	if ( res > 0 ) free( resp );
+		if ( res > 0 ) free( resp );
+	}
 
-	msg_close();
+	// The reader thread must be gone before the interface is closed
+	__atomic_store_n( &conn->connected, false, __ATOMIC_RELEASE );
+	dispatcher_stop();
+	msg_close( &conn->link );
 }
 
 
@@ -438,7 +1004,8 @@ void cmd_disconnect( void )
 
 bool cmd_is_connected( void )
 {
-	return connected;
+	cmd_conn_t *conn = cmd_selected();
+	return __atomic_load_n( &conn->connected, __ATOMIC_ACQUIRE );
 }
 
 
@@ -0,0 +1,689 @@
+//======================================================================
+/**
+ *  @file
+ *  dispatcher.cpp
+ *
+ *  @section dispatcher.cpp_general General file information
+ *
+ *  @brief
+ *  Response dispatcher
+ *
+ *  The gripper answers every command with a message carrying the same ID,
+ *  but automatic updates (e.g. 0x43 - 0x45) and late responses (e.g. of a
+ *  stop command) may arrive in between. Instead of expecting the next
+ *  message on the link to be the response, a single reader thread
+ *  receives all messages and sorts them by command ID:
+ *
+ *  - Subscribers get a callback for every message with their ID.
+ *  - Additionally, every message is queued per ID, so a command can wait
+ *    for its own response with dispatcher_receive() while other messages
+ *    keep arriving.
+ *
+ *  The gripper's automatic updates carry the ID of the command that
+ *  requested them. A query with a subscribed ID would take the next update
+ *  for its response, so getOpening() and friends refuse to read while the
+ *  ID is subscribed (see dispatcher_is_subscribed()).
+ *
+ *  Every connection (see cmd_select()) has its own queues and subscribers,
+ *  but all connections whose interface provides a descriptor are served
+ *  by one reader thread that sleeps in epoll (see reactor.c) until any of
+ *  them has data. Interfaces without descriptor get a reader thread of
+ *  their own, which blocks in the interface read. Waiting commands sleep
+ *  on a condition variable.
+ *
+ *  Stop frames take a priority lane (see dispatcher_send_urgent()): they
+ *  are written by the shared reader thread, which may have a real-time
+ *  priority, ahead of any frame other threads are waiting to send.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "wsg50/common.h"
+#include "wsg50/msg.h"
+#include "wsg50/cmd.h"
+#include "wsg50/dispatcher.h"
+#include "wsg50/metrics.h"
+#include "wsg50/reactor.h"
+#include "wsg50/rt.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define DISPATCHER_ERROR_BACKOFF_MS		10			// Pause after a failed read, so a broken link does not spin
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+namespace
+{
+
+struct queued_msg
+{
+	std::vector<unsigned char> data;				// Capacity is kept when the slot is reused
+	struct timespec stamp;
+};
+
+/** Responses received for one command ID, oldest first */
+struct response_queue
+{
+	std::condition_variable received;				// Only waiters for this ID are woken up
+	queued_msg slot[DISPATCHER_QUEUE_LEN];
+	unsigned int first = 0;
+	unsigned int count = 0;
+	unsigned long dropped = 0;
+};
+
+struct subscriber
+{
+	dispatcher_cb_t cb = nullptr;
+	void *arg = nullptr;
+};
+
+} // namespace
+
+/** Dispatcher state of one connection; kept until the connection is destroyed */
+struct dispatcher_conn
+{
+	cmd_conn_t *conn;
+	std::mutex lock;
+	std::unique_ptr<response_queue> queue[256];		// Allocated on first use of that ID
+	subscriber subscribers[256];
+	std::mutex cb_lock;								// Held while a callback runs, so unsubscribe can wait for it
+
+	std::atomic<bool> running{ false };
+	int fd = -1;									// Descriptor served by the event loop, -1: own reader thread
+	std::thread reader;								// Only used without descriptor
+};
+
+namespace
+{
+
+/** Reader thread shared by all connections with a descriptor */
+struct event_loop
+{
+	std::mutex lock;								// Serializes dispatcher_start() and dispatcher_stop()
+	std::mutex serve_lock;							// Held while messages are handed out, protects conns
+	std::vector<dispatcher_conn *> conns;
+
+	std::thread reader;
+	std::atomic<bool> running{ false };
+	reactor_t reactor{ -1, -1 };
+
+	rt_options_t options{};							// Of the reader threads started from now on, protected by lock
+};
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+event_loop loop;
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+dispatcher_conn *dispatcher_selected( void );
+response_queue *dispatcher_queue( dispatcher_conn *dc, unsigned char id );
+void dispatcher_deliver( dispatcher_conn *dc, const msg_t *msg );
+int dispatcher_serve( dispatcher_conn *dc, msg_t *msg, unsigned char *buf, unsigned int size );
+void dispatcher_loop( rt_options_t options );
+void dispatcher_conn_loop( dispatcher_conn *dc, rt_options_t options );
+void dispatcher_drop( dispatcher_conn *dc );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+/**
+ * Get the dispatcher state of the connection selected by the calling thread
+ *
+ * @return Dispatcher state, NULL if the dispatcher was never started on it
+ */
+
+dispatcher_conn *dispatcher_selected( void )
+{
+	return cmd_selected()->dispatch;
+}
+
+
+/**
+ * Get the response queue of a command ID, dc->lock must be held
+ */
+
+response_queue *dispatcher_queue( dispatcher_conn *dc, unsigned char id )
+{
+	std::unique_ptr<response_queue> &q = dc->queue[id];
+	if ( !q ) q.reset( new response_queue );
+	return q.get();
+}
+
+
+/**
+ * Hand a received message to its subscriber and queue it
+ *
+ * @param *dc		Connection the message was received on
+ * @param *msg		Received message
+ */
+
+void dispatcher_deliver( dispatcher_conn *dc, const msg_t *msg )
+{
+	subscriber sub;
+	response_queue *q;
+
+	{
+		std::lock_guard<std::mutex> guard( dc->lock );
+
+		q = dispatcher_queue( dc, msg->id );
+		sub = dc->subscribers[msg->id];
+
+		// Drop the oldest response if nobody picked them up. Messages of a
+		// subscribed ID, e.g. automatic updates, are queued as well, since a
+		// command may wait for its response, but their subscriber has seen
+		// them, so they are not lost.
+		if ( q->count == DISPATCHER_QUEUE_LEN )
+		{
+			q->first = ( q->first + 1 ) % DISPATCHER_QUEUE_LEN;
+			q->count--;
+			if ( !sub.cb )
+			{
+				q->dropped++;
+				metrics_queue_dropped( dc->conn->link.metrics, msg->id );
+			}
+		}
+
+		queued_msg &slot = q->slot[( q->first + q->count ) % DISPATCHER_QUEUE_LEN];
+		slot.data.assign( msg->data, msg->data + msg->len );
+		slot.stamp = msg->stamp;
+		q->count++;
+	}
+	q->received.notify_all();
+
+	if ( sub.cb )
+	{
+		std::lock_guard<std::mutex> guard( dc->cb_lock );
+
+		// Commands sent by the callback go to the gripper the message came from
+		cmd_select( dc->conn );
+		sub.cb( msg, sub.arg );
+	}
+}
+
+
+/**
+ * Read what a readable link has to offer and hand out all complete messages
+ *
+ * @param *dc		Connection with data
+ * @param *msg		Message struct used for delivery
+ * @param *buf		Payload buffer used for delivery
+ * @param size		Size of buffer
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int dispatcher_serve( dispatcher_conn *dc, msg_t *msg, unsigned char *buf, unsigned int size )
+{
+	int res;
+
+	// The descriptor is readable, so this does not block
+	res = msg_receive_fill( &dc->conn->link );
+	if ( res < 0 ) return -1;
+
+	while ( ( res = msg_receive_buffered_into( &dc->conn->link, msg, buf, size ) ) != 0 )
+	{
+		// On errors, the broken message has been skipped already
+		if ( res > 0 ) dispatcher_deliver( dc, msg );
+	}
+
+	return 0;
+}
+
+
+/**
+ * Wake up everybody waiting for a response on a connection
+ */
+
+void dispatcher_drop( dispatcher_conn *dc )
+{
+	std::lock_guard<std::mutex> guard( dc->lock );
+	for ( unsigned int i = 0; i < 256; i++ ) if ( dc->queue[i] ) dc->queue[i]->received.notify_all();
+}
+
+
+/**
+ * Shared reader thread: serve all connections with a descriptor until the
+ * last one is stopped
+ */
+
+void dispatcher_loop( rt_options_t options )
+{
+	unsigned char buf[DISPATCHER_RX_BUFSIZE];
+	void *ready[REACTOR_MAX_EVENTS];
+	unsigned int count, i;
+	dispatcher_conn *dc;
+	msg_t msg;
+	int res;
+
+	if ( rt_options_set( &options ) ) rt_apply_thread( &options, "wsg50_io" );
+
+	while ( loop.running )
+	{
+		res = reactor_wait( &loop.reactor, -1, ready, &count );
+		if ( res < 0 )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( DISPATCHER_ERROR_BACKOFF_MS ) );
+			continue;
+		}
+
+		std::lock_guard<std::mutex> guard( loop.serve_lock );
+
+		// Frames of the priority lane first, before reading delays them
+		if ( res & REACTOR_WAKEUP )
+			for ( i = 0; i < loop.conns.size(); i++ )
+				if ( msg_flush_urgent( &loop.conns[i]->conn->link ) < 0 ) cmd_mark_failed( loop.conns[i]->conn );
+
+		for ( i = 0; i < count; i++ )
+		{
+			// Skip connections stopped after the descriptors were reported
+			dc = static_cast<dispatcher_conn *>( ready[i] );
+			if ( std::find( loop.conns.begin(), loop.conns.end(), dc ) == loop.conns.end() ) continue;
+
+			if ( dispatcher_serve( dc, &msg, buf, sizeof( buf ) ) < 0 )
+			{
+				// Its descriptor stays readable, which would keep the other grippers waiting.
+				// Waiting commands fail, and the link is left to be reconnected.
+				fprintf( stderr, "Failed to read from gripper link, not reading it any more\n" );
+				reactor_remove( &loop.reactor, dc->fd );
+				loop.conns.erase( std::find( loop.conns.begin(), loop.conns.end(), dc ) );
+				cmd_mark_failed( dc->conn );
+				dc->running = false;
+				dispatcher_drop( dc );
+			}
+		}
+	}
+}
+
+
+/**
+ * Reader thread of a connection without descriptor: block in the interface
+ * read until the dispatcher is stopped
+ *
+ * @param *dc		Connection
+ */
+
+void dispatcher_conn_loop( dispatcher_conn *dc, rt_options_t options )
+{
+	unsigned char buf[DISPATCHER_RX_BUFSIZE];
+	msg_t msg;
+	int res;
+
+	if ( rt_options_set( &options ) ) rt_apply_thread( &options, "wsg50_io_conn" );
+
+	while ( dc->running )
+	{
+		res = msg_receive_into( &dc->conn->link, &msg, buf, sizeof( buf ) );
+		if ( res > 0 ) dispatcher_deliver( dc, &msg );
+		else if ( res < 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( DISPATCHER_ERROR_BACKOFF_MS ) );
+	}
+
+	dispatcher_drop( dc );
+}
+
+} // namespace
+
+
+/**
+ * Start receiving on the connection selected by the calling thread
+ *
+ * From now on, all messages of this connection must be received via the
+ * dispatcher, i.e. msg_receive() must not be called by anybody else. The
+ * shared reader thread is started with the first connection.
+ *
+ * @return 0 on success, -1 if already running or on error
+ */
+
+int dispatcher_start( void )
+{
+	cmd_conn_t *conn = cmd_selected();
+	dispatcher_conn *dc = conn->dispatch;
+
+	std::lock_guard<std::mutex> guard( loop.lock );
+
+	if ( !dc )
+	{
+		dc = new dispatcher_conn;
+		dc->conn = conn;
+		conn->dispatch = dc;
+	}
+	if ( dc->running ) return -1;
+
+	// Discard responses of an earlier session
+	{
+		std::lock_guard<std::mutex> guard( dc->lock );
+		for ( unsigned int i = 0; i < 256; i++ ) if ( dc->queue[i] ) dc->queue[i]->count = 0;
+	}
+
+	dc->fd = msg_get_fd( &conn->link );
+	if ( dc->fd < 0 )
+	{
+		dc->running = true;
+		dc->reader = std::thread( dispatcher_conn_loop, dc, loop.options );
+		return 0;
+	}
+
+	if ( !loop.reader.joinable() )
+	{
+		if ( reactor_open( &loop.reactor ) < 0 ) return -1;
+
+		loop.running = true;
+		loop.reader = std::thread( dispatcher_loop, loop.options );
+	}
+
+	{
+		std::lock_guard<std::mutex> guard( loop.serve_lock );
+		loop.conns.push_back( dc );
+	}
+	if ( reactor_add( &loop.reactor, dc->fd, dc ) < 0 )
+	{
+		std::lock_guard<std::mutex> guard( loop.serve_lock );
+		loop.conns.pop_back();
+		return -1;
+	}
+
+	dc->running = true;
+
+	return 0;
+}
+
+
+/**
+ * Stop receiving on the connection selected by the calling thread
+ *
+ * Returns once no message of this connection is handed out any more. The
+ * shared reader thread finishes with the last connection. Without a
+ * descriptor to wait on, this may take up to the receive timeout of the
+ * interface.
+ */
+
+void dispatcher_stop( void )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	bool last;
+
+	if ( !dc ) return;
+
+	std::lock_guard<std::mutex> guard( loop.lock );
+
+	dc->running = false;
+
+	if ( dc->fd < 0 )
+	{
+		if ( dc->reader.joinable() ) dc->reader.join();
+		return;
+	}
+
+	// Once the lock is held, the reader is not handing out messages of it
+	{
+		std::lock_guard<std::mutex> guard( loop.serve_lock );
+
+		auto it = std::find( loop.conns.begin(), loop.conns.end(), dc );
+		if ( it != loop.conns.end() )
+		{
+			reactor_remove( &loop.reactor, dc->fd );
+			loop.conns.erase( it );
+		}
+		last = loop.conns.empty();
+	}
+	msg_flush_urgent( &dc->conn->link );
+	dispatcher_drop( dc );
+
+	if ( last && loop.reader.joinable() )
+	{
+		loop.running = false;
+		reactor_wakeup( &loop.reactor );
+		loop.reader.join();
+
+		reactor_close( &loop.reactor );
+	}
+}
+
+
+/**
+ * Free the dispatcher state of a connection; the dispatcher must have been
+ * stopped on it
+ *
+ * @param *dc		Dispatcher state, may be NULL
+ */
+
+void dispatcher_release( struct dispatcher_conn *dc )
+{
+	if ( dc && dc->running ) return;
+	delete dc;
+}
+
+
+/**
+ * Send a frame through the priority lane of the connection selected by the
+ * calling thread, e.g. a stop. It overtakes all frames other threads are
+ * waiting to send; its response is received as usual.
+ *
+ * With the shared reader thread, the frame is handed to it, so it is
+ * written with the reader's scheduling (see dispatcher_set_thread_options())
+ * rather than the caller's. Otherwise the caller writes it.
+ *
+ * @param *msg		Message to send, at most MSG_URGENT_LEN bytes payload
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int dispatcher_send_urgent( const msg_t *msg )
+{
+	cmd_conn_t *conn = cmd_selected();
+	dispatcher_conn *dc = conn->dispatch;
+
+	// Another frame is waiting in the lane; this one is written right after it
+	if ( msg_post_urgent( &conn->link, msg ) < 0 )
+		return msg_send( &conn->link, const_cast<msg_t *>( msg ) ) > 0 ? 0 : -1;
+
+	if ( dc && dc->running && dc->fd >= 0 )
+	{
+		reactor_wakeup( &loop.reactor );
+		return 0;
+	}
+
+	return msg_flush_urgent( &conn->link ) < 0 ? -1 : 0;
+}
+
+
+/**
+ * Set the scheduling of the reader threads, see rt.h. Applies to the
+ * threads started from now on; the shared one is started with the first
+ * connection.
+ *
+ * @param *options		Priority, CPUs and stack prefault
+ */
+
+void dispatcher_set_thread_options( const rt_options_t *options )
+{
+	std::lock_guard<std::mutex> guard( loop.lock );
+	loop.options = *options;
+}
+
+
+/**
+ * Get dispatcher state
+ *
+ * @return true if the connection selected by the calling thread is served
+ */
+
+bool dispatcher_is_running( void )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	return dc && dc->running;
+}
+
+
+/**
+ * Subscribe to all messages with the given ID
+ *
+ * The callback is invoked from the reader thread and should return
+ * quickly. It must neither wait for responses nor unsubscribe itself, and
+ * it delays the messages of all other grippers while it runs.
+ *
+ * @param id		Command ID
+ * @param cb		Callback
+ * @param *arg		Passed to the callback
+ *
+ * @return 0 on success, -1 if the ID already has a subscriber or the
+ *         dispatcher has not been started
+ */
+
+int dispatcher_subscribe( unsigned char id, dispatcher_cb_t cb, void *arg )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	if ( !dc ) return -1;
+
+	std::lock_guard<std::mutex> guard( dc->lock );
+
+	if ( !cb || dc->subscribers[id].cb ) return -1;
+
+	dc->subscribers[id].cb = cb;
+	dc->subscribers[id].arg = arg;
+
+	return 0;
+}
+
+
+/**
+ * Remove the subscriber of the given ID
+ *
+ * Once this returns, the callback is not running and won't be called again.
+ *
+ * @param id		Command ID
+ */
+
+void dispatcher_unsubscribe( unsigned char id )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	if ( !dc ) return;
+
+	{
+		std::lock_guard<std::mutex> guard( dc->lock );
+		dc->subscribers[id] = subscriber();
+	}
+
+	// Wait for a callback that is currently running
+	std::lock_guard<std::mutex> guard( dc->cb_lock );
+}
+
+
+/**
+ * Check whether messages with the given ID go to a subscriber. A command
+ * with such an ID cannot tell its response from the messages pushed by the
+ * gripper, e.g. automatic updates.
+ *
+ * @param id		Command ID
+ *
+ * @return true if the ID has a subscriber on the selected connection
+ */
+
+bool dispatcher_is_subscribed( unsigned char id )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	if ( !dc ) return false;
+
+	std::lock_guard<std::mutex> guard( dc->lock );
+	return dc->subscribers[id].cb != nullptr;
+}
+
+
+/**
+ * Wait for the next message with the given ID
+ *
+ * @param id			Command ID
+ * @param *msg			Message struct; data points to buf afterwards
+ * @param *buf			Buffer for the payload
+ * @param size			Size of buffer
+ * @param timeout_ms	Max. time to wait; 0 returns immediately, < 0 waits forever
+ *
+ * @return 1 when a message was received, 0 on timeout, -1 on error
+ */
+
+int dispatcher_receive( unsigned char id, msg_t *msg, unsigned char *buf, unsigned int size, int timeout_ms )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	if ( !dc ) return -1;
+
+	std::unique_lock<std::mutex> guard( dc->lock );
+	response_queue *q = dispatcher_queue( dc, id );
+
+	auto available = [q, dc] { return q->count > 0 || !dc->running; };
+
+	if ( timeout_ms < 0 ) q->received.wait( guard, available );
+	else if ( timeout_ms > 0 ) q->received.wait_for( guard, std::chrono::milliseconds( timeout_ms ), available );
+
+	if ( q->count == 0 ) return dc->running ? 0 : -1;
+
+	queued_msg &slot = q->slot[q->first];
+	q->first = ( q->first + 1 ) % DISPATCHER_QUEUE_LEN;
+	q->count--;
+
+	if ( slot.data.size() > size )
+	{
+		fprintf( stderr, "Receive buffer too small (%d, expected %d)\n", size, (int) slot.data.size() );
+		return -1;
+	}
+
+	if ( !slot.data.empty() ) memcpy( buf, slot.data.data(), slot.data.size() );
+	msg->id = id;
+	msg->len = (unsigned int) slot.data.size();
+	msg->data = buf;
+	msg->stamp = slot.stamp;
+
+	return 1;
+}
+
+
+/**
+ * Discard all queued messages with the given ID
+ *
+ * Called before submitting a command, so that late responses of an earlier
+ * command with the same ID are not taken for the new response.
+ *
+ * @param id		Command ID
+ */
+
+void dispatcher_flush( unsigned char id )
+{
+	dispatcher_conn *dc = dispatcher_selected();
+	if ( !dc ) return;
+
+	std::lock_guard<std::mutex> guard( dc->lock );
+	if ( dc->queue[id] ) dc->queue[id]->count = 0;
+}
+
+
+//------------------------------------------------------------------------
+// Testing functions
+//------------------------------------------------------------------------
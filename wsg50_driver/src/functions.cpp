@@ -53,33 +53,101 @@
 #include <string.h>
 #include <cmath>
 #include <string>
+#include <atomic>
+#include <map>
+#include <mutex>
 
 #include "wsg50/common.h"
 #include "wsg50/cmd.h"
+#include "wsg50/dispatcher.h"
 #include "wsg50/msg.h"
 #include "wsg50/functions.h"
+#include "wsg50/command.h"
 
 //------------------------------------------------------------------------
-// Support functions
+// Settings cache
 //------------------------------------------------------------------------
 
-float convert(unsigned char *b){
-	float tmp;
-  	unsigned int src = 0;
+// Cache of settings that only change when we change them. Written values
+// are read back once, as the gripper clamps them to its limits.
+// Invalidated on (re)connect and fault acknowledge. Every gripper
+// connection (see cmd_select()) has its own.
+struct settings_cache {
+	bool acc_valid, force_valid, limits_valid, info_valid;
+	float acc, force;
+	float limit_minus, limit_plus;
+	system_info info;
+};
+
+static std::mutex settings_lock;
+static std::map<const cmd_conn_t *, settings_cache> settings_per_conn;
+
+/** \brief  Get the cache of the connection selected by the calling thread */
+static settings_cache &current_settings( void )
+{
+	std::lock_guard<std::mutex> guard( settings_lock );
+	return settings_per_conn[cmd_selected()];		// Zeroed, i.e. invalid, when new
+}
+
+/** \brief  Forget all cached settings, so they are read from the gripper again */
+void invalidateSettingsCache( void )
+{
+	settings_cache &settings = current_settings();
+	std::lock_guard<std::mutex> guard( settings_lock );
+	settings.acc_valid = settings.force_valid = settings.limits_valid = settings.info_valid = false;
+}
+
+/** \brief  Write the cached settings to the gripper again, e.g. after a reconnect. The gripper
+ *  may have been restarted meanwhile and lost them. Other cached values are read again. */
+int restoreSettings( void )
+{
+	settings_cache &settings = current_settings();
+	settings_cache saved;
+	int res = 0;
+
+	{
+		std::lock_guard<std::mutex> guard( settings_lock );
+		saved = settings;
+		settings.acc_valid = settings.force_valid = settings.limits_valid = settings.info_valid = false;
+	}
 
-	/*
-	dbgPrint("b[3]=%x\n", b[3]);
-	dbgPrint("b[2]=%x\n", b[2]);
-	dbgPrint("b[1]=%x\n", b[1]);
-	dbgPrint("b[0]=%x\n", b[0]);
-	*/
+	if ( saved.acc_valid && setAcceleration( saved.acc ) != 0 ) res = -1;
+	if ( saved.force_valid && setGraspingForceLimit( saved.force ) != 0 ) res = -1;
+	if ( saved.limits_valid && setSoftLimits( saved.limit_minus, saved.limit_plus ) != 0 ) res = -1;
 
-  	src = b[3] * 16777216 + b[2] * 65536 + b[1] * 256 + b[0];
+	return res;
+}
 
-  	memcpy(&tmp, &src, sizeof tmp);
-  	//printf("Converted value: %f \n", tmp);
+/** \brief  Get a cached value; returns false if it has to be read from the gripper */
+static bool cache_get( const bool &valid, const float &value, float *out )
+{
+	std::lock_guard<std::mutex> guard( settings_lock );
+	if ( valid ) *out = value;
+	return valid;
+}
 
-	return tmp;
+/** \brief  Store a value that was written to or read from the gripper */
+static void cache_put( bool &valid, float &value, float v )
+{
+	std::lock_guard<std::mutex> guard( settings_lock );
+	value = v;
+	valid = true;
+}
+
+/** \brief  Forget a value, e.g. after a failed write */
+static void cache_drop( bool &valid )
+{
+	std::lock_guard<std::mutex> guard( settings_lock );
+	valid = false;
+}
+
+
+//------------------------------------------------------------------------
+// Support functions
+//------------------------------------------------------------------------
+
+float convert(unsigned char *b){
+	return le_field<float>::get( b );
 }
 
 
@@ -99,30 +167,9 @@ float convert(unsigned char *b){
 int homing( void )
 {
 	status_t status;
-	int res;
-	unsigned char payload[1];
-	unsigned char *resp;
-	unsigned int resp_len;
-
-	// Set flags: Homing direction (0: default, 1: widthitive movement, 2: negative movement).
-	payload[0] = 0x00;
 
-	// Submit command and wait for response. Push result to stack.
-	res = cmd_submit( 0x20, payload, 1, true, &resp, &resp_len );
-	if ( res != 2 )
-	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
-	}
-
-	//dbgPrint("&resp: %s\n", resp);
-	//dbgPrint("&resp_len: %d\n", resp_len);
-
-	// Check response status
-	status = cmd_get_response_status( resp );
-	free( resp );
-	if ( status != E_SUCCESS )
+	// Homing direction (0: default, 1: positive movement, 2: negative movement)
+	if ( cmd_homing::call( true, &status, 0x00 ) != 0 )
 	{
 		dbgPrint( "Command HOMING not successful: %s\n", status_to_str( status ) );
 		return -1;
@@ -132,21 +179,18 @@ int homing( void )
 }
 
 int homing_async ( void ) {
-	int res;
-	unsigned char payload[1];
-
-	// Set flags: Homing direction (0: default, 1: widthitive movement, 2: negative movement).
-	payload[0] = 0x00;
-
-    // Submit command
-    res = cmd_submit_async( 0x20, payload, 1);
-    if (res < 0) {
-        dbgPrint( "Failed to submit HOMING command\n");
-        return -1;
-    }
+	if ( cmd_homing::submit_async( 0x00 ) != 0 ) {
+		dbgPrint( "Failed to submit HOMING command\n" );
+		return -1;
+	}
 
 	return 0;
+}
 
+/** \brief  Flags of a move command: absolute movement (bit 0 is 0), stop on block (bit 1) */
+static uint8_t move_flags( bool stop_on_block )
+{
+	return stop_on_block ? 0x02 : 0x00;
 }
 
 /** \brief  Send move command (0x21) to gripper
@@ -154,71 +198,30 @@ int homing_async ( void ) {
  */
 int move( float width, float speed, bool stop_on_block, bool ignore_response)
 {
-
 	status_t status;
-	int res;
-	unsigned char payload[9];
-	unsigned char *resp;
-	unsigned int resp_len;
 
-	// Set flags: Absolute movement (bit 0 is 0), stop on block (bit 1 is 1).
-	payload[0] = 0x00;
-	if (stop_on_block) payload[0] |= 0x02;
-
-	// Copy target width and speed
-	memcpy( &payload[1], &width, sizeof( float ) );
-	memcpy( &payload[5], &speed, sizeof( float ) );
-
-    if (!ignore_response) {
-        // Submit command and wait for response. Push result to stack.
-        res = cmd_submit( 0x21, payload, 9, true, &resp, &resp_len );
-        if ( res != 2 )
-        {
-            dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-            if ( res > 0 ) free( resp );
-            return 0;
-        }
-
-        // Check response status
-        status = cmd_get_response_status( resp );
-        free( resp );
-        if ( status != E_SUCCESS )
-        {
-            dbgPrint( "Command MOVE not successful: %s\n", status_to_str( status ) );
-            return -1;
-        }
-    } else {
-        // Submit command, do not wait for response
-        msg_t msg;
-        msg.id = 0x21; msg.len = 9; msg.data = &payload[0];
-        res = msg_send(&msg);
-        if (res <= 0) {
-            dbgPrint("Failed to send command MOVE\n");
-            return -1;
-        }
-    }
+	if ( ignore_response ) {
+		if ( cmd_move::send( move_flags( stop_on_block ), width, speed ) != 0 ) {
+			dbgPrint( "Failed to send command MOVE\n" );
+			return -1;
+		}
+		return 0;
+	}
+
+	if ( cmd_move::call( true, &status, move_flags( stop_on_block ), width, speed ) != 0 )
+	{
+		dbgPrint( "Command MOVE not successful: %s\n", status_to_str( status ) );
+		return -1;
+	}
 
 	return 0;
 }
 
 int move_async( float width, float speed, bool stop_on_block) {
-	int res;
-	unsigned char payload[9];
-
-	// Set flags: Absolute movement (bit 0 is 0), stop on block (bit 1 is 1).
-	payload[0] = 0x00;
-	if (stop_on_block) payload[0] |= 0x02;
-
-	// Copy target width and speed
-	memcpy( &payload[1], &width, sizeof( float ) );
-	memcpy( &payload[5], &speed, sizeof( float ) );
-
-    // Submit command
-    res = cmd_submit_async( 0x21, payload, 9);
-    if (res < 0) {
-        dbgPrint( "Failed to submit move command\n");
-        return -1;
-    }
+	if ( cmd_move::submit_async( move_flags( stop_on_block ), width, speed ) != 0 ) {
+		dbgPrint( "Failed to submit move command\n" );
+		return -1;
+	}
 
 	return 0;
 }
@@ -227,78 +230,54 @@ int move_async( float width, float speed, bool stop_on_block) {
 int stop( bool ignore_response )
 {
 	status_t status;
-	int res;
-	unsigned char payload[1];
-	unsigned char *resp;
-	unsigned int resp_len;
 
-	//payload[0] = 0x00;
-
-    if (!ignore_response) {
-        // Submit command and wait for response. Push result to stack.
-        res = cmd_submit( 0x22, payload, 0, true, &resp, &resp_len);
-
-        if ( res != 2 )
-        {
-            dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-            if ( res > 0 ) free( resp );
-            return 0;
-        }
-
-        // Check response status
-        status = cmd_get_response_status( resp );
-        free( resp );
-        if ( status != E_SUCCESS )
-        {
-            dbgPrint( "Command STOP not successful: %s\n", status_to_str( status ) );
-            return -1;
-        }
-    } else {
-        // Submit command, do not wait for response
-        msg_t msg;
-        msg.id = 0x22; msg.len = 0; msg.data = &payload[0];
-        res = msg_send(&msg);
-        if (res <= 0) {
-            dbgPrint("Failed to send command STOP\n");
-            return -1;
-        }
-    }
+	// Stops overtake the commands waiting to be sent
+	if ( ignore_response ) {
+		if ( cmd_stop::send_urgent() != 0 ) {
+			dbgPrint( "Failed to send command STOP\n" );
+			return -1;
+		}
+		return 0;
+	}
 
-    return 0;
+	if ( cmd_stop::call_urgent( true, &status ) != 0 )
+	{
+		dbgPrint( "Command STOP not successful: %s\n", status_to_str( status ) );
+		return -1;
+	}
+
+	return 0;
 }
 
 
-int ack_fault( void )
+int fast_stop( void )
 {
 	status_t status;
-	int res;
-	unsigned char payload[3];
-	unsigned char *resp;
-	unsigned int resp_len;
 
-	payload[0] = 0x61;  //MBJ: Està ben enviat, si es posa alrevés no torna error en terminal però si que es posa roig el LED
-	payload[1] = 0x63;
-	payload[2] = 0x6B;
-
-	// Submit command and wait for response. Push result to stack.
-	res = cmd_submit( 0x24, payload, 3, true, &resp, &resp_len );
-	if ( res != 2 )
+	// The gripper refuses motion commands until the fast stop is acknowledged with ack_fault()
+	if ( cmd_fast_stop::call_urgent( false, &status ) != 0 )
 	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
+		dbgPrint( "Command FAST STOP not successful: %s\n", status_to_str( status ) );
+		return -1;
 	}
 
+	return 0;
+}
+
+
+int ack_fault( void )
+{
+	status_t status;
 
-	// Check response status
-	status = cmd_get_response_status( resp );
-	free( resp );
-	if ( status != E_SUCCESS )
+	if ( cmd_ack_fault::call( true, &status, 'a', 'c', 'k' ) != 0 )
 	{
 		dbgPrint( "Command ACK not successful: %s\n", status_to_str( status ) );
 		return -1;
 	}
 
+	// Settings may have been reset by the fault
+	invalidateSettingsCache();
+
 	return 0;
 }
 
@@ -306,51 +285,21 @@ int ack_fault( void )
 int grasp( float objWidth, float speed )
 {
 	status_t status;
-	int res;
-	unsigned char payload[8];
-	unsigned char *resp;
-	unsigned int resp_len;
 
-	// Copy part width and speed
-	memcpy( &payload[0], &objWidth, sizeof( float ) );
-	memcpy( &payload[4], &speed, sizeof( float ) );
-
-	// Submit command and wait for response. Push result to stack.
-	res = cmd_submit( 0x25, payload, 8, true, &resp, &resp_len);
-
-	if ( res != 2 )
-	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
-	}
-
-	// Check response status
-	status = cmd_get_response_status( resp );
-	free( resp );
-	if (status != E_SUCCESS && status != E_CMD_PENDING)
+	if ( cmd_grasp::call( true, &status, objWidth, speed ) != 0 )
 	{
 		dbgPrint( "Command GRASP not successful: %s\n", status_to_str( status ) );
 		return -1;
 	}
 
-	return( 0 );
+	return 0;
 }
 
 int grasp_async( float objWidth, float speed ) {
-	int res;
-	unsigned char payload[8];
-
-	// Copy part width and speed
-	memcpy( &payload[0], &objWidth, sizeof( float ) );
-	memcpy( &payload[4], &speed, sizeof( float ) );
-
-    // Submit command
-    res = cmd_submit_async( 0x25, payload, 8);
-    if (res < 0) {
-        dbgPrint( "Failed to submit GRASP command\n");
-        return -1;
-    }
+	if ( cmd_grasp::submit_async( objWidth, speed ) != 0 ) {
+		dbgPrint( "Failed to submit GRASP command\n" );
+		return -1;
+	}
 
 	return 0;
 }
@@ -359,29 +308,8 @@ int grasp_async( float objWidth, float speed ) {
 int release( float width, float speed )
 {
 	status_t status;
-	int res;
-	unsigned char payload[8];
-	unsigned char *resp;
-	unsigned int resp_len;
-
-	// Copy part width and speed
-	memcpy( &payload[0], &width, sizeof( float ) );
-	memcpy( &payload[4], &speed, sizeof( float ) );
 
-	// Submit command and wait for response. Push result to stack.
-	res = cmd_submit( 0x26, payload, 8, true, &resp, &resp_len);
-
-	if ( res != 2 )
-	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-		if ( res > 0 ) free( resp );
-		return -1;
-	}
-
-	// Check response status
-	status = cmd_get_response_status( resp );
-	free( resp );
-	if (status != E_SUCCESS && status != E_CMD_PENDING)
+	if ( cmd_release::call( true, &status, width, speed ) != 0 )
 	{
 		dbgPrint( "Command RELEASE not successful: %s\n", status_to_str( status ) );
 		return -1;
@@ -392,19 +320,10 @@ int release( float width, float speed )
 
 
 int release_async( float width, float speed ) {
-	int res;
-	unsigned char payload[8];
-
-	// Copy part width and speed
-	memcpy( &payload[0], &width, sizeof( float ) );
-	memcpy( &payload[4], &speed, sizeof( float ) );
-
-    // Submit command
-    res = cmd_submit_async( 0x26, payload, 8);
-    if (res < 0) {
-        dbgPrint( "Failed to submit RELEASE command\n");
-        return -1;
-    }
+	if ( cmd_release::submit_async( width, speed ) != 0 ) {
+		dbgPrint( "Failed to submit RELEASE command\n" );
+		return -1;
+	}
 
 	return 0;
 }
@@ -412,52 +331,236 @@ int release_async( float width, float speed ) {
 
 // returns 0 when no msg available, 1 when msg is available and correct, -1 on error
 int recv_ack(unsigned char id, status_t *status) {
+    return recv_ack_wait(id, status, 0);
+}
+
+// Like recv_ack(), but sleeps up to timeout_ms until the response arrives
+// returns 0 when no msg available, 1 when msg is available and correct, -1 on error
+int recv_ack_wait(unsigned char id, status_t *status, int timeout_ms) {
 	int res;
-	unsigned char *resp;
+	unsigned char resp[2];
 	unsigned int resp_len;
 
     // Receive response
-    res = cmd_recv_ack(id, &resp, &resp_len);
+    res = cmd_wait_ack_into(id, resp, sizeof(resp), &resp_len, timeout_ms);
 
     if ( res == 0 ) return 0;
     if ( res < 0 ) return -1;
 
 
-    if ( resp_len > 0 && resp_len != 2 ){
-        dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-        free( resp );
+    if ( resp_len != 2 ){
+        dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", resp_len );
         return -1;
     }
 
     // Check response status
     *status = cmd_get_response_status( resp );
-    free( resp );
 
 	return 1;
 }
 
 
+/** \brief  Check whether a command starts a motion. The gripper runs only one motion at a time. */
+static bool is_motion_cmd( unsigned char id )
+{
+	return id == 0x20 || id == 0x21 || id == 0x25 || id == 0x26;
+}
+
+/** \brief  Execute a sequence of commands, pipelining them where possible
+ *
+ *  All steps up to and including the next motion are sent back to back, and
+ *  their responses are collected afterwards (see cmd_submit_batch()). The
+ *  next batch is sent once the motion has finished. The sequence stops at
+ *  the first step that fails; if the motion of that batch is already
+ *  running, it is stopped.
+ *
+ *  \param  status        Status of the last step evaluated
+ *  \param  abort         Checked between batches; the sequence stops when set (may be NULL)
+ *  \param  after_motion  Called after each motion, e.g. to wait for the axis to get idle (may be NULL)
+ *  \param  arg           Passed to after_motion
+ *  \return Number of steps that succeeded, -1 on error
+ */
+int execute_sequence( const sequence_step *steps, unsigned int count, status_t *status,
+                      const std::atomic<bool> *abort, void (*after_motion)( void * ), void *arg )
+{
+	settings_cache &settings = current_settings();
+	cmd_request_t req[SEQUENCE_MAX_STEPS];
+	unsigned char payload[SEQUENCE_MAX_STEPS][cmd_move::request_len];	// Longest request of a step
+	unsigned int i, first, last, done = 0;
+	int res;
+
+	*status = E_SUCCESS;
+	if ( count > SEQUENCE_MAX_STEPS ) {
+		dbgPrint( "Too many steps (%d, max. %d)\n", count, SEQUENCE_MAX_STEPS );
+		*status = E_INSUFFICIENT_RESOURCES;
+		return -1;
+	}
+
+	// Assemble all commands
+	for ( i = 0; i < count; i++ ) {
+		const sequence_step &step = steps[i];
+		req[i].payload = payload[i];
+		req[i].pending = true;
+
+		switch ( step.type ) {
+		case SEQUENCE_SET_ACCELERATION:
+			req[i].id = cmd_set_acceleration::id;
+			req[i].len = cmd_set_acceleration::encode( payload[i], step.val );
+			break;
+		case SEQUENCE_SET_FORCE:
+			req[i].id = cmd_set_force_limit::id;
+			req[i].len = cmd_set_force_limit::encode( payload[i], step.val );
+			break;
+		case SEQUENCE_MOVE:
+			// Absolute movement, no stop on block
+			req[i].id = cmd_move::id;
+			req[i].len = cmd_move::encode( payload[i], move_flags( false ), step.width, step.speed );
+			break;
+		case SEQUENCE_GRASP:
+			req[i].id = cmd_grasp::id;
+			req[i].len = cmd_grasp::encode( payload[i], step.width, step.speed );
+			break;
+		case SEQUENCE_RELEASE:
+			req[i].id = cmd_release::id;
+			req[i].len = cmd_release::encode( payload[i], step.width, step.speed );
+			break;
+		case SEQUENCE_HOMING:
+			// Default homing direction
+			req[i].id = cmd_homing::id;
+			req[i].len = cmd_homing::encode( payload[i], 0x00 );
+			break;
+		default:
+			dbgPrint( "Unknown sequence step type %d\n", step.type );
+			*status = E_CMD_FORMAT_ERROR;
+			return -1;
+		}
+	}
+
+	for ( first = 0; first < count; first = last + 1 ) {
+		if ( abort && *abort ) {
+			*status = E_CMD_ABORTED;
+			break;
+		}
+
+		// Batch ends with the next motion
+		for ( last = first; last < count - 1 && !is_motion_cmd( req[last].id ); last++ );
+
+		// The gripper may clamp the values, so they are read back when needed
+		for ( i = first; i <= last; i++ ) {
+			if ( req[i].id == 0x30 ) cache_drop( settings.acc_valid );
+			if ( req[i].id == 0x32 ) cache_drop( settings.force_valid );
+		}
+
+		res = cmd_submit_batch( &req[first], last - first + 1, status );
+		if ( res < 0 ) {
+			dbgPrint( "Failed to submit sequence\n" );
+			return -1;
+		}
+		done += res;
+
+		if ( first + res <= last ) {
+			dbgPrint( "Sequence step %d not successful: %s\n", done, status_to_str( *status ) );
+
+			// An earlier step failed, but the motion has been sent already
+			if ( first + res < last && is_motion_cmd( req[last].id ) ) stop( req[last].id == 0x20 );
+			break;
+		}
+
+		if ( is_motion_cmd( req[last].id ) && after_motion ) after_motion( arg );
+	}
+
+	return (int) done;
+}
+
+
+// Fills in the fields of a measurement that follow from its state byte
+static void set_measurement_state(gripper_response & info)
+{
+	unsigned char resp_state[6] = {0,0,0,0,0,0};
+	resp_state[2] = info.state;
+	info.state_text = std::string(getStateValues(resp_state));
+	info.ismoving = (info.state & 0x02/*fingers mnoving*/) != 0;
+	// only in position mode; cannot determine reliably for velocity mode
+	// 0x40 /* axis stopped */
+	info.t = 0.0;
+}
+
+// Decodes one sample of the measure script: state (lowest byte), position,
+// speed, motor force and forces of finger 0 and 1
+static void parse_measurement(unsigned char *b, gripper_response & info)
+{
+	unsigned char state;
+	script_measurement::get(b, state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1);
+	info.state = state;
+	set_measurement_state(info);
+}
+
 // Custom script: Command-and-measure
 // cmd_type:	0 - read only; 1 - position control; 2 - speed control
 int script_measure_move (unsigned char cmd_type, float cmd_width, float cmd_speed, gripper_response & info)
 {
 	status_t status;
+	unsigned char state;
 	int res;
-	const unsigned char CMD_CUSTOM = 0xB0;
-	unsigned char payload[9];
-	unsigned char *resp;
-	unsigned int resp_len;
 
 	// Custom payload format:
 	// 0:	Unused
 	// 1:	float, target width, used for 0xB1 command
 	// 5:	float, target speed, used for 0xB1 and 0xB2 command
-	payload[0] = 0x00;
-	memcpy(&payload[1], &cmd_width, sizeof(float));
-	memcpy(&payload[5], &cmd_speed, sizeof(float));
+	switch (cmd_type) {
+	case 0: res = script_command<0xB0>::call(true, &status, 0x00, cmd_width, cmd_speed, state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1); break;
+	case 1: res = script_command<0xB1>::call(true, &status, 0x00, cmd_width, cmd_speed, state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1); break;
+	case 2: res = script_command<0xB2>::call(true, &status, 0x00, cmd_width, cmd_speed, state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1); break;
+	case 5: res = script_command<0xB5>::call(true, &status, 0x00, cmd_width, cmd_speed, state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1); break;
+	default:
+		dbgPrint ("measure_move: Unknown command type %u\n", cmd_type);
+		return 0;
+	}
+
+	if (res != 0) {
+		dbgPrint ("measure_move: %s\n", status == E_CMD_UNKNOWN ? "Command unknown - make sure script is running" : status_to_str(status));
+		return 0;
+	}
+
+	info.state = state;
+	set_measurement_state(info);
 
-	// Submit command and process result
-	res = cmd_submit(CMD_CUSTOM + cmd_type, payload, 9, true, &resp, &resp_len);
+	if (0)
+		printf("Received: %02X, %6.2f,%6.2f,%6.2f,%6.2f,%6.2f\n  %s\n",
+			info.state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1,
+			info.state_text.c_str());
+
+	return 1;
+}
+
+
+
+// Custom script: Batch of measurements
+// The script takes count samples, one every period_ms, and returns them in one frame.
+// samples[i].t is the gripper time of sample i relative to the last sample (<= 0, in s).
+// Returns the number of samples received, 0 on failure.
+int script_measure_batch (unsigned int count, unsigned int period_ms, gripper_response *samples)
+{
+	status_t status;
+	int res;
+	const unsigned int SAMPLE_LEN = 2 + script_measurement::size;
+	unsigned char payload[cmd_script_batch::request_len];
+	unsigned char resp[7 + SCRIPT_BATCH_MAX_SAMPLES * SAMPLE_LEN];
+	unsigned int n, i;
+
+	if (count < 1 || count > SCRIPT_BATCH_MAX_SAMPLES || count * period_ms > SCRIPT_BATCH_MAX_DURATION_MS) {
+		dbgPrint("measure_batch: invalid batch (%u samples every %u ms)\n", count, period_ms);
+		return 0;
+	}
+
+	// Payload format:
+	// 0:	Number of samples
+	// 1:	uint16, sample period in ms
+	cmd_script_batch::encode(payload, (uint8_t) count, (uint16_t) period_ms);
+
+	// Submit command and process result; the response length depends on
+	// the number of samples, so it is checked below
+	res = cmd_submit_into(cmd_script_batch::id, payload, sizeof(payload), true, resp, sizeof(resp));
 	try {
 		if (res < 2)
 			throw std::string("Invalid Response");
@@ -466,43 +569,87 @@ int script_measure_move (unsigned char cmd_type, float cmd_width, float cmd_spee
 			throw std::string("Command unknown - make sure script is running");
 		if (status != E_SUCCESS)
 			throw std::string("Command failed");
-		if (res != 23)
+
+		// Response format:
+		// 2:	Number of samples n
+		// 3:	uint32, gripper time of the first sample in ms (unused)
+		// 7:	n samples: uint16 ms since the first sample, followed by a measurement
+		n = res >= 3 ? resp[2] : 0;
+		if (n < 1 || n > count || (unsigned int) res != 7 + n * SAMPLE_LEN)
 			throw std::string("Response payload incorrect (" + std::to_string(res) + ")");
 
-		// Extract data from response
-		int off=2;
-		unsigned char resp_state[6] = {0,0,0,0,0,0};
-		resp_state[2] = resp[2];
-		info.state = resp[2];					 off+=1;
-		info.state_text = std::string(getStateValues(resp_state));
-		info.position = convert(&resp[off]);     off+=4;
-		info.speed = convert(&resp[off]);        off+=4;
-		info.f_motor = convert(&resp[off]);      off+=4;
-		info.f_finger0 = convert(&resp[off]);    off+=4;
-		info.f_finger1 = convert(&resp[off]);    off+=4;
+		unsigned char *p = &resp[7 + (n - 1) * SAMPLE_LEN];
+		unsigned short t_last = make_short(p[0], p[1]);
+		for (i = 0; i < n; i++) {
+			p = &resp[7 + i * SAMPLE_LEN];
+			parse_measurement(&p[2], samples[i]);
+			samples[i].t = -(double)(unsigned short)(t_last - make_short(p[0], p[1])) / 1000.0;
+		}
 
+	} catch (std::string msg) {
+		msg = "measure_batch: " + msg + "\n";
+		dbgPrint ("%s", msg.c_str());
+		return 0;
+	}
 
-		info.ismoving = (info.state & 0x02/*fingers mnoving*/) != 0;
-		// only in position mode; cannot determine reliably for velocity mode
-		// 0x40 /* axis stopped */
+	return (int) n;
+}
 
-		if (0)
-			printf("Received: %02X, %6.2f,%6.2f,%6.2f,%6.2f,%6.2f\n  %s\n",
-				info.state, info.position, info.speed, info.f_motor, info.f_finger0, info.f_finger1,
-				info.state_text.c_str());
 
-	} catch (std::string msg) {
-		msg = "measure_move: " + msg + "\n";
-        dbgPrint ("%s", msg.c_str());
-		if (res > 0) free(resp);
-		return 0;
+
+// Custom script: Start (period_ms > 0) or stop (0) pushing measurements
+// The script sends 0xB4 frames on its own then, see script_stream_decode().
+int script_stream (unsigned int period_ms)
+{
+	status_t status;
+	int res;
+	unsigned char payload[cmd_script_stream::request_len];
+	unsigned char resp[script_command<0xB0>::response_len];
+
+	cmd_script_stream::encode(payload, (uint16_t) period_ms);
+
+	// Frames pushed before the acknowledge are taken as acknowledge, too
+	res = cmd_submit_into(cmd_script_stream::id, payload, sizeof(payload), true, resp, sizeof(resp));
+	if (res < 2) {
+		dbgPrint("measure_stream: Invalid Response\n");
+		return -1;
+	}
+	status = cmd_get_response_status(resp);
+	if (status != E_SUCCESS) {
+		dbgPrint("measure_stream: %s\n", status == E_CMD_UNKNOWN ? "Command unknown - make sure script is running" : status_to_str(status));
+		return -1;
 	}
 
+	return 0;
+}
+
+// Custom script: Decode a pushed measurement frame (0xB4) or the response to
+// 0xB0 - 0xB2. Returns 1 for a measurement; 0 for anything else, e.g. the
+// acknowledge of script_stream().
+int script_stream_decode (unsigned char *data, unsigned int len, gripper_response & info)
+{
+	if (len != script_command<0xB0>::response_len || cmd_get_response_status(data) != E_SUCCESS)
+		return 0;
 
-	free( resp );
+	parse_measurement(&data[2], info);
 	return 1;
 }
 
+// Custom script: Send a command without waiting for the response
+// cmd_type:	1 - position control; 2 - speed control; 5 - set-point (followed without stopping while streaming)
+int script_command_async (unsigned char cmd_type, float cmd_width, float cmd_speed)
+{
+	// Same payload as script_measure_move()
+	switch (cmd_type) {
+	case 1: return script_command<0xB1>::submit_async(0x00, cmd_width, cmd_speed);
+	case 2: return script_command<0xB2>::submit_async(0x00, cmd_width, cmd_speed);
+	case 5: return script_command<0xB5>::submit_async(0x00, cmd_width, cmd_speed);
+	default:
+		dbgPrint ("command_async: Unknown command type %u\n", cmd_type);
+		return -1;
+	}
+}
+
 
 
 ///////////////////
@@ -512,338 +659,400 @@ int script_measure_move (unsigned char cmd_type, float cmd_width, float cmd_spee
 
 int setAcceleration( float acc )
 {
+	settings_cache &settings = current_settings();
 	status_t status;
-	int res;
-	unsigned char payload[4];
-	unsigned char *resp;
-	unsigned int resp_len;
+	float cached;
 
-	// Copy target width and speed
-	memcpy( &payload[0], &acc, sizeof( float ) );
+	// Skip the command if the value is set already
+	if ( cache_get( settings.acc_valid, settings.acc, &cached ) && cached == acc ) return 0;
+	cache_drop( settings.acc_valid );
 
-	// Submit command and wait for response. Push result to stack.
-	res = cmd_submit( 0x30, payload, 4, true, &resp, &resp_len);
-
-	if ( res != 2 )
-	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
-	}
-
-	// Check response status
-	status = cmd_get_response_status( resp );
-	free( resp );
-	if ( status != E_SUCCESS )
+	if ( cmd_set_acceleration::call( true, &status, acc ) != 0 )
 	{
 		dbgPrint( "Command SET ACCELERATION not successful: %s\n", status_to_str( status ) );
 		return -1;
 	}
 
+	// The gripper clamps values outside its limits, so cache the one it uses
+	getAcceleration();
+
 	return 0;
 }
 
 int setGraspingForceLimit( float force )
 {
+	settings_cache &settings = current_settings();
 	status_t status;
-	int res;
-	unsigned char payload[4];
-	unsigned char *resp;
-	unsigned int resp_len;
-
-	// Copy target width and speed
-	memcpy( &payload[0], &force, sizeof( float ) );
+	float cached;
 
-	// Submit command and wait for response. Push result to stack.
-	res = cmd_submit( 0x32, payload, 4, true, &resp, &resp_len );
-	if ( res != 2 )
-	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 2)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
-	}
+	// Skip the command if the value is set already
+	if ( cache_get( settings.force_valid, settings.force, &cached ) && cached == force ) return 0;
+	cache_drop( settings.force_valid );
 
-	// Check response status
-	status = cmd_get_response_status( resp );
-	free( resp );
-	if ( status != E_SUCCESS )
+	if ( cmd_set_force_limit::call( true, &status, force ) != 0 )
 	{
 		dbgPrint( "Command SET GRASPING FORCE LIMIT not successful: %s\n", status_to_str( status ) );
 		return -1;
 	}
 
+	// The gripper clamps values outside its limits, so cache the one it uses
+	getGraspingForceLimit();
+
 	return 0;
 }
 
+int setSoftLimits( float limit_minus, float limit_plus )
+{
+	settings_cache &settings = current_settings();
+	status_t status;
 
-///////////////////
-// GET FUNCTIONS //
-///////////////////
-
+	// Skip the command if the limits are set already
+	{
+		std::lock_guard<std::mutex> guard( settings_lock );
+		if ( settings.limits_valid && settings.limit_minus == limit_minus && settings.limit_plus == limit_plus ) return 0;
+		settings.limits_valid = false;
+	}
 
-// const char * systemState( void ) 
-// {
-// 	status_t status;
-// 	int res;
-// 	unsigned char payload[3];
-// 	unsigned char *resp;
-// 	unsigned int resp_len;
+	if ( cmd_set_soft_limits::call( false, &status, limit_minus, limit_plus ) != 0 )
+	{
+		dbgPrint( "Command SET SOFT LIMITS not successful: %s\n", status_to_str( status ) );
+		return -1;
+	}
 
-// 	// Don't use automatic update, so the payload bytes are 0.
-// 	memset( payload, 0, 3 );
+	std::lock_guard<std::mutex> guard( settings_lock );
+	settings.limit_minus = limit_minus;
+	settings.limit_plus = limit_plus;
+	settings.limits_valid = true;
 
-// 	// Submit command and wait for response. Expecting exactly 4 bytes response payload.
-// 	res = cmd_submit( 0x40, payload, 3, false, &resp, &resp_len);
-// 	if ( res != 6 )
-// 	{
-// 		dbgPrint( "Response payload length doesn't match (is %d, expected 6)\n", res );
-// 		if ( res > 0 ) free( resp );
-// 		return 0;
-// 	}
+	return 0;
+}
 
-// 	// Check response status
-// 	status = cmd_get_response_status( resp );
+int clearSoftLimits( void )
+{
+	settings_cache &settings = current_settings();
+	status_t status;
 
-// 	/*
-// 	dbgPrint("LSB -> resp[0]: %x\n", resp[2]);
-// 	dbgPrint("       resp[1]: %x\n", resp[3]);
-// 	dbgPrint("       resp[2]: %x\n", resp[4]);
-// 	dbgPrint("MSB -> resp[3]: %x\n", resp[5]);
-// 	*/
+	cache_drop( settings.limits_valid );
 
-// 	return getStateValues(resp);
+	if ( cmd_clear_soft_limits::call( false, &status ) != 0 )
+	{
+		dbgPrint( "Command CLEAR SOFT LIMITS not successful: %s\n", status_to_str( status ) );
+		return -1;
+	}
 
-// 	if ( status != E_SUCCESS )
-// 	{
-// 		dbgPrint( "Command GET SYSTEM STATE not successful: %s\n", status_to_str( status ) );
-// 		free( resp );
-// 		return 0;
-// 	}
+	return 0;
+}
 
-// 	free( resp );
 
-//     return 0;
+///////////////////
+// GET FUNCTIONS //
+///////////////////
 
-// 	//return (int) resp[2]; MBJ
-// }
 
 const char * systemState( void ) 
 {
 	status_t status;
-	int res;
-	unsigned char payload[3];
-	unsigned char *resp;
-	unsigned int resp_len;
+	uint32_t flags;
+	unsigned char resp[6] = { 0, 0, 0, 0, 0, 0 };
 
 	// Don't use automatic update, so the payload bytes are 0.
-	memset( payload, 0, 3 );
-
-	// Submit command and wait for response. Expecting exactly 4 bytes response payload.
-	res = cmd_submit( 0x40, payload, 3, false, &resp, &resp_len);
-	if ( res != 6 )
+	if ( cmd_system_state::call( false, &status, 0x00, 0, flags ) != 0 )
 	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 6)\n", res );
-		if ( res > 0 ) free( resp );
+		dbgPrint( "Command GET SYSTEM STATE not successful: %s\n", status_to_str( status ) );
 		return 0;
 	}
 
-	// Check response status
-	status = cmd_get_response_status( resp );
+	// getStateValues() decodes a response buffer
+	le_field<uint32_t>::put( &resp[2], flags );
+	return getStateValues( resp );
+}
+
 
-	if ( status != E_SUCCESS )
+/**
+ * Read the system state flags (SF_xxx) without the text decoding of systemState()
+ *
+ * @param *flags		System state flags
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int getSystemStateFlags( unsigned int *flags )
+{
+	status_t status;
+	uint32_t value;
+
+	// Don't use automatic update, so the payload bytes are 0.
+	if ( cmd_system_state::call( false, &status, 0x00, 0, value ) != 0 )
 	{
 		dbgPrint( "Command GET SYSTEM STATE not successful: %s\n", status_to_str( status ) );
-		free( resp );
-		return 0;
+		return -1;
 	}
 
-    return getStateValues(resp);
+	*flags = value;
+
+	return 0;
 }
 
 
-int graspingState( void )
+/**
+ * Check that the gripper answers, using the loop-back command
+ *
+ * @param timeout_ms	Max. time to wait for the echo
+ *
+ * @return 0 if the gripper echoed the data in time, -1 otherwise
+ */
+
+int ping( int timeout_ms )
 {
-	status_t status;
-	int res;
-	unsigned char payload[3];
-	unsigned char *resp;
+	static std::atomic<unsigned int> seq( 0 );
+	unsigned int n = seq++;
+	unsigned char payload[4];
+	unsigned char resp[6];
 	unsigned int resp_len;
+	int res;
 
-	// Don't use automatic update, so the payload bytes are 0.
-	memset( payload, 0, 3 );
+	memcpy( payload, &n, sizeof( payload ) );
+
+	if ( cmd_submit_async( 0x06, payload, sizeof( payload ) ) != 0 ) return -1;
 
-	// Submit command and wait for response. Expecting exactly 4 bytes response payload.
-	res = cmd_submit( 0x41, payload, 3, false, &resp, &resp_len );
-	if ( res != 3 )
+	// Skip echoes of earlier pings that timed out
+	do
 	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 3)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
+		res = cmd_wait_ack_into( 0x06, resp, sizeof( resp ), &resp_len, timeout_ms );
+		if ( res != 1 ) return -1;
 	}
+	while ( resp_len != 6 || memcmp( &resp[2], payload, sizeof( payload ) ) != 0 );
+
+	return cmd_get_response_status( resp ) == E_SUCCESS ? 0 : -1;
+}
 
-	// Check response status
-	status = cmd_get_response_status( resp );
-	if ( status != E_SUCCESS )
+
+int graspingState( void )
+{
+	status_t status;
+	uint8_t state;
+
+	// Don't use automatic update, so the payload bytes are 0.
+	if ( cmd_grasping_state::call( false, &status, 0x00, 0, state ) != 0 )
 	{
 		dbgPrint( "Command GET GRASPING STATE not successful: %s\n", status_to_str( status ) );
-		free( resp );
 		return 0;
 	}
 
-	free( resp );
-
 	dbgPrint("GRASPING STATUS: %s\n", status_to_str (status) );
 
-	return (int) resp[2];
+	return (int) state;
 }
 
 
-float getOpeningSpeedForce(unsigned char cmd, int auto_update)
+template <typename Cmd>
+static float getOpeningSpeedForce(const char *name, int auto_update)
 {
     status_t status;
-    int res;
-    unsigned char payload[3];
-    unsigned char *resp;
-    unsigned int resp_len;
-    std::string names[] = { "opening", "speed", "force", "???" };
+    float value;
 
-    // Payload = 0, except for auto update
-    memset(payload, 0, 3);
-    if (auto_update > 0) {
-        payload[0] = 0x01;
-        payload[1] = (auto_update & 0xff);
-        payload[2] = ((auto_update & 0xff00) >> 8);
+    // The response could not be told from the automatic updates, see setAutoUpdate()
+    if (dispatcher_is_subscribed(Cmd::id)) {
+        dbgPrint( "Command 0x%02X get %s refused: the gripper pushes the %s\n", Cmd::id, name, name );
+        return 0;
     }
 
-    // Submit command and wait for response. Expecting exactly 4 bytes response payload.
-    res = cmd_submit(cmd, payload, 3 , false, &resp, &resp_len ); // 0x43
+    // Payload = 0, except for auto update
+    uint8_t flags = auto_update > 0 ? 0x01 : 0x00;
+    uint16_t period = auto_update > 0 ? (uint16_t) auto_update : 0;
 
-    if (res != 6) {
-        dbgPrint( "Response payload length doesn't match (is %d, expected 3)\n", res );
-        if ( res > 0 ) free( resp );
+    if (Cmd::call(false, &status, flags, period, value) != 0) {
+        dbgPrint( "Command 0x%02X get %s not successful: %s\n", Cmd::id, name, status_to_str( status ) );
         return 0;
     }
 
-    // Check response status
-    status = cmd_get_response_status( resp );
-    if ( status != E_SUCCESS )	{
-        const char *info = names[3].c_str();
-        if (cmd >= 0x43 && cmd <= 0x45)
-            info = names[cmd-0x43].c_str();
-        dbgPrint( "Command 0x%02X get %s not successful: %s\n", cmd, info, status_to_str( status ) );
-        free( resp );
-        return 0;
+    return value;
+}
+
+template <typename Cmd>
+static int requestAutoUpdate(const char *name, int interval_ms)
+{
+    status_t status;
+    float value;
+
+    uint8_t flags = interval_ms > 0 ? 0x01 : 0x00;
+    uint16_t period = interval_ms > 0 ? (uint16_t) interval_ms : 0;
+
+    if (Cmd::call(false, &status, flags, period, value) != 0) {
+        dbgPrint( "Command 0x%02X %s update not successful: %s\n", Cmd::id, name, status_to_str( status ) );
+        return -1;
     }
 
-    float r = convert(&resp[2]);
-    free( resp );
-    return r;
+    return 0;
 }
 
-/** \brief Read measured opening (width/position) from gripper (0x43).
+/** \brief Read measured opening (width/position) from gripper (0x43). Refused (0) while the
+ *  automatic update of the opening is subscribed on the dispatcher.
  *  \param auto_update Request periodic updates (unit: ms) from the gripper; responses need to be read out elsewhere.
  */
 float getOpening(int auto_update) {
-    return getOpeningSpeedForce(0x43, auto_update);
+    return getOpeningSpeedForce<cmd_get_opening>("opening", auto_update);
 }
 
-/** \brief Read measured speed from gripper (0x44).
+/** \brief Read measured speed from gripper (0x44). Refused (0) like getOpening().
  *  \param auto_update Request periodic updates (unit: ms) from the gripper; responses need to be read out elsewhere.
  */
 float getSpeed(int auto_update) {
-    return getOpeningSpeedForce(0x44, auto_update);
+    return getOpeningSpeedForce<cmd_get_speed>("speed", auto_update);
 }
 
-/** \brief Read measured force from gripper (0x45).
+/** \brief Read measured force from gripper (0x45). Refused (0) like getOpening().
  *  \param auto_update Request periodic updates (unit: ms) from the gripper; responses need to be read out elsewhere.
  */
 float getForce(int auto_update){
-    return getOpeningSpeedForce(0x45, auto_update);
+    return getOpeningSpeedForce<cmd_get_force>("force", auto_update);
+}
+
+/** \brief Start, change or stop the automatic updates of opening, speed and force (0x43 - 0x45).
+ *  May be called while they are subscribed on the dispatcher: the gripper's frames carry the same
+ *  IDs, so a pushed frame may be taken for a response, and only the status is used.
+ *  \param interval_ms Period of the updates, 0 to stop them
+ *  \return 0 on success, -1 if a request failed
+ */
+int setAutoUpdate(int interval_ms)
+{
+    int res = 0;
+    if (requestAutoUpdate<cmd_get_opening>("opening", interval_ms) != 0) res = -1;
+    if (requestAutoUpdate<cmd_get_speed>("speed", interval_ms) != 0) res = -1;
+    if (requestAutoUpdate<cmd_get_force>("force", interval_ms) != 0) res = -1;
+    return res;
 }
 
 
 int getAcceleration( void )  
 {
+	settings_cache &settings = current_settings();
 	status_t status;
-	int res;
-	unsigned char payload[6];
-	unsigned char *resp;
-	unsigned int resp_len;
-	unsigned char vResult[4];
+	float value;
 
-	// Don't use automatic update, so the payload bytes are 0.
-	memset( payload, 0, 1 );
+	// Answer from the cache if possible
+	if ( cache_get( settings.acc_valid, settings.acc, &value ) ) return value;
 
-	// Submit command and wait for response. Expecting exactly 4 bytes response payload.
-	res = cmd_submit( 0x31, payload, 0, false,  &resp, &resp_len);
-	if ( res != 6 )
+	if ( cmd_get_acceleration::call( false, &status, value ) != 0 )
 	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 3)\n", res );
-		if ( res > 0 ) free( resp );
+		dbgPrint( "Command GET ACCELERATION not successful: %s\n", status_to_str( status ) );
 		return 0;
 	}
 
-	// Check response status
-	status = cmd_get_response_status( resp );
-	if ( status != E_SUCCESS )
+	cache_put( settings.acc_valid, settings.acc, value );
+
+	return value;
+}
+
+int getGraspingForceLimit( void )  
+{
+	settings_cache &settings = current_settings();
+	status_t status;
+	float value;
+
+	// Answer from the cache if possible
+	if ( cache_get( settings.force_valid, settings.force, &value ) ) return value;
+
+	if ( cmd_get_force_limit::call( false, &status, value ) != 0 )
 	{
-		dbgPrint( "Command GET ACCELERATION not successful: %s\n", status_to_str( status ) );
-		free( resp );
+		dbgPrint( "Command GET GRASPING FORCE not successful: %s\n", status_to_str( status ) );
 		return 0;
 	}
-	
-	vResult[0] = resp[2];
-	vResult[1] = resp[3];
-	vResult[2] = resp[4];
-	vResult[3] = resp[5];
-	
-	free( resp );
 
-	return convert(vResult);
+	cache_put( settings.force_valid, settings.force, value );
 
-	//return (int) resp[2];
+	return value;
 }
 
-int getGraspingForceLimit( void )  
+int getSoftLimits( float *limit_minus, float *limit_plus )
 {
+	settings_cache &settings = current_settings();
 	status_t status;
-	int res;
-	unsigned char payload[6];
-	unsigned char *resp;
-	unsigned int resp_len;
-	unsigned char vResult[4];
 
-	// Don't use automatic update, so the payload bytes are 0.
-	memset( payload, 0, 1 );
+	// Answer from the cache if possible
+	{
+		std::lock_guard<std::mutex> guard( settings_lock );
+		if ( settings.limits_valid )
+		{
+			*limit_minus = settings.limit_minus;
+			*limit_plus = settings.limit_plus;
+			return 0;
+		}
+	}
 
-	// Submit command and wait for response. Expecting exactly 4 bytes response payload.
-	res = cmd_submit( 0x33, payload, 0, false, &resp, &resp_len );
-	if ( res != 6 )
+	if ( cmd_get_soft_limits::call( false, &status, *limit_minus, *limit_plus ) != 0 )
 	{
-		dbgPrint( "Response payload length doesn't match (is %d, expected 3)\n", res );
-		if ( res > 0 ) free( resp );
-		return 0;
+		dbgPrint( "Command GET SOFT LIMITS not successful: %s\n", status_to_str( status ) );
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> guard( settings_lock );
+	settings.limit_minus = *limit_minus;
+	settings.limit_plus = *limit_plus;
+	settings.limits_valid = true;
+
+	return 0;
+}
+
+int getSystemInfo( system_info *info )
+{
+	settings_cache &settings = current_settings();
+	status_t status;
+	uint8_t type, hw_rev;
+	uint16_t fw_version;
+	uint32_t sn;
+
+	// Answer from the cache if possible
+	{
+		std::lock_guard<std::mutex> guard( settings_lock );
+		if ( settings.info_valid )
+		{
+			*info = settings.info;
+			return 0;
+		}
 	}
 
-	// Check response status
-	status = cmd_get_response_status( resp );
-	if ( status != E_SUCCESS )
+	if ( cmd_system_info::call( false, &status, type, hw_rev, fw_version, sn ) != 0 )
 	{
-		dbgPrint( "Command GET GRASPING FORCE not successful: %s\n", status_to_str( status ) );
-		free( resp );
-		return 0;
+		dbgPrint( "Command GET SYSTEM INFORMATION not successful: %s\n", status_to_str( status ) );
+		return -1;
 	}
-	
-	vResult[0] = resp[2];
-	vResult[1] = resp[3];
-	vResult[2] = resp[4];
-	vResult[3] = resp[5];
-	
-	free( resp );
 
-	return convert(vResult);
+	info->type = type;
+	info->hw_rev = hw_rev;
+	info->fw_version = fw_version;
+	info->sn = sn;
 
-	//return (int) resp[2];
+	std::lock_guard<std::mutex> guard( settings_lock );
+	settings.info = *info;
+	settings.info_valid = true;
+
+	return 0;
+}
+
+/**
+ * Read the forces measured by the two fingers, which must be FMF fingers.
+ * Each finger has a command of its own (0x63, 0x73).
+ *
+ * @param *force0, *force1		Forces of finger 1 and 2 in N
+ * @param *status				Status of the failed read, e.g. E_NOT_AVAILABLE
+ *								if a finger does not measure forces
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int getFingerForces( float *force0, float *force1, status_t *status )
+{
+	// There is no automatic update of the finger data, so both are read every time
+	if ( cmd_get_finger1_data::call( false, status, *force0 ) != 0 ||
+		 cmd_get_finger2_data::call( false, status, *force1 ) != 0 )
+	{
+		dbgPrint( "Command GET FINGER DATA not successful: %s\n", status_to_str( *status ) );
+		return -1;
+	}
+
+	*status = E_SUCCESS;
+	return 0;
 }
 
 // MAIN
@@ -0,0 +1,406 @@
+//======================================================================
+/**
+ *  @file
+ *  gcl.c
+ *
+ *  @section gcl.c_general General file information
+ *
+ *  @brief
+ *  Link layer of the GCL text protocol
+ *
+ *  A line is taken apart where it was received: the tokenizer terminates
+ *  it in the receive buffer and the parser points into it, so receiving
+ *  does not allocate or copy, however many lines a read returns. A command
+ *  is formatted on the stack and written with a single write, including
+ *  its line end.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "wsg50/gcl.h"
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+static const char *status_names[] = STATUS_DESCRIPTORS;
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+/**
+ * Reset a tokenizer
+ *
+ * @param *t		Tokenizer
+ */
+
+void gcl_tokenizer_init( gcl_tokenizer_t *t )
+{
+	t->start = t->scan = t->end = 0;
+	t->skipping = false;
+	t->overlong = 0;
+}
+
+
+/**
+ * Get the free space at the end of the buffer for the next read
+ *
+ * @param *t		Tokenizer
+ * @param *len		Returns the size of the space
+ *
+ * @return Pointer to the space, to be passed to gcl_tokenizer_commit() after reading
+ */
+
+char * gcl_tokenizer_space( gcl_tokenizer_t *t, unsigned int *len )
+{
+	if ( t->start == t->end ) t->start = t->scan = t->end = 0;
+	else if ( GCL_RX_BUFSIZE - t->end < GCL_LINE_MAX && t->start > 0 )
+	{
+		// Only the partial line at the end, at most GCL_LINE_MAX bytes
+		memmove( t->buf, &t->buf[t->start], t->end - t->start );
+		t->end -= t->start;
+		t->scan -= t->start;
+		t->start = 0;
+	}
+
+	*len = GCL_RX_BUFSIZE - t->end;
+	return &t->buf[t->end];
+}
+
+
+/**
+ * Add the data read into gcl_tokenizer_space()
+ *
+ * @param *t		Tokenizer
+ * @param len		Number of bytes read
+ */
+
+void gcl_tokenizer_commit( gcl_tokenizer_t *t, unsigned int len )
+{
+	t->end += len;
+}
+
+
+/**
+ * Get the next complete line. The line end ("\n" or "\r\n") is replaced
+ * by a terminating zero; empty and overlong lines are skipped.
+ *
+ * @param *t		Tokenizer
+ * @param *len		Returns the length of the line
+ *
+ * @return Pointer to the line in the buffer, valid until the next call of
+ *         gcl_tokenizer_space(); NULL if no line is complete
+ */
+
+const char * gcl_tokenizer_next( gcl_tokenizer_t *t, unsigned int *len )
+{
+	const char *nl;
+	unsigned int first, n;
+
+	for ( ;; )
+	{
+		nl = memchr( &t->buf[t->scan], '\n', t->end - t->scan );
+		if ( !nl )
+		{
+			t->scan = t->end;
+			if ( t->skipping || t->end - t->start > GCL_LINE_MAX )
+			{
+				// Nothing of this line is needed any more
+				t->skipping = true;
+				t->start = t->scan = t->end;
+			}
+			return NULL;
+		}
+
+		first = t->start;
+		n = (unsigned int) ( nl - t->buf ) - first;
+		t->start = t->scan = first + n + 1;
+
+		if ( t->skipping || n > GCL_LINE_MAX )
+		{
+			t->skipping = false;
+			t->overlong++;
+			continue;
+		}
+		if ( n > 0 && t->buf[first + n - 1] == '\r' ) n--;
+		t->buf[first + n] = '\0';
+		if ( n == 0 ) continue;
+
+		*len = n;
+		return &t->buf[first];
+	}
+}
+
+
+/**
+ * Get the status code of an error given as number or name, e.g. "16" or
+ * "E_ACCESS_DENIED"
+ *
+ * @return The status, E_CMD_FAILED if it is unknown
+ */
+
+status_t gcl_status_from_str( const char *str, unsigned int len )
+{
+	unsigned int i, code = 0;
+
+	if ( len > 0 && isdigit( (unsigned char) str[0] ) )
+	{
+		for ( i = 0; i < len && isdigit( (unsigned char) str[i] ); i++ ) code = code * 10 + ( str[i] - '0' );
+		return code <= E_FILE_EXISTS ? (status_t) code : E_CMD_FAILED;
+	}
+
+	for ( i = 0; status_names[i]; i++ )
+		if ( strlen( status_names[i] ) == len && strncmp( status_names[i], str, len ) == 0 ) return (status_t) i;
+
+	return E_CMD_FAILED;
+}
+
+
+/**
+ * Take a line apart. Numbers are read in place, so the line must be
+ * terminated as it is by gcl_tokenizer_next().
+ *
+ * @param *line		Line without line end
+ * @param len		Length of the line
+ * @param *parsed	Returns the parts of the line
+ *
+ * @return 0 for a reply or update, -1 for any other line (GCL_LINE_OTHER)
+ */
+
+int gcl_parse( const char *line, unsigned int len, gcl_line_t *parsed )
+{
+	const char *s = line, *e = line + len, *w;
+	char *end;
+	bool has_code = false;
+
+	memset( parsed, 0, sizeof( *parsed ) );
+	parsed->type = GCL_LINE_OTHER;
+	parsed->status = E_SUCCESS;
+
+	while ( s < e && *s == ' ' ) s++;
+
+	// "ACK MOVE", "FIN MOVE", "ERR MOVE E_AXIS_BLOCKED"; the code may come without name
+	if ( e - s >= 3 && ( e - s == 3 || s[3] == ' ' ) )
+	{
+		if ( strncmp( s, "ACK", 3 ) == 0 ) parsed->type = GCL_LINE_ACK;
+		else if ( strncmp( s, "FIN", 3 ) == 0 ) parsed->type = GCL_LINE_FIN;
+		else if ( strncmp( s, "ERR", 3 ) == 0 ) parsed->type = GCL_LINE_ERR;
+	}
+	if ( parsed->type != GCL_LINE_OTHER )
+	{
+		for ( s += 3; s < e && !has_code; )
+		{
+			while ( s < e && *s == ' ' ) s++;
+			for ( w = s; s < e && *s != ' '; s++ );
+			if ( w == s ) break;
+
+			if ( parsed->type == GCL_LINE_ERR && ( isdigit( (unsigned char) *w ) || ( s - w > 2 && w[0] == 'E' && w[1] == '_' ) ) )
+			{
+				parsed->status = gcl_status_from_str( w, (unsigned int) ( s - w ) );
+				has_code = true;
+			}
+			else if ( !parsed->name )
+			{
+				parsed->name = w;
+				parsed->name_len = (unsigned int) ( s - w );
+			}
+			else break;
+		}
+		if ( parsed->type == GCL_LINE_ERR && !has_code ) parsed->status = E_CMD_FAILED;
+		return 0;
+	}
+
+	// "POS=10.0", "@POS=10.0"
+	if ( s < e && *s == '@' )
+	{
+		parsed->type = GCL_LINE_UPDATE;
+		s++;
+	}
+	for ( w = s; s < e && ( isalnum( (unsigned char) *s ) || *s == '_' ); s++ );
+	if ( s == w || s == e || *s != '=' )
+	{
+		parsed->type = GCL_LINE_OTHER;
+		return -1;
+	}
+
+	if ( parsed->type != GCL_LINE_UPDATE ) parsed->type = GCL_LINE_VALUE;
+	parsed->name = w;
+	parsed->name_len = (unsigned int) ( s - w );
+	parsed->value = s + 1;
+	parsed->number = strtod( parsed->value, &end );
+	parsed->has_number = end != parsed->value;
+
+	return 0;
+}
+
+
+/**
+ * Check the command name or value key of a parsed line
+ */
+
+bool gcl_name_is( const gcl_line_t *parsed, const char *name )
+{
+	return parsed->name && strlen( name ) == parsed->name_len && strncmp( parsed->name, name, parsed->name_len ) == 0;
+}
+
+
+/**
+ * Open a GCL connection
+ *
+ * @param *link		Link
+ * @param *iface	Byte stream interface, e.g. tcp
+ * @param *params	Parameters of the interface, e.g. tcp_params_t
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int gcl_open( gcl_link_t *link, const interface_t *iface, const void *params )
+{
+	memset( link, 0, sizeof( *link ) );
+	if ( !iface ) return -1;
+
+	link->conn = calloc( 1, iface->conn_size > 0 ? iface->conn_size : 1 );
+	if ( !link->conn ) return -1;
+	if ( iface->open( link->conn, params ) != 0 )
+	{
+		free( link->conn );
+		link->conn = NULL;
+		return -1;
+	}
+
+	link->iface = iface;
+	pthread_mutex_init( &link->tx_lock, NULL );
+	gcl_tokenizer_init( &link->rx );
+
+	return 0;
+}
+
+
+/**
+ * Close a GCL connection. No other thread may use the link any more.
+ *
+ * @param *link		Link
+ */
+
+void gcl_close( gcl_link_t *link )
+{
+	if ( !link->iface ) return;
+
+	link->iface->close( link->conn );
+	free( link->conn );
+	pthread_mutex_destroy( &link->tx_lock );
+	memset( link, 0, sizeof( *link ) );
+}
+
+
+bool gcl_is_open( const gcl_link_t *link )
+{
+	return link->iface != NULL;
+}
+
+
+/**
+ * Get the descriptor that becomes readable when a reply arrives
+ *
+ * @return The descriptor, -1 if the interface has none
+ */
+
+int gcl_get_fd( const gcl_link_t *link )
+{
+	if ( !link->iface || !link->iface->get_fd ) return -1;
+	return link->iface->get_fd( link->conn );
+}
+
+
+/**
+ * Send a command line; the line end is appended. May be called by
+ * several threads at the same time.
+ *
+ * @param *link		Link
+ * @param *fmt		printf format of the command, e.g. "MOVE(%.2f,%.2f)"
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int gcl_send( gcl_link_t *link, const char *fmt, ... )
+{
+	char line[GCL_LINE_MAX + 1];
+	va_list ap;
+	int len, res;
+
+	if ( !link->iface ) return -1;
+
+	va_start( ap, fmt );
+	len = vsnprintf( line, sizeof( line ) - 1, fmt, ap );
+	va_end( ap );
+	if ( len < 0 || len >= (int) sizeof( line ) - 1 )
+	{
+		fprintf( stderr, "GCL command too long: %s...\n", line );
+		return -1;
+	}
+	line[len++] = '\n';
+
+	pthread_mutex_lock( &link->tx_lock );
+	res = link->iface->write( link->conn, (unsigned char *) line, (unsigned int) len );
+	pthread_mutex_unlock( &link->tx_lock );
+
+	if ( res != len )
+	{
+		fprintf( stderr, "Failed to send GCL command %.*s\n", len - 1, line );
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Read once from the link and hand out every complete line. Blocks in the
+ * read of the interface, so is called when the link is readable.
+ *
+ * @param *link		Link
+ * @param cb		Called for each line
+ * @param *arg		Argument of cb
+ *
+ * @return Number of lines handed out, -1 on error
+ */
+
+int gcl_receive( gcl_link_t *link, gcl_line_cb_t cb, void *arg )
+{
+	gcl_line_t parsed;
+	const char *line;
+	unsigned int space, len;
+	char *buf;
+	int res, count = 0;
+
+	if ( !link->iface ) return -1;
+
+	buf = gcl_tokenizer_space( &link->rx, &space );
+	res = link->iface->read( link->conn, (unsigned char *) buf, space );
+	if ( res <= 0 ) return res;
+	gcl_tokenizer_commit( &link->rx, (unsigned int) res );
+
+	if ( !link->iface->get_rx_time || link->iface->get_rx_time( link->conn, &link->rx_time ) != 0 )
+		clock_gettime( CLOCK_REALTIME, &link->rx_time );
+
+	while ( ( line = gcl_tokenizer_next( &link->rx, &len ) ) )
+	{
+		gcl_parse( line, len, &parsed );
+		cb( line, &parsed, arg );
+		count++;
+	}
+
+	return count;
+}
@@ -0,0 +1,511 @@
+//======================================================================
+/**
+ *  @file
+ *  gcl_client.cpp
+ *
+ *  @section gcl_client.cpp_general General file information
+ *
+ *  @brief
+ *  Commands and automatic updates of a gripper speaking GCL
+ *
+ *  As with the binary protocol (see dispatcher.cpp), one reader thread
+ *  receives everything the gripper sends and sleeps in epoll (see
+ *  reactor.c) in between. Values pushed by AUTOSEND update the state,
+ *  which is read without a round trip, and replies complete the command
+ *  waiting for them: "ACK", "FIN" and "ERR" by the command name, e.g.
+ *  "FIN MOVE", and a query by its key, e.g. "POS=10.0". Commands are sent
+ *  by the calling thread, so a stop is never queued behind anything but
+ *  the line being written.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "wsg50/gcl_client.h"
+#include "wsg50/reactor.h"
+#include "wsg50/seqlock.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define GCL_CLIENT_ERROR_BACKOFF_MS		10			// Pause after a failed wait, so a broken epoll does not spin
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+namespace
+{
+
+/** A command waiting for its reply */
+struct pending_cmd
+{
+	bool used = false;
+	bool done = false;
+	char name[GCL_NAME_LEN] = "";					// Command name or query key
+	unsigned int name_len = 0;
+	gcl_wait_t wait = GCL_WAIT_NONE;
+	unsigned long seq = 0;							// Replies with the same name complete the oldest command first
+	status_t status = E_SUCCESS;
+	double value = 0.0;
+};
+
+} // namespace
+
+struct gcl_client
+{
+	std::mutex link_lock;							// Held while sending, so the link is not closed meanwhile
+	gcl_link_t link{};
+	reactor_t reactor{ -1, -1 };
+	std::thread reader;
+	std::atomic<bool> running{ false };
+	std::atomic<bool> failed{ false };				// Read or write error; cleared by the next connect
+	rt_options_t options{};
+
+	std::mutex lock;								// Protects pending
+	std::condition_variable replied;
+	pending_cmd pending[GCL_CLIENT_PENDING_MAX];
+	unsigned long seq = 0;
+
+	gcl_state_t current{};							// Only touched by the reader thread
+	seqlock<gcl_state_t> state;
+	gcl_update_cb_t cb = nullptr;
+	void *cb_arg = nullptr;
+	std::atomic<long long> last_rx_ms{ 0 };
+};
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+namespace
+{
+
+long long now_ms( void );
+void gcl_client_fail( gcl_client *c );
+void gcl_client_reply( gcl_client *c, const gcl_line_t *parsed );
+void gcl_client_line( const char *line, const gcl_line_t *parsed, void *arg );
+void gcl_client_loop( gcl_client *c, rt_options_t options );
+int gcl_client_send( gcl_client *c, gcl_wait_t wait, int timeout_ms, status_t *status, double *value, const char *line );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+long long now_ms( void )
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+/**
+ * Mark the link broken and wake up every waiting command
+ */
+
+void gcl_client_fail( gcl_client *c )
+{
+	std::lock_guard<std::mutex> guard( c->lock );
+	c->failed = true;
+	c->replied.notify_all();
+}
+
+
+/**
+ * Complete the oldest command waiting for a reply
+ */
+
+void gcl_client_reply( gcl_client *c, const gcl_line_t *parsed )
+{
+	pending_cmd *best = nullptr;
+
+	std::lock_guard<std::mutex> guard( c->lock );
+	for ( pending_cmd &p : c->pending )
+	{
+		if ( !p.used || p.done ) continue;
+
+		// An error without command name is taken for the oldest command
+		if ( parsed->name_len && ( p.name_len != parsed->name_len || strncmp( p.name, parsed->name, p.name_len ) != 0 ) ) continue;
+		if ( ( parsed->type == GCL_LINE_ACK && p.wait != GCL_WAIT_ACK ) ||
+			 ( parsed->type == GCL_LINE_FIN && p.wait != GCL_WAIT_FIN ) ||
+			 ( parsed->type == GCL_LINE_VALUE && p.wait != GCL_WAIT_VALUE ) )
+			continue;
+
+		if ( !best || p.seq < best->seq ) best = &p;
+	}
+	if ( !best ) return;
+
+	best->done = true;
+	best->status = parsed->status;
+	best->value = parsed->number;
+	c->replied.notify_all();
+}
+
+
+/**
+ * Handle a line received by the reader thread
+ */
+
+void gcl_client_line( const char *, const gcl_line_t *parsed, void *arg )
+{
+	gcl_client *c = static_cast<gcl_client *>( arg );
+	gcl_value_t value;
+
+	c->last_rx_ms = now_ms();
+
+	if ( parsed->type == GCL_LINE_OTHER ) return;
+	if ( parsed->type != GCL_LINE_UPDATE )
+	{
+		gcl_client_reply( c, parsed );
+		if ( parsed->type != GCL_LINE_VALUE ) return;
+	}
+	if ( !parsed->has_number ) return;
+
+	// Replies to queries are as recent as the updates
+	if ( gcl_name_is( parsed, "POS" ) )
+	{
+		value = GCL_VALUE_POS;
+		c->current.position = (float) parsed->number;
+		c->current.stamp = c->link.rx_time;
+		c->current.valid = true;
+	}
+	else if ( gcl_name_is( parsed, "SPEED" ) )
+	{
+		value = GCL_VALUE_SPEED;
+		c->current.speed = (float) parsed->number;
+	}
+	else if ( gcl_name_is( parsed, "FORCE" ) )
+	{
+		value = GCL_VALUE_FORCE;
+		c->current.force = (float) parsed->number;
+	}
+	else if ( gcl_name_is( parsed, "GRIPSTATE" ) )
+	{
+		value = GCL_VALUE_GRIPSTATE;
+		c->current.grip_state = (int) parsed->number;
+	}
+	else return;
+
+	c->state.store( c->current );
+	if ( parsed->type == GCL_LINE_UPDATE && c->cb ) c->cb( value, &c->current, c->cb_arg );
+}
+
+
+/**
+ * Reader thread: receive until the client is disconnected
+ */
+
+void gcl_client_loop( gcl_client *c, rt_options_t options )
+{
+	void *ready[REACTOR_MAX_EVENTS];
+	unsigned int count;
+	int res;
+
+	if ( rt_options_set( &options ) ) rt_apply_thread( &options, "wsg50_gcl_io" );
+
+	while ( c->running )
+	{
+		res = reactor_wait( &c->reactor, -1, ready, &count );
+		if ( res < 0 )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( GCL_CLIENT_ERROR_BACKOFF_MS ) );
+			continue;
+		}
+		if ( !( res & REACTOR_READABLE ) || c->failed ) continue;
+
+		if ( gcl_receive( &c->link, gcl_client_line, c ) < 0 )
+		{
+			// The descriptor stays readable; the link is left to be reconnected
+			fprintf( stderr, "Failed to read from GCL link, not reading it any more\n" );
+			reactor_remove( &c->reactor, gcl_get_fd( &c->link ) );
+			gcl_client_fail( c );
+		}
+	}
+}
+
+
+/**
+ * Send a command line and wait for its reply
+ *
+ * @return 0 if the reply was received, -1 on timeout or link error
+ */
+
+int gcl_client_send( gcl_client *c, gcl_wait_t wait, int timeout_ms, status_t *status, double *value, const char *line )
+{
+	pending_cmd *p = nullptr;
+	unsigned int n;
+	status_t st;
+	int res;
+
+	if ( wait != GCL_WAIT_NONE )
+	{
+		std::lock_guard<std::mutex> guard( c->lock );
+		for ( pending_cmd &slot : c->pending ) if ( !slot.used )
+		{
+			p = &slot;
+			break;
+		}
+		if ( !p )
+		{
+			fprintf( stderr, "Too many GCL commands waiting, not sending %s\n", line );
+			if ( status ) *status = E_INSUFFICIENT_RESOURCES;
+			return -1;
+		}
+
+		// Registered before sending, the reply may be quicker than we are
+		for ( n = 0; n < GCL_NAME_LEN - 1 && ( isalnum( (unsigned char) line[n] ) || line[n] == '_' ); n++ ) p->name[n] = line[n];
+		p->name[n] = '\0';
+		p->name_len = n;
+		p->used = true;
+		p->done = false;
+		p->wait = wait;
+		p->seq = c->seq++;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard( c->link_lock );
+		res = gcl_is_open( &c->link ) && !c->failed ? gcl_send( &c->link, "%s", line ) : -1;
+	}
+	if ( res != 0 )
+	{
+		if ( gcl_is_open( &c->link ) ) gcl_client_fail( c );
+		if ( p )
+		{
+			std::lock_guard<std::mutex> guard( c->lock );
+			p->used = false;
+		}
+		if ( status ) *status = E_WRITE_ERROR;
+		return -1;
+	}
+	if ( !p )
+	{
+		if ( status ) *status = E_SUCCESS;
+		return 0;
+	}
+
+	std::unique_lock<std::mutex> lock( c->lock );
+	c->replied.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [c, p] { return p->done || c->failed; } );
+
+	st = p->done ? p->status : c->failed ? E_READ_ERROR : E_TIMEOUT;
+	if ( p->done && value ) *value = p->value;
+	res = p->done ? 0 : -1;
+	p->used = false;
+	lock.unlock();
+
+	if ( res != 0 ) fprintf( stderr, "No reply to GCL command %s: %s\n", line, status_to_str( st ) );
+	if ( status ) *status = st;
+	return res;
+}
+
+} // namespace
+
+
+/**
+ * Create a client; it is connected with gcl_client_connect()
+ *
+ * @return The client, NULL if out of memory
+ */
+
+gcl_client * gcl_client_create( void )
+{
+	gcl_client *c = new ( std::nothrow ) gcl_client;
+	if ( !c ) return NULL;
+
+	c->current.grip_state = -1;
+	c->state.store( c->current );
+	return c;
+}
+
+
+void gcl_client_destroy( gcl_client *c )
+{
+	if ( !c ) return;
+	gcl_client_disconnect( c );
+	delete c;
+}
+
+
+/**
+ * Set the scheduling of the reader thread; takes effect with the next
+ * gcl_client_connect()
+ */
+
+void gcl_client_set_thread_options( gcl_client *c, const rt_options_t *options )
+{
+	c->options = *options;
+}
+
+
+/**
+ * Set the callback for the values pushed by AUTOSEND. Must be called
+ * before gcl_client_connect().
+ */
+
+void gcl_client_set_update_cb( gcl_client *c, gcl_update_cb_t cb, void *arg )
+{
+	c->cb = cb;
+	c->cb_arg = arg;
+}
+
+
+/**
+ * Connect to a gripper and start receiving
+ *
+ * @param *c		Client
+ * @param *iface	Interface with descriptor, e.g. tcp
+ * @param *params	Parameters of the interface, e.g. tcp_params_t
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int gcl_client_connect( gcl_client *c, const interface_t *iface, const void *params )
+{
+	int fd;
+
+	gcl_client_disconnect( c );
+
+	{
+		std::lock_guard<std::mutex> guard( c->link_lock );
+		if ( gcl_open( &c->link, iface, params ) != 0 ) return -1;
+	}
+
+	fd = gcl_get_fd( &c->link );
+	if ( fd < 0 ) fprintf( stderr, "GCL needs an interface with descriptor\n" );
+	if ( fd < 0 || reactor_open( &c->reactor ) < 0 || reactor_add( &c->reactor, fd, c ) < 0 )
+	{
+		reactor_close( &c->reactor );
+		std::lock_guard<std::mutex> guard( c->link_lock );
+		gcl_close( &c->link );
+		return -1;
+	}
+
+	c->failed = false;
+	c->last_rx_ms = now_ms();
+	c->running = true;
+	c->reader = std::thread( gcl_client_loop, c, c->options );
+
+	return 0;
+}
+
+
+/**
+ * Stop receiving and close the connection; waiting commands fail. The
+ * latest state is kept.
+ */
+
+void gcl_client_disconnect( gcl_client *c )
+{
+	if ( c->running )
+	{
+		c->running = false;
+		reactor_wakeup( &c->reactor );
+		c->reader.join();
+	}
+	if ( !gcl_is_open( &c->link ) ) return;
+
+	gcl_client_fail( c );
+	reactor_close( &c->reactor );
+
+	std::lock_guard<std::mutex> guard( c->link_lock );
+	if ( c->link.rx.overlong ) fprintf( stderr, "%lu overlong GCL lines skipped\n", c->link.rx.overlong );
+	gcl_close( &c->link );
+}
+
+
+/**
+ * Check whether the link is connected and has not failed
+ */
+
+bool gcl_client_link_ok( gcl_client *c )
+{
+	return gcl_is_open( &c->link ) && !c->failed;
+}
+
+
+/**
+ * Get the time since the last line was received (or since connecting)
+ */
+
+int gcl_client_rx_age_ms( gcl_client *c )
+{
+	return (int) ( now_ms() - c->last_rx_ms );
+}
+
+
+/**
+ * Send a command, e.g. gcl_client_command( c, GCL_WAIT_FIN, 30000, &status, "MOVE(%.2f,%.2f)", width, speed )
+ *
+ * @param *c			Client
+ * @param wait			Reply to wait for
+ * @param timeout_ms	Max. time to wait for it
+ * @param *status		Returns the status: E_SUCCESS, the error code of an "ERR" reply, E_TIMEOUT or
+ *						an I/O error; may be NULL
+ * @param *fmt			printf format of the command
+ *
+ * @return 0 if the command was sent and the reply received (see status), -1 on timeout or link error
+ */
+
+int gcl_client_command( gcl_client *c, gcl_wait_t wait, int timeout_ms, status_t *status, const char *fmt, ... )
+{
+	char line[GCL_LINE_MAX + 1];
+	va_list ap;
+	int len;
+
+	va_start( ap, fmt );
+	len = vsnprintf( line, sizeof( line ), fmt, ap );
+	va_end( ap );
+	if ( len < 0 || len >= GCL_LINE_MAX )
+	{
+		if ( status ) *status = E_CMD_FORMAT_ERROR;
+		return -1;
+	}
+
+	return gcl_client_send( c, wait, timeout_ms, status, NULL, line );
+}
+
+
+/**
+ * Read a value, e.g. gcl_client_query( c, "POS", &pos, 500 )
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int gcl_client_query( gcl_client *c, const char *key, double *value, int timeout_ms )
+{
+	char line[GCL_NAME_LEN + 2];
+	status_t status;
+
+	if ( strlen( key ) >= GCL_NAME_LEN ) return -1;
+	snprintf( line, sizeof( line ), "%s?", key );
+
+	if ( gcl_client_send( c, GCL_WAIT_VALUE, timeout_ms, &status, value, line ) != 0 ) return -1;
+	return status == E_SUCCESS ? 0 : -1;
+}
+
+
+/**
+ * Get the latest values received; never blocks
+ */
+
+void gcl_client_state( gcl_client *c, gcl_state_t *state )
+{
+	*state = c->state.load();
+}
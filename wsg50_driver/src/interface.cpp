@@ -58,6 +58,8 @@
 #include "wsg50/tcp.h"
 #include "wsg50/udp.h"
 #include "wsg50/serial.h"
+#include "wsg50/can.h"
+#include "wsg50/replay.h"
 
 
 //------------------------------------------------------------------------
@@ -78,6 +80,8 @@
 extern const interface_t tcp;
 extern const interface_t udp;
 extern const interface_t serial;
+extern const interface_t can;
+extern const interface_t replay;
 
 // Collection of interfaces, NULL terminated
 static const interface_t *interfaces[] =
@@ -85,6 +89,8 @@ static const interface_t *interfaces[] =
 	&tcp,
 	&udp,
 	&serial,
+	&can,
+	&replay,
 	NULL
 };
 
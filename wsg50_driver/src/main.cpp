@@ -42,18 +42,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 
 #include "wsg50/common.h"
 #include "wsg50/cmd.h"
 #include "wsg50/msg.h"
+#include "wsg50/dispatcher.h"
+#include "wsg50/spsc_ring.h"
+#include "wsg50/seqlock.h"
+#include "wsg50/metrics.h"
+#include "wsg50/recorder.h"
+#include "wsg50/rt.h"
 #include "wsg50/tcp.h"
+#include "wsg50/serial.h"
 #include "wsg50/functions.h"
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include "std_msgs/String.h"
 #include "std_srvs/Empty.h"
 #include "wsg50_common/Status.h"
@@ -61,7 +80,11 @@
 #include "wsg50_common/Conf.h"
 #include "wsg50_common/Incr.h"
 #include "wsg50_common/Cmd.h"
+#include "wsg50_common/Trajectory.h"
+#include "wsg50_common/FingerForce.h"
+#include "wsg50_common/ExecuteSequence.h"
 #include "dnb_msgs/ComponentStatus.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
 
 #include "sensor_msgs/JointState.h"
 #include "std_msgs/Float32.h"
@@ -78,24 +101,206 @@
 //------------------------------------------------------------------------
 
 #define GRIPPER_MIN_OPEN 0.0
+#define SERVICE_THREADS 3 // A motion control service, stop and one more service may run at the same time
+#define STOP_TO_WIRE_LIMIT_US 1000 // Diagnostics warn if the 99th percentile of the stop latency exceeds this
+#define IDLE_POLL_MS 5 // Interval for reading the system state after a motion
+#define IDLE_TIMEOUT_MS 100 // Never wait longer for the axis to get idle than the fixed delay of hw-rev. 2 grippers
+#define PUBLISH_QUEUE_LEN 256 // Samples buffered between the dispatcher and the publisher thread (power of two)
+#define STATE_MAX_AGE 0.5 // Max. age in s of gripper::state to be used instead of reading the opening width
+#define METRICS_PERIOD 5.0 // Interval in s for publishing diagnostics and writing the metrics file
+#define LINK_CHECK_MS 20 // Interval for checking whether the link of a gripper broke
+#define RECONNECT_BACKOFF_MIN 0.1 // First delay in s between reconnect attempts; doubled up to reconnect_backoff_max
+#define STALL_MIN_TRAVEL 0.5 // mm the fingers must move between two checks of an overdue motion to be waited for
+#define SETPOINT_SCRIPT_CMD 5 // 0xB5: set-point the script follows without stopping, see cmd_measure.lua
+
+// Sample handed from the dispatcher thread to publish_thread()
+enum sample_type { SAMPLE_STATE, SAMPLE_MOVING };
+struct state_sample {
+    sample_type type;
+    ros::Time stamp;
+    struct timespec arrived; // For the publish latency
+    bool moving; // SAMPLE_MOVING
+    bool has_state; // State byte of the measure script; the state text is built by the publisher
+    unsigned char state;
+    float position, speed, acceleration;
+    float f_motor, f_finger0, f_finger1;
+};
+
+// Reduction of the samples between two messages of a decimated topic
+enum aggregate_mode { AGGREGATE_LAST, AGGREGATE_MEAN, AGGREGATE_MIN, AGGREGATE_MAX };
+#define SAMPLE_VALUES 6 // position, speed, acceleration, f_motor, f_finger0, f_finger1
+
+// Output rate of a topic, see publish_status_and_joint_states()
+struct decimator {
+    double period = 0.0; // s between two messages, 0: one per sample
+    ros::Time next;
+    int n = 0;
+    float lo[SAMPLE_VALUES], hi[SAMPLE_VALUES], sum[SAMPLE_VALUES], last[SAMPLE_VALUES];
+
+    /** \brief Adds a sample. Returns true if a message is due; out is the aggregate of the samples since the last one then. */
+    bool add(const float *v, const ros::Time &stamp, aggregate_mode mode, float *out)
+    {
+        for (int i=0; i<SAMPLE_VALUES; i++) {
+            lo[i] = n ? std::min(lo[i], v[i]) : v[i];
+            hi[i] = n ? std::max(hi[i], v[i]) : v[i];
+            sum[i] = n ? sum[i] + v[i] : v[i];
+            last[i] = v[i];
+        }
+        n++;
+
+        // Not due yet, unless the clock went back
+        if (period > 0.0 && !next.isZero() && stamp < next && (next - stamp).toSec() <= period)
+            return false;
+        next = (next.isZero() || stamp < next || (stamp - next).toSec() > period) ? stamp + ros::Duration(period) : next + ros::Duration(period);
+
+        for (int i=0; i<SAMPLE_VALUES; i++)
+            out[i] = mode == AGGREGATE_MEAN ? sum[i] / n : mode == AGGREGATE_MIN ? lo[i] : mode == AGGREGATE_MAX ? hi[i] : last[i];
+        n = 0;
+        return true;
+    }
+};
+
+// Goal of the set-point stream, see setpoint_loop()
+struct setpoint {
+    float pos, speed; // pos is NAN if there is no goal
+};
+
+// Latest gripper state, see gripper::state
+struct gripper_state {
+    bool valid; // false until the first sample and after each motion control service
+    ros::Time stamp;
+    bool ismoving;
+    float position, speed, acceleration;
+    float f_motor, f_finger0, f_finger1;
+};
 
 //------------------------------------------------------------------------
 // Global variables
 //------------------------------------------------------------------------
 
-float increment;
-bool objectGraspped;
-bool in_motion;
-unsigned char last_cmd_id;
-bool stop_called;
+// One gripper served by the node. All of its callbacks get it passed and
+// talk to its connection (see cmd_select()).
+struct gripper {
+    std::string name; // Sub-namespace of the gripper, empty if the node serves a single one
+    std::string label; // Appended to log messages, e.g. " (left)"
+    ros::NodeHandle nh;
+    cmd_conn_t *conn = nullptr;
+    std::string joint_name;
+
+    std::atomic<bool> objectGraspped{false};
+    std::atomic<bool> in_motion{false};
+    std::atomic<unsigned char> last_cmd_id{0};
+    std::atomic<bool> stop_called{false};
+    std::mutex motion_lock;
+    std::condition_variable motion_done;
+
+    int size = 210;
+    int hw_revision = 3;
+
+    ros::Publisher pub_state, pub_joint, pub_moving;
+    // Mode flags are set before any callback thread is started
+    bool mode_script = false, mode_periodic = false, mode_polling = false;
+    std::atomic<bool> ismoving{false};
+    // Goals are only touched by callbacks of the main queue (topics and timer_cb())
+    float goal_position = NAN, goal_speed = NAN, speed = 10.0;
+
+    // Set-point stream: goals are collected by the topic callbacks and sent by setpoint_loop()
+    double setpoint_rate = 0.0; // 0: every goal is sent right away
+    float setpoint_deadband = 0.1; // mm
+    std::mutex setpoint_lock; // Protects the members below
+    std::condition_variable setpoint_wake;
+    setpoint goal{NAN, 0.0f}; // Latest goal; latest wins
+    std::vector<setpoint> trajectory; // Played back from trajectory_start, one every trajectory_period
+    std::chrono::steady_clock::time_point trajectory_start;
+    double trajectory_period = 0.0;
+    bool setpoints_running = false;
+    std::thread setpoint_thread;
+
+    // Forces of FMF fingers: read by finger_loop() and published in batches on their own topic,
+    // so the finger rate does not add to the status messages
+    double finger_rate = 0.0; // Hz, 0: not read
+    int finger_batch = 10; // Samples per message
+    std::mutex finger_lock; // Protects fingers_running
+    std::condition_variable finger_wake;
+    bool fingers_running = false;
+    std::thread finger_thread;
+    ros::Publisher pub_finger;
+
+    // Written wherever a sample is decoded; read e.g. by the services without a round trip
+    seqlock<gripper_state> state;
+    std::atomic<float> last_opening{NAN}; // Of the latest sample; unlike state, kept after a motion
+    int script_batch = 0, script_batch_period = 5; // Samples per measurement frame in script mode (0: one per tick)
+    bool script_stream = false; // Script pushes measurements instead of being polled by timer_cb()
+
+    // State assembled from automatic updates; only touched by the dispatcher thread
+    gripper_response auto_info;
+    std::atomic<int> auto_cnt[3];
+    double auto_rate_exp = 0.0;
+
+    // Output of status and /joint_states, see publish_status_and_joint_states(). Only touched by
+    // the thread publishing the samples of the mode (timer_cb() or publish_thread()).
+    decimator status_out, joint_out;
+    aggregate_mode pub_aggregate = AGGREGATE_LAST;
+    bool status_on_change = false, moving_on_change = false; // Skip messages equal to the one published last
+    wsg50_common::Status status_msg; // Reused, and the last one published
+    bool status_published = false;
+    sensor_msgs::JointState joint_msg;
+    int moving_published = -1;
+    int state_text_byte = -1; // State byte of state_text, see publish_sample()
+    std::string state_text;
+
+    // Streamed samples are published by their own thread, so publishing never delays receiving
+    spsc_ring<state_sample, PUBLISH_QUEUE_LEN> pub_queue;
+    std::thread pub_thread;
+    std::atomic<bool> publishing{false};
+    bool pub_coalesce = false; // Publish only the newest state sample of those queued
+    std::atomic<unsigned long> pub_coalesced{0};
+    unsigned long pub_overruns = 0; // Reported by check_publisher() so far
+    unsigned long frames_last[256] = {}; // Frames per ID at the last metrics_cb()
+
+    // Topics and timers are served by one thread, services by SERVICE_THREADS of their own
+    ros::CallbackQueue queue, srv_queue;
+    std::vector<ros::ServiceServer> services;
+    ros::Subscriber sub_position, sub_speed, sub_trajectory;
+    ros::Timer tmr;
+    bool auto_update = false, streaming = false; // What has to be stopped on shutdown
+    int auto_interval_ms = 0, stream_period_ms = 0; // Requested again after a reconnect
+
+    // Link parameters, kept for reconnecting
+    std::string protocol, ip, serial_port, can_device;
+    int port = 1000, local_port = 1501, serial_baudrate = 115200, can_id = 0x01, can_rx_id = 0x02;
+    tcp_options_t tcp_options;
+    serial_options_t serial_options;
+    std::string replay_file; // protocol replay: recording played back instead of a gripper
+    double replay_speed = 1.0;
+
+    // Recording of the link traffic, see recorder.h
+    std::string record_file; // Empty: not recorded
+    int record_size = 64; // MB
+    recorder_t recorder;
+    bool recording = false;
+
+    // Link supervision, see supervise()
+    double keepalive_period = 0.25; // 0: link loss is only detected by failed reads and writes
+    int keepalive_misses = 3;
+    double reconnect_backoff_max = 5.0;
+    std::atomic<bool> link_lost{false};
+
+    // Stall detection of the motion services, see wait_for_motion()
+    double motion_timeout_factor = 2.0; // Multiple of the expected duration; 0: wait up to timeout_commands
+    double motion_timeout_margin = 0.5; // s
+    std::atomic<bool> supervising{false};
+    std::thread supervisor;
+    std::mutex supervisor_lock;
+    std::condition_variable supervisor_wake;
+};
 
 const float timeout_commands = 30.0;
 
-ros::Publisher g_pub_state, g_pub_joint, g_pub_moving;
+std::vector<std::unique_ptr<gripper>> g_grippers;
 ros::Publisher component_status;
-int g_timer_cnt = 0, g_size;
-bool g_ismoving = false, g_mode_script = false, g_mode_periodic = false, g_mode_polling = false;
-float g_goal_position = NAN, g_goal_speed = NAN, g_speed = 10.0;
+ros::Publisher g_pub_diagnostics;
+std::string g_metrics_file;
 
 
 //------------------------------------------------------------------------
@@ -111,45 +316,222 @@ float g_goal_position = NAN, g_goal_speed = NAN, g_speed = 10.0;
 //------------------------------------------------------------------------
 // Function implementation
 //------------------------------------------------------------------------
-void publish_status_and_joint_states(gripper_response info) {
-    // ==== Status msg ====
-    wsg50_common::Status status_msg;
-    status_msg.status = info.state_text;
-    status_msg.width = info.position;
-    status_msg.speed = info.speed;
-    status_msg.acc = info.acceleration;
-    status_msg.force = info.f_motor;
-    status_msg.force_finger0 = info.f_finger0;
-    status_msg.force_finger1 = info.f_finger1;
+/** \brief Sets up the messages reused by publish_status_and_joint_states() */
+void init_messages(gripper &g)
+{
+    g.joint_msg.header.frame_id = "";//"wsg50_gripper_base_link";
+    g.joint_msg.name.assign(1, g.joint_name);
+    g.joint_msg.position.resize(1);
+    g.joint_msg.velocity.resize(1);
+    g.joint_msg.effort.resize(1);
+    g.status_published = false;
+    g.moving_published = -1;
+    g.state_text_byte = -1;
+}
 
-    g_pub_state.publish(status_msg);
+/** \brief Publishes a sample on status and /joint_states, each with its own rate (see status_rate, joint_states_rate)
+ *  \param state_text Text of the state instead of info.state_text (may be NULL)
+ */
+void publish_status_and_joint_states(gripper &g, const gripper_response &info, const ros::Time &stamp = ros::Time::now(),
+                                     const std::string *state_text = NULL) {
+    const std::string &text = state_text ? *state_text : info.state_text;
+    const float v[SAMPLE_VALUES] = { info.position, info.speed, info.acceleration, info.f_motor, info.f_finger0, info.f_finger1 };
+    float out[SAMPLE_VALUES];
+
+    // ==== Status msg ====
+    if (g.status_out.add(v, stamp, g.pub_aggregate, out)) {
+        wsg50_common::Status &status_msg = g.status_msg;
+        bool changed = !g.status_published || status_msg.status != text ||
+                       status_msg.width != out[0] || status_msg.speed != out[1] || status_msg.acc != out[2] ||
+                       status_msg.force != out[3] || status_msg.force_finger0 != out[4] || status_msg.force_finger1 != out[5];
+        if (changed || !g.status_on_change) {
+            status_msg.status = text;
+            status_msg.width = out[0];
+            status_msg.speed = out[1];
+            status_msg.acc = out[2];
+            status_msg.force = out[3];
+            status_msg.force_finger0 = out[4];
+            status_msg.force_finger1 = out[5];
+            g.pub_state.publish(status_msg);
+            g.status_published = true;
+        }
+    }
 
     // ==== Joint state msg ====
-    sensor_msgs::JointState joint_states;
-    joint_states.header.stamp = ros::Time::now();;
-    joint_states.header.frame_id = "";//"wsg50_gripper_base_link";
-    joint_states.name.push_back("wsg50_finger_left_joint");
-    joint_states.position.resize(1);
+    if (g.joint_out.add(v, stamp, g.pub_aggregate, out)) {
+        sensor_msgs::JointState &joint_states = g.joint_msg;
+        joint_states.header.stamp = stamp;
+        joint_states.position[0] = out[0]/2000.0;
+        joint_states.velocity[0] = out[1]/1000.0;
+        joint_states.effort[0] = out[3];
+        g.pub_joint.publish(joint_states);
+    }
+}
 
-    joint_states.position[0] = info.position/2000.0;
-    joint_states.velocity.resize(1);
-    joint_states.velocity[0] = info.speed/1000.0;
-    joint_states.effort.resize(1);
-    joint_states.effort[0] = info.f_motor;
+/** \brief Publishes a change of the motion state; repeated ones only without moving_on_change */
+void publish_moving(gripper &g, bool moving)
+{
+    if (g.moving_on_change && g.moving_published == (int)moving)
+        return;
+    std_msgs::Bool moving_msg;
+    moving_msg.data = moving;
+    g.pub_moving.publish(moving_msg);
+    g.moving_published = moving;
+}
 
-    g_pub_joint.publish(joint_states);
+/** \brief Makes a decoded sample the latest gripper state */
+void update_state(gripper &g, const gripper_response &info, const ros::Time &stamp)
+{
+    gripper_state st;
+    st.valid = true;
+    st.stamp = stamp;
+    st.ismoving = info.ismoving;
+    st.position = info.position;
+    st.speed = info.speed;
+    st.acceleration = info.acceleration;
+    st.f_motor = info.f_motor;
+    st.f_finger0 = info.f_finger0;
+    st.f_finger1 = info.f_finger1;
+    g.state.store(st);
+    g.last_opening = info.position;
 }
 
-bool moveSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
+/** \brief Current opening width; taken from the latest sample if that is recent enough.
+ *  While the gripper pushes the opening, it is never read: 0x43 would end the automatic update,
+ *  and one of its frames could be taken for the response. The latest pushed value is used instead,
+ *  whatever its age; NAN if none has arrived yet. */
+float current_opening(gripper &g)
+{
+    gripper_state st = g.state.load();
+    if (st.valid && (ros::Time::now() - st.stamp).toSec() < STATE_MAX_AGE)
+        return st.position;
+    if (g.mode_periodic || g.auto_update)
+        return g.last_opening;
+    return getOpening();
+}
 
-    if (in_motion){
+/** \brief Marks the start of a motion control service. Fails if another one is running. */
+bool begin_motion(gripper &g, unsigned char cmd_id)
+{
+    if (g.in_motion.exchange(true)) {
         ROS_WARN("Another Motion Control service is already running. Try again later!");
-        res.error = E_ALREADY_RUNNING;
-        return true;
+        return false;
+    }
+    g.last_cmd_id = cmd_id;
+    g.stop_called = false;
+    return true;
+}
+
+/** \brief Marks the end of a motion control service and wakes up stopSrv() */
+void end_motion(gripper &g)
+{
+    // Samples taken before or during the motion are outdated now
+    g.state.store(gripper_state());
+
+    {
+        std::lock_guard<std::mutex> lock(g.motion_lock);
+        g.in_motion = false;
+    }
+    g.motion_done.notify_all();
+}
+
+/** \brief Returns as soon as the axis is idle after a motion, so the next command is accepted */
+void wait_until_idle(void *arg)
+{
+    gripper &g = *static_cast<gripper *>(arg);
+    if (g.hw_revision == 2) {
+        ros::Duration(0.1).sleep(); // A small delay to fix the problem with hw-rev. 2 grippers
+        return;
+    }
+
+    // The final response may arrive slightly before the state flags are updated
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(IDLE_TIMEOUT_MS);
+    unsigned int flags;
+    while (getSystemStateFlags(&flags) == 0 && (flags & SF_MOVING)) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            ROS_DEBUG("Axis still reported moving %d ms after the motion command finished", IDLE_TIMEOUT_MS);
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_POLL_MS));
+    }
+}
+
+/** \brief Expected duration in s of a motion over distance mm: a trapezoidal speed profile with the
+ *  acceleration set, plus the response time measured for the command on the gripper's connection.
+ *  0 if it cannot be told. */
+double expected_motion_time(gripper &g, unsigned char id, float distance, float speed)
+{
+    if (speed <= 0.0 || std::isnan(distance))
+        return 0.0;
+
+    double v = std::min(speed, 420.0f);
+    double a = getAcceleration(); // From the settings cache, as a rule
+    if (a <= 0.0)
+        a = 100.0; // Lowest acceleration of the gripper
+    double d = fabs(distance);
+    double t = d > v * v / a ? d / v + v / a : 2.0 * sqrt(d / a);
+
+    return t + metrics_rtt_timeout_ms(g.conn->link.metrics, id, 1, 1000) / 1000.0;
+}
+
+/** \brief Sleeps until the final response of a motion control command arrives (or timeout_commands
+ *  expires). Stop requests are served by another spinner thread meanwhile.
+ *  Once the motion takes motion_timeout_factor times the expected time plus motion_timeout_margin,
+ *  it is only waited for while the fingers keep moving; a stalled motion, e.g. a grasp that never
+ *  reaches its force, is stopped and ends with E_TIMEOUT.
+ *  \param expected Expected duration in s, see expected_motion_time(); 0: unknown */
+int wait_for_motion(gripper &g, unsigned char id, status_t *status, const char *pending_info, double expected = 0.0)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration<double>(timeout_commands);
+    auto check = deadline;
+    float last_pos = NAN;
+    int msg_available = 0; // 0 when no msg available, 1 when msg is available and correct, -1 on error
+
+    // Without a start position, stalls are not detected
+    if (g.motion_timeout_factor > 0.0 && expected > 0.0)
+        last_pos = current_opening(g);
+    if (!std::isnan(last_pos))
+        check = std::min(deadline, start + std::chrono::duration<double>(expected * g.motion_timeout_factor + g.motion_timeout_margin));
+
+    do {
+        auto now = std::chrono::steady_clock::now();
+        // After timeout_commands, give up; the service reports the failure
+        if (now >= deadline) {
+            ROS_ERROR("No final response to command 0x%02X within %.0f s", id, timeout_commands);
+            return -1;
+        }
+
+        if (now >= check) {
+            float pos = current_opening(g);
+            if (!std::isnan(pos) && fabs(pos - last_pos) < STALL_MIN_TRAVEL) {
+                ROS_ERROR("Command 0x%02X stalled at %.1f mm: no final response after %.2f s (expected %.2f s), stopping",
+                          id, pos, std::chrono::duration<double>(now - start).count(), expected);
+                // The response to the stop, and the one of the motion, are received by the dispatcher;
+                // a late one is flushed before the next command with its ID
+                stop(true);
+                *status = E_TIMEOUT;
+                return 1;
+            }
+            // Slower than expected, but still moving
+            if (!std::isnan(pos))
+                last_pos = pos;
+            check = std::min(deadline, now + std::chrono::duration<double>(std::max(g.motion_timeout_margin, 0.1)));
+        }
+
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(check - now).count();
+        msg_available = recv_ack_wait(id, status, std::max(remaining, 1));
+        if (msg_available == 1 && *status == E_CMD_PENDING) ROS_INFO("%s", pending_info);
     }
+    while (msg_available == 0 || (msg_available == 1 && *status == E_CMD_PENDING));
+
+    return msg_available;
+}
+
+bool moveSrv(gripper &g, wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
 
-    if (req.width < 0.0 || req.width > g_size) {
-        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g_size);
+    if (req.width < 0.0 || req.width > g.size) {
+        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
         res.error = E_RANGE_ERROR;
         return false;
     }
@@ -158,40 +540,29 @@ bool moveSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res
         ROS_WARN("Speed values are outside the gripper's physical limits ([0.1 - 420.0])  Using clamped values.");
     }
 
-    // Moving asnchronously while spinning to check for stop command
-    if (move_async(req.width, req.speed, false) == 0) {
-        in_motion = true;
-        last_cmd_id = 0x21;
+    if (!begin_motion(g, 0x21)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
 
+    // Moving asnchronously, stopSrv() may abort the motion meanwhile
+    float start = current_opening(g);
+    if (move_async(req.width, req.speed, false) == 0) {
         status_t status;
-        int msg_available = 0; // 0 when no msg available, 1 when msg is available and correct, -1 on error
-
-        ros::Time begin = ros::Time::now();
-        do {
-
-            msg_available = recv_ack(0x21, &status);
-            if (msg_available == 1 && status == E_CMD_PENDING) ROS_INFO("Moving to %f position at %f mm/s.", req.width, req.speed);
-            ros::spinOnce();
-
-            if (stop_called) {
-                res.error = E_CMD_ABORTED;
-                stop_called = false;
-                in_motion = false;
-                return true;
-            }
+        char info[128];
+        snprintf(info, sizeof(info), "Moving to %f position at %f mm/s.", req.width, req.speed);
 
-            // After 10 seconds, exit
-            if ((ros::Time::now() - begin).toSec() > timeout_commands){
-                //close( conn.sock );
-                quit("Failed to read data from TCP socket");
-            }
+        int msg_available = wait_for_motion(g, 0x21, &status, info, expected_motion_time(g, 0x21, req.width - start, req.speed));
 
+        if (g.stop_called) {
+            res.error = E_CMD_ABORTED;
+            end_motion(g);
+            return true;
         }
-        while (msg_available == 0 || (msg_available == 1 && status == E_CMD_PENDING));
 
-        ros::Duration(0.1).sleep(); // A small delay to fix the problem with hw-rev. 2 grippers
+        wait_until_idle(&g);
 
-        in_motion = false;
+        end_motion(g);
 
         res.error = msg_available == -1? 255 : status;
         if (res.error == 0) {
@@ -200,21 +571,16 @@ bool moveSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res
             ROS_ERROR("Failed while moving : %s", status_to_str(status));
         }
     }else {
+        end_motion(g);
         res.error = 255;
     }
 
     return true;
 }
 
-bool graspSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res){
-    if (in_motion){
-        ROS_WARN("Another Motion Control service is already running. Try again later!");
-        res.error = E_ALREADY_RUNNING;
-        return true;
-    }
-
-    if (req.width < 0.0 || req.width > g_size) {
-        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g_size);
+bool graspSrv(gripper &g, wsg50_common::Move::Request &req, wsg50_common::Move::Response &res){
+    if (req.width < 0.0 || req.width > g.size) {
+        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
         res.error = E_RANGE_ERROR;
         return false;
     }
@@ -223,53 +589,47 @@ bool graspSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &re
         ROS_WARN("Speed values are outside the gripper's physical limits ([0.1 - 420.0])  Using clamped values.");
     }
 
-    // Moving asnchronously while spinning to check for stop command
-    if (grasp_async(req.width, req.speed) == 0) {        
-        in_motion = true;
-        last_cmd_id = 0x25;
+    if (!begin_motion(g, 0x25)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
 
+    // Grasping asnchronously, stopSrv() may abort the motion meanwhile
+    float start = current_opening(g);
+    if (grasp_async(req.width, req.speed) == 0) {
         status_t status;
-        int msg_available = 0; // 0 when no msg available, 1 when msg is available and correct, -1 on error
-
-        ros::Time begin = ros::Time::now();
-        do {
-            msg_available = recv_ack(0x25, &status);
-            if (msg_available == 1 && status == E_CMD_PENDING) ROS_INFO("Grasping object at %f with %f mm/s.", req.width, req.speed);
-            ros::spinOnce();
-            if (stop_called) {
-                res.error = E_CMD_ABORTED;
-                stop_called = false;
-                in_motion = false;
-                return true;
-            }
-            // After 10 seconds, exit
-            if ((ros::Time::now() - begin).toSec() > timeout_commands){
-                //close( conn.sock );
-                quit("Failed to read data from TCP socket");
-            }
+        char info[128];
+        snprintf(info, sizeof(info), "Grasping object at %f with %f mm/s.", req.width, req.speed);
+
+        int msg_available = wait_for_motion(g, 0x25, &status, info, expected_motion_time(g, 0x25, req.width - start, req.speed));
+
+        if (g.stop_called) {
+            res.error = E_CMD_ABORTED;
+            end_motion(g);
+            return true;
         }
-        while (msg_available == 0 || (msg_available == 1 && status == E_CMD_PENDING));
 
-        ros::Duration(0.1).sleep(); // A small delay to fix the problem with hw-rev. 2 grippers
+        wait_until_idle(&g);
 
-        in_motion = false;
+        end_motion(g);
 
         res.error = msg_available == -1? 255 : status;
         if (res.error == 0) {
             ROS_INFO("Object grasped correctly.");
-            objectGraspped=true;
+            g.objectGraspped=true;
         } else {
             ROS_ERROR("Failed while grasping object : %s", status_to_str(status));
         }
     }else {
+        end_motion(g);
         res.error = 255;
     }
 
     return true;
 }
 
-bool incrementSrv(wsg50_common::Incr::Request &req, wsg50_common::Incr::Response &res) {
-    if (in_motion){
+bool incrementSrv(gripper &g, wsg50_common::Incr::Request &req, wsg50_common::Incr::Response &res) {
+    if (g.in_motion){
         ROS_WARN("Another Motion Control service is already running. Try again later!");
         res.error = E_ALREADY_RUNNING;
         return true;
@@ -277,51 +637,47 @@ bool incrementSrv(wsg50_common::Incr::Request &req, wsg50_common::Incr::Response
 
     float currentWidth, nextWidth, speed; 
     if (req.direction == "open") {  
-        currentWidth = getOpening();
+        currentWidth = current_opening(g);
         nextWidth = currentWidth + req.increment;
-        nextWidth = nextWidth >= g_size? g_size : nextWidth;
-        speed = nextWidth >= g_size? 1 : 20;
+        nextWidth = nextWidth >= g.size? g.size : nextWidth;
+        speed = nextWidth >= g.size? 1 : 20;
     }
     else if (req.direction == "close") {
-        currentWidth = getOpening();  
+        currentWidth = current_opening(g);
         nextWidth = currentWidth - req.increment;
         nextWidth = nextWidth <= GRIPPER_MIN_OPEN? GRIPPER_MIN_OPEN : nextWidth;
         speed = nextWidth <= GRIPPER_MIN_OPEN? 1 : 20;
     }
 
+    if ((req.direction == "open" || req.direction == "close") && std::isnan(currentWidth)) {
+        ROS_WARN("Opening width not known yet. Try again later!");
+        res.error = E_NOT_AVAILABLE;
+        return true;
+    }
+
     if (req.direction == "open" || req.direction == "close") {
-        // Incremental moving asnchronously while spinning to check for stop command
+        if (!begin_motion(g, 0x21)) {
+            res.error = E_ALREADY_RUNNING;
+            return true;
+        }
+
+        // Incremental moving asnchronously, stopSrv() may abort the motion meanwhile
         if (move_async(nextWidth, speed, true) == 0) {   
-            in_motion = true;
-            last_cmd_id = 0x21;
+            status_t status;
+            char info[160];
+            snprintf(info, sizeof(info), "Incremental %sing of %f mm - CurrWidth: %f - NxtWidth: %f", req.direction.c_str(), req.increment, currentWidth, nextWidth);
 
+            int msg_available = wait_for_motion(g, 0x21, &status, info, expected_motion_time(g, 0x21, nextWidth - currentWidth, speed));
 
-            status_t status;
-            int msg_available = 0; // 0 when no msg available, 1 when msg is available and correct, -1 on error
-            ros::Time begin = ros::Time::now();
-            do {
-                msg_available = recv_ack(0x21, &status);
-                if (msg_available == 1 && status == E_CMD_PENDING) {
-                    ROS_INFO("Incremental %sing of %f mm - CurrWidth: %f - NxtWidth: %f", req.direction.c_str(), req.increment, currentWidth, nextWidth);            
-                }
-                ros::spinOnce();
-                if (stop_called) {
-                    res.error = E_CMD_ABORTED;
-                    stop_called = false;
-                    in_motion = false;
-                    return true;
-                }
-                // After 10 seconds, exit
-                if ((ros::Time::now() - begin).toSec() > timeout_commands){
-                    //close( conn.sock );
-                    quit("Failed to read data from TCP socket");
-                }
+            if (g.stop_called) {
+                res.error = E_CMD_ABORTED;
+                end_motion(g);
+                return true;
             }
-            while (msg_available == 0 || (msg_available == 1 && status == E_CMD_PENDING));
 
-            ros::Duration(0.1).sleep(); // A small delay to fix the problem with hw-rev. 2 grippers
+            wait_until_idle(&g);
 
-            in_motion = false;
+            end_motion(g);
 
             res.error = msg_available == -1? 255 : status;
             if (res.error == 0) {
@@ -331,6 +687,7 @@ bool incrementSrv(wsg50_common::Incr::Request &req, wsg50_common::Incr::Response
             }
         }
         else {
+            end_motion(g);
             res.error = 255;
         }
     }
@@ -338,15 +695,9 @@ bool incrementSrv(wsg50_common::Incr::Request &req, wsg50_common::Incr::Response
     return true;
 }
 
-bool releaseSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
-    if (in_motion){
-        ROS_WARN("Another Motion Control service is already running. Try again later!");
-        res.error = E_ALREADY_RUNNING;
-        return true;
-    }
-
-    if (req.width < 0.0 || req.width > g_size) {
-        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g_size);
+bool releaseSrv(gripper &g, wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
+    if (req.width < 0.0 || req.width > g.size) {
+        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
         res.error = E_RANGE_ERROR;
         return false;
     }
@@ -355,76 +706,58 @@ bool releaseSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &
         ROS_WARN("Speed values are outside the gripper's physical limits ([0.1 - 420.0])  Using clamped values.");
     }
 
-    // Releasing asnchronously while spinning to check for stop command
-    if (release_async(req.width, req.speed) == 0) {
-        in_motion = true;
-        last_cmd_id = 0x26;
+    if (!begin_motion(g, 0x26)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
 
+    // Releasing asnchronously, stopSrv() may abort the motion meanwhile
+    float start = current_opening(g);
+    if (release_async(req.width, req.speed) == 0) {
         status_t status;
-        int msg_available = 0; // 0 when no msg available, 1 when msg is available and correct, -1 on error
-        ros::Time begin = ros::Time::now();
-        do {
-            msg_available = recv_ack(0x26, &status);
-            if (msg_available == 1 && status == E_CMD_PENDING) ROS_INFO("Releasing to %f position at %f mm/s.", req.width, req.speed);
-            ros::spinOnce();
-            if (stop_called) {
-                res.error = E_CMD_ABORTED;
-                stop_called = false;
-                in_motion = false;
-                return true;
-            }
-            // After 10 seconds, exit
-            if ((ros::Time::now() - begin).toSec() > timeout_commands){
-                //close( conn.sock );
-                quit("Failed to read data from TCP socket");
-            }
+        char info[128];
+        snprintf(info, sizeof(info), "Releasing to %f position at %f mm/s.", req.width, req.speed);
+
+        // Whether the width is the opening or the distance to open, the fingers travel at most this far
+        float distance = std::max(req.width, fabsf(req.width - start));
+        int msg_available = wait_for_motion(g, 0x26, &status, info, expected_motion_time(g, 0x26, distance, req.speed));
+
+        if (g.stop_called) {
+            res.error = E_CMD_ABORTED;
+            end_motion(g);
+            return true;
         }
-        while (msg_available == 0 || (msg_available == 1 && status == E_CMD_PENDING));
 
-        ros::Duration(0.1).sleep(); // A small delay to fix the problem with hw-rev. 2 grippers
+        wait_until_idle(&g);
 
-        in_motion = false;
+        end_motion(g);
 
         res.error = msg_available == -1? 255 : status;
         if (res.error == 0) {
-            objectGraspped = false;
+            g.objectGraspped = false;
             ROS_INFO("Object released correctly.");
         } else {
             ROS_ERROR("Failed to release object : %s", status_to_str(status));
         }
     }else {
+        end_motion(g);
         res.error = 255;
     }
     return true;
 }
 
-bool homingSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
-    if (in_motion){
-        ROS_WARN("Another Motion Control service is already running. Try again later!");
+bool homingSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
+    if (!begin_motion(g, 0x20))
         return false;
-    }
 
-    // Homing asnchronously while spinning to check for stop command
+    // Homing asnchronously, stopSrv() may abort the motion meanwhile
     if (homing_async() == 0) {
-        in_motion = true;
-        last_cmd_id = 0x20;
         status_t status;
-        int msg_available = 0; // 0 when no msg available, 1 when msg is available and correct, -1 on error
-        ros::Time begin = ros::Time::now();
-        do {
-            msg_available = recv_ack(0x20, &status);
-            if (msg_available == 1 && status == E_CMD_PENDING) ROS_INFO("Homing...");
-            // After 10 seconds, exit
-            if ((ros::Time::now() - begin).toSec() > timeout_commands){
-                //close( conn.sock );
-                quit("Failed to read data from TCP socket");
-            }
-        }
-        while (msg_available == 0 || (msg_available == 1 && status == E_CMD_PENDING));
+        int msg_available = wait_for_motion(g, 0x20, &status, "Homing...");
 
-        ros::Duration(0.1).sleep(); // A small delay to fix the problem with hw-rev. 2 grippers
+        wait_until_idle(&g);
 
-        in_motion = false;
+        end_motion(g);
 
         if (msg_available == -1) return false;
 
@@ -434,22 +767,77 @@ bool homingSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
             ROS_ERROR("Failed to reach home position : %s", status_to_str(status));
             return false;
         }
+    } else {
+        end_motion(g);
+    }
+
+    return true;
+}
+
+bool executeSequenceSrv(gripper &g, wsg50_common::ExecuteSequence::Request &req, wsg50_common::ExecuteSequence::Response &res) {
+    res.completed = 0;
+
+    if (req.primitives.size() > SEQUENCE_MAX_STEPS) {
+        ROS_ERROR("Sequence too long (%d primitives, max. %d)", (int)req.primitives.size(), SEQUENCE_MAX_STEPS);
+        res.error = E_RANGE_ERROR;
+        return false;
+    }
+
+    std::vector<sequence_step> steps(req.primitives.size());
+    for (size_t i = 0; i < steps.size(); i++) {
+        const wsg50_common::Primitive &p = req.primitives[i];
+        if (p.type > wsg50_common::Primitive::HOMING) {
+            ROS_ERROR("Unknown primitive type %d at index %d", p.type, (int)i);
+            res.error = E_CMD_FORMAT_ERROR;
+            return false;
+        }
+        if ((p.type == wsg50_common::Primitive::MOVE || p.type == wsg50_common::Primitive::GRASP ||
+             p.type == wsg50_common::Primitive::RELEASE) && (p.width < 0.0 || p.width > g.size)) {
+            ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
+            res.error = E_RANGE_ERROR;
+            return false;
+        }
+        steps[i].type = (sequence_type_t)p.type;
+        steps[i].width = p.width;
+        steps[i].speed = p.speed;
+        steps[i].val = p.val;
+    }
+
+    if (!begin_motion(g, 0)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
+
+    ROS_INFO("Executing sequence of %d primitives", (int)steps.size());
+    status_t status;
+    int done = execute_sequence(steps.data(), steps.size(), &status, &g.stop_called, wait_until_idle, &g);
+
+    if (g.stop_called)
+        status = E_CMD_ABORTED;
+    end_motion(g);
+
+    res.completed = done < 0 ? 0 : done;
+    res.error = done < 0 ? 255 : status;
+    if (res.error == 0) {
+        ROS_INFO("Sequence done");
+    } else {
+        ROS_ERROR("Sequence failed after %d primitives : %s", (int)res.completed, status_to_str(status));
     }
 
     return true;
 }
 
-bool stopSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
+bool stopSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
     ROS_WARN("Stop!");
 
-    if (in_motion) {
-        status_t status;
+    if (g.in_motion) {
+        g.stop_called = true; // this will abort the last motion control service once its command returns
         // In practice, if a homing command was running, the gripper will not send response of the stop message immediately
         // & hence response should be ignored
-        stop(last_cmd_id == 0x20); 
+        stop(g.last_cmd_id == 0x20);
         ROS_WARN("Waiting for the last motion control command");
-        while (recv_ack(last_cmd_id, &status) == 0);
-        stop_called = true; // this will abort the last motion control service once stop returns 
+        std::unique_lock<std::mutex> lock(g.motion_lock);
+        g.motion_done.wait_for(lock, std::chrono::duration<double>(timeout_commands), [&g] { return !g.in_motion; });
     }
     else {
         stop();
@@ -459,6 +847,25 @@ bool stopSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
     return true;
 }
 
+/** \brief Stops the gripper right away; motion commands fail until the fast stop is acknowledged with the ack service */
+bool fastStopSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
+    ROS_WARN("Fast stop!");
+
+    if (g.in_motion)
+        g.stop_called = true;
+    if (fast_stop() != 0) {
+        ROS_ERROR("Fast stop failed%s", g.label.c_str());
+        return false;
+    }
+    if (g.in_motion) {
+        std::unique_lock<std::mutex> lock(g.motion_lock);
+        g.motion_done.wait_for(lock, std::chrono::duration<double>(timeout_commands), [&g] { return !g.in_motion; });
+    }
+
+    ROS_WARN("Fast stopped, acknowledge with ack to move again.");
+    return true;
+}
+
 // bool stopSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
 //     ROS_WARN("Stop!");
     
@@ -483,58 +890,247 @@ bool stopSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
 // }
 
 
-bool setAccSrv(wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
+bool setAccSrv(gripper &g, wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
 {
     setAcceleration(req.val);
     return true;
 }
 
-bool setForceSrv(wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
+bool setForceSrv(gripper &g, wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
 {
     setGraspingForceLimit(req.val);
     return true;
 }
 
-bool ackSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
+bool ackSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
 {
     ack_fault();
     return true;
 }
 
 /** \brief Callback for goal_position topic (in appropriate modes) */
-void position_cb(const wsg50_common::Cmd::ConstPtr& msg)
+void position_cb(gripper &g, const wsg50_common::Cmd::ConstPtr& msg)
 {
-    g_speed = msg->speed;
-    g_goal_position = msg->pos;
+    cmd_select(g.conn);
+    g.speed = msg->speed;
+
+    if (g.setpoint_rate > 0.0) {
+        // setpoint_loop() sends the latest goal with its next cycle; a trajectory is given up
+        std::lock_guard<std::mutex> lock(g.setpoint_lock);
+        g.goal = setpoint{msg->pos, msg->speed};
+        g.trajectory.clear();
+        return;
+    }
+
+    if (g.script_stream) {
+        // Send command to gripper without waiting for a response
+        // script_stream_cb() handles responses
+        ROS_INFO("Position command: pos=%5.1f, speed=%5.1f", msg->pos, msg->speed);
+        if (script_command_async(1, msg->pos, msg->speed) != 0)
+            ROS_ERROR("Failed to send position command");
+        return;
+    }
+
+    g.goal_position = msg->pos;
     // timer_cb() will send command to gripper
 
-    if (g_mode_periodic) {
+    if (g.mode_periodic) {
         // Send command to gripper without waiting for a response
-        // read_thread() handles responses
-        // read/write may be simultaneous, therefore no mutex
+        // move_response_cb() handles responses
         stop(true);
-        if (move(g_goal_position, g_speed, false, true) != 0)
+        if (move(g.goal_position, g.speed, false, true) != 0)
             ROS_ERROR("Failed to send MOVE command");
     }
 }
 
 /** \brief Callback for goal_speed topic (in appropriate modes) */
-void speed_cb(const std_msgs::Float32::ConstPtr& msg)
+void speed_cb(gripper &g, const std_msgs::Float32::ConstPtr& msg)
 {
-    g_goal_speed = msg->data;
-    g_speed = msg->data;
+    cmd_select(g.conn);
+    g.speed = msg->data;
+
+    if (g.script_stream) {
+        ROS_INFO("Velocity command: speed=%5.1f", msg->data);
+        if (script_command_async(2, 0, msg->data) != 0)
+            ROS_ERROR("Failed to send velocity command");
+        return;
+    }
+
+    g.goal_speed = msg->data;
     // timer_cb() will send command to gripper
 }
 
+/** \brief Callback for goal_trajectory topic: the set-points replace the current goal and are sent
+ *  one after the other by setpoint_loop() */
+void trajectory_cb(gripper &g, const wsg50_common::Trajectory::ConstPtr& msg)
+{
+    if (msg->speed.size() > 1 && msg->speed.size() != msg->pos.size()) {
+        ROS_ERROR("Trajectory ignored%s: %zu speeds for %zu set-points", g.label.c_str(), msg->speed.size(), msg->pos.size());
+        return;
+    }
+    if (msg->pos.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(g.setpoint_lock);
+    g.trajectory.resize(msg->pos.size());
+    for (size_t i = 0; i < msg->pos.size(); i++) {
+        g.trajectory[i].pos = msg->pos[i];
+        g.trajectory[i].speed = msg->speed.empty() ? g.speed : msg->speed.size() == 1 ? msg->speed[0] : msg->speed[i];
+    }
+    g.speed = g.trajectory.back().speed;
+    g.trajectory_period = msg->period > 0.0f ? msg->period : 1.0 / g.setpoint_rate;
+    g.trajectory_start = std::chrono::steady_clock::now();
+}
+
+/** \brief Sends a set-point without waiting for the response */
+bool send_setpoint(gripper &g, const setpoint &sp)
+{
+    // The script follows a new set-point without stopping
+    if (g.script_stream)
+        return script_command_async(SETPOINT_SCRIPT_CMD, sp.pos, sp.speed) == 0;
+
+    // A move command needs the running motion to be stopped; move_response_cb() handles the responses
+    stop(true);
+    return move(sp.pos, sp.speed, false, true) == 0;
+}
+
+/** \brief Set-point thread of a gripper: sends the latest goal, or the point of a trajectory that is
+ *  due, with a fixed rate. Goals that came in meanwhile are dropped, and goals within the deadband
+ *  of the one sent last are not sent at all. */
+void setpoint_loop(gripper &g)
+{
+    cmd_select(g.conn);
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(1.0 / g.setpoint_rate));
+    auto next = std::chrono::steady_clock::now();
+    setpoint sent{NAN, 0.0f};
+
+    std::unique_lock<std::mutex> lock(g.setpoint_lock);
+    for (;;) {
+        // Skip the cycles missed, e.g. while a send blocked
+        next = std::max(next + period, std::chrono::steady_clock::now());
+        if (g.setpoint_wake.wait_until(lock, next, [&g] { return !g.setpoints_running; }))
+            break;
+
+        if (!g.trajectory.empty()) {
+            size_t i = (size_t)(std::chrono::duration<double>(std::chrono::steady_clock::now() - g.trajectory_start).count() / g.trajectory_period);
+            g.goal = g.trajectory[std::min(i, g.trajectory.size() - 1)];
+            if (i >= g.trajectory.size() - 1)
+                g.trajectory.clear();
+        }
+
+        setpoint sp = g.goal;
+        if (std::isnan(sp.pos))
+            continue;
+        if (!std::isnan(sent.pos) && std::fabs(sp.pos - sent.pos) <= g.setpoint_deadband && sp.speed == sent.speed)
+            continue;
+
+        // The supervisor is reconnecting; the goal is sent once the link is back
+        lock.unlock();
+        bool ok = cmd_link_ok() && send_setpoint(g, sp);
+        lock.lock();
+        sent = ok ? sp : setpoint{NAN, 0.0f};
+    }
+}
+
+void start_setpoints(gripper &g)
+{
+    g.setpoints_running = true;
+    g.setpoint_thread = std::thread(setpoint_loop, std::ref(g));
+}
+
+void stop_setpoints(gripper &g)
+{
+    {
+        std::lock_guard<std::mutex> lock(g.setpoint_lock);
+        g.setpoints_running = false;
+    }
+    g.setpoint_wake.notify_all();
+    if (g.setpoint_thread.joinable())
+        g.setpoint_thread.join();
+}
+
+/** \brief Finger thread of a gripper: reads the finger forces with finger_rate and publishes
+ *  them every finger_batch samples. Stops for good if the fingers do not measure forces. */
+void finger_loop(gripper &g)
+{
+    cmd_select(g.conn);
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(1.0 / g.finger_rate));
+    auto next = std::chrono::steady_clock::now();
+    wsg50_common::FingerForce msg;
+    msg.period = 1.0 / g.finger_rate;
+    msg.finger0.reserve(g.finger_batch);
+    msg.finger1.reserve(g.finger_batch);
+
+    std::unique_lock<std::mutex> lock(g.finger_lock);
+    for (;;) {
+        // Skip the cycles missed, so the samples of a message stay equidistant as far as possible
+        next = std::max(next + period, std::chrono::steady_clock::now());
+        if (g.finger_wake.wait_until(lock, next, [&g] { return !g.fingers_running; }))
+            break;
+        lock.unlock();
+
+        float f0, f1;
+        status_t status = E_SUCCESS;
+        if (!cmd_link_ok() || getFingerForces(&f0, &f1, &status) != 0) {
+            if (status == E_NOT_AVAILABLE || status == E_NO_SENSOR || status == E_CMD_UNKNOWN ||
+                status == E_FEATURE_NOT_SUPPORTED || status == E_INDEX_OUT_OF_BOUNDS) {
+                ROS_WARN("Finger forces not available%s (%s), not publishing finger_force", g.label.c_str(), status_to_str(status));
+                lock.lock();
+                break;
+            }
+            // A batch must not have gaps
+            msg.finger0.clear();
+            msg.finger1.clear();
+            lock.lock();
+            continue;
+        }
+
+        msg.finger0.push_back(f0);
+        msg.finger1.push_back(f1);
+        if ((int)msg.finger0.size() >= g.finger_batch) {
+            msg.header.stamp = ros::Time::now();
+            g.pub_finger.publish(msg);
+            msg.finger0.clear();
+            msg.finger1.clear();
+        }
+        lock.lock();
+    }
+}
+
+void start_fingers(gripper &g)
+{
+    g.fingers_running = true;
+    g.finger_thread = std::thread(finger_loop, std::ref(g));
+}
+
+void stop_fingers(gripper &g)
+{
+    {
+        std::lock_guard<std::mutex> lock(g.finger_lock);
+        g.fingers_running = false;
+    }
+    g.finger_wake.notify_all();
+    if (g.finger_thread.joinable())
+        g.finger_thread.join();
+}
+
 /** \brief Loop for state polling in modes script and polling. Also sends command in script mode. */
-void timer_cb(const ros::TimerEvent& ev)
+void timer_cb(gripper &g, const ros::TimerEvent& ev)
 {
+    cmd_select(g.conn);
+
+    // The supervisor is reconnecting
+    if (!cmd_link_ok())
+        return;
+
     // ==== Get state values by built-in commands ====
     gripper_response info;
     info.acceleration = 0.0;
     info.speed = 0.0;
 
-    if (g_mode_polling && !in_motion) {
+    if (g.mode_polling && !g.in_motion) {
         const char * state = systemState();
         if (!state)
             return;
@@ -543,21 +1139,33 @@ void timer_cb(const ros::TimerEvent& ev)
         info.acceleration = getAcceleration();
         info.f_motor = getForce();//getGraspingForce();
 
-    } else if (g_mode_script) {
+    } else if (g.mode_script) {
         // ==== Call custom measure-and-move command ====
         int res = 0;
-        if (!std::isnan(g_goal_position)) {
-            ROS_INFO("Position command: pos=%5.1f, speed=%5.1f", g_goal_position, g_speed);
-            res = script_measure_move(1, g_goal_position, g_speed, info);
-        } else if (!std::isnan(g_goal_speed)) {
-            ROS_INFO("Velocity command: speed=%5.1f", g_goal_speed);
-            res = script_measure_move(2, 0, g_goal_speed, info);
+        if (!std::isnan(g.goal_position)) {
+            ROS_INFO("Position command: pos=%5.1f, speed=%5.1f", g.goal_position, g.speed);
+            res = script_measure_move(1, g.goal_position, g.speed, info);
+        } else if (!std::isnan(g.goal_speed)) {
+            ROS_INFO("Velocity command: speed=%5.1f", g.goal_speed);
+            res = script_measure_move(2, 0, g.goal_speed, info);
+        } else if (g.script_batch > 1) {
+            // Several samples per frame, stamped backwards from the time of reception
+            gripper_response samples[SCRIPT_BATCH_MAX_SAMPLES];
+            int n = script_measure_batch(g.script_batch, g.script_batch_period, samples);
+            ros::Time received = ros::Time::now();
+            for (int i=0; i<n-1; i++) {
+                samples[i].acceleration = 0.0;
+                publish_status_and_joint_states(g, samples[i], received + ros::Duration(samples[i].t));
+            }
+            if (n > 0)
+                info = samples[n-1];
+            res = n;
         } else
             res = script_measure_move(0, 0, 0, info);
-        if (!std::isnan(g_goal_position))
-            g_goal_position = NAN;
-        if (!std::isnan(g_goal_speed))
-            g_goal_speed = NAN;
+        if (!std::isnan(g.goal_position))
+            g.goal_position = NAN;
+        if (!std::isnan(g.goal_speed))
+            g.goal_speed = NAN;
 
         if (!res) {
             ROS_ERROR("Measure-and-move command failed");
@@ -565,316 +1173,1046 @@ void timer_cb(const ros::TimerEvent& ev)
         }
 
         // ==== Moving msg ====
-        if (g_ismoving != info.ismoving) {
-            std_msgs::Bool moving_msg;
-            moving_msg.data = info.ismoving;
-            g_pub_moving.publish(moving_msg);
-            g_ismoving = info.ismoving;
+        if (g.ismoving != info.ismoving) {
+            publish_moving(g, info.ismoving);
+            g.ismoving = info.ismoving;
         }
     } else
         return;
 
-    publish_status_and_joint_states(info);
+    ros::Time stamp = ros::Time::now();
+    update_state(g, info, stamp);
+    publish_status_and_joint_states(g, info, stamp);
 
     // printf("Timer, last duration: %6.1f\n", ev.profile.last_duration.toSec() * 1000.0);
 }
 
-/** \brief Reads gripper responses in auto_update mode. The gripper pushes state messages in regular intervals. */
-void read_thread(int interval_ms)
+/** \brief Time a message arrived at the socket; now if the interface does not tell */
+ros::Time arrival_time(const msg_t *msg)
 {
-    ROS_INFO("Thread started");
+    if (msg->stamp.tv_sec == 0 && msg->stamp.tv_nsec == 0)
+        return ros::Time::now();
+    return ros::Time(msg->stamp.tv_sec, msg->stamp.tv_nsec);
+}
 
-    status_t status;
-    int res;
-    bool pub_state = false;
+/** \brief Hands a state sample to the publisher thread. Called from the dispatcher thread. */
+void queue_state(gripper &g, const gripper_response &info, bool has_state, const msg_t *msg)
+{
+    state_sample s;
+    s.type = SAMPLE_STATE;
+    s.stamp = arrival_time(msg);
+    s.arrived = msg->stamp;
+    update_state(g, info, s.stamp);
+    s.moving = info.ismoving;
+    s.has_state = has_state;
+    s.state = (unsigned char)info.state;
+    s.position = info.position;
+    s.speed = info.speed;
+    s.acceleration = info.acceleration;
+    s.f_motor = info.f_motor;
+    s.f_finger0 = info.f_finger0;
+    s.f_finger1 = info.f_finger1;
+    g.pub_queue.push(s);
+}
+
+/** \brief Hands a change of the motion state to the publisher thread. Called from the dispatcher thread. */
+void queue_moving(gripper &g, bool moving, const msg_t *msg)
+{
+    state_sample s = state_sample();
+    s.type = SAMPLE_MOVING;
+    s.stamp = arrival_time(msg);
+    s.arrived = msg->stamp;
+    s.moving = moving;
+    g.pub_queue.push(s);
+}
+
+/** \brief Publishes a sample taken from the queue */
+void publish_sample(gripper &g, const state_sample &s)
+{
+    if (s.type == SAMPLE_MOVING) {
+        publish_moving(g, s.moving);
+        metrics_publish_latency(g.conn->link.metrics, &s.arrived);
+        return;
+    }
+
+    gripper_response info;
+    info.state = s.state;
+    info.ismoving = s.moving;
+    info.position = s.position;
+    info.speed = s.speed;
+    info.acceleration = s.acceleration;
+    info.f_motor = s.f_motor;
+    info.f_finger0 = s.f_finger0;
+    info.f_finger1 = s.f_finger1;
+    // The text only changes with the state byte
+    int state_byte = s.has_state ? s.state : 0x100;
+    if (state_byte != g.state_text_byte) {
+        unsigned char state[6] = {0, 0, s.state, 0, 0, 0};
+        g.state_text = s.has_state ? getStateValues(state) : "UNKNOWN";
+        g.state_text_byte = state_byte;
+    }
+
+    publish_status_and_joint_states(g, info, s.stamp, &g.state_text);
+    metrics_publish_latency(g.conn->link.metrics, &s.arrived);
+}
+
+/** \brief Publisher thread: drains the queue filled by the dispatcher thread */
+void publish_thread(gripper &g)
+{
+    state_sample s, latest;
+    while (g.publishing) {
+        g.pub_queue.wait();
+
+        bool have_latest = false;
+        while (g.pub_queue.pop(&s)) {
+            if (!g.pub_coalesce || s.type == SAMPLE_MOVING) {
+                publish_sample(g, s);
+                continue;
+            }
+            // Coalesce: motion state changes are kept, state samples replace each other
+            if (have_latest)
+                g.pub_coalesced++;
+            latest = s;
+            have_latest = true;
+        }
+        if (have_latest)
+            publish_sample(g, latest);
+    }
+}
+
+void start_publisher(gripper &g)
+{
+    g.publishing = true;
+    g.pub_thread = std::thread(publish_thread, std::ref(g));
+}
+
+void stop_publisher(gripper &g)
+{
+    g.publishing = false;
+    g.pub_queue.wakeup();
+    if (g.pub_thread.joinable())
+        g.pub_thread.join();
+}
+
+/** \brief Reports samples the publisher thread could not keep up with */
+void check_publisher(gripper &g)
+{
+    unsigned long n = g.pub_queue.overruns();
+    if (n != g.pub_overruns)
+        ROS_WARN("Publisher fell behind%s: %lu samples dropped (%lu in total)", g.label.c_str(), n - g.pub_overruns, n);
+    g.pub_overruns = n;
+    if (g.pub_coalesce)
+        ROS_DEBUG("%lu samples coalesced in total", (unsigned long)g.pub_coalesced);
+}
+
+/** \brief Handles opening/speed/force messages in auto_update mode. The gripper pushes them in regular intervals. */
+void auto_update_cb(const msg_t *msg, void *arg)
+{
+    gripper &g = *static_cast<gripper *>(arg);
+    if (msg->len != 6) {
+        ROS_ERROR("Gripper response failure: too short");
+        return;
+    }
+    if (cmd_get_response_status(msg->data) != E_SUCCESS) {
+        ROS_ERROR("Gripper response failure for opening/speed/force\n");
+        return;
+    }
+
+    float val = convert(&msg->data[2]);
+    switch (msg->id) {
+    /*** Opening ***/
+    case 0x43:
+        g.auto_info.position = val;
+        g.auto_cnt[0]++;
+        // ***** PUBLISH state message & joint message
+        queue_state(g, g.auto_info, false, msg);
+        break;
+
+    /*** Speed ***/
+    case 0x44:
+        g.auto_info.speed = val;
+        g.auto_cnt[1]++;
+        break;
+
+    /*** Force ***/
+    case 0x45:
+        g.auto_info.f_motor = val;
+        g.auto_cnt[2]++;
+        break;
+    }
+}
+
+/** \brief Publishes the motion state from responses to move commands in auto_update mode. */
+void move_response_cb(const msg_t *msg, void *arg)
+{
+    gripper &g = *static_cast<gripper *>(arg);
+    if (msg->len < 2) {
+        ROS_ERROR("Gripper response failure: too short");
+        return;
+    }
 
-    double rate_exp = 1000.0 / (double)interval_ms;
-    std::string names[3] = { "opening", "speed", "force" };
+    // Move commands are sent by position_cb() and the services
+    int motion = -1;
+    status_t status = cmd_get_response_status(msg->data);
+    if (status == E_SUCCESS) {
+        ROS_INFO("Position reached");
+        motion = 0;
+    } else if (status == E_AXIS_BLOCKED) {
+        ROS_INFO("Axis blocked");
+        motion = 0;
+    } else if (status == E_CMD_PENDING) {
+        ROS_INFO("Movement started");
+        motion = 1;
+    } else if (status == E_ALREADY_RUNNING) {
+        ROS_INFO("Movement error: already running");
+    } else if (status == E_CMD_ABORTED) {
+        ROS_INFO("Movement aborted");
+        motion = 0;
+    } else {
+        ROS_INFO("Movement error");
+        motion = 0;
+    }
+
+    // ***** PUBLISH motion message
+    if (motion == 0 || motion == 1) {
+        queue_moving(g, motion, msg);
+        g.ismoving = motion;
+    }
+}
 
-    // Prepare messages
+/** \brief Handles measurements pushed by the script (0xB4) and responses to script commands (0xB1, 0xB2, 0xB5) */
+void script_stream_cb(const msg_t *msg, void *arg)
+{
+    gripper &g = *static_cast<gripper *>(arg);
     gripper_response info;
-    info.state_text = "UNKNOWN";
+    if (!script_stream_decode(msg->data, msg->len, info))
+        return;
+    // The state text is built by the publisher
 
-    // Request automatic updates (error checking is done below)
-    getOpening(interval_ms);
-    getSpeed(interval_ms);
-    getForce(interval_ms);
+    info.acceleration = 0.0;
+    if (msg->id == 0xB4)
+        g.auto_cnt[0]++;
 
+    // ==== Moving msg ====
+    if (g.ismoving != info.ismoving) {
+        queue_moving(g, info.ismoving, msg);
+        g.ismoving = info.ismoving;
+    }
 
-    msg_t msg;
-    msg.id = 0;
-    msg.data = 0;
-    msg.len = 0;
-    int cnt[3] = {0,0,0};
-    auto time_start = std::chrono::system_clock::now();
+    queue_state(g, info, true, msg);
+}
 
+/** \brief Subscribes to the measurements of the script and starts streaming */
+bool start_script_stream(gripper &g, int period_ms)
+{
+    dispatcher_subscribe(0xB1, script_stream_cb, &g);
+    dispatcher_subscribe(0xB2, script_stream_cb, &g);
+    dispatcher_subscribe(0xB4, script_stream_cb, &g);
+    dispatcher_subscribe(0xB0 + SETPOINT_SCRIPT_CMD, script_stream_cb, &g);
 
-    while (g_mode_periodic) {
-        // Receive gripper response
-        msg_free(&msg);
-        res = msg_receive( &msg );
-        if (res < 0 || msg.len < 2) {
-            ROS_ERROR("Gripper response failure: too short");
-            continue;
-        }
+    g.stream_period_ms = period_ms;
+    if (script_stream(period_ms) == 0)
+        return true;
 
-        float val = 0.0;
-        status = cmd_get_response_status(msg.data);
+    dispatcher_unsubscribe(0xB1);
+    dispatcher_unsubscribe(0xB2);
+    dispatcher_unsubscribe(0xB4);
+    dispatcher_unsubscribe(0xB0 + SETPOINT_SCRIPT_CMD);
+    return false;
+}
 
-        // Decode float for opening/speed/force
-        if (msg.id >= 0x43 && msg.id <= 0x45 && msg.len == 6) {
-            if (status != E_SUCCESS) {
-                ROS_ERROR("Gripper response failure for opening/speed/force\n");
-                continue;
-            }
-            val = convert(&msg.data[2]);
-        }
+/** \brief Stops streaming of the script */
+void stop_script_stream(gripper &g)
+{
+    script_stream(0);
 
-        // Handle response types
-        int motion = -1;
-        switch (msg.id) {
-        /*** Opening ***/
-        case 0x43:
-            info.position = val;
-            pub_state = true;
-            cnt[0]++;
-            break;
+    dispatcher_unsubscribe(0xB1);
+    dispatcher_unsubscribe(0xB2);
+    dispatcher_unsubscribe(0xB4);
+    dispatcher_unsubscribe(0xB0 + SETPOINT_SCRIPT_CMD);
+}
 
-        /*** Speed ***/
-        case 0x44:
-            info.speed = val;
-            cnt[1]++;
-            break;
+/** \brief Checks # of received automatic updates regularly */
+void rate_cb(gripper &g, const ros::TimerEvent& ev)
+{
+    static const char *names[3] = { "opening", "speed", "force" };
+    double t = (ev.current_real - ev.last_real).toSec();
+    if (ev.last_real.isZero() || t <= 0.0)
+        t = 5.0;
+
+    std::string info = "Rates for ";
+    for (int i=0; i<3; i++) {
+        double rate_is = (double)g.auto_cnt[i].exchange(0)/t;
+        info += std::string(names[i]) + ": " + std::to_string((int)rate_is) + "Hz, ";
+        if (rate_is == 0.0)
+            ROS_ERROR("Did not receive data for %s%s", names[i], g.label.c_str());
+    }
+    check_publisher(g);
+    ROS_DEBUG_STREAM((info + " expected: " + std::to_string((int)g.auto_rate_exp) + "Hz").c_str());
+}
 
-        /*** Force ***/
-        case 0x45:
-            info.f_motor = val;
-            cnt[2]++;
-            break;
+/** \brief Checks # of received script measurements regularly */
+void script_rate_cb(gripper &g, const ros::TimerEvent& ev)
+{
+    double t = (ev.current_real - ev.last_real).toSec();
+    if (ev.last_real.isZero() || t <= 0.0)
+        t = 5.0;
+
+    double rate_is = (double)g.auto_cnt[0].exchange(0)/t;
+    if (rate_is == 0.0)
+        ROS_ERROR("Did not receive measurements from the script%s", g.label.c_str());
+    check_publisher(g);
+    ROS_DEBUG_STREAM(("Rate of script measurements: " + std::to_string((int)rate_is) + "Hz, expected: " + std::to_string((int)g.auto_rate_exp) + "Hz").c_str());
+}
 
-        /*** Move ***/
-        // Move commands are sent from outside this thread
-        case 0x21:
-            if (status == E_SUCCESS) {
-                ROS_INFO("Position reached");
-                motion = 0;
-            } else if (status == E_AXIS_BLOCKED) {
-                ROS_INFO("Axis blocked");
-                motion = 0;
-            } else if (status == E_CMD_PENDING) {
-                ROS_INFO("Movement started");
-                motion = 1;
-            } else if (status == E_ALREADY_RUNNING) {
-                ROS_INFO("Movement error: already running");
-            } else if (status == E_CMD_ABORTED) {
-                ROS_INFO("Movement aborted");
-                motion = 0;
-            } else {
-                ROS_INFO("Movement error");
-                motion = 0;
-            }
-            break;
+/** \brief Adds a latency summary to a diagnostic status */
+void add_summary(diagnostic_msgs::DiagnosticStatus &status, const std::string &name, const metrics_summary_t &sum)
+{
+    char buf[128];
+    diagnostic_msgs::KeyValue kv;
+    kv.key = name;
+    snprintf(buf, sizeof(buf), "n=%lu mean=%.0f p50=%lu p90=%lu p99=%lu max=%lu us",
+             sum.count, sum.mean_us, sum.p50_us, sum.p90_us, sum.p99_us, sum.max_us);
+    kv.value = buf;
+    status.values.push_back(kv);
+}
 
-        /*** Stop ***/
-        // Stop commands are sent from outside this thread
-        case 0x22:
-            // Stop command; nothing to do
-            break;
-        default:
-            ROS_INFO("Received unknown respone 0x%02x (%2dB)\n", msg.id, msg.len);
+/** \brief Builds the diagnostic status of the command path of a gripper */
+diagnostic_msgs::DiagnosticStatus command_path_status(gripper &g, double t)
+{
+    const metrics_t *m = g.conn->link.metrics;
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = ros::this_node::getName() + ": command path" + g.label;
+    status.hardware_id = g.name.empty() ? "wsg50" : "wsg50/" + g.name;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "OK";
+
+    diagnostic_msgs::KeyValue kv;
+    metrics_summary_t sum;
+    char name[32];
+    for (int id=0; id<256; id++) {
+        if (metrics_rtt_summary(m, id, &sum)) {
+            snprintf(name, sizeof(name), "rtt 0x%02X", id);
+            add_summary(status, name, sum);
         }
 
-        // ***** PUBLISH motion message
-        if (motion == 0 || motion == 1) {
-            std_msgs::Bool moving_msg;
-            moving_msg.data = motion;
-            g_pub_moving.publish(moving_msg);
-            g_ismoving = motion;
+        unsigned long frames = metrics_frames(m, id);
+        if (frames != g.frames_last[id]) {
+            snprintf(name, sizeof(name), "rate 0x%02X", id);
+            kv.key = name;
+            kv.value = std::to_string((int)((frames - g.frames_last[id]) / t)) + " Hz";
+            status.values.push_back(kv);
+            g.frames_last[id] = frames;
         }
 
-        // ***** PUBLISH state message & joint message
-        if (pub_state) {
-            pub_state = false;
-            publish_status_and_joint_states(info);
-        }
-
-        // Check # of received messages regularly
-        std::chrono::duration<float> t = std::chrono::system_clock::now() - time_start;
-        double t_ = t.count();
-        if (t_ > 5.0) {
-            time_start = std::chrono::system_clock::now();
-            //printf("Infos for %5.1fHz, %5.1fHz, %5.1fHz\n", (double)cnt[0]/t_, (double)cnt[1]/t_, (double)cnt[2]/t_);
-
-            std::string info = "Rates for ";
-            for (int i=0; i<3; i++) {
-                double rate_is = (double)cnt[i]/t_;
-                info += names[i] + ": " + std::to_string((int)rate_is) + "Hz, ";
-                if (rate_is == 0.0)
-                    ROS_ERROR("Did not receive data for %s", names[i].c_str());
-            }
-            ROS_DEBUG_STREAM((info + " expected: " + std::to_string((int)rate_exp) + "Hz").c_str());
-            cnt[0] = 0;
-            cnt[1] = 0;
-            cnt[2] = 0;
+        if (metrics_drops(m, id)) {
+            snprintf(name, sizeof(name), "dropped 0x%02X", id);
+            kv.key = name;
+            kv.value = std::to_string(metrics_drops(m, id));
+            status.values.push_back(kv);
+        }
+    }
+
+    if (metrics_publish_summary(m, &sum))
+        add_summary(status, "receive to publish", sum);
+    if (metrics_urgent_summary(m, &sum)) {
+        add_summary(status, "stop to wire", sum);
+        if (sum.p99_us > STOP_TO_WIRE_LIMIT_US) {
+            status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            status.message = "Stops are slow";
         }
+    }
 
+    kv.key = "checksum errors";
+    kv.value = std::to_string(metrics_crc_errors(m));
+    status.values.push_back(kv);
+    kv.key = "resync bytes";
+    kv.value = std::to_string(metrics_resync_bytes(m));
+    status.values.push_back(kv);
+    unsigned long overruns = g.pub_queue.overruns();
+    kv.key = "publisher overruns";
+    kv.value = std::to_string(overruns);
+    status.values.push_back(kv);
+
+    if (metrics_crc_errors(m) > 0 || overruns > 0) {
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = "Frames lost";
+    }
 
+    return status;
+}
+
+/** \brief Publishes the metrics of the command path of every gripper on the diagnostics topic and to
+ *  the metrics file */
+void metrics_cb(const ros::TimerEvent& ev)
+{
+    double t = (ev.current_real - ev.last_real).toSec();
+    if (ev.last_real.isZero() || t <= 0.0)
+        t = METRICS_PERIOD;
+
+    diagnostic_msgs::DiagnosticArray diag;
+    diag.header.stamp = ros::Time::now();
+    std::vector<const metrics_t *> metrics;
+    std::vector<const char *> names;
+    for (auto &g : g_grippers) {
+        diag.status.push_back(command_path_status(*g, t));
+        metrics.push_back(g->conn->link.metrics);
+        names.push_back(g->name.c_str());
     }
+    g_pub_diagnostics.publish(diag);
+
+    if (!g_metrics_file.empty())
+        metrics_write_prometheus(g_metrics_file.c_str(), metrics.data(), names.data(), metrics.size());
+}
+
+/** \brief Requests the automatic updates from the gripper */
+void request_auto_update(int interval_ms)
+{
+    setAutoUpdate(interval_ms);
+}
+
+/** \brief Subscribes to the automatic updates and requests them from the gripper */
+void start_auto_update(gripper &g, int interval_ms)
+{
+    g.auto_info.state_text = "UNKNOWN";
+    g.auto_rate_exp = 1000.0 / (double)interval_ms;
+    g.auto_interval_ms = interval_ms;
+    for (int i=0; i<3; i++)
+        g.auto_cnt[i] = 0;
+
+    dispatcher_subscribe(0x43, auto_update_cb, &g);
+    dispatcher_subscribe(0x44, auto_update_cb, &g);
+    dispatcher_subscribe(0x45, auto_update_cb, &g);
+    dispatcher_subscribe(0x21, move_response_cb, &g);
+
+    request_auto_update(interval_ms);
+}
 
-    // Disable automatic updates
-    // TODO: The functions will receive an unexpected response
-    getOpening(0);
-    getSpeed(0);
-    getForce(0);
+/** \brief Disables the automatic updates */
+void stop_auto_update(gripper &g)
+{
+    request_auto_update(0);
 
-    ROS_INFO("Thread ended");
+    dispatcher_unsubscribe(0x43);
+    dispatcher_unsubscribe(0x44);
+    dispatcher_unsubscribe(0x45);
+    dispatcher_unsubscribe(0x21);
 }
 
 void sigint_handler(int sig) {
     ROS_INFO("Exiting...");
-    g_mode_periodic = false;
-    g_mode_script = false;
-    g_mode_polling = false;
+    for (auto &g : g_grippers) {
+        g->mode_periodic = false;
+        g->mode_script = false;
+        g->mode_polling = false;
+    }
     ros::shutdown();
 }
 
+/** \brief Reads a parameter of a gripper. Parameters missing in the gripper's
+ *  namespace are taken from the node, so common settings are given only once. */
+template <class T>
+void gripper_param(const gripper &g, const ros::NodeHandle &nh, const std::string &key, T &val, const T &def)
+{
+    if (!g.nh.getParam(key, val))
+        nh.param(key, val, def);
+}
+
+/** \brief Advertises a service of a gripper; the callback talks to the gripper's connection */
+template <class MReq, class MRes>
+void advertise_service(gripper &g, ros::NodeHandle &nh, const std::string &name, bool (*srv)(gripper &, MReq &, MRes &))
+{
+    gripper *gp = &g;
+    boost::function<bool(MReq &, MRes &)> cb = [gp, srv](MReq &req, MRes &res) {
+        cmd_select(gp->conn);
+        return srv(*gp, req, res);
+    };
+    g.services.push_back(nh.advertiseService<MReq, MRes>(name, cb));
+}
+
+/** \brief Splits the grippers parameter, e.g. "left=192.168.1.20, right=192.168.1.21:1000",
+ *  into names and addresses. The address (ip[:port]) is optional. */
+std::vector<std::pair<std::string, std::string>> parse_grippers(const std::string &spec)
+{
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::string::size_type start = 0;
+    while (start < spec.size()) {
+        std::string::size_type end = spec.find(',', start);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string entry = spec.substr(start, end - start);
+        entry.erase(0, entry.find_first_not_of(" \t"));
+        entry.erase(entry.find_last_not_of(" \t") + 1);
+        start = end + 1;
+        if (entry.empty())
+            continue;
+
+        std::string::size_type eq = entry.find('=');
+        if (eq == std::string::npos)
+            entries.push_back(std::make_pair(entry, std::string()));
+        else
+            entries.push_back(std::make_pair(entry.substr(0, eq), entry.substr(eq + 1)));
+    }
+    return entries;
+}
+
+/** \brief Reads the socket options of a TCP connection; unset ones keep the defaults of tcp.c */
+void read_tcp_options(gripper &g, const ros::NodeHandle &nh)
+{
+    tcp_options_t &opt = g.tcp_options;
+    tcp_options_default(&opt);
+
+    double connect_timeout, recv_timeout;
+    gripper_param(g, nh, "tcp_nodelay", opt.nodelay, opt.nodelay);
+    gripper_param(g, nh, "tcp_quickack", opt.quickack, opt.quickack);
+    gripper_param(g, nh, "tcp_rcvbuf", opt.rcvbuf, opt.rcvbuf);
+    gripper_param(g, nh, "tcp_priority", opt.priority, opt.priority);
+    gripper_param(g, nh, "tcp_dscp", opt.dscp, opt.dscp);
+    gripper_param(g, nh, "tcp_busy_poll", opt.busy_poll_us, opt.busy_poll_us);
+    gripper_param(g, nh, "connect_timeout", connect_timeout, opt.connect_timeout_ms / 1000.0);
+    gripper_param(g, nh, "tcp_recv_timeout", recv_timeout, opt.recv_timeout_ms / 1000.0);
+    opt.connect_timeout_ms = connect_timeout > 0.0 ? (unsigned int)(connect_timeout * 1000.0) : 0;
+    opt.recv_timeout_ms = recv_timeout > 0.0 ? (unsigned int)(recv_timeout * 1000.0) : 0;
+
+    if (opt.dscp > 63) {
+        ROS_WARN("tcp_dscp: %d is invalid (0 - 63), not setting it", opt.dscp);
+        opt.dscp = -1;
+    }
+}
+
+/** \brief Reads the line options of a serial connection */
+void read_serial_options(gripper &g, const ros::NodeHandle &nh)
+{
+    serial_options_t &opt = g.serial_options;
+    serial_options_default(&opt);
+
+    int vmin;
+    double vtime, recv_timeout;
+    gripper_param(g, nh, "serial_low_latency", opt.low_latency, opt.low_latency);
+    gripper_param(g, nh, "serial_vmin", vmin, (int)opt.vmin);
+    gripper_param(g, nh, "serial_vtime", vtime, opt.vtime_ms / 1000.0);
+    gripper_param(g, nh, "serial_recv_timeout", recv_timeout, opt.recv_timeout_ms / 1000.0);
+    opt.vtime_ms = vtime > 0.0 ? (unsigned int)(vtime * 1000.0) : 0;
+    opt.recv_timeout_ms = recv_timeout > 0.0 ? (unsigned int)(recv_timeout * 1000.0) : 0;
+
+    if (vmin < 0 || vmin > 255) {
+        ROS_WARN("serial_vmin: %d is invalid (0 - 255), using 0", vmin);
+        vmin = 0;
+    }
+    opt.vmin = (unsigned int)vmin;
+}
+
 /**
- * The main function
+ * \brief Sets up the scheduling of the thread receiving from the grippers and locks the memory
+ *
+ * Must be called before the first gripper connects. What the system does not grant
+ * is reported, and the node runs with the defaults.
  */
+void read_rt_options(const ros::NodeHandle &nh)
+{
+    rt_options_t opt;
+    std::string cpus;
+    int stack_prefault;
+    bool lock_memory;
+
+    rt_options_default(&opt);
+    nh.param("io_priority", opt.priority, 0); // SCHED_FIFO 1 - 99, 0: default scheduling
+    nh.param("io_cpus", cpus, std::string("")); // e.g. "3" or "2-3"
+    nh.param("io_stack_prefault", stack_prefault, 0); // kB
+    nh.param("lock_memory", lock_memory, false);
+
+    if (cpus.size() >= sizeof(opt.cpus))
+        ROS_WARN("io_cpus: %s is too long, not pinning the I/O thread", cpus.c_str());
+    else
+        strcpy(opt.cpus, cpus.c_str());
+    opt.stack_prefault_kb = (unsigned int)std::max(stack_prefault, 0);
+
+    // Also covers everything mapped later, e.g. the stacks of the gripper threads
+    if (lock_memory && rt_lock_memory() < 0)
+        ROS_WARN("lock_memory: not granted, memory may be paged out");
+
+    // The reader thread prints what it was granted when it starts
+    dispatcher_set_thread_options(&opt);
+}
 
-int main( int argc, char **argv )
+/** \brief Connects to a gripper using Serial/TCP/UDP/CAN, or replays a recording, with the parameters read by connect_gripper() */
+bool open_link(gripper &g)
 {
-    ros::init(argc, argv, "wsg50");
-    ros::NodeHandle nh("~");
-    signal(SIGINT, sigint_handler);
-    in_motion = false; 
-    stop_called = false;
+    cmd_select(g.conn);
+    int res_con = -1;
+    if (g.protocol == "serial")
+        res_con = cmd_connect_serial_options(g.serial_port.c_str(), g.serial_baudrate, &g.serial_options);
+    else if (g.protocol == "udp")
+        res_con = cmd_connect_udp(g.local_port, g.ip.c_str(), g.port);
+    else if (g.protocol == "tcp")
+        res_con = cmd_connect_tcp_options(g.ip.c_str(), g.port, &g.tcp_options);
+    else if (g.protocol == "can")
+        res_con = cmd_connect_can(g.can_device.c_str(), g.can_id, g.can_rx_id);
+    else if (g.protocol == "replay")
+        res_con = cmd_connect_replay(g.replay_file.c_str(), g.replay_speed);
+    else
+        ROS_ERROR("UNKNOWN protocol!");
 
-    component_status = nh.advertise<dnb_msgs::ComponentStatus>("component/status", 1, true);
-    dnb_msgs::ComponentStatus cstatus_msg;
-    std::string ip, protocol, com_mode, serial_port;
-    int size, port, local_port, serial_baudrate;
-    double rate, grasping_force;
-    bool use_udp = false;
-
-    nh.param("size", size, 210);
-    nh.param("ip", ip, std::string("192.168.1.20"));
-    nh.param("port", port, 1000);
-    nh.param("local_port", local_port, 1501);
-    nh.param("serial_port", serial_port, std::string("/dev/ttyS1"));
-    nh.param("serial_baudrate", serial_baudrate, 115200);
-    nh.param("protocol", protocol, std::string("serial"));
-    nh.param("com_mode", com_mode, std::string(""));
-    nh.param("rate", rate, 5.0); // With custom script, up to 30Hz are possible
-    nh.param("grasping_force", grasping_force, 0.0);
+    return res_con == 0;
+}
+
+/** \brief Reads the parameters of a gripper and connects to it */
+bool connect_gripper(gripper &g, const ros::NodeHandle &nh, const std::string &address, double &rate, double &grasping_force)
+{
+    std::string com_mode, publish_policy, publish_aggregate;
+    double status_rate, joint_states_rate;
+    int size;
+
+    gripper_param(g, nh, "size", size, 210);
+    gripper_param(g, nh, "ip", g.ip, std::string("192.168.1.20"));
+    gripper_param(g, nh, "port", g.port, 1000);
+    gripper_param(g, nh, "local_port", g.local_port, 1501);
+    gripper_param(g, nh, "serial_port", g.serial_port, std::string("/dev/ttyS1"));
+    gripper_param(g, nh, "serial_baudrate", g.serial_baudrate, 115200);
+    gripper_param(g, nh, "can_device", g.can_device, std::string("can0"));
+    gripper_param(g, nh, "can_id", g.can_id, 0x01);
+    gripper_param(g, nh, "can_rx_id", g.can_rx_id, g.can_id + 1);
+    gripper_param(g, nh, "protocol", g.protocol, std::string("serial"));
+    gripper_param(g, nh, "com_mode", com_mode, std::string(""));
+    gripper_param(g, nh, "rate", rate, 5.0); // With custom script, up to 30Hz are possible
+    gripper_param(g, nh, "grasping_force", grasping_force, 0.0);
+    gripper_param(g, nh, "hardware_revision", g.hw_revision, 3); // 2: fixed delay after each motion instead of checking the system state
+    gripper_param(g, nh, "script_batch", g.script_batch, 0);
+    gripper_param(g, nh, "script_batch_period", g.script_batch_period, 5);
+    gripper_param(g, nh, "setpoint_rate", g.setpoint_rate, 0.0);
+    gripper_param(g, nh, "setpoint_deadband", g.setpoint_deadband, 0.1f);
+    gripper_param(g, nh, "script_stream", g.script_stream, false);
+    gripper_param(g, nh, "finger_rate", g.finger_rate, 0.0);
+    gripper_param(g, nh, "finger_batch", g.finger_batch, 10);
+    gripper_param(g, nh, "publish_policy", publish_policy, std::string("drop_oldest"));
+    gripper_param(g, nh, "status_rate", status_rate, 0.0); // 0: every sample
+    gripper_param(g, nh, "joint_states_rate", joint_states_rate, 0.0);
+    gripper_param(g, nh, "publish_aggregate", publish_aggregate, std::string("last"));
+    gripper_param(g, nh, "status_on_change", g.status_on_change, false);
+    gripper_param(g, nh, "moving_on_change", g.moving_on_change, false);
+    read_tcp_options(g, nh);
+    read_serial_options(g, nh);
+    gripper_param(g, nh, "keepalive_period", g.keepalive_period, 0.25);
+    gripper_param(g, nh, "keepalive_misses", g.keepalive_misses, 3);
+    gripper_param(g, nh, "reconnect_backoff_max", g.reconnect_backoff_max, 5.0);
+    gripper_param(g, nh, "motion_timeout_factor", g.motion_timeout_factor, 2.0);
+    gripper_param(g, nh, "motion_timeout_margin", g.motion_timeout_margin, 0.5);
+    gripper_param(g, nh, "record_file", g.record_file, std::string(""));
+    gripper_param(g, nh, "record_size", g.record_size, 64);
+    gripper_param(g, nh, "replay_file", g.replay_file, std::string(""));
+    gripper_param(g, nh, "replay_speed", g.replay_speed, 1.0); // 0: as fast as possible
+    // Joint names have to differ when several grippers publish on /joint_states
+    gripper_param(g, nh, "joint_name", g.joint_name, g.name.empty() ? std::string("wsg50_finger_left_joint") : g.name + "_wsg50_finger_left_joint");
+
+    g.pub_coalesce = publish_policy == "coalesce";
+    if (!g.pub_coalesce && publish_policy != "drop_oldest")
+        ROS_WARN("Unknown publish_policy %s, using drop_oldest", publish_policy.c_str());
+
+    g.status_out.period = status_rate > 0.0 ? 1.0 / status_rate : 0.0;
+    g.joint_out.period = joint_states_rate > 0.0 ? 1.0 / joint_states_rate : 0.0;
+    if (publish_aggregate == "mean")
+        g.pub_aggregate = AGGREGATE_MEAN;
+    else if (publish_aggregate == "min")
+        g.pub_aggregate = AGGREGATE_MIN;
+    else if (publish_aggregate == "max")
+        g.pub_aggregate = AGGREGATE_MAX;
+    else if (publish_aggregate != "last")
+        ROS_WARN("Unknown publish_aggregate %s, using last", publish_aggregate.c_str());
+
+    // The address given with the gripper's name replaces ip and port
+    if (!address.empty()) {
+        std::string::size_type colon = address.find(':');
+        g.ip = address.substr(0, colon);
+        if (colon != std::string::npos)
+            g.port = atoi(address.c_str() + colon + 1);
+    }
 
     if (size != 210 && size != 110) {
         ROS_WARN("Gripper size: %d is invalid. Using default size of 210 mm.", size);
-        g_size = 210;
+        g.size = 210;
     }
     else {
-        g_size = size;
+        g.size = size;
     }
 
     if (com_mode == "script")
-        g_mode_script = true;
+        g.mode_script = true;
     else if (com_mode == "auto_update")
-        g_mode_periodic = true;
+        g.mode_periodic = true;
     else {
         com_mode = "polling";
-        g_mode_polling = true;
+        g.mode_polling = true;
+    }
+    g.script_stream = g.script_stream && g.mode_script;
+    if (g.finger_rate > 0.0 && g.finger_batch < 1) {
+        ROS_WARN("finger_batch: %d is invalid, publishing every sample", g.finger_batch);
+        g.finger_batch = 1;
+    }
+    if (g.setpoint_rate > 0.0 && !g.mode_periodic && !g.script_stream) {
+        ROS_WARN("setpoint_rate: only used in mode auto_update or with script_stream");
+        g.setpoint_rate = 0.0;
     }
 
-    // Connect to device using Serial/TCP/UDPđ
-    int res_con = -1;
-    if (protocol == "serial") {
-        res_con = cmd_connect_serial(serial_port.c_str(), serial_baudrate);
-        ROS_INFO("Connecting to %s:%d (%s); communication mode: %s ...", serial_port.c_str(), serial_baudrate, protocol.c_str(), com_mode.c_str());
+    if (g.protocol == "serial")
+        ROS_INFO("Connecting%s to %s:%d (%s); communication mode: %s ...", g.label.c_str(), g.serial_port.c_str(), g.serial_baudrate, g.protocol.c_str(), com_mode.c_str());
+    else if (g.protocol == "can")
+        ROS_INFO("Connecting%s to %s, ID 0x%x/0x%x (%s); communication mode: %s ...", g.label.c_str(), g.can_device.c_str(), g.can_id, g.can_rx_id, g.protocol.c_str(), com_mode.c_str());
+    else if (g.protocol == "replay")
+        ROS_INFO("Replaying%s %s; communication mode: %s ...", g.label.c_str(), g.replay_file.c_str(), com_mode.c_str());
+    else
+        ROS_INFO("Connecting%s to %s:%d (%s); communication mode: %s ...", g.label.c_str(), g.ip.c_str(), g.port, g.protocol.c_str(), com_mode.c_str());
+
+    if (!open_link(g))
+        return false;
+
+    // Kept over reconnects, so a recording covers the link loss as well
+    if (!g.record_file.empty() && g.protocol != "replay") {
+        g.recording = recorder_open(&g.recorder, g.record_file.c_str(), (size_t)std::max(g.record_size, 1) << 20) == 0;
+        if (g.recording)
+            msg_set_recorder(&g.conn->link, &g.recorder);
+        else
+            ROS_WARN("Unable to record the link traffic%s to %s", g.label.c_str(), g.record_file.c_str());
     }
-    else if (protocol == "udp") {
-        res_con = cmd_connect_udp(local_port, ip.c_str(), port );
-        ROS_INFO("Connecting to %s:%d (%s); communication mode: %s ...", ip.c_str(), port, protocol.c_str(), com_mode.c_str());
+    return true;
+}
+
+/** \brief Starts receiving from a connected gripper and advertises its topics and services */
+void setup_gripper(gripper &g)
+{
+    cmd_select(g.conn);
+    ROS_INFO("Gripper connection established%s", g.label.c_str());
+
+    // Settings may have been changed while we were not connected
+    invalidateSettingsCache();
+
+    // All responses are received by the dispatcher from now on, so services
+    // may be called while automatic updates are streaming in.
+    if (dispatcher_start() != 0)
+        ROS_ERROR("Unable to start the response dispatcher%s", g.label.c_str());
+
+    // Services
+    // Served by their own spinner threads; a motion control service sleeps until the
+    // gripper is done, while stop and the topic/timer callbacks keep being served.
+    ros::NodeHandle nh_srv(g.nh);
+    nh_srv.setCallbackQueue(&g.srv_queue);
+    advertise_service(g, nh_srv, "move", moveSrv);
+    advertise_service(g, nh_srv, "grasp", graspSrv);
+    advertise_service(g, nh_srv, "release", releaseSrv);
+    advertise_service(g, nh_srv, "homing", homingSrv);
+    advertise_service(g, nh_srv, "stop", stopSrv);
+    advertise_service(g, nh_srv, "fast_stop", fastStopSrv);
+    advertise_service(g, nh_srv, "ack", ackSrv);
+    advertise_service(g, nh_srv, "move_incrementally", incrementSrv);
+
+    advertise_service(g, nh_srv, "set_acceleration", setAccSrv);
+    advertise_service(g, nh_srv, "set_force", setForceSrv);
+    advertise_service(g, nh_srv, "execute_sequence", executeSequenceSrv);
+
+    // Topics and timers of the gripper are served by its own spinner thread
+    g.nh.setCallbackQueue(&g.queue);
+
+    // Subscriber
+    if (g.mode_script || g.mode_periodic)
+        g.sub_position = g.nh.subscribe<wsg50_common::Cmd>("goal_position", 5, boost::bind(position_cb, boost::ref(g), _1));
+    if (g.mode_script)
+        g.sub_speed = g.nh.subscribe<std_msgs::Float32>("goal_speed", 5, boost::bind(speed_cb, boost::ref(g), _1));
+    if (g.setpoint_rate > 0.0)
+        g.sub_trajectory = g.nh.subscribe<wsg50_common::Trajectory>("goal_trajectory", 5, boost::bind(trajectory_cb, boost::ref(g), _1));
+
+    // Publisher
+    g.pub_state = g.nh.advertise<wsg50_common::Status>("status", 1000);
+    g.pub_joint = g.nh.advertise<sensor_msgs::JointState>("/joint_states", 10);
+
+    if (g.mode_script || g.mode_periodic)
+        g.pub_moving = g.nh.advertise<std_msgs::Bool>("moving", 10);
+    if (g.finger_rate > 0.0)
+        g.pub_finger = g.nh.advertise<wsg50_common::FingerForce>("finger_force", 100);
+    init_messages(g);
+}
+
+/** \brief Acknowledges faults and homes a gripper. Runs in a thread of its own for each gripper. */
+void init_gripper(gripper &g, double grasping_force)
+{
+    cmd_select(g.conn);
+
+    ack_fault();
+
+    sleep(1);
+
+    ROS_INFO("Ready to use, homing now...%s", g.label.c_str());
+    homing();
+
+    if (grasping_force > 0.0) {
+        ROS_INFO("Setting grasping force limit to %5.1f", grasping_force);
+        setGraspingForceLimit(grasping_force);
     }
-    else if (protocol == "tcp") {
-        res_con = cmd_connect_tcp( ip.c_str(), port );
-        ROS_INFO("Connecting to %s:%d (%s); communication mode: %s ...", ip.c_str(), port, protocol.c_str(), com_mode.c_str());
+}
+
+/** \brief Publishes the component status: running, or which grippers are being reconnected */
+void publish_link_status()
+{
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::string lost;
+    for (auto &g : g_grippers)
+        if (g->link_lost)
+            lost += g->label;
+
+    dnb_msgs::ComponentStatus cstatus_msg;
+    if (lost.empty()) {
+        cstatus_msg.status_id = 2;
+        cstatus_msg.status_msg = g_grippers.size() > 1 ? "WSG50 grippers were homed and are running." : "WSG50 was homed and is running.";
+    } else {
+        cstatus_msg.status_id = 4;
+        cstatus_msg.status_msg = "Connection lost" + lost + ", reconnecting...";
     }
-    else {
-        ROS_ERROR("UNKNOWN protocol!");
+    component_status.publish(cstatus_msg);
+}
+
+/** \brief Sleeps unless the supervisor is stopped meanwhile; returns false if it was */
+bool supervisor_sleep(gripper &g, double seconds)
+{
+    std::unique_lock<std::mutex> lock(g.supervisor_lock);
+    return !g.supervisor_wake.wait_for(lock, std::chrono::duration<double>(seconds), [&g] { return !g.supervising; });
+}
+
+/** \brief Reconnects a lost gripper, retrying with increasing delays. Settings, automatic updates
+ *  and streaming are restored afterwards; the dispatcher keeps the subscriptions meanwhile. */
+void reconnect(gripper &g)
+{
+    g.link_lost = true;
+    publish_link_status();
+
+    // Commands waiting for a response fail now; nothing is announced to the gripper
+    cmd_mark_failed(g.conn);
+    cmd_disconnect();
+
+    double backoff = RECONNECT_BACKOFF_MIN;
+    int timeout_ms = (int)(std::max(g.keepalive_period, 0.25) * 1000.0);
+    for (int attempt = 1; g.supervising; attempt++) {
+        if (open_link(g)) {
+            if (dispatcher_start() == 0 && ping(timeout_ms) == 0) {
+                ROS_INFO("Gripper connection re-established%s (attempt %d)", g.label.c_str(), attempt);
+                break;
+            }
+            cmd_mark_failed(g.conn);
+            cmd_disconnect();
+        }
+        ROS_WARN_THROTTLE(5.0, "Unable to reconnect%s, retrying every %.1f s", g.label.c_str(), backoff);
+        if (!supervisor_sleep(g, backoff))
+            return;
+        backoff = std::min(backoff * 2.0, std::max(g.reconnect_backoff_max, RECONNECT_BACKOFF_MIN));
     }
+    if (!g.supervising)
+        return;
 
-    // check if connection was successful
-    if (res_con == 0 ) {
-        ROS_INFO("Gripper connection established");
-        //pub
+    if (restoreSettings() != 0)
+        ROS_WARN("Unable to restore the settings%s", g.label.c_str());
+    if (g.auto_update)
+        request_auto_update(g.auto_interval_ms);
+    if (g.streaming && script_stream(g.stream_period_ms) != 0)
+        ROS_ERROR("Unable to restart streaming%s, make sure the script is running", g.label.c_str());
+
+    g.link_lost = false;
+    publish_link_status();
+}
+
+/** \brief Supervisor thread of a gripper: detects a lost link by failed reads and writes or by
+ *  unanswered keepalives, and reconnects without leaving the node */
+void supervise(gripper &g)
+{
+    cmd_select(g.conn);
+
+    int missed = 0;
+    auto next_ping = std::chrono::steady_clock::now();
+    while (supervisor_sleep(g, LINK_CHECK_MS / 1000.0)) {
+        if (cmd_link_ok()) {
+            if (g.keepalive_period <= 0.0 || std::chrono::steady_clock::now() < next_ping)
+                continue;
+            next_ping = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(g.keepalive_period));
+
+            // A keepalive may wait up to one period for its echo
+            if (ping((int)(g.keepalive_period * 1000.0)) == 0) {
+                missed = 0;
+                continue;
+            }
+            if (!cmd_link_ok())
+                ROS_ERROR("Connection lost%s", g.label.c_str());
+            else if (++missed < g.keepalive_misses)
+                continue;
+            else
+                ROS_ERROR("Connection lost%s: %d keepalives were not answered", g.label.c_str(), missed);
+        } else
+            ROS_ERROR("Connection lost%s", g.label.c_str());
 
-        // Services
-        ros::ServiceServer moveSS, graspSS, releaseSS, homingSS, stopSS, ackSS, incrementSS, setAccSS, setForceSS;
+        missed = 0;
+        reconnect(g);
+    }
+}
+
+void start_supervisor(gripper &g)
+{
+    g.supervising = true;
+    g.supervisor = std::thread(supervise, std::ref(g));
+}
 
-        if (g_mode_script || g_mode_polling) {
-            moveSS = nh.advertiseService("move", moveSrv);
-            graspSS = nh.advertiseService("grasp", graspSrv);
-            releaseSS = nh.advertiseService("release", releaseSrv);
-            homingSS = nh.advertiseService("homing", homingSrv);
-            stopSS = nh.advertiseService("stop", stopSrv);
-            ackSS = nh.advertiseService("ack", ackSrv);
-            incrementSS = nh.advertiseService("move_incrementally", incrementSrv);
+void stop_supervisor(gripper &g)
+{
+    {
+        std::lock_guard<std::mutex> lock(g.supervisor_lock);
+        g.supervising = false;
+    }
+    g.supervisor_wake.notify_all();
+    if (g.supervisor.joinable())
+        g.supervisor.join();
+}
 
-            setAccSS = nh.advertiseService("set_acceleration", setAccSrv);
-            setForceSS = nh.advertiseService("set_force", setForceSrv);
+/** \brief Starts the timer or the automatic updates of a gripper */
+void start_gripper(gripper &g, double rate)
+{
+    cmd_select(g.conn);
+
+    ROS_INFO("Init done%s. Starting timer/automatic updates with target rate %.1f.", g.label.c_str(), rate);
+    g.auto_update = g.mode_periodic; // sigint_handler() resets the mode flags
+    if (g.mode_script && g.script_batch > 1) {
+        if (g.script_batch > SCRIPT_BATCH_MAX_SAMPLES || g.script_batch * g.script_batch_period > SCRIPT_BATCH_MAX_DURATION_MS) {
+            ROS_WARN("script_batch: at most %d samples and %d ms per frame, reading one sample per cycle", SCRIPT_BATCH_MAX_SAMPLES, SCRIPT_BATCH_MAX_DURATION_MS);
+            g.script_batch = 0;
+        } else if (g.script_batch * g.script_batch_period > 1000.0/rate) {
+            ROS_WARN("script_batch: a frame takes %d ms, more than one timer cycle", g.script_batch * g.script_batch_period);
         }
+    }
+    g.streaming = g.script_stream;
+    if (g.auto_update || g.streaming)
+        start_publisher(g);
+    if (g.streaming) {
+        // Don't fall back to polling, so goals are not sent twice
+        g.auto_rate_exp = rate;
+        g.auto_cnt[0] = 0;
+        if (!start_script_stream(g, (int)(1000.0/rate)))
+            ROS_ERROR("Unable to start streaming, make sure the script is running");
+        g.tmr = g.nh.createTimer(ros::Duration(5.0), boost::bind(script_rate_cb, boost::ref(g), _1));
+    } else if (g.mode_polling || g.mode_script)
+        g.tmr = g.nh.createTimer(ros::Duration(1.0/rate), boost::bind(timer_cb, boost::ref(g), _1));
+    if (g.auto_update) {
+        start_auto_update(g, (int)(1000.0/rate));
+        g.tmr = g.nh.createTimer(ros::Duration(5.0), boost::bind(rate_cb, boost::ref(g), _1));
+    }
+    if (g.setpoint_rate > 0.0)
+        start_setpoints(g);
+    if (g.finger_rate > 0.0)
+        start_fingers(g);
 
-        // Subscriber
-        ros::Subscriber sub_position, sub_speed;
-        if (g_mode_script || g_mode_periodic)
-            sub_position = nh.subscribe("goal_position", 5, position_cb);
-        if (g_mode_script)
-            sub_speed = nh.subscribe("goal_speed", 5, speed_cb);
+    start_supervisor(g);
+}
 
-        // Publisher
-        g_pub_state = nh.advertise<wsg50_common::Status>("status", 1000);
-        g_pub_joint = nh.advertise<sensor_msgs::JointState>("/joint_states", 10);
+/** \brief Stops what start_gripper() started */
+void stop_gripper(gripper &g)
+{
+    cmd_select(g.conn);
+
+    stop_setpoints(g);
+    stop_fingers(g);
+    stop_supervisor(g);
+    g.tmr.stop();
+    if (g.auto_update)
+        stop_auto_update(g);
+    if (g.streaming)
+        stop_script_stream(g);
+    if (g.auto_update || g.streaming)
+        stop_publisher(g);
+}
 
-        if (g_mode_script || g_mode_periodic)
-            g_pub_moving = nh.advertise<std_msgs::Bool>("moving", 10);
+/**
+ * The main function
+ */
 
-        sleep(1);
+int main( int argc, char **argv )
+{
+    ros::init(argc, argv, "wsg50");
+    ros::NodeHandle nh("~");
+    signal(SIGINT, sigint_handler);
 
-        ack_fault();
+    component_status = nh.advertise<dnb_msgs::ComponentStatus>("component/status", 1, true);
+    dnb_msgs::ComponentStatus cstatus_msg;
+    nh.param("metrics_file", g_metrics_file, std::string("")); // Prometheus text format, e.g. for the node_exporter textfile collector
+    read_rt_options(nh);
+
+    // Several grippers are served by one node if they are listed, e.g. "left=192.168.1.20, right=192.168.1.21".
+    // Each one gets the sub-namespace of its name, otherwise a single gripper uses the node's namespace.
+    std::string grippers;
+    nh.param("grippers", grippers, std::string(""));
+    std::vector<std::pair<std::string, std::string>> entries = parse_grippers(grippers);
+    if (entries.empty())
+        entries.push_back(std::make_pair(std::string(), std::string()));
+
+    std::vector<double> rates, grasping_forces;
+    bool connected = true;
+    std::string failed;
+    for (auto &entry : entries) {
+        g_grippers.emplace_back(new gripper);
+        gripper &g = *g_grippers.back();
+        g.name = entry.first;
+        g.label = g.name.empty() ? std::string() : " (" + g.name + ")";
+        g.nh = g.name.empty() ? nh : ros::NodeHandle(nh, g.name);
+        g.conn = cmd_conn_create();
+
+        double rate = 0.0, grasping_force = 0.0;
+        if (!g.conn || !connect_gripper(g, nh, entry.second, rate, grasping_force)) {
+            connected = false;
+            failed += g.label;
+        }
+        rates.push_back(rate);
+        grasping_forces.push_back(grasping_force);
+    }
+
+    // check if connection was successful
+    if (connected) {
+        for (auto &g : g_grippers)
+            setup_gripper(*g);
+        g_pub_diagnostics = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
 
         sleep(1);
 
-        ROS_INFO("Ready to use, homing now...");
-        homing();
+        // Homing takes a while, so all grippers are initialized at the same time
+        std::vector<std::thread> init;
+        for (size_t i = 0; i < g_grippers.size(); i++)
+            init.push_back(std::thread(init_gripper, std::ref(*g_grippers[i]), grasping_forces[i]));
+        for (auto &t : init)
+            t.join();
 
         // Set component status to running
-        cstatus_msg.status_id = 2;
-        cstatus_msg.status_msg = "WSG50 was homed and is running.";
-        component_status.publish(cstatus_msg);
+        publish_link_status();
 
-        if (grasping_force > 0.0) {
-            ROS_INFO("Setting grasping force limit to %5.1f", grasping_force);
-            setGraspingForceLimit(grasping_force);
-        }
+        for (size_t i = 0; i < g_grippers.size(); i++)
+            start_gripper(*g_grippers[i], rates[i]);
 
-        ROS_INFO("Init done. Starting timer/thread with target rate %.1f.", rate);
-        std::thread th;
-        ros::Timer tmr;
-        if (g_mode_polling || g_mode_script)
-            tmr = nh.createTimer(ros::Duration(1.0/rate), timer_cb);
-        if (g_mode_periodic)
-            th = std::thread(read_thread, (int)(1000.0/rate));
+        ros::Timer metrics_tmr = nh.createTimer(ros::Duration(METRICS_PERIOD), metrics_cb);
 
         sleep(5);
 
+        std::vector<std::unique_ptr<ros::AsyncSpinner>> spinners;
+        for (auto &g : g_grippers) {
+            spinners.emplace_back(new ros::AsyncSpinner(SERVICE_THREADS, &g->srv_queue));
+            spinners.emplace_back(new ros::AsyncSpinner(1, &g->queue));
+        }
+        for (auto &spinner : spinners)
+            spinner->start();
         ros::spin();
+        for (auto &spinner : spinners)
+            spinner->stop();
+
+        for (auto &g : g_grippers)
+            stop_gripper(*g);
 
     } else {
-        ROS_ERROR("Unable to connect, please check the port and address used.");
+        ROS_ERROR("Unable to connect%s, please check the port and address used.", failed.c_str());
 
         // Set component status to error
         cstatus_msg.status_id = 4;
-        cstatus_msg.status_msg = "Unable to connect, please check the port and address used.";
+        cstatus_msg.status_msg = "Unable to connect" + failed + ", please check the port and address used.";
         component_status.publish(cstatus_msg);
     }
 
@@ -884,11 +2222,24 @@ int main( int argc, char **argv )
     component_status.publish(cstatus_msg);
 
     ROS_INFO("Exiting...");
-    g_mode_periodic = false;
-    g_mode_script = false;
-    g_mode_polling = false;
+    for (auto &g : g_grippers) {
+        g->mode_periodic = false;
+        g->mode_script = false;
+        g->mode_polling = false;
+    }
     sleep(1);
-    cmd_disconnect();
+    for (auto &g : g_grippers) {
+        cmd_select(g->conn);
+        if (g->conn && cmd_is_connected())
+            cmd_disconnect();
+        if (g->recording) {
+            msg_set_recorder(&g->conn->link, NULL);
+            recorder_close(&g->recorder);
+        }
+        cmd_select(NULL);
+        cmd_conn_destroy(g->conn);
+    }
+    g_grippers.clear();
 
     return 0;
 
@@ -0,0 +1,625 @@
+//======================================================================
+/**
+ *  @file
+ *  main_gcl.cpp
+ *
+ *  @section main_gcl.cpp_general General file information
+ *
+ *  @brief
+ *  WSG-50 ROS driver for grippers speaking the GCL text protocol
+ *
+ *  Takes the place of the former gcl_tcp_driver.py, with its services and
+ *  topics. The
+ *  gripper pushes position, speed, force and grasping state with AUTOSEND;
+ *  they are received by the thread of gcl_client.cpp and read by the
+ *  services and the publishing timer without a round trip. Motion services
+ *  wait for their "FIN", while stop is served by another thread.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#include "wsg50/common.h"
+#include "wsg50/gcl_client.h"
+#include "wsg50/interface.h"
+#include "wsg50/rt.h"
+#include "wsg50/tcp.h"
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include "std_srvs/Empty.h"
+#include "wsg50_common/Status.h"
+#include "wsg50_common/Move.h"
+#include "wsg50_common/Conf.h"
+#include "wsg50_common/Incr.h"
+#include "wsg50_common/State.h"
+#include "dnb_msgs/ComponentStatus.h"
+#include "sensor_msgs/JointState.h"
+
+
+//------------------------------------------------------------------------
+// Local macros
+//------------------------------------------------------------------------
+
+#define GRIPPER_MIN_OPEN 0.0
+#define SERVICE_THREADS 3 // A motion control service, stop and one more service may run at the same time
+#define REPLY_TIMEOUT_MS 1000 // For the commands that are acknowledged right away
+#define LINK_CHECK_MS 100 // Interval for checking whether the link broke
+#define RECONNECT_BACKOFF_MIN 0.1 // First delay in s between reconnect attempts; doubled up to reconnect_backoff_max
+
+// GRIPSTATE values
+#define GRIP_IDLE 0
+#define GRIP_NO_PART 2
+#define GRIP_PART_LOST 3
+#define GRIP_HOLDING 4
+#define GRIP_ERROR 7
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+// The gripper served by the node
+struct gripper {
+    gcl_client *client = nullptr;
+    tcp_params_t tcp_params;
+    tcp_options_t tcp_options;
+    std::string ip;
+    int port = 1000;
+    int size = 210;
+    double rate = 50.0; // Hz of the AUTOSEND values and the topics
+    double timeout = 60.0; // s a motion may take
+    double link_timeout = 1.0; // s without any line until the link counts as lost
+    double reconnect_backoff_max = 5.0;
+    bool autorelease = true; // Release a part before grasping the next one
+    bool fast_stop = true; // FASTSTOP instead of STOP
+    std::string joint_name;
+
+    std::atomic<float> target_force{0.0f}; // GRIP needs the force, set with set_force
+    std::atomic<bool> in_motion{false};
+    std::atomic<bool> stop_called{false};
+    std::mutex motion_lock;
+    std::condition_variable motion_done;
+
+    ros::Publisher pub_state, pub_joint, pub_component;
+    wsg50_common::Status status_msg; // Reused
+    sensor_msgs::JointState joint_msg;
+    ros::CallbackQueue srv_queue;
+    std::vector<ros::ServiceServer> services;
+
+    std::atomic<bool> link_lost{true};
+    std::atomic<bool> supervising{false};
+    std::thread supervisor;
+    std::mutex supervisor_lock;
+    std::condition_variable supervisor_wake;
+};
+
+gripper g_gripper;
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+/** \brief Publishes the component status: running once the gripper sends its values, error while not connected */
+void publish_component_status(gripper &g)
+{
+    dnb_msgs::ComponentStatus cstatus_msg;
+    if (g.link_lost) {
+        cstatus_msg.status_id = 4;
+        cstatus_msg.status_msg = "Connection to the WSG50 lost, reconnecting...";
+    } else {
+        cstatus_msg.status_id = 2;
+        cstatus_msg.status_msg = "WSG50 is running.";
+    }
+    g.pub_component.publish(cstatus_msg);
+}
+
+/** \brief Publishes the latest values on status and /joint_states */
+void publish_cb(gripper &g, const ros::TimerEvent &ev)
+{
+    gcl_state_t st;
+    gcl_client_state(g.client, &st);
+    if (!st.valid)
+        return;
+
+    g.status_msg.status = std::to_string(std::max(st.grip_state, 0));
+    g.status_msg.width = st.position;
+    g.status_msg.speed = st.speed;
+    g.status_msg.force = st.force;
+    g.pub_state.publish(g.status_msg);
+
+    // Stamped with the reception of the position
+    g.joint_msg.header.stamp = ros::Time(st.stamp.tv_sec, st.stamp.tv_nsec);
+    g.joint_msg.position[0] = st.position/2000.0;
+    g.joint_msg.velocity[0] = st.speed/1000.0;
+    g.joint_msg.effort[0] = st.force;
+    g.pub_joint.publish(g.joint_msg);
+}
+
+/** \brief Acknowledges a fault, so the gripper accepts motions again */
+bool reset_error(gripper &g)
+{
+    gcl_state_t st;
+    gcl_client_state(g.client, &st);
+    if (st.grip_state != GRIP_ERROR)
+        return true;
+
+    status_t status;
+    if (gcl_client_command(g.client, GCL_WAIT_ACK, REPLY_TIMEOUT_MS, &status, "FSACK()") != 0 || status != E_SUCCESS) {
+        ROS_ERROR("Unable to acknowledge the fault: %s", status_to_str(status));
+        return false;
+    }
+    return true;
+}
+
+/** \brief Marks the start of a motion control service. Fails if another one is running. */
+bool begin_motion(gripper &g)
+{
+    if (g.in_motion.exchange(true)) {
+        ROS_WARN("Another Motion Control service is already running. Try again later!");
+        return false;
+    }
+    g.stop_called = false;
+    reset_error(g);
+    return true;
+}
+
+/** \brief Marks the end of a motion control service and wakes up stopSrv() */
+void end_motion(gripper &g)
+{
+    {
+        std::lock_guard<std::mutex> lock(g.motion_lock);
+        g.in_motion = false;
+    }
+    g.motion_done.notify_all();
+}
+
+/** \brief Sends a motion command and waits for its end. Returns the error of the service response. */
+unsigned char run_motion(gripper &g, const char *what, const char *fmt, float a, float b, float c)
+{
+    status_t status;
+    int res = gcl_client_command(g.client, GCL_WAIT_FIN, (int)(g.timeout * 1000.0), &status, fmt, a, b, c);
+
+    if (g.stop_called)
+        return E_CMD_ABORTED;
+    if (res != 0) {
+        ROS_ERROR("Failed while %s : no response (%s)", what, status_to_str(status));
+        return 255;
+    }
+    if (status != E_SUCCESS)
+        ROS_ERROR("Failed while %s : %s", what, status_to_str(status));
+    return status;
+}
+
+/** \brief Current opening width, if the gripper has sent it */
+bool current_opening(gripper &g, float &width)
+{
+    gcl_state_t st;
+    gcl_client_state(g.client, &st);
+    if (!st.valid) {
+        ROS_ERROR("No position received yet. Check the gripper connection");
+        return false;
+    }
+    width = st.position;
+    return true;
+}
+
+bool moveSrv(gripper &g, wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
+    if (req.width < 0.0 || req.width > g.size) {
+        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
+        res.error = E_RANGE_ERROR;
+        return false;
+    }
+
+    if (!begin_motion(g)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
+
+    ROS_INFO("Moving to %f position at %f mm/s.", req.width, req.speed);
+    if (req.speed > 0.0)
+        res.error = run_motion(g, "moving", "MOVE(%.2f,%.2f)", req.width, req.speed, 0.0f);
+    else
+        res.error = run_motion(g, "moving", "MOVE(%.2f)", req.width, 0.0f, 0.0f);
+    end_motion(g);
+
+    if (res.error == 0)
+        ROS_INFO("Target position reached");
+    return true;
+}
+
+bool graspSrv(gripper &g, wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
+    if (req.width < 0.0 || req.width > g.size) {
+        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
+        res.error = E_RANGE_ERROR;
+        return false;
+    }
+    if (g.target_force <= 0.0f) {
+        ROS_ERROR("Attempting to grasp without setting the force first (set_force)");
+        res.error = E_NOT_INITIALIZED;
+        return true;
+    }
+
+    float width;
+    if (!current_opening(g, width)) {
+        res.error = 255;
+        return true;
+    }
+    if (!begin_motion(g)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
+
+    // Something grasped before is let go first; a move to the current width does that
+    gcl_state_t st;
+    gcl_client_state(g.client, &st);
+    res.error = 0;
+    if (g.autorelease && (st.grip_state == GRIP_HOLDING || st.grip_state == GRIP_NO_PART || st.grip_state == GRIP_PART_LOST))
+        res.error = run_motion(g, "releasing", "MOVE(%.2f,%.2f)", width, req.speed, 0.0f);
+
+    if (res.error == 0) {
+        ROS_INFO("Grasping object at %f with %f mm/s.", req.width, req.speed);
+        res.error = run_motion(g, "grasping object", "GRIP(%.2f,%.2f,%.2f)", g.target_force.load(), req.width, req.speed);
+    }
+    end_motion(g);
+
+    if (res.error == 0)
+        ROS_INFO("Object grasped correctly.");
+    return true;
+}
+
+bool releaseSrv(gripper &g, wsg50_common::Move::Request &req, wsg50_common::Move::Response &res) {
+    if (req.width < 0.0 || req.width > g.size) {
+        ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %d] ", g.size);
+        res.error = E_RANGE_ERROR;
+        return false;
+    }
+
+    // RELEASE opens by a distance
+    float width;
+    if (!current_opening(g, width)) {
+        res.error = 255;
+        return true;
+    }
+    if (!begin_motion(g)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
+
+    ROS_INFO("Releasing to %f position at %f mm/s.", req.width, req.speed);
+    res.error = run_motion(g, "releasing object", "RELEASE(%.2f,%.2f)", req.width - width, req.speed, 0.0f);
+    end_motion(g);
+
+    if (res.error == 0)
+        ROS_INFO("Object released correctly.");
+    return true;
+}
+
+bool incrementSrv(gripper &g, wsg50_common::Incr::Request &req, wsg50_common::Incr::Response &res) {
+    if (req.direction != "open" && req.direction != "close")
+        return true;
+
+    float width;
+    if (!current_opening(g, width)) {
+        res.error = 255;
+        return true;
+    }
+    float next = req.direction == "open" ? std::min(width + req.increment, (float)g.size) :
+                                           std::max(width - req.increment, (float)GRIPPER_MIN_OPEN);
+
+    if (!begin_motion(g)) {
+        res.error = E_ALREADY_RUNNING;
+        return true;
+    }
+
+    ROS_INFO("Incremental %sing of %f mm - CurrWidth: %f - NxtWidth: %f", req.direction.c_str(), req.increment, width, next);
+    res.error = run_motion(g, "moving incrementally", "MOVE(%.2f)", next, 0.0f, 0.0f);
+    end_motion(g);
+
+    if (res.error == 0)
+        ROS_INFO("Incremental %s done", req.direction.c_str());
+    return true;
+}
+
+bool homingSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
+    if (!begin_motion(g))
+        return false;
+
+    ROS_INFO("Homing...");
+    unsigned char error = run_motion(g, "homing", "HOME()", 0.0f, 0.0f, 0.0f);
+    end_motion(g);
+
+    if (error != 0)
+        return false;
+    ROS_INFO("Home position reached.");
+    return true;
+}
+
+bool stopSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res) {
+    ROS_WARN("Stop!");
+
+    // The motion waiting for its end gets an error once the gripper stopped
+    if (g.in_motion)
+        g.stop_called = true;
+    status_t status;
+    if (gcl_client_command(g.client, GCL_WAIT_ACK, REPLY_TIMEOUT_MS, &status, g.fast_stop ? "FASTSTOP()" : "STOP()") != 0) {
+        ROS_ERROR("Stop failed: %s", status_to_str(status));
+        return false;
+    }
+    if (g.in_motion) {
+        std::unique_lock<std::mutex> lock(g.motion_lock);
+        g.motion_done.wait_for(lock, std::chrono::duration<double>(g.timeout), [&g] { return !g.in_motion; });
+    }
+
+    // A fast stop is a fault that has to be acknowledged before the next motion
+    if (g.fast_stop && gcl_client_command(g.client, GCL_WAIT_ACK, REPLY_TIMEOUT_MS, &status, "FSACK()") != 0)
+        ROS_WARN("Unable to acknowledge the fast stop: %s", status_to_str(status));
+
+    ROS_WARN("Stopped.");
+    return true;
+}
+
+bool ackSrv(gripper &g, std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
+{
+    return reset_error(g);
+}
+
+bool setAccSrv(gripper &g, wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
+{
+    ROS_WARN("Acceleration ignored: GCL motions use the acceleration configured on the gripper");
+    res.error = 0;
+    return true;
+}
+
+bool setForceSrv(gripper &g, wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
+{
+    // Used by the next grasp
+    g.target_force = req.val;
+    res.error = 0;
+    return true;
+}
+
+bool getStateSrv(gripper &g, wsg50_common::State::Request &req, wsg50_common::State::Response &res)
+{
+    gcl_state_t st;
+    gcl_client_state(g.client, &st);
+    res.state = (unsigned char)std::max(st.grip_state, 0);
+    return true;
+}
+
+/** \brief Advertises a service of the gripper */
+template <class MReq, class MRes>
+void advertise_service(gripper &g, ros::NodeHandle &nh, const std::string &name, bool (*srv)(gripper &, MReq &, MRes &))
+{
+    gripper *gp = &g;
+    boost::function<bool(MReq &, MRes &)> cb = [gp, srv](MReq &req, MRes &res) {
+        return srv(*gp, req, res);
+    };
+    g.services.push_back(nh.advertiseService<MReq, MRes>(name, cb));
+}
+
+/** \brief Connects and turns on the automatic updates */
+bool open_link(gripper &g)
+{
+    if (gcl_client_connect(g.client, interface_get("tcp"), &g.tcp_params) != 0)
+        return false;
+
+    // A fault pending from before blocks every motion
+    status_t status;
+    int period_ms = std::max((int)(1000.0/g.rate), 1);
+    bool ok = gcl_client_command(g.client, GCL_WAIT_NONE, 0, &status, "FSACK()") == 0;
+    const char *values[] = { "POS", "SPEED", "FORCE", "GRIPSTATE" };
+    for (const char *v : values)
+        ok = ok && gcl_client_command(g.client, GCL_WAIT_ACK, REPLY_TIMEOUT_MS, &status, "AUTOSEND(\"%s\",%d)", v, period_ms) == 0 &&
+             status == E_SUCCESS;
+    if (!ok) {
+        ROS_ERROR("Unable to turn on the automatic updates: %s", status_to_str(status));
+        gcl_client_disconnect(g.client);
+    }
+    return ok;
+}
+
+/** \brief Sleeps unless the supervisor is stopped meanwhile; returns false if it was */
+bool supervisor_sleep(gripper &g, double seconds)
+{
+    std::unique_lock<std::mutex> lock(g.supervisor_lock);
+    return !g.supervisor_wake.wait_for(lock, std::chrono::duration<double>(seconds), [&g] { return !g.supervising; });
+}
+
+/** \brief Supervisor thread: (re)connects with increasing delays whenever the link broke or the values stopped coming */
+void supervise(gripper &g)
+{
+    double backoff = RECONNECT_BACKOFF_MIN;
+    for (int attempt = 1; g.supervising; attempt++) {
+        if (!open_link(g)) {
+            ROS_WARN_THROTTLE(5.0, "Unable to connect to %s:%d, retrying every %.1f s", g.ip.c_str(), g.port, backoff);
+            if (!supervisor_sleep(g, backoff))
+                break;
+            backoff = std::min(backoff * 2.0, std::max(g.reconnect_backoff_max, RECONNECT_BACKOFF_MIN));
+            continue;
+        }
+
+        ROS_INFO("Connected to %s:%d (attempt %d)", g.ip.c_str(), g.port, attempt);
+        g.link_lost = false;
+        publish_component_status(g);
+        backoff = RECONNECT_BACKOFF_MIN;
+        attempt = 0;
+
+        while (supervisor_sleep(g, LINK_CHECK_MS / 1000.0)) {
+            if (!gcl_client_link_ok(g.client)) {
+                ROS_ERROR("Connection lost");
+                break;
+            }
+            if (gcl_client_rx_age_ms(g.client) > g.link_timeout * 1000.0) {
+                ROS_ERROR("Connection lost: nothing received for %.1f s", g.link_timeout);
+                break;
+            }
+        }
+
+        // Waiting commands fail now
+        gcl_client_disconnect(g.client);
+        g.link_lost = true;
+        publish_component_status(g);
+    }
+}
+
+void start_supervisor(gripper &g)
+{
+    g.supervising = true;
+    g.supervisor = std::thread(supervise, std::ref(g));
+}
+
+void stop_supervisor(gripper &g)
+{
+    {
+        std::lock_guard<std::mutex> lock(g.supervisor_lock);
+        g.supervising = false;
+    }
+    g.supervisor_wake.notify_all();
+    if (g.supervisor.joinable())
+        g.supervisor.join();
+}
+
+/** \brief Sets up the scheduling of the receiving thread and locks the memory, as io_priority etc. of the binary driver */
+void read_rt_options(gripper &g, const ros::NodeHandle &nh)
+{
+    rt_options_t opt;
+    std::string cpus;
+    int stack_prefault;
+    bool lock_memory;
+
+    rt_options_default(&opt);
+    nh.param("io_priority", opt.priority, 0);
+    nh.param("io_cpus", cpus, std::string(""));
+    nh.param("io_stack_prefault", stack_prefault, 0);
+    nh.param("lock_memory", lock_memory, false);
+
+    if (cpus.size() >= sizeof(opt.cpus))
+        ROS_WARN("io_cpus: %s is too long, not pinning the I/O thread", cpus.c_str());
+    else
+        strcpy(opt.cpus, cpus.c_str());
+    opt.stack_prefault_kb = (unsigned int)std::max(stack_prefault, 0);
+
+    if (lock_memory && rt_lock_memory() < 0)
+        ROS_WARN("lock_memory: not granted, memory may be paged out");
+    gcl_client_set_thread_options(g.client, &opt);
+}
+
+void sigint_handler(int sig) {
+    ros::shutdown();
+}
+
+/**
+ * The main function
+ */
+
+int main( int argc, char **argv )
+{
+    ros::init(argc, argv, "wsg50_gcl");
+    ros::NodeHandle nh("~");
+    signal(SIGINT, sigint_handler);
+
+    gripper &g = g_gripper;
+    g.client = gcl_client_create();
+    if (!g.client)
+        return 1;
+
+    double connect_timeout;
+    nh.param("ip", g.ip, std::string("192.168.1.20"));
+    nh.param("port", g.port, 1000);
+    nh.param("size", g.size, 210);
+    nh.param("rate", g.rate, 50.0);
+    nh.param("timeout", g.timeout, 60.0);
+    nh.param("link_timeout", g.link_timeout, 1.0);
+    nh.param("reconnect_backoff_max", g.reconnect_backoff_max, 5.0);
+    nh.param("autorelease", g.autorelease, true);
+    nh.param("fast_stop", g.fast_stop, true);
+    float grasping_force;
+    nh.param("grasping_force", grasping_force, 0.0f);
+    g.target_force = grasping_force;
+    nh.param("joint_name", g.joint_name, std::string("wsg50_finger_left_joint"));
+
+    tcp_options_default(&g.tcp_options);
+    nh.param("tcp_nodelay", g.tcp_options.nodelay, g.tcp_options.nodelay);
+    nh.param("connect_timeout", connect_timeout, g.tcp_options.connect_timeout_ms / 1000.0);
+    g.tcp_options.connect_timeout_ms = connect_timeout > 0.0 ? (unsigned int)(connect_timeout * 1000.0) : 0;
+    g.tcp_params.addr = str_to_ipaddr(g.ip.c_str());
+    g.tcp_params.port = (unsigned short)g.port;
+    g.tcp_params.options = &g.tcp_options;
+    read_rt_options(g, nh);
+
+    if (g.size != 210 && g.size != 110) {
+        ROS_WARN("Gripper size: %d is invalid. Using default size of 210 mm.", g.size);
+        g.size = 210;
+    }
+    if (g.rate <= 0.0) {
+        ROS_WARN("rate: %.1f is invalid, using 50 Hz", g.rate);
+        g.rate = 50.0;
+    }
+    // The values are the keepalive, so the timeout has to allow for a few of them
+    g.link_timeout = std::max(g.link_timeout, 3.0/g.rate);
+
+    g.pub_component = nh.advertise<dnb_msgs::ComponentStatus>("component/status", 1, true);
+    g.pub_state = nh.advertise<wsg50_common::Status>("status", 1000);
+    g.pub_joint = nh.advertise<sensor_msgs::JointState>("/joint_states", 10);
+    g.joint_msg.name.assign(1, g.joint_name);
+    g.joint_msg.position.resize(1);
+    g.joint_msg.velocity.resize(1);
+    g.joint_msg.effort.resize(1);
+    publish_component_status(g);
+
+    ROS_INFO("Connecting to %s:%d (GCL) ...", g.ip.c_str(), g.port);
+    start_supervisor(g);
+
+    // Served by their own spinner threads, so stop is served while a motion waits for its end
+    ros::NodeHandle nh_srv(nh);
+    nh_srv.setCallbackQueue(&g.srv_queue);
+    advertise_service(g, nh_srv, "move", moveSrv);
+    advertise_service(g, nh_srv, "grasp", graspSrv);
+    advertise_service(g, nh_srv, "release", releaseSrv);
+    advertise_service(g, nh_srv, "homing", homingSrv);
+    advertise_service(g, nh_srv, "stop", stopSrv);
+    advertise_service(g, nh_srv, "ack", ackSrv);
+    advertise_service(g, nh_srv, "move_incrementally", incrementSrv);
+    advertise_service(g, nh_srv, "set_acceleration", setAccSrv);
+    advertise_service(g, nh_srv, "set_force", setForceSrv);
+    advertise_service(g, nh_srv, "get_state", getStateSrv);
+
+    ros::Timer tmr = nh.createTimer(ros::Duration(1.0/g.rate), boost::bind(publish_cb, boost::ref(g), _1));
+
+    ros::AsyncSpinner spinner(SERVICE_THREADS, &g.srv_queue);
+    spinner.start();
+    ros::spin();
+    spinner.stop();
+
+    tmr.stop();
+    stop_supervisor(g);
+    gcl_client_disconnect(g.client);
+
+    dnb_msgs::ComponentStatus cstatus_msg;
+    cstatus_msg.status_id = 1;
+    cstatus_msg.status_msg = "Driver was stopped.";
+    g.pub_component.publish(cstatus_msg);
+
+    gcl_client_destroy(g.client);
+    return 0;
+}
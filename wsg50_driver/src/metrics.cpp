@@ -0,0 +1,598 @@
+//======================================================================
+/**
+ *  @file
+ *  metrics.cpp
+ *
+ *  @section metrics.cpp_general General file information
+ *
+ *  @brief
+ *  Counters and latency histograms of the command path
+ *
+ *  Everything is recorded with relaxed atomics, so the reader thread and
+ *  the commands never wait for each other or for somebody reading the
+ *  metrics. Latencies go into log-linear histograms (as in HdrHistogram):
+ *  every power of two is split into METRICS_HIST_SUB_BUCKETS buckets, so
+ *  percentiles are exact to 12.5% over the whole range with a fixed,
+ *  small amount of memory.
+ *
+ *  - Round-trip time: from sending a command to the first response with
+ *    the same ID (for motions, that is the "pending" acknowledge). Each ID
+ *    also keeps a smoothed mean and deviation of it, as TCP does for its
+ *    retransmission timeout, see metrics_rtt_timeout_ms(). Like all
+ *    metrics, the estimate belongs to one connection, so retries and
+ *    motion deadlines follow the gripper they are meant for.
+ *  - Publish latency: from the arrival of a frame to its publication
+ *  - Frames received and dropped by the dispatcher per ID, checksum
+ *    errors and bytes skipped while searching for the preamble
+ *
+ *  Every connection has metrics of its own (see msg_link_init()), so the
+ *  round trips of one gripper are never matched with the commands sent to
+ *  another.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "wsg50/common.h"
+#include "wsg50/metrics.h"
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+namespace
+{
+
+struct histogram
+{
+	std::atomic<unsigned long> bucket[METRICS_HIST_BUCKETS];
+	std::atomic<unsigned long> count{ 0 };
+	std::atomic<unsigned long long> sum_us{ 0 };
+	std::atomic<unsigned long> max_us{ 0 };
+
+	histogram( void ) { for ( unsigned int i = 0; i < METRICS_HIST_BUCKETS; i++ ) bucket[i] = 0; }
+};
+
+} // namespace
+
+/** Metrics of one connection */
+struct metrics
+{
+	std::atomic<histogram *> rtt[256];				// Allocated on first use of that ID
+	histogram publish;
+	histogram urgent;								// Priority lane: posted to written
+	std::atomic<unsigned long long> sent_us[256];	// Send time of the pending command, 0 if none
+	std::atomic<bool> resent[256];					// The pending command has been sent again; its round trip is not used
+	std::atomic<unsigned long> srtt_us[256];		// Smoothed round-trip time, 0 until measured
+	std::atomic<unsigned long> rttvar_us[256];		// Smoothed mean deviation of it
+	std::atomic<unsigned long> frames[256];
+	std::atomic<unsigned long> drops[256];
+	std::atomic<unsigned long> crc_errors{ 0 };
+	std::atomic<unsigned long> resync_bytes{ 0 };
+
+	metrics( void )
+	{
+		for ( unsigned int i = 0; i < 256; i++ )
+		{
+			rtt[i] = nullptr; sent_us[i] = 0; frames[i] = 0; drops[i] = 0;
+			resent[i] = false; srtt_us[i] = 0; rttvar_us[i] = 0;
+		}
+	}
+
+	~metrics( void )
+	{
+		for ( unsigned int i = 0; i < 256; i++ ) delete rtt[i].load( std::memory_order_relaxed );
+	}
+};
+
+namespace
+{
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+metrics default_metrics;							// Of the default connection
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+metrics *resolve( metrics_t *m );
+const metrics *resolve( const metrics_t *m );
+unsigned long long now_us( int clock );
+unsigned int hist_index( unsigned long long us );
+unsigned long hist_value( unsigned int index );
+void hist_record( histogram *h, unsigned long long us );
+void rtt_estimate( metrics *m, unsigned char id, unsigned long long us );
+int hist_summary( const histogram *h, metrics_summary_t *summary );
+std::string with_label( const std::string &labels, const char *label );
+void write_summary( FILE *f, const char *name, const std::string &labels, const histogram *h );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+metrics *resolve( metrics_t *m ) { return m ? m : &default_metrics; }
+const metrics *resolve( const metrics_t *m ) { return m ? m : &default_metrics; }
+
+
+unsigned long long now_us( int clock )
+{
+	struct timespec ts;
+	clock_gettime( clock, &ts );
+	return (unsigned long long) ts.tv_sec * 1000000ull + (unsigned long long) ts.tv_nsec / 1000ull;
+}
+
+
+/**
+ * Histogram bucket of a value: exact below METRICS_HIST_SUB_BUCKETS,
+ * then METRICS_HIST_SUB_BUCKETS buckets per power of two
+ */
+
+unsigned int hist_index( unsigned long long us )
+{
+	if ( us < METRICS_HIST_SUB_BUCKETS ) return (unsigned int) us;
+
+	unsigned int e = 63 - __builtin_clzll( us );		// >= 3
+	unsigned int index = METRICS_HIST_SUB_BUCKETS * ( e - 2 ) + (unsigned int) ( ( us >> ( e - 3 ) ) & ( METRICS_HIST_SUB_BUCKETS - 1 ) );
+
+	return index < METRICS_HIST_BUCKETS ? index : METRICS_HIST_BUCKETS - 1;
+}
+
+
+/**
+ * Highest value that falls into a bucket
+ */
+
+unsigned long hist_value( unsigned int index )
+{
+	if ( index < METRICS_HIST_SUB_BUCKETS ) return index;
+
+	unsigned int e = index / METRICS_HIST_SUB_BUCKETS + 2;
+	unsigned long sub = index % METRICS_HIST_SUB_BUCKETS;
+
+	return ( ( METRICS_HIST_SUB_BUCKETS + sub + 1 ) << ( e - 3 ) ) - 1;
+}
+
+
+void hist_record( histogram *h, unsigned long long us )
+{
+	h->bucket[hist_index( us )].fetch_add( 1, std::memory_order_relaxed );
+	h->count.fetch_add( 1, std::memory_order_relaxed );
+	h->sum_us.fetch_add( us, std::memory_order_relaxed );
+
+	unsigned long max = h->max_us.load( std::memory_order_relaxed );
+	while ( us > max && !h->max_us.compare_exchange_weak( max, (unsigned long) us, std::memory_order_relaxed ) );
+}
+
+
+/**
+ * Update the smoothed round-trip time of an ID with a new sample
+ * (RFC 6298: gain 1/8 for the mean, 1/4 for the deviation)
+ */
+
+void rtt_estimate( metrics *m, unsigned char id, unsigned long long us )
+{
+	long srtt = (long) m->srtt_us[id].load( std::memory_order_relaxed );
+	long var = (long) m->rttvar_us[id].load( std::memory_order_relaxed );
+	long r = (long) us;
+
+	if ( srtt == 0 )
+	{
+		srtt = r > 0 ? r : 1;
+		var = r / 2;
+	}
+	else
+	{
+		var += ( labs( srtt - r ) - var ) / 4;
+		srtt += ( r - srtt ) / 8;
+		if ( srtt <= 0 ) srtt = 1;
+	}
+
+	m->srtt_us[id].store( (unsigned long) srtt, std::memory_order_relaxed );
+	m->rttvar_us[id].store( (unsigned long) var, std::memory_order_relaxed );
+}
+
+
+/**
+ * Percentiles of a histogram
+ *
+ * @return 1 if the histogram has values, 0 if it is empty
+ */
+
+int hist_summary( const histogram *h, metrics_summary_t *summary )
+{
+	unsigned long counts[METRICS_HIST_BUCKETS], total = 0, seen = 0;
+	unsigned long *targets[3] = { &summary->p50_us, &summary->p90_us, &summary->p99_us };
+	const double quantiles[3] = { 0.5, 0.9, 0.99 };
+	unsigned int q = 0;
+
+	memset( summary, 0, sizeof( *summary ) );
+
+	// Buckets may be updated meanwhile; the total is taken from the copy, so it matches
+	for ( unsigned int i = 0; i < METRICS_HIST_BUCKETS; i++ )
+	{
+		counts[i] = h->bucket[i].load( std::memory_order_relaxed );
+		total += counts[i];
+	}
+	if ( total == 0 ) return 0;
+
+	summary->count = total;
+	summary->mean_us = (double) h->sum_us.load( std::memory_order_relaxed ) / (double) h->count.load( std::memory_order_relaxed );
+	summary->max_us = h->max_us.load( std::memory_order_relaxed );
+
+	for ( unsigned int i = 0; i < METRICS_HIST_BUCKETS && q < 3; i++ )
+	{
+		seen += counts[i];
+		while ( q < 3 && (double) seen >= quantiles[q] * (double) total )
+		{
+			unsigned long v = hist_value( i );
+			*targets[q++] = v < summary->max_us ? v : summary->max_us;
+		}
+	}
+
+	return 1;
+}
+
+
+/**
+ * Append a label to a list of labels
+ */
+
+std::string with_label( const std::string &labels, const char *label )
+{
+	return labels.empty() ? std::string( label ) : labels + "," + label;
+}
+
+
+/**
+ * Write a histogram as Prometheus summary
+ */
+
+void write_summary( FILE *f, const char *name, const std::string &labels, const histogram *h )
+{
+	metrics_summary_t s;
+	std::string sep = labels.empty() ? "" : ",";
+
+	if ( !hist_summary( h, &s ) ) return;
+
+	fprintf( f, "%s{%s%squantile=\"0.5\"} %g\n", name, labels.c_str(), sep.c_str(), s.p50_us / 1e6 );
+	fprintf( f, "%s{%s%squantile=\"0.9\"} %g\n", name, labels.c_str(), sep.c_str(), s.p90_us / 1e6 );
+	fprintf( f, "%s{%s%squantile=\"0.99\"} %g\n", name, labels.c_str(), sep.c_str(), s.p99_us / 1e6 );
+	fprintf( f, "%s_sum{%s} %g\n", name, labels.c_str(), h->sum_us.load( std::memory_order_relaxed ) / 1e6 );
+	fprintf( f, "%s_count{%s} %lu\n", name, labels.c_str(), s.count );
+}
+
+} // namespace
+
+
+/**
+ * Create the metrics of a connection
+ *
+ * @return New metrics, NULL on error
+ */
+
+metrics_t *metrics_create( void )
+{
+	return new ( std::nothrow ) metrics;
+}
+
+
+/**
+ * Release metrics created with metrics_create()
+ *
+ * @param *m		Metrics, may be NULL
+ */
+
+void metrics_destroy( metrics_t *m )
+{
+	delete m;
+}
+
+
+/**
+ * Note that a command is being sent; the next response with this ID
+ * completes the round trip
+ *
+ * @param *m		Metrics of the connection
+ * @param id		Command ID
+ */
+
+void metrics_cmd_sent( metrics_t *m, unsigned char id )
+{
+	resolve( m )->sent_us[id].store( now_us( CLOCK_MONOTONIC ), std::memory_order_relaxed );
+}
+
+
+/**
+ * Note that a response has been received. Only the first response after
+ * metrics_cmd_sent() counts, e.g. automatic updates are ignored.
+ *
+ * @param *m		Metrics of the connection
+ * @param id		Command ID
+ */
+
+void metrics_cmd_response( metrics_t *m, unsigned char id )
+{
+	metrics *c = resolve( m );
+	unsigned long long sent = c->sent_us[id].exchange( 0, std::memory_order_relaxed );
+	if ( sent == 0 ) return;
+
+	histogram *h = c->rtt[id].load( std::memory_order_acquire );
+	if ( !h )
+	{
+		histogram *created = new histogram;
+		if ( c->rtt[id].compare_exchange_strong( h, created, std::memory_order_acq_rel ) ) h = created;
+		else delete created;
+	}
+
+	unsigned long long now = now_us( CLOCK_MONOTONIC );
+	unsigned long long us = now > sent ? now - sent : 0;
+	hist_record( h, us );
+
+	// The response may be the one of the first attempt (Karn's algorithm)
+	if ( !c->resent[id].exchange( false, std::memory_order_relaxed ) ) rtt_estimate( c, id, us );
+}
+
+
+/**
+ * Note that a command is sent again because its response did not arrive.
+ * The round trip completed by the next response does not go into the
+ * estimate of metrics_rtt_timeout_ms(); call before sending.
+ *
+ * @param *m		Metrics of the connection
+ * @param id		Command ID
+ */
+
+void metrics_cmd_resent( metrics_t *m, unsigned char id )
+{
+	resolve( m )->resent[id].store( true, std::memory_order_relaxed );
+}
+
+
+void metrics_frame_received( metrics_t *m, unsigned char id )
+{
+	resolve( m )->frames[id].fetch_add( 1, std::memory_order_relaxed );
+}
+
+
+void metrics_queue_dropped( metrics_t *m, unsigned char id )
+{
+	resolve( m )->drops[id].fetch_add( 1, std::memory_order_relaxed );
+}
+
+
+void metrics_crc_error( metrics_t *m )
+{
+	resolve( m )->crc_errors.fetch_add( 1, std::memory_order_relaxed );
+}
+
+
+void metrics_resync( metrics_t *m, unsigned int bytes )
+{
+	resolve( m )->resync_bytes.fetch_add( bytes, std::memory_order_relaxed );
+}
+
+
+/**
+ * Note that a frame has been published
+ *
+ * @param *m		Metrics of the connection the frame was received on
+ * @param *stamp	Arrival time of the frame (CLOCK_REALTIME); ignored if zero
+ */
+
+void metrics_publish_latency( metrics_t *m, const struct timespec *stamp )
+{
+	if ( stamp->tv_sec == 0 && stamp->tv_nsec == 0 ) return;
+
+	unsigned long long arrived = (unsigned long long) stamp->tv_sec * 1000000ull + (unsigned long long) stamp->tv_nsec / 1000ull;
+	unsigned long long now = now_us( CLOCK_REALTIME );
+	hist_record( &resolve( m )->publish, now > arrived ? now - arrived : 0 );
+}
+
+
+/**
+ * Note that a frame of the priority lane has been written
+ *
+ * @param *m		Metrics of the connection
+ * @param *posted	Time it was posted (CLOCK_MONOTONIC)
+ */
+
+void metrics_urgent_written( metrics_t *m, const struct timespec *posted )
+{
+	unsigned long long t = (unsigned long long) posted->tv_sec * 1000000ull + (unsigned long long) posted->tv_nsec / 1000ull;
+	unsigned long long now = now_us( CLOCK_MONOTONIC );
+	hist_record( &resolve( m )->urgent, now > t ? now - t : 0 );
+}
+
+
+/**
+ * Get round-trip times of a command
+ *
+ * @param *m			Metrics of the connection
+ * @param id			Command ID
+ * @param *summary		Percentiles in us
+ *
+ * @return 1 if the command has been sent, else 0
+ */
+
+int metrics_rtt_summary( const metrics_t *m, unsigned char id, metrics_summary_t *summary )
+{
+	const histogram *h = resolve( m )->rtt[id].load( std::memory_order_acquire );
+	if ( !h )
+	{
+		memset( summary, 0, sizeof( *summary ) );
+		return 0;
+	}
+	return hist_summary( h, summary );
+}
+
+
+/**
+ * Get the time to wait for the response to a command before it may be
+ * taken as lost: the smoothed round-trip time plus four times its mean
+ * deviation, which adapts to the link and to the load of the gripper
+ *
+ * @param *m			Metrics of the connection the command is sent on
+ * @param id			Command ID
+ * @param min_ms		Lower bound, also covers the resolution of the estimate
+ * @param max_ms		Upper bound; returned as long as the command has not been measured
+ *
+ * @return Timeout in ms
+ */
+
+unsigned int metrics_rtt_timeout_ms( const metrics_t *m, unsigned char id, unsigned int min_ms, unsigned int max_ms )
+{
+	const metrics *c = resolve( m );
+	unsigned long srtt = c->srtt_us[id].load( std::memory_order_relaxed );
+	if ( srtt == 0 ) return max_ms;
+
+	unsigned long ms = ( srtt + 4 * c->rttvar_us[id].load( std::memory_order_relaxed ) + 999 ) / 1000;
+	return ms < min_ms ? min_ms : ms > max_ms ? max_ms : (unsigned int) ms;
+}
+
+
+/**
+ * Get the latency from the arrival of a frame to its publication
+ *
+ * @param *m			Metrics of the connection
+ * @param *summary		Percentiles in us
+ *
+ * @return 1 if anything has been published, else 0
+ */
+
+int metrics_publish_summary( const metrics_t *m, metrics_summary_t *summary )
+{
+	return hist_summary( &resolve( m )->publish, summary );
+}
+
+
+/**
+ * Get the latency from posting a frame to the priority lane (stop, fast
+ * stop) to writing it
+ *
+ * @param *m			Metrics of the connection
+ * @param *summary		Percentiles in us
+ *
+ * @return 1 if anything has been written, else 0
+ */
+
+int metrics_urgent_summary( const metrics_t *m, metrics_summary_t *summary )
+{
+	return hist_summary( &resolve( m )->urgent, summary );
+}
+
+
+unsigned long metrics_frames( const metrics_t *m, unsigned char id ) { return resolve( m )->frames[id].load( std::memory_order_relaxed ); }
+unsigned long metrics_drops( const metrics_t *m, unsigned char id ) { return resolve( m )->drops[id].load( std::memory_order_relaxed ); }
+unsigned long metrics_crc_errors( const metrics_t *m ) { return resolve( m )->crc_errors.load( std::memory_order_relaxed ); }
+unsigned long metrics_resync_bytes( const metrics_t *m ) { return resolve( m )->resync_bytes.load( std::memory_order_relaxed ); }
+
+
+/**
+ * Write the metrics of several connections in the Prometheus text format,
+ * e.g. for the textfile collector of node_exporter. Each series is
+ * labeled with the name of its connection. The file is replaced
+ * atomically.
+ *
+ * @param *path		Output file
+ * @param *m		Metrics of the connections
+ * @param *names	Names of the connections; an empty name adds no label
+ * @param count		Number of connections
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int metrics_write_prometheus( const char *path, const metrics_t *const *m, const char *const *names, unsigned int count )
+{
+	std::string tmp = std::string( path ) + ".tmp";
+	std::vector<std::string> conn_labels( count );
+	char cmd[16];
+	unsigned int id, i;
+
+	FILE *f = fopen( tmp.c_str(), "w" );
+	if ( !f )
+	{
+		fprintf( stderr, "Cannot write metrics to %s\n", tmp.c_str() );
+		return -1;
+	}
+
+	for ( i = 0; i < count; i++ )
+		if ( names[i] && names[i][0] ) conn_labels[i] = std::string( "gripper=\"" ) + names[i] + "\"";
+
+	fprintf( f, "# HELP wsg50_command_rtt_seconds Time from sending a command to its first response\n" );
+	fprintf( f, "# TYPE wsg50_command_rtt_seconds summary\n" );
+	for ( i = 0; i < count; i++ )
+		for ( id = 0; id < 256; id++ )
+		{
+			const histogram *h = resolve( m[i] )->rtt[id].load( std::memory_order_acquire );
+			if ( !h ) continue;
+			snprintf( cmd, sizeof( cmd ), "cmd=\"0x%02X\"", id );
+			write_summary( f, "wsg50_command_rtt_seconds", with_label( conn_labels[i], cmd ), h );
+		}
+
+	fprintf( f, "# HELP wsg50_publish_latency_seconds Time from the arrival of a frame to its publication\n" );
+	fprintf( f, "# TYPE wsg50_publish_latency_seconds summary\n" );
+	for ( i = 0; i < count; i++ )
+		write_summary( f, "wsg50_publish_latency_seconds", conn_labels[i], &resolve( m[i] )->publish );
+
+	fprintf( f, "# HELP wsg50_stop_to_wire_seconds Time from requesting a stop or fast stop to writing its frame\n" );
+	fprintf( f, "# TYPE wsg50_stop_to_wire_seconds summary\n" );
+	for ( i = 0; i < count; i++ )
+		write_summary( f, "wsg50_stop_to_wire_seconds", conn_labels[i], &resolve( m[i] )->urgent );
+
+	fprintf( f, "# HELP wsg50_frames_received_total Frames received per command ID\n" );
+	fprintf( f, "# TYPE wsg50_frames_received_total counter\n" );
+	for ( i = 0; i < count; i++ )
+		for ( id = 0; id < 256; id++ )
+		{
+			unsigned long n = metrics_frames( m[i], (unsigned char) id );
+			if ( !n ) continue;
+			snprintf( cmd, sizeof( cmd ), "cmd=\"0x%02X\"", id );
+			fprintf( f, "wsg50_frames_received_total{%s} %lu\n", with_label( conn_labels[i], cmd ).c_str(), n );
+		}
+
+	fprintf( f, "# HELP wsg50_frames_dropped_total Frames dropped by the dispatcher because nobody picked them up\n" );
+	fprintf( f, "# TYPE wsg50_frames_dropped_total counter\n" );
+	for ( i = 0; i < count; i++ )
+		for ( id = 0; id < 256; id++ )
+		{
+			unsigned long n = metrics_drops( m[i], (unsigned char) id );
+			if ( !n ) continue;
+			snprintf( cmd, sizeof( cmd ), "cmd=\"0x%02X\"", id );
+			fprintf( f, "wsg50_frames_dropped_total{%s} %lu\n", with_label( conn_labels[i], cmd ).c_str(), n );
+		}
+
+	fprintf( f, "# HELP wsg50_checksum_errors_total Frames with a wrong checksum\n" );
+	fprintf( f, "# TYPE wsg50_checksum_errors_total counter\n" );
+	for ( i = 0; i < count; i++ )
+		fprintf( f, "wsg50_checksum_errors_total{%s} %lu\n", conn_labels[i].c_str(), metrics_crc_errors( m[i] ) );
+
+	fprintf( f, "# HELP wsg50_resync_bytes_total Bytes skipped while searching for the preamble\n" );
+	fprintf( f, "# TYPE wsg50_resync_bytes_total counter\n" );
+	for ( i = 0; i < count; i++ )
+		fprintf( f, "wsg50_resync_bytes_total{%s} %lu\n", conn_labels[i].c_str(), metrics_resync_bytes( m[i] ) );
+
+	if ( fclose( f ) != 0 || rename( tmp.c_str(), path ) != 0 )
+	{
+		fprintf( stderr, "Cannot write metrics to %s\n", path );
+		return -1;
+	}
+
+	return 0;
+}
@@ -51,34 +51,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 #include "wsg50/common.h"
 #include "wsg50/checksum.h"
 #include "wsg50/interface.h"
+#include "wsg50/metrics.h"
 #include "wsg50/msg.h"
+#include "wsg50/recorder.h"
 
 
 //------------------------------------------------------------------------
 // Macros
 //------------------------------------------------------------------------
 
+#define MSG_TX_BUFSIZE		256			// Messages up to this size are assembled on the stack if the interface has no writev
+
 
 //------------------------------------------------------------------------
 // Typedefs, enums, structs
 //------------------------------------------------------------------------
 
 
+
 //------------------------------------------------------------------------
 // Global variables
 //------------------------------------------------------------------------
 
-static const interface_t *interface;
 
 
 //------------------------------------------------------------------------
 // Local function prototypes
 //------------------------------------------------------------------------
 
+static void msg_rx_reset( msg_link_t *link );
+static int msg_rx_fill( msg_link_t *link, unsigned int max );
+static int msg_rx_extract( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int bufsize );
+static int msg_write_frame( msg_link_t *link, unsigned char id, const struct iovec *iov, unsigned int iovcnt, unsigned int len );
+static int msg_write_urgent( msg_link_t *link );
+
 
 //------------------------------------------------------------------------
 // Unit Testing
@@ -90,236 +102,617 @@ static const interface_t *interface;
 //------------------------------------------------------------------------
 
 /**
- * Receive answer
+ * Reset receive buffer, e.g. after the interface has changed
  *
- * @param **response		Data buffer
- * @param len				Expected size of message
+ * @param *link		Connection to the gripper
+ */
+
+static void msg_rx_reset( msg_link_t *link )
+{
+	link->rx.head = 0;
+	link->rx.tail = 0;
+}
+
+
+/**
+ * Read a block of data from the interface into the receive buffer
  *
- * @return Overall number of bytes received, including header and checksum. -1 on error.
+ * Data that has already been consumed is dropped from the buffer first,
+ * so that the whole free space can be filled with a single read call.
+ *
+ * @param *link		Connection to the gripper
+ * @param max			Maximum number of bytes to read (0: as many as fit)
+ *
+ * @return Number of bytes read, 0 if nothing was read, -1 on error
  */
 
-int msg_receive( msg_t *msg )
+static int msg_rx_fill( msg_link_t *link, unsigned int max )
 {
+	unsigned int space;
 	int res;
-	unsigned char header[3];			// 1 byte command, 2 bytes payload length
-	unsigned short checksum = 0x50f5;	// Checksum over preamble (0xaa 0xaa 0xaa)
-	unsigned int sync;
 
-	// Syncing - necessary for compatibility with serial interface
-	sync = 0;
-	while( sync != MSG_PREAMBLE_LEN )
+	// Move unconsumed data to the start of the buffer
+	if ( link->rx.head > 0 )
 	{
-		res = interface->read( header, 1 );
-		if ( header[0] == MSG_PREAMBLE_BYTE ) sync++;
+		if ( link->rx.tail > link->rx.head ) memmove( link->rx.buf, &link->rx.buf[link->rx.head], link->rx.tail - link->rx.head );
+		link->rx.tail -= link->rx.head;
+		link->rx.head = 0;
 	}
 
-	// Read header
-	res = interface->read( header, 3 );
-	if ( res < 3 )
+	space = MSG_RX_BUFSIZE - link->rx.tail;
+	if ( max > 0 && max < space ) space = max;
+	if ( space == 0 ) return 0;
+
+	res = link->iface->read( link->conn, &link->rx.buf[link->rx.tail], space );
+	if ( res > 0 )
 	{
-		fprintf( stderr, "Failed to receive header data (%d bytes read)\n", res );
-		return -1;
+		if ( link->rec )
+		{
+			struct iovec iov = { .iov_base = &link->rx.buf[link->rx.tail], .iov_len = (size_t) res };
+			recorder_write( link->rec, RECORDER_RX, &iov, 1 );
+		}
+
+		link->rx.tail += (unsigned int) res;
+
+		// Prefer the time the kernel received the data
+		if ( !link->iface->get_rx_time || link->iface->get_rx_time( link->conn, &link->rx.stamp ) != 0 )
+			clock_gettime( CLOCK_REALTIME, &link->rx.stamp );
 	}
 
-	// Calculate checksum over header
-	checksum = checksum_update_crc16( header, 3, checksum );
+	return res;
+}
 
-	// Get message id of received
-	msg->id = header[0];
 
-	// Get payload size of received message
-	msg->len = make_short( header[1], header[2] );
+/**
+ * Extract the next message from the receive buffer
+ *
+ * Bytes in front of the preamble are skipped. If the checksum of a
+ * message is wrong, only the first preamble byte is dropped, so the next
+ * call resynchronizes on the messages following the broken one. Skipped
+ * bytes and checksum errors are counted (see metrics.cpp).
+ *
+ * The message is stamped with the arrival of the data read last, as the
+ * message has been completed by that read.
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg			Message struct
+ * @param *buf			Buffer for the payload. If NULL, the payload (and
+ * 						checksum) is allocated and must be freed using msg_free()
+ * @param bufsize		Size of buffer
+ *
+ * @return Overall number of bytes of the message, 0 if there is no complete
+ *         message in the buffer, -1 on error
+ */
 
-	// Allocate space for payload and checksum
-	msg->data = malloc( msg->len + 2u );
-	if ( !msg->data ) return -1;
+static int msg_rx_extract( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int bufsize )
+{
+	unsigned char *p, *frame;
+	unsigned short checksum;
+	unsigned int len, size;
 
-	// Read payload and checksum
-	res = interface->read( msg->data, msg->len + 2 );
-	if ( res < (int) (msg->len + 2) )
+	while ( link->rx.tail - link->rx.head >= MSG_PREAMBLE_LEN )
 	{
-		fprintf( stderr, "Not enough data (%d, expected %d)\n", res, msg->len + 2 );
-		return -1;
+		// Syncing - necessary for compatibility with serial interface
+		p = memchr( &link->rx.buf[link->rx.head], MSG_PREAMBLE_BYTE, link->rx.tail - link->rx.head );
+		if ( !p )
+		{
+			metrics_resync( link->metrics, link->rx.tail - link->rx.head );
+			link->rx.head = link->rx.tail;
+			break;
+		}
+		if ( p != &link->rx.buf[link->rx.head] ) metrics_resync( link->metrics, (unsigned int) ( p - &link->rx.buf[link->rx.head] ) );
+		link->rx.head = (unsigned int) ( p - link->rx.buf );
+		if ( link->rx.tail - link->rx.head < MSG_PREAMBLE_LEN ) break;
+		if ( p[1] != MSG_PREAMBLE_BYTE || p[2] != MSG_PREAMBLE_BYTE )
+		{
+			metrics_resync( link->metrics, 1 );
+			link->rx.head++;
+			continue;
+		}
+
+		// Wait for header: 1 byte command, 2 bytes payload length
+		if ( link->rx.tail - link->rx.head < MSG_PREAMBLE_LEN + 3 ) break;
+
+		frame = &link->rx.buf[link->rx.head];
+		len = make_short( frame[MSG_PREAMBLE_LEN + 1], frame[MSG_PREAMBLE_LEN + 2] );
+		size = MSG_PREAMBLE_LEN + 3 + len + 2;
+		if ( size > MSG_RX_BUFSIZE )
+		{
+			fprintf( stderr, "Message too large (%d bytes payload)\n", len );
+			metrics_resync( link->metrics, 1 );
+			link->rx.head++;
+			continue;
+		}
+
+		// Wait for payload and checksum
+		if ( link->rx.tail - link->rx.head < size ) break;
+
+		// Check checksum over header, payload and checksum.
+		// 0x50f5 is the checksum over the preamble (0xaa 0xaa 0xaa).
+		checksum = checksum_update_crc16( &frame[MSG_PREAMBLE_LEN], len + 5, 0x50f5 );
+		if ( checksum != 0 )
+		{
+			fprintf( stderr, "Checksum error\n" );
+			metrics_crc_error( link->metrics );
+			metrics_resync( link->metrics, 1 );
+			link->rx.head++;
+			return -1;
+		}
+
+		msg->id = frame[MSG_PREAMBLE_LEN];
+		msg->len = len;
+		msg->stamp = link->rx.stamp;
+		metrics_frame_received( link->metrics, msg->id );
+		metrics_cmd_response( link->metrics, msg->id );
+
+		if ( buf )
+		{
+			// Copy payload to caller's buffer
+			if ( len > bufsize )
+			{
+				fprintf( stderr, "Receive buffer too small (%d, expected %d)\n", bufsize, len );
+				msg->data = NULL;
+				link->rx.head += size;
+				return -1;
+			}
+			memcpy( buf, &frame[MSG_PREAMBLE_LEN + 3], len );
+			msg->data = buf;
+		}
+		else
+		{
+			// Allocate space for payload and checksum
+			msg->data = malloc( len + 2u );
+			if ( !msg->data ) return -1;
+			memcpy( msg->data, &frame[MSG_PREAMBLE_LEN + 3], len + 2 );
+		}
+
+		link->rx.head += size;
+		if ( link->rx.head == link->rx.tail ) msg_rx_reset( link );
+
+		return (int) size;
 	}
 
-	// Check checksum
-	checksum = checksum_update_crc16( msg->data, msg->len + 2, checksum );
-	if ( checksum != 0 )
+	return 0;
+}
+
+
+/**
+ * Receive answer into a caller-supplied buffer
+ *
+ * Data is read from the interface in blocks. Messages that are already
+ * in the receive buffer are returned without accessing the interface.
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg		Message struct; data points to buf afterwards
+ * @param *buf		Buffer for the payload. If NULL, the payload is
+ * 					allocated and must be freed using msg_free().
+ * @param size		Size of buffer
+ *
+ * @return Overall number of bytes received, including header and checksum.
+ *         0 if the interface timed out before a message was complete, -1 on error.
+ */
+
+int msg_receive_into( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int size )
+{
+	int res;
+
+	while ( ( res = msg_rx_extract( link, msg, buf, size ) ) == 0 )
 	{
-		fprintf( stderr, "Checksum error\n" );
-		return -1;
+		res = msg_rx_fill( link, 0 );
+		if ( res == 0 ) return 0;
+		if ( res < 0 )
+		{
+			fprintf( stderr, "Failed to receive data (%d bytes read)\n", res );
+			return -1;
+		}
 	}
 
-	return msg->len + 8;
+	return res;
 }
 
-//  returns 0 when no msg available, 1 when msg is available and correct, -1 on error
-int msg_receive_async( msg_t *msg ) {
-	int bytes_count = interface->get_bytes_count();
+
+/**
+ * Receive answer into a caller-supplied buffer without blocking
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg		Message struct; data points to buf afterwards
+ * @param *buf		Buffer for the payload. If NULL, the payload is
+ * 					allocated and must be freed using msg_free().
+ * @param size		Size of buffer
+ *
+ * @return 0 when no msg available, 1 when msg is available and correct, -1 on error
+ */
+
+int msg_receive_async_into( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int size )
+{
+	int res;
+
+	// Check for message that has already been received
+	res = msg_rx_extract( link, msg, buf, size );
+	if ( res != 0 ) return res < 0 ? -1 : 1;
+
+	int bytes_count = link->iface->get_bytes_count( link->conn );
 	if ( bytes_count == 0) return 0;
 	if ( bytes_count < 0) return -1;
 	// fprintf( stdout, "Number of available bytes is %d \n", bytes_count);
 
-	int res;
-	unsigned char header[3];			// 1 byte command, 2 bytes payload length
-	unsigned short checksum = 0x50f5;	// Checksum over preamble (0xaa 0xaa 0xaa)
-	unsigned int sync;
-
-	// Syncing - necessary for compatibility with serial interface
-	sync = 0;
-	while( sync != MSG_PREAMBLE_LEN ) {
-		res = interface->read( header, 1 );
-		if ( header[0] == MSG_PREAMBLE_BYTE ) sync++;
-	}
+	// Read only what is available, so this does not block
+	res = msg_rx_fill( link, (unsigned int) bytes_count );
+	if ( res < 0 ) return -1;
 
-	// Read header
-	res = interface->read( header, 3 );
-	if (res < 0) {
-		return -1;
-	}
-	if ( res < 3 )
-	{
-		fprintf( stderr, "Failed to receive header data (%d bytes read)\n", res );
-		return -1;
-	}
+	res = msg_rx_extract( link, msg, buf, size );
+	if ( res == 0 ) return 0;
+	if ( res < 0 ) return -1;
 
-	// Calculate checksum over header
-	checksum = checksum_update_crc16( header, 3, checksum );
+	return 1;
+}
 
-	// Get message id of received
-	msg->id = header[0];
 
-	// Get payload size of received message
-	msg->len = make_short( header[1], header[2] );
+/**
+ * Read whatever the interface has to offer into the receive buffer
+ *
+ * Meant to be called once the descriptor returned by msg_get_fd() is
+ * readable, so the read does not block. Complete messages can be taken
+ * from the buffer with msg_receive_buffered_into() afterwards.
+ *
+ * @param *link		Connection to the gripper
+ *
+ * @return Number of bytes read, 0 on interface timeout, -1 on error
+ */
 
-	// Allocate space for payload and checksum
-	msg->data = malloc( msg->len + 2u );
-	if ( !msg->data ) {
-		return -1;
-	}
+int msg_receive_fill( msg_link_t *link )
+{
+	if ( !link->iface ) return -1;
+	return msg_rx_fill( link, 0 );
+}
 
-	// Read payload and checksum
-	res = interface->read( msg->data, msg->len + 2 );
-	if ( res < (int) (msg->len + 2) )
-	{
-		fprintf( stderr, "Not enough data (%d, expected %d)\n", res, msg->len + 2 );
-		return -1;
-	}
 
-	// Check checksum
-	checksum = checksum_update_crc16( msg->data, msg->len + 2, checksum );
-	if ( checksum != 0 )
-	{
-		fprintf( stderr, "Checksum error\n" );
-		return -1;
-	}
+/**
+ * Take the next complete message from the receive buffer, without
+ * accessing the interface
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg		Message struct; data points to buf afterwards
+ * @param *buf		Buffer for the payload
+ * @param size		Size of buffer
+ *
+ * @return Overall number of bytes of the message, 0 if there is no complete
+ *         message in the buffer, -1 on error
+ */
 
-	return 1;
+int msg_receive_buffered_into( msg_link_t *link, msg_t *msg, unsigned char *buf, unsigned int size )
+{
+	return msg_rx_extract( link, msg, buf, size );
 }
 
+
 /**
- * Send command
+ * Get the descriptor of the command interface to wait for incoming data
+ *
+ * @param *link		Connection to the gripper
+ *
+ * @return Descriptor, -1 if the interface does not provide one
+ */
+
+int msg_get_fd( msg_link_t *link )
+{
+	if ( !link->iface || !link->iface->get_fd ) return -1;
+	return link->iface->get_fd( link->conn );
+}
+
+
+/**
+ * Record the traffic of a link, or stop recording (rec is NULL). Must not
+ * be called while the link is in use.
+ *
+ * @param *link		Connection to the gripper
+ * @param *rec		Open recorder
+ */
+
+void msg_set_recorder( msg_link_t *link, struct recorder *rec )
+{
+	link->rec = rec;
+}
+
+
+/**
+ * Receive answer
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg		Message struct; payload is allocated and must be
+ * 					freed using msg_free()
+ *
+ * @return Overall number of bytes received, including header and checksum. -1 on error.
+ */
+
+int msg_receive( msg_link_t *link, msg_t *msg )
+{
+	return msg_receive_into( link, msg, NULL, 0 );
+}
+
+//  returns 0 when no msg available, 1 when msg is available and correct, -1 on error
+int msg_receive_async( msg_link_t *link, msg_t *msg )
+{
+	return msg_receive_async_into( link, msg, NULL, 0 );
+}
+
+
+/**
+ * Write a frame; tx_lock must be held
  *
+ * @param *link		Connection to the gripper
  * @param id		Command ID
+ * @param *iov		Payload chunks
+ * @param iovcnt	Number of payload chunks
  * @param len		Payload length
- * @param *payload	Payload data
  *
- * @return 0 on success, else -1
+ * @return Overall number of bytes sent, else -1
  */
 
-int msg_send( msg_t *msg )
+static int msg_write_frame( msg_link_t *link, unsigned char id, const struct iovec *iov, unsigned int iovcnt, unsigned int len )
 {
 	unsigned char header[MSG_PREAMBLE_LEN + 3];
-    //unsigned char checksum[2];
+	unsigned char checksum[2];
+	unsigned char txbuf[MSG_TX_BUFSIZE];
+	unsigned char *buf;
+	struct iovec vec[MSG_IOV_MAX + 2];
 	unsigned short crc;
-	int i, res;
+	unsigned int i, size, off;
+	int res;
+
+	size = MSG_PREAMBLE_LEN + 3 + len + 2;
 
 	// Preamble
 	for ( i = 0; i < MSG_PREAMBLE_LEN; i++ ) header[i] = MSG_PREAMBLE_BYTE;
 
 	// Command ID
-	header[MSG_PREAMBLE_LEN] = msg->id;
+	header[MSG_PREAMBLE_LEN] = id;
 
 	// Length
-	header[MSG_PREAMBLE_LEN + 1] = lo( msg->len );
-	header[MSG_PREAMBLE_LEN + 2] = hi( msg->len );
+	header[MSG_PREAMBLE_LEN + 1] = lo( len );
+	header[MSG_PREAMBLE_LEN + 2] = hi( len );
 
 	// Checksum
 	crc = checksum_crc16( header, 6 );
-	crc = checksum_update_crc16( msg->data, msg->len, crc );
+	for ( i = 0; i < iovcnt; i++ ) crc = checksum_update_crc16( (unsigned char *) iov[i].iov_base, iov[i].iov_len, crc );
 
-    //checksum[0] = lo( crc );
-    //checksum[1] = hi( crc );
+	checksum[0] = lo( crc );
+	checksum[1] = hi( crc );
 
-	if ( interface->write )
+	// Before writing, so a fast response cannot be missed
+	metrics_cmd_sent( link->metrics, id );
+
+	if ( link->iface->writev )
+	{
+		vec[0].iov_base = header;
+		vec[0].iov_len = sizeof( header );
+		for ( i = 0; i < iovcnt; i++ ) vec[i + 1] = iov[i];
+		vec[iovcnt + 1].iov_base = checksum;
+		vec[iovcnt + 1].iov_len = sizeof( checksum );
+
+		res = link->iface->writev( link->conn, vec, iovcnt + 2 );
+		if ( link->rec && res == (int) size ) recorder_write( link->rec, RECORDER_TX, vec, iovcnt + 2 );
+	}
+	else
 	{
+		// Assemble message in one buffer
+		buf = size <= sizeof( txbuf ) ? txbuf : malloc( size );
+		if ( !buf ) return -1;
 
-		unsigned char *buf = malloc( 6 + msg->len + 2 ); // 6+2 fixes (PREAMBLE, ID, PAILOAD / ... / CRC)
 		memcpy( buf, header, 6 );
-		memcpy( buf + 6, msg->data, msg->len );
-		memcpy( buf + 6 + msg->len, (unsigned char *) &crc, 2 );
+		off = 6;
+		for ( i = 0; i < iovcnt; i++ )
+		{
+			memcpy( buf + off, iov[i].iov_base, iov[i].iov_len );
+			off += iov[i].iov_len;
+		}
+		memcpy( buf + off, checksum, 2 );
 
-		res = interface->write( buf, 6 + msg->len + 2 );
-        if ( res < 6 + (int)msg->len + 2 )
+		res = link->iface->write( link->conn, buf, size );
+		if ( link->rec && res == (int) size )
 		{
-			interface->close();
-			quit( "Failed to submit message checksum" );
+			struct iovec iov_buf = { .iov_base = buf, .iov_len = size };
+			recorder_write( link->rec, RECORDER_TX, &iov_buf, 1 );
 		}
 
-		free( buf );
-
-// The following implementation doesn't work:
-//
-//		// Submit header
-//		res = interface->write( header, 6 );
-//		if ( res < 6 )
-//		{
-//			interface->close();
-//			quit( "Failed to submit message header" );
-//		}
-//
-//		// Submit payload
-//		res = interface->write( msg->data, msg->len );
-//		if ( res < msg->len )
-//		{
-//			interface->close();
-//			quit( "Failed to submit message payload" );
-//		}
-//
-//		res = interface->write( (unsigned char *) &crc, 2 );
-//		if ( res < sizeof( crc ) )
-//		{
-//			interface->close();
-//			quit( "Failed to submit message checksum" );
-//		}
-
-//		unsigned short check = checksum_crc16( header, 6 );
-//		check = checksum_update_crc16( msg->data, msg->len, check );
-//		check = checksum_update_crc16( (unsigned char *) &crc, sizeof( short ), check );
-
-		return msg->len + 8;
+		if ( buf != txbuf ) free( buf );
 	}
 
-	return -1;
+	// The link is broken; reconnecting is up to the caller
+	if ( res < (int) size )
+	{
+		fprintf( stderr, "Failed to submit message (%d of %u bytes sent)\n", res, size );
+		return -1;
+	}
+
+	return (int) size;
+}
+
+
+/**
+ * Write the frame waiting in the priority lane, if any; tx_lock must be held
+ *
+ * @return 1 if a frame was written, 0 if none was waiting, -1 on error
+ */
+
+static int msg_write_urgent( msg_link_t *link )
+{
+	msg_urgent_t *u = &link->urgent;
+	struct iovec iov;
+	int res;
+
+	// Only moves on from READY under tx_lock, so nobody else takes it meanwhile
+	if ( __atomic_load_n( &u->state, __ATOMIC_ACQUIRE ) != MSG_URGENT_READY ) return 0;
+	u->state = MSG_URGENT_WRITING;
+
+	iov.iov_base = u->payload;
+	iov.iov_len = u->len;
+	res = msg_write_frame( link, u->id, &iov, 1, u->len );
+	if ( res > 0 ) metrics_urgent_written( link->metrics, &u->posted );
+
+	__atomic_store_n( &u->state, MSG_URGENT_EMPTY, __ATOMIC_RELEASE );
+
+	return res > 0 ? 1 : -1;
+}
+
+
+/**
+ * Send command with the payload given as scatter/gather list
+ *
+ * Preamble, header and checksum are kept on the stack. If the interface
+ * supports it, everything is passed to the interface in one writev call
+ * without copying the payload.
+ *
+ * Note: The message must be submitted by a single call to the interface.
+ * Writing header, payload and checksum separately does not work (e.g. the
+ * UDP interface would send three datagrams). The call is serialized, so
+ * messages may be sent from several threads.
+ *
+ * @param *link		Connection to the gripper
+ * @param id		Command ID
+ * @param *iov		Payload data chunks
+ * @param iovcnt	Number of payload data chunks (max. MSG_IOV_MAX)
+ *
+ * @return Overall number of bytes sent, else -1
+ */
+
+int msg_send_iov( msg_link_t *link, unsigned char id, const struct iovec *iov, unsigned int iovcnt )
+{
+	unsigned int i, len = 0;
+	int res;
+
+	if ( !link->iface || iovcnt > MSG_IOV_MAX ) return -1;
+	if ( !link->iface->writev && !link->iface->write ) return -1;
+
+	for ( i = 0; i < iovcnt; i++ ) len += iov[i].iov_len;
+	if ( len > 0xffff ) return -1;
+
+	pthread_mutex_lock( &link->tx_lock );
+
+	// A frame in the priority lane overtakes this one
+	msg_write_urgent( link );
+	res = msg_write_frame( link, id, iov, iovcnt, len );
+
+	pthread_mutex_unlock( &link->tx_lock );
+
+	return res;
+}
+
+
+/**
+ * Post a frame to the priority lane of a link. It is written by the next
+ * thread that gets the link, before the frame that thread wanted to send,
+ * or by msg_flush_urgent(). Only one frame can be waiting.
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg		Message to send, at most MSG_URGENT_LEN bytes payload
+ *
+ * @return 0 on success, -1 if a frame is waiting already or the payload is too long
+ */
+
+int msg_post_urgent( msg_link_t *link, const msg_t *msg )
+{
+	msg_urgent_t *u = &link->urgent;
+	int empty = MSG_URGENT_EMPTY;
+
+	if ( msg->len > MSG_URGENT_LEN ) return -1;
+	if ( !__atomic_compare_exchange_n( &u->state, &empty, MSG_URGENT_FILLING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+		return -1;
+
+	u->id = msg->id;
+	u->len = (unsigned char) msg->len;
+	if ( msg->len ) memcpy( u->payload, msg->data, msg->len );
+	clock_gettime( CLOCK_MONOTONIC, &u->posted );
+
+	__atomic_store_n( &u->state, MSG_URGENT_READY, __ATOMIC_RELEASE );
+
+	return 0;
+}
+
+
+/**
+ * Write the frame waiting in the priority lane, if any
+ *
+ * @param *link		Connection to the gripper
+ *
+ * @return 1 if a frame was written, 0 if none was waiting, -1 on error
+ */
+
+int msg_flush_urgent( msg_link_t *link )
+{
+	int res;
+
+	if ( !msg_urgent_pending( link ) ) return 0;
+
+	pthread_mutex_lock( &link->tx_lock );
+	res = msg_write_urgent( link );
+	pthread_mutex_unlock( &link->tx_lock );
+
+	return res;
+}
+
+
+/**
+ * Check for a frame waiting in the priority lane
+ */
+
+bool msg_urgent_pending( msg_link_t *link )
+{
+	return __atomic_load_n( &link->urgent.state, __ATOMIC_ACQUIRE ) == MSG_URGENT_READY;
+}
+
+
+/**
+ * Send command
+ *
+ * @param *link		Connection to the gripper
+ * @param *msg		Message to send (id, payload length and data)
+ *
+ * @return Overall number of bytes sent, else -1
+ */
+
+int msg_send( msg_link_t *link, msg_t *msg )
+{
+	struct iovec iov =
+	{
+		.iov_base = msg->data,
+		.iov_len = msg->len
+	};
+
+	return msg_send_iov( link, msg->id, &iov, msg->len > 0 ? 1 : 0 );
 }
 
 
 /**
  * Change command interface
  *
+ * @param *link		Connection to the gripper
  * @param *iface		Pointer to interface struct
  * 						describing new interface
  *
  * @return 0 on success, else -1
  */
 
-int msg_change_interface( const interface_t *iface )
+int msg_change_interface( msg_link_t *link, const interface_t *iface )
 {
+	void *conn;
+
 	if ( !iface ) return -1;
 
-	if ( interface && iface != interface && interface->close ) interface->close();
+	if ( iface != link->iface || !link->conn )
+	{
+		// Connection state matches the interface, so it is replaced as well
+		conn = calloc( 1, iface->conn_size > 0 ? iface->conn_size : 1 );
+		if ( !conn ) return -1;
+
+		if ( link->iface && link->iface->close ) link->iface->close( link->conn );
+		free( link->conn );
+
+		link->conn = conn;
+	}
 
-	interface = iface;
+	link->iface = iface;
+	msg_rx_reset( link );
 
 	return 0;
 }
@@ -328,6 +721,7 @@ int msg_change_interface( const interface_t *iface )
 /**
  * Open command interface
  *
+ * @param *link			Connection to the gripper
  * @param *iface
  * @param *params		Pointer referencing a struct that holds
  * 						parameters for the interface (e.g. address)
@@ -335,26 +729,79 @@ int msg_change_interface( const interface_t *iface )
  * @return 0 on success, else -1
  */
 
-int msg_open( const interface_t *iface, const void *params )
+int msg_open( msg_link_t *link, const interface_t *iface, const void *params )
 {
 	int res;
 
-	res = msg_change_interface( iface );
+	res = msg_change_interface( link, iface );
 	if ( res < 0 ) return( res );
 
-	if ( iface->open ) return iface->open( params );
+	if ( iface->open ) return iface->open( link->conn, params );
 	else return -1;
 }
 
 
 /**
  * Close command interface
+ *
+ * @param *link			Connection to the gripper
+ */
+
+void msg_close( msg_link_t *link )
+{
+	if ( !link->iface || !link->iface->close ) return;
+
+	// Not while another thread is sending. A frame still waiting in the
+	// priority lane is meant for this connection, not for the next one.
+	pthread_mutex_lock( &link->tx_lock );
+	link->iface->close( link->conn );
+	if ( msg_urgent_pending( link ) ) __atomic_store_n( &link->urgent.state, MSG_URGENT_EMPTY, __ATOMIC_RELEASE );
+	pthread_mutex_unlock( &link->tx_lock );
+
+	msg_rx_reset( link );
+}
+
+
+/**
+ * Prepare a connection struct for msg_open()
+ *
+ * @param *link			Connection to the gripper
+ *
+ * @return 0 on success, else -1
+ */
+
+int msg_link_init( msg_link_t *link )
+{
+	memset( link, 0, sizeof( *link ) );
+
+	link->metrics = metrics_create();
+	if ( !link->metrics ) return -1;
+
+	if ( pthread_mutex_init( &link->tx_lock, NULL ) != 0 )
+	{
+		metrics_destroy( link->metrics );
+		link->metrics = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Release a connection struct. The interface has to be closed already.
+ *
+ * @param *link			Connection to the gripper
  */
 
-void msg_close( void )
+void msg_link_destroy( msg_link_t *link )
 {
-	if ( !interface || !interface->close ) return;
-	interface->close();
+	free( link->conn );
+	link->conn = NULL;
+	link->iface = NULL;
+	metrics_destroy( link->metrics );
+	link->metrics = NULL;
+	pthread_mutex_destroy( &link->tx_lock );
 }
 
 
@@ -367,7 +814,7 @@ void msg_close( void )
 void msg_free( msg_t *msg )
 {
 	if ( msg->data ) free( msg->data );
-	memset( msg, 0, sizeof( msg ) );
+	memset( msg, 0, sizeof( *msg ) );
 }
 
 
@@ -0,0 +1,212 @@
+//======================================================================
+/**
+ *  @file
+ *  reactor.c
+ *
+ *  @section reactor.c_general General file information
+ *
+ *  @brief
+ *  Event loop primitive based on epoll
+ *
+ *  A reactor waits on the descriptors of any number of gripper links and
+ *  on an eventfd that lets other threads wake the waiting thread. The
+ *  waiting thread sleeps in the kernel until one of them fires, so no CPU
+ *  time is spent while the grippers are busy, and a single thread can
+ *  serve all of them.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "wsg50/common.h"
+#include "wsg50/reactor.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+static void reactor_drain( int fd );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+/**
+ * Read the counter of an eventfd, so it stops firing
+ */
+
+static void reactor_drain( int fd )
+{
+	uint64_t cnt;
+	ssize_t res;
+
+	res = read( fd, &cnt, sizeof( cnt ) );
+	(void) res;
+}
+
+
+/**
+ * Create a reactor
+ *
+ * @param *r			Reactor struct
+ *
+ * @return 0 on success, else -1
+ */
+
+int reactor_open( reactor_t *r )
+{
+	struct epoll_event ev;
+
+	r->epfd = epoll_create1( EPOLL_CLOEXEC );
+	r->wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+	if ( r->epfd < 0 || r->wake_fd < 0 ) goto fail;
+
+	// The eventfd is told apart from the links by pointing to itself
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.ptr = &r->wake_fd;
+	if ( epoll_ctl( r->epfd, EPOLL_CTL_ADD, r->wake_fd, &ev ) < 0 ) goto fail;
+
+	return 0;
+
+fail:
+	fprintf( stderr, "Cannot create event loop: %s\n", strerror( errno ) );
+	reactor_close( r );
+	return -1;
+}
+
+
+/**
+ * Destroy a reactor. The link descriptors are not closed.
+ */
+
+void reactor_close( reactor_t *r )
+{
+	if ( r->epfd >= 0 ) close( r->epfd );
+	if ( r->wake_fd >= 0 ) close( r->wake_fd );
+
+	r->epfd = r->wake_fd = -1;
+}
+
+
+/**
+ * Wait for data on a link descriptor. May be called while another thread
+ * waits in reactor_wait().
+ *
+ * @param *r			Reactor struct
+ * @param fd			Descriptor
+ * @param *ptr			Reported by reactor_wait() when the descriptor is readable
+ *
+ * @return 0 on success, else -1
+ */
+
+int reactor_add( reactor_t *r, int fd, void *ptr )
+{
+	struct epoll_event ev;
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.ptr = ptr;
+
+	if ( epoll_ctl( r->epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+	{
+		fprintf( stderr, "Cannot wait for descriptor %d: %s\n", fd, strerror( errno ) );
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Stop waiting for data on a link descriptor. Note that a reactor_wait()
+ * call running at the same time may still report it.
+ *
+ * @param *r			Reactor struct
+ * @param fd			Descriptor
+ *
+ * @return 0 on success, else -1
+ */
+
+int reactor_remove( reactor_t *r, int fd )
+{
+	return epoll_ctl( r->epfd, EPOLL_CTL_DEL, fd, NULL );
+}
+
+
+/**
+ * Sleep until something happens
+ *
+ * @param *r			Reactor struct
+ * @param timeout_ms	Max. time to wait, < 0 waits forever
+ * @param **ready		Pointers of the readable links, REACTOR_MAX_EVENTS entries
+ * @param *count		Number of readable links
+ *
+ * @return Combination of REACTOR_xxx flags, 0 on timeout, -1 on error
+ */
+
+int reactor_wait( reactor_t *r, int timeout_ms, void **ready, unsigned int *count )
+{
+	struct epoll_event ev[REACTOR_MAX_EVENTS];
+	int res, i, flags = 0;
+
+	*count = 0;
+
+	res = epoll_wait( r->epfd, ev, REACTOR_MAX_EVENTS, timeout_ms );
+	if ( res < 0 ) return errno == EINTR ? 0 : -1;
+
+	for ( i = 0; i < res; i++ )
+	{
+		if ( ev[i].data.ptr == &r->wake_fd )
+		{
+			flags |= REACTOR_WAKEUP;
+			continue;
+		}
+
+		// Errors/hangup on a link are reported as readable, the read call returns the error
+		ready[( *count )++] = ev[i].data.ptr;
+		flags |= REACTOR_READABLE;
+	}
+
+	if ( flags & REACTOR_WAKEUP ) reactor_drain( r->wake_fd );
+
+	return flags;
+}
+
+
+/**
+ * Wake up the thread waiting in reactor_wait(). May be called from any thread.
+ */
+
+void reactor_wakeup( reactor_t *r )
+{
+	uint64_t one = 1;
+	ssize_t res;
+
+	res = write( r->wake_fd, &one, sizeof( one ) );
+	(void) res;
+}
+
+
+//------------------------------------------------------------------------
+// Testing functions
+//------------------------------------------------------------------------
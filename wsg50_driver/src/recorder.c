@@ -0,0 +1,281 @@
+//======================================================================
+/**
+ *  @file
+ *  recorder.c
+ *
+ *  @section recorder.c_general General file information
+ *
+ *  @brief
+ *  Recorder of the link traffic
+ *
+ *  Writing a record costs a clock read, an atomic add and a copy into the
+ *  mapped file; nothing is formatted and no system call is made. The
+ *  kernel writes the pages back on its own, so the recording survives a
+ *  crash of the process. The reader thread and the sending threads may
+ *  record at the same time: each reserves its records with the atomic
+ *  add, and a record is valid once its sequence number has been written.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wsg50/recorder.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define RECORDER_MIN_RECORDS		64		// Enough for the largest message the link layer accepts
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+static uint64_t recorder_clock_ns( clockid_t clock );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+static uint64_t recorder_clock_ns( clockid_t clock )
+{
+	struct timespec ts;
+	clock_gettime( clock, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+/**
+ * Create a recording. A file that exists already is kept as <path>.prev,
+ * so restarting after a failure does not overwrite its recording.
+ *
+ * @param *rec			Recorder
+ * @param *path			File name
+ * @param size			Size of the file in bytes
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int recorder_open( recorder_t *rec, const char *path, size_t size )
+{
+	char prev[PATH_MAX];
+	uint64_t capacity;
+
+	memset( rec, 0, sizeof( *rec ) );
+	rec->fd = -1;
+
+	capacity = size > sizeof( recorder_header_t ) ? ( size - sizeof( recorder_header_t ) ) / sizeof( recorder_record_t ) : 0;
+	if ( capacity < RECORDER_MIN_RECORDS )
+	{
+		fprintf( stderr, "Recording of %zu bytes too small\n", size );
+		return -1;
+	}
+	rec->map_size = sizeof( recorder_header_t ) + capacity * sizeof( recorder_record_t );
+
+	if ( snprintf( prev, sizeof( prev ), "%s.prev", path ) < (int) sizeof( prev ) &&
+		 rename( path, prev ) != 0 && errno != ENOENT )
+		fprintf( stderr, "Unable to keep the previous recording %s: %s\n", path, strerror( errno ) );
+
+	rec->fd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+	if ( rec->fd < 0 )
+	{
+		fprintf( stderr, "Unable to create recording %s: %s\n", path, strerror( errno ) );
+		return -1;
+	}
+
+	if ( ftruncate( rec->fd, (off_t) rec->map_size ) != 0 )
+	{
+		fprintf( stderr, "Unable to size recording %s: %s\n", path, strerror( errno ) );
+		recorder_close( rec );
+		return -1;
+	}
+
+	// Fault the pages in now rather than while recording
+	rec->hdr = mmap( NULL, rec->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rec->fd, 0 );
+	if ( rec->hdr == MAP_FAILED )
+	{
+		fprintf( stderr, "Unable to map recording %s: %s\n", path, strerror( errno ) );
+		rec->hdr = NULL;
+		recorder_close( rec );
+		return -1;
+	}
+	rec->rec = (recorder_record_t *) ( rec->hdr + 1 );
+
+	memcpy( rec->hdr->magic, RECORDER_MAGIC, sizeof( rec->hdr->magic ) );
+	rec->hdr->version = RECORDER_VERSION;
+	rec->hdr->record_size = sizeof( recorder_record_t );
+	rec->hdr->capacity = capacity;
+	rec->hdr->count = 0;
+	rec->hdr->realtime_offset_ns = (int64_t) ( recorder_clock_ns( CLOCK_REALTIME ) - recorder_clock_ns( CLOCK_MONOTONIC ) );
+
+	printf( "Recording link traffic to %s (%llu records)\n", path, (unsigned long long) capacity );
+
+	return 0;
+}
+
+
+/**
+ * Open a recording for reading
+ *
+ * @param *rec			Recorder
+ * @param *path			File name
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int recorder_map( recorder_t *rec, const char *path )
+{
+	struct stat st;
+
+	memset( rec, 0, sizeof( *rec ) );
+
+	rec->fd = open( path, O_RDONLY | O_CLOEXEC );
+	if ( rec->fd < 0 || fstat( rec->fd, &st ) != 0 )
+	{
+		fprintf( stderr, "Unable to open recording %s: %s\n", path, strerror( errno ) );
+		recorder_close( rec );
+		return -1;
+	}
+
+	rec->map_size = (size_t) st.st_size;
+	if ( rec->map_size < sizeof( recorder_header_t ) ) goto invalid;
+
+	rec->hdr = mmap( NULL, rec->map_size, PROT_READ, MAP_SHARED, rec->fd, 0 );
+	if ( rec->hdr == MAP_FAILED )
+	{
+		rec->hdr = NULL;
+		goto invalid;
+	}
+	rec->rec = (recorder_record_t *) ( rec->hdr + 1 );
+
+	if ( memcmp( rec->hdr->magic, RECORDER_MAGIC, sizeof( rec->hdr->magic ) ) != 0 ||
+		 rec->hdr->version != RECORDER_VERSION || rec->hdr->record_size != sizeof( recorder_record_t ) ||
+		 rec->hdr->capacity == 0 ||
+		 rec->hdr->capacity > ( rec->map_size - sizeof( recorder_header_t ) ) / sizeof( recorder_record_t ) )
+		goto invalid;
+
+	return 0;
+
+invalid:
+	fprintf( stderr, "%s is no recording of this version\n", path );
+	recorder_close( rec );
+	return -1;
+}
+
+
+/**
+ * Close a recording
+ *
+ * @param *rec			Recorder
+ */
+
+void recorder_close( recorder_t *rec )
+{
+	if ( rec->hdr ) munmap( rec->hdr, rec->map_size );
+	if ( rec->fd >= 0 ) close( rec->fd );
+	memset( rec, 0, sizeof( *rec ) );
+	rec->fd = -1;
+}
+
+
+/**
+ * Append a chunk of data, taking as many records as it needs
+ *
+ * @param *rec			Recorder
+ * @param dir			RECORDER_RX, RECORDER_TX
+ * @param *iov			Data of the chunk
+ * @param iovcnt		Number of data pieces
+ */
+
+void recorder_write( recorder_t *rec, unsigned int dir, const struct iovec *iov, unsigned int iovcnt )
+{
+	recorder_record_t *r;
+	uint64_t t, i, n, k;
+	size_t total = 0, piece = 0, off = 0, len;
+	unsigned int v;
+
+	for ( v = 0; v < iovcnt; v++ ) total += iov[v].iov_len;
+	if ( total == 0 ) return;
+
+	n = ( total + RECORDER_DATA_LEN - 1 ) / RECORDER_DATA_LEN;
+	if ( n > rec->hdr->capacity ) return;
+
+	t = recorder_clock_ns( CLOCK_MONOTONIC );
+	i = __atomic_fetch_add( &rec->hdr->count, n, __ATOMIC_RELAXED );
+
+	for ( k = 0; k < n; k++ )
+	{
+		r = &rec->rec[( i + k ) % rec->hdr->capacity];
+		__atomic_store_n( &r->seq, 0, __ATOMIC_RELAXED );
+
+		r->t_ns = t;
+		r->dir = (uint8_t) dir;
+		r->flags = k + 1 < n ? RECORDER_MORE : 0;
+		r->len = 0;
+
+		// Gather the data of this record from the pieces
+		while ( r->len < RECORDER_DATA_LEN && piece < iovcnt )
+		{
+			len = iov[piece].iov_len - off;
+			if ( len > (size_t) ( RECORDER_DATA_LEN - r->len ) ) len = RECORDER_DATA_LEN - r->len;
+			memcpy( &r->data[r->len], (const unsigned char *) iov[piece].iov_base + off, len );
+			r->len += (uint16_t) len;
+			off += len;
+			if ( off == iov[piece].iov_len )
+			{
+				piece++;
+				off = 0;
+			}
+		}
+
+		__atomic_store_n( &r->seq, i + k + 1, __ATOMIC_RELEASE );
+	}
+}
+
+
+/**
+ * Get the number of the oldest record still in the file
+ */
+
+uint64_t recorder_first( const recorder_t *rec )
+{
+	uint64_t count = __atomic_load_n( &rec->hdr->count, __ATOMIC_ACQUIRE );
+	return count > rec->hdr->capacity ? count - rec->hdr->capacity : 0;
+}
+
+
+/**
+ * Get a record
+ *
+ * @param *rec			Recorder
+ * @param i				Number of the record, from recorder_first() on
+ *
+ * @return The record, NULL if it does not exist (any more) or is incomplete
+ */
+
+const recorder_record_t * recorder_get( const recorder_t *rec, uint64_t i )
+{
+	const recorder_record_t *r;
+
+	if ( i >= __atomic_load_n( &rec->hdr->count, __ATOMIC_ACQUIRE ) ) return NULL;
+
+	r = &rec->rec[i % rec->hdr->capacity];
+	if ( __atomic_load_n( &r->seq, __ATOMIC_ACQUIRE ) != i + 1 ) return NULL;
+	return r;
+}
@@ -0,0 +1,336 @@
+//======================================================================
+/**
+ *  @file
+ *  replay.c
+ *
+ *  @section replay.c_general General file information
+ *
+ *  @brief
+ *  Replay interface
+ *
+ *  The received data of a recording is handed out in the order and at
+ *  the times it was recorded, relative to the start of the replay. The
+ *  messages sent are ignored, so the driver sees the same byte stream
+ *  whatever it sends; broken frames and resyncs are replayed as well.
+ *  Reads are stamped with the original receive time.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "wsg50/interface.h"
+#include "wsg50/recorder.h"
+#include "wsg50/replay.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define REPLAY_RCV_TIMEOUT_NS				1000000000ull	// Max. time a read waits for data
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+const interface_t replay =
+{
+	.name = "replay",
+	.conn_size = sizeof( replay_conn_t ),
+	.open = &replay_open,
+	.close = &replay_close,
+	.read = &replay_read,
+	.write = &replay_write,
+	.get_bytes_count = &replay_get_bytes_count,
+	.writev = &replay_writev,
+	.get_fd = NULL,
+	.get_rx_time = &replay_get_rx_time
+};
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+static uint64_t replay_now( void );
+static const recorder_record_t * replay_next_rx( replay_conn_t *conn );
+static uint64_t replay_due( const replay_conn_t *conn, const recorder_record_t *r );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+static uint64_t replay_now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+/**
+ * Skip to the next received data
+ *
+ * @return The record, NULL at the end of the recording
+ */
+
+static const recorder_record_t * replay_next_rx( replay_conn_t *conn )
+{
+	const recorder_record_t *r;
+	uint64_t count = conn->file.hdr->count;
+
+	for ( ; conn->next < count; conn->next++, conn->pos = 0 )
+	{
+		r = recorder_get( &conn->file, conn->next );
+		if ( r && r->dir == RECORDER_RX && conn->pos < r->len ) return r;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Time the data of a record is due in the replay (CLOCK_MONOTONIC)
+ */
+
+static uint64_t replay_due( const replay_conn_t *conn, const recorder_record_t *r )
+{
+	if ( conn->speed <= 0.0 || r->t_ns <= conn->t0_ns ) return conn->start_ns;
+	return conn->start_ns + (uint64_t) ( (double) ( r->t_ns - conn->t0_ns ) / conn->speed );
+}
+
+
+/**
+ * Open a recording for replay
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ * @param *params	Recording and speed (replay_params_t)
+ *
+ * @return 0 on success, -1 on error
+ */
+
+int replay_open( void *ctx, const void *params )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+	const replay_params_t *pars = (const replay_params_t *) params;
+	const recorder_record_t *r = NULL;
+
+	memset( conn, 0, sizeof( *conn ) );
+	if ( !pars || !pars->path || recorder_map( &conn->file, pars->path ) != 0 ) return -1;
+
+	// Records overwritten while the ring wrapped, or cut off by a crash, are skipped
+	conn->next = recorder_first( &conn->file );
+	while ( conn->next < conn->file.hdr->count && !( r = recorder_get( &conn->file, conn->next ) ) ) conn->next++;
+	if ( !r )
+	{
+		fprintf( stderr, "Recording %s is empty\n", pars->path );
+		recorder_close( &conn->file );
+		return -1;
+	}
+
+	conn->t0_ns = r->t_ns;
+	conn->speed = pars->speed;
+	conn->start_ns = replay_now();
+
+	printf( "Replaying %s (%llu records) at %s\n", pars->path,
+			(unsigned long long) ( conn->file.hdr->count - conn->next ), conn->speed > 0.0 ? "recorded speed" : "full speed" );
+	if ( conn->speed > 0.0 && conn->speed != 1.0 ) printf( "Speed factor %.2f\n", conn->speed );
+
+	return 0;
+}
+
+
+/**
+ * Close the recording
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ */
+
+void replay_close( void *ctx )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+
+	if ( !conn->file.hdr ) return;
+
+	printf( "Replay closed: %llu bytes read, %llu bytes written\n", conn->rx_bytes, conn->tx_bytes );
+	recorder_close( &conn->file );
+}
+
+
+/**
+ * Read the recorded data that is due
+ *
+ * Waits up to 1 s for the next data. Data of several records is returned
+ * together if they are all due.
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ * @param *buf		Pointer to input buffer
+ * @param len		Size of buffer
+ *
+ * @return Number of bytes read, 0 if no data became due within 1 s,
+ *         -1 at the end of the recording
+ */
+
+int replay_read( void *ctx, unsigned char *buf, unsigned int len )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+	const recorder_record_t *r, *last = NULL;
+	uint64_t now, due;
+	unsigned int n, total = 0;
+	struct timespec ts;
+	int64_t realtime_ns;
+	bool timeout;
+
+	if ( !conn->file.hdr || buf == NULL ) return -1;
+
+	r = replay_next_rx( conn );
+	if ( !r )
+	{
+		if ( !conn->finished ) fprintf( stderr, "End of recording\n" );
+		__atomic_store_n( &conn->finished, true, __ATOMIC_RELEASE );
+		return -1;
+	}
+
+	now = replay_now();
+	due = replay_due( conn, r );
+	if ( due > now )
+	{
+		timeout = due - now >= REPLAY_RCV_TIMEOUT_NS;
+		ts.tv_sec = timeout ? REPLAY_RCV_TIMEOUT_NS / 1000000000ull : 0;
+		ts.tv_nsec = timeout ? 0 : (long) ( due - now );
+		nanosleep( &ts, NULL );
+		if ( timeout ) return 0;
+		now = replay_now();
+	}
+
+	while ( r && total < len && replay_due( conn, r ) <= now )
+	{
+		n = r->len - conn->pos;
+		if ( n > len - total ) n = len - total;
+		memcpy( &buf[total], &r->data[conn->pos], n );
+		conn->pos += n;
+		total += n;
+		last = r;
+		if ( conn->pos < r->len ) break;
+
+		conn->next++;
+		conn->pos = 0;
+		r = replay_next_rx( conn );
+	}
+
+	if ( last )
+	{
+		realtime_ns = (int64_t) last->t_ns + conn->file.hdr->realtime_offset_ns;
+		conn->rx_time.tv_sec = realtime_ns / 1000000000ll;
+		conn->rx_time.tv_nsec = realtime_ns % 1000000000ll;
+		conn->rx_time_valid = true;
+	}
+	conn->rx_bytes += total;
+
+	return (int) total;
+}
+
+
+/**
+ * Get the recorded receive time of the data read last
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ * @param *ts		Receive time in CLOCK_REALTIME
+ *
+ * @return 0 on success, -1 if nothing has been read yet
+ */
+
+int replay_get_rx_time( void *ctx, struct timespec *ts )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+	if ( !conn->rx_time_valid ) return -1;
+	*ts = conn->rx_time;
+	return 0;
+}
+
+
+/**
+ * Check for the end of the recording; may be called while another thread
+ * reads
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ *
+ * @return true once all data has been read
+ */
+
+bool replay_finished( void *ctx )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+	return __atomic_load_n( &conn->finished, __ATOMIC_ACQUIRE );
+}
+
+
+/**
+ * Get the number of bytes that can be read without blocking
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ *
+ * @return Bytes of the next record if it is due, else 0
+ */
+
+int replay_get_bytes_count( void *ctx )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+	const recorder_record_t *r;
+
+	if ( !conn->file.hdr ) return -1;
+
+	r = replay_next_rx( conn );
+	if ( !r || replay_due( conn, r ) > replay_now() ) return 0;
+	return (int) ( r->len - conn->pos );
+}
+
+
+/**
+ * Write a message; it is dropped
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ * @param *iov		Data chunks
+ * @param iovcnt	Number of data chunks
+ *
+ * @return Number of bytes written, -1 on error
+ */
+
+int replay_writev( void *ctx, const struct iovec *iov, unsigned int iovcnt )
+{
+	replay_conn_t *conn = (replay_conn_t *) ctx;
+	unsigned int i, total = 0;
+
+	if ( !conn->file.hdr ) return -1;
+
+	for ( i = 0; i < iovcnt; i++ ) total += iov[i].iov_len;
+	conn->tx_bytes += total;
+
+	return (int) total;
+}
+
+
+/**
+ * Write data; it is dropped
+ *
+ * @param *ctx		Connection state (replay_conn_t)
+ * @param *buf		Pointer to buffer that holds data to be sent
+ * @param len		Number of bytes to send
+ *
+ * @return Number of bytes written, -1 on error
+ */
+
+int replay_write( void *ctx, unsigned char *buf, unsigned int len )
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	return replay_writev( ctx, &iov, 1 );
+}
@@ -0,0 +1,307 @@
+//======================================================================
+/**
+ *  @file
+ *  rt.c
+ *
+ *  @section rt.c_general General file information
+ *
+ *  @brief
+ *  Real-time settings of the driver's threads and the process
+ *
+ *  A thread applies its settings to itself when it starts, so the threads
+ *  of roscpp and the publishers keep the default scheduling. The settings
+ *  in effect are read back from the kernel and printed.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE							// pthread_setaffinity_np(), pthread_setname_np()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "wsg50/rt.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define RT_STACK_RESERVE_KB			64		// Stack left untouched by the prefault for the thread's own use
+#define CAP_IPC_LOCK_BIT			14		// CAP_IPC_LOCK in the capability sets of /proc/self/status
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+static int rt_parse_cpus( const char *list, cpu_set_t *set );
+static void rt_format_cpus( const cpu_set_t *set, char *buf, size_t size );
+static unsigned int rt_prefault_stack( unsigned int kb );
+static bool rt_lock_unlimited( void );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+/**
+ * Parse a CPU list like "2", "2-3,6"
+ *
+ * @return 0 on success, -1 if the list is invalid or empty
+ */
+
+static int rt_parse_cpus( const char *list, cpu_set_t *set )
+{
+	const char *p = list;
+	char *end;
+	long first, last, cpu;
+
+	CPU_ZERO( set );
+	while ( *p )
+	{
+		first = strtol( p, &end, 10 );
+		if ( end == p || first < 0 ) return -1;
+		last = first;
+		p = end;
+		if ( *p == '-' )
+		{
+			last = strtol( p + 1, &end, 10 );
+			if ( end == p + 1 || last < first ) return -1;
+			p = end;
+		}
+		if ( last >= CPU_SETSIZE ) return -1;
+		for ( cpu = first; cpu <= last; cpu++ ) CPU_SET( cpu, set );
+
+		while ( *p == ' ' ) p++;
+		if ( *p == ',' ) p++;
+		else if ( *p ) return -1;
+		while ( *p == ' ' ) p++;
+	}
+
+	return CPU_COUNT( set ) > 0 ? 0 : -1;
+}
+
+
+/**
+ * Print a CPU set as list, e.g. "0-3,6"
+ */
+
+static void rt_format_cpus( const cpu_set_t *set, char *buf, size_t size )
+{
+	size_t len = 0;
+	int cpu, last;
+
+	buf[0] = '\0';
+	for ( cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++ )
+	{
+		if ( !CPU_ISSET( cpu, set ) ) continue;
+		for ( last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET( last + 1, set ); last++ );
+
+		if ( last == cpu ) len += snprintf( buf + len, size - len, "%s%d", len ? "," : "", cpu );
+		else len += snprintf( buf + len, size - len, "%s%d-%d", len ? "," : "", cpu, last );
+		cpu = last;
+	}
+}
+
+
+/**
+ * Touch the given amount of stack below the caller, so the thread does
+ * not take page faults when it gets there later
+ *
+ * @return kB touched; limited to the stack size of the thread
+ */
+
+static unsigned int __attribute__(( noinline )) rt_prefault_stack( unsigned int kb )
+{
+	pthread_attr_t attr;
+	size_t stack_size = 0;
+	volatile unsigned char *p;
+
+	if ( pthread_getattr_np( pthread_self(), &attr ) == 0 )
+	{
+		pthread_attr_getstacksize( &attr, &stack_size );
+		pthread_attr_destroy( &attr );
+	}
+	if ( stack_size / 1024 <= RT_STACK_RESERVE_KB ) return 0;
+	if ( kb > stack_size / 1024 - RT_STACK_RESERVE_KB ) kb = (unsigned int) ( stack_size / 1024 - RT_STACK_RESERVE_KB );
+
+	p = alloca( (size_t) kb * 1024 );
+	memset( (void *) p, 0, (size_t) kb * 1024 );
+
+	return kb;
+}
+
+
+/**
+ * Get the default settings: scheduling and CPUs are not changed
+ *
+ * @param *options		Settings
+ */
+
+void rt_options_default( rt_options_t *options )
+{
+	memset( options, 0, sizeof( *options ) );
+}
+
+
+/**
+ * Check whether any setting differs from the default
+ */
+
+bool rt_options_set( const rt_options_t *options )
+{
+	return options->priority > 0 || options->cpus[0] != '\0' || options->stack_prefault_kb > 0;
+}
+
+
+/**
+ * Apply settings to the calling thread and print those in effect
+ *
+ * @param *options		Settings
+ * @param *name			Thread name shown by ps and top (max. 15 characters)
+ *
+ * @return 0 if everything was granted, -1 if some setting was not
+ */
+
+int rt_apply_thread( const rt_options_t *options, const char *name )
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	char list[RT_CPUS_LEN];
+	unsigned int prefaulted = 0;
+	int policy, prio, res = 0;
+
+	if ( name ) pthread_setname_np( pthread_self(), name );
+
+	if ( options->cpus[0] != '\0' )
+	{
+		if ( rt_parse_cpus( options->cpus, &cpus ) < 0 )
+		{
+			fprintf( stderr, "Invalid CPU list \"%s\", not pinning %s\n", options->cpus, name ? name : "thread" );
+			res = -1;
+		}
+		else if ( ( errno = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus ) ) != 0 )
+		{
+			fprintf( stderr, "Unable to pin %s to CPUs %s: %s\n", name ? name : "thread", options->cpus, strerror( errno ) );
+			res = -1;
+		}
+	}
+
+	if ( options->priority > 0 )
+	{
+		prio = options->priority;
+		if ( prio < sched_get_priority_min( SCHED_FIFO ) ) prio = sched_get_priority_min( SCHED_FIFO );
+		if ( prio > sched_get_priority_max( SCHED_FIFO ) ) prio = sched_get_priority_max( SCHED_FIFO );
+
+		memset( &param, 0, sizeof( param ) );
+		param.sched_priority = prio;
+		if ( ( errno = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param ) ) != 0 )
+		{
+			fprintf( stderr, "SCHED_FIFO priority %d not granted for %s: %s (needs CAP_SYS_NICE or an rtprio limit), "
+					 "keeping the default scheduling\n", prio, name ? name : "thread", strerror( errno ) );
+			res = -1;
+		}
+	}
+
+	// Prefaulted last, so it happens on the CPU the thread runs on from now on
+	if ( options->stack_prefault_kb > 0 )
+	{
+		prefaulted = rt_prefault_stack( options->stack_prefault_kb );
+		if ( prefaulted < options->stack_prefault_kb )
+			fprintf( stderr, "Prefaulted only %u of %u kB stack of %s\n", prefaulted, options->stack_prefault_kb, name ? name : "thread" );
+	}
+
+	// Report what the kernel has actually granted
+	if ( pthread_getschedparam( pthread_self(), &policy, &param ) != 0 )
+	{
+		policy = -1;
+		param.sched_priority = 0;
+	}
+	if ( pthread_getaffinity_np( pthread_self(), sizeof( cpus ), &cpus ) == 0 ) rt_format_cpus( &cpus, list, sizeof( list ) );
+	else strcpy( list, "?" );
+
+	printf( "Thread %s: %s priority %d, CPUs %s, %u kB stack prefaulted\n", name ? name : "?",
+			policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER",
+			param.sched_priority, list, prefaulted );
+
+	return res;
+}
+
+
+/**
+ * Check whether memory mapped later can be locked as well; with a limited
+ * amount, MCL_FUTURE would make the next thread stack fail to map
+ *
+ * @return true with CAP_IPC_LOCK or without memlock limit
+ */
+
+static bool rt_lock_unlimited( void )
+{
+	struct rlimit limit;
+	unsigned long long caps = 0;
+	char line[128];
+	FILE *f;
+
+	if ( getrlimit( RLIMIT_MEMLOCK, &limit ) == 0 && limit.rlim_cur == RLIM_INFINITY ) return true;
+
+	f = fopen( "/proc/self/status", "r" );
+	if ( !f ) return false;
+	while ( fgets( line, sizeof( line ), f ) )
+		if ( sscanf( line, "CapEff: %llx", &caps ) == 1 ) break;
+	fclose( f );
+
+	return ( caps & ( 1ull << CAP_IPC_LOCK_BIT ) ) != 0;
+}
+
+
+/**
+ * Lock the memory of the process so it is never paged out. Memory mapped
+ * later is locked too if the memlock limit allows; otherwise only what is
+ * mapped now.
+ *
+ * @return 0 on success, 1 if only the present memory was locked, -1 if
+ *         nothing was locked
+ */
+
+int rt_lock_memory( void )
+{
+	struct rlimit limit;
+	unsigned long long limit_kb = 0;
+
+	if ( getrlimit( RLIMIT_MEMLOCK, &limit ) == 0 && limit.rlim_cur != RLIM_INFINITY ) limit_kb = limit.rlim_cur / 1024;
+
+	if ( rt_lock_unlimited() )
+	{
+		if ( mlockall( MCL_CURRENT | MCL_FUTURE ) == 0 )
+		{
+			printf( "Memory of the process locked\n" );
+			return 0;
+		}
+		fprintf( stderr, "Unable to lock the memory: %s\n", strerror( errno ) );
+		return -1;
+	}
+
+	if ( mlockall( MCL_CURRENT ) == 0 )
+	{
+		fprintf( stderr, "Locked the present memory only: memlock limit %llu kB (needs CAP_IPC_LOCK or an unlimited memlock limit "
+				 "to lock memory mapped later)\n", limit_kb );
+		return 1;
+	}
+	fprintf( stderr, "Unable to lock the memory: %s (memlock limit %llu kB, needs CAP_IPC_LOCK or a higher limit)\n",
+			 strerror( errno ), limit_kb );
+	return -1;
+}
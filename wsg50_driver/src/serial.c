@@ -59,9 +59,15 @@
 	#include <fcntl.h>
 	#include <termios.h>
 	#include <errno.h>
+	#include <poll.h>
 	#include <unistd.h>
 	#include <sys/types.h>
 	#include <sys/stat.h>
+	#include <sys/ioctl.h>
+	#include <sys/uio.h>
+	#ifdef __linux__
+		#include <linux/serial.h>
+	#endif
 #endif
 
 #include "wsg50/interface.h"
@@ -72,6 +78,9 @@
 // Macros
 //------------------------------------------------------------------------
 
+#define SERIAL_RCV_TIMEOUT_MS				1000
+#define SERIAL_VTIME_MAX_MS					25500	// VTIME is a byte of 0.1 s steps
+
 
 //------------------------------------------------------------------------
 // Typedefs, enums, structs
@@ -85,27 +94,23 @@
 const interface_t serial =
 {
 	.name = "serial",
+	.conn_size = sizeof( ser_conn_t ),
 	.open = &serial_open,
 	.close = &serial_close,
 	.read = &serial_read,
 	.write = &serial_write,
-	.get_bytes_count = serial_get_bytes_count
+	.get_bytes_count = serial_get_bytes_count,
+	.writev = &serial_writev,
+	.get_fd = &serial_get_fd
 };
 
-#ifdef WIN32
-
-#else
-
-static ser_conn_t conn;
-
-#endif
-
 
 //------------------------------------------------------------------------
 // Local function prototypes
 //------------------------------------------------------------------------
 
 static inline tcflag_t __bitrate_to_flag( unsigned int bitrate );
+static bool serial_set_low_latency( ser_conn_t *conn, bool enable );
 
 
 //------------------------------------------------------------------------
@@ -139,24 +144,100 @@ static inline tcflag_t __bitrate_to_flag( unsigned int bitrate )
 		case 115200: return B115200;
 		case 230400: return B230400;
 		case 460800: return B460800;
+#ifdef B500000
+		case 500000: return B500000;
+		case 576000: return B576000;
+		case 921600: return B921600;
+		case 1000000: return B1000000;
+		case 1152000: return B1152000;
+		case 1500000: return B1500000;
+		case 2000000: return B2000000;
+		case 2500000: return B2500000;
+		case 3000000: return B3000000;
+#endif
 		default: return 0;
 	}
 }
 
 
+/**
+ * Get the default line options: low latency where the adapter supports it,
+ * reads return whatever has arrived and wait up to 1 s for the first byte
+ *
+ * @param *options		Options to fill in
+ */
+
+void serial_options_default( serial_options_t *options )
+{
+	memset( options, 0, sizeof( *options ) );
+	options->low_latency = true;
+	options->vmin = 0;
+	options->vtime_ms = 0;
+	options->recv_timeout_ms = SERIAL_RCV_TIMEOUT_MS;
+}
+
+
+/**
+ * Switch the driver's low latency mode on or off. USB adapters otherwise
+ * buffer received bytes up to their latency timer (16 ms on FTDI chips)
+ * before handing them on.
+ *
+ * @param *conn		Connection state
+ * @param enable	New state
+ *
+ * @return true if the flag was changed, false if it already had the
+ *         requested state or the driver does not support it
+ */
+
+static bool serial_set_low_latency( ser_conn_t *conn, bool enable )
+{
+#if defined( __linux__ ) && defined( ASYNC_LOW_LATENCY )
+	struct serial_struct ser;
+
+	if ( ioctl( conn->fd, TIOCGSERIAL, &ser ) < 0 ) return false;
+	if ( !!( ser.flags & ASYNC_LOW_LATENCY ) == enable ) return false;
+
+	if ( enable ) ser.flags |= ASYNC_LOW_LATENCY;
+	else ser.flags &= ~ASYNC_LOW_LATENCY;
+
+	if ( ioctl( conn->fd, TIOCSSERIAL, &ser ) < 0 )
+	{
+		fprintf( stderr, "Unable to %s low latency mode: %s\n", enable ? "set" : "clear", strerror( errno ) );
+		return false;
+	}
+	return true;
+#else
+	(void) conn;
+	(void) enable;
+	return false;
+#endif
+}
+
+
 /**
  * Open serial device
  *
- * @param *device		Path to serial device, e.g. /dev/ttyS0
+ * @param *ctx		Connection state (ser_conn_t)
+ * @param *params		Device, bitrate and line options
  *
  * @return 0 on success, else -1
  */
 
-int serial_open( const void *params )
+int serial_open( void *ctx, const void *params )
 {
+	ser_conn_t *conn = (ser_conn_t *) ctx;
 	ser_params_t *serial = (ser_params_t *) params;
+	const serial_options_t *opt = serial->options;
+	serial_options_t defaults;
     struct termios settings;
     tcflag_t bitrate;
+    unsigned int vtime;
+
+    if ( !opt )
+    {
+    	serial_options_default( &defaults );
+    	opt = &defaults;
+    }
 
     // Convert bitrate to flag
     bitrate = __bitrate_to_flag( serial->bitrate );
@@ -167,18 +248,18 @@ int serial_open( const void *params )
     }
 
     // Open serial device
-	conn.fd = open( serial->device, O_RDWR | O_NOCTTY );
-	if ( conn.fd < 0 )
+	conn->fd = open( serial->device, O_RDWR | O_NOCTTY );
+	if ( conn->fd < 0 )
 	{
 		fprintf( stderr, "Failed to open serial device '%s' (errno: %s)\n", serial->device, strerror(errno) );
 		return -1;
 	}
 
 	// Check if device is a terminal device
-    if ( !isatty( conn.fd ) )
+    if ( !isatty( conn->fd ) )
     {
         fprintf( stderr, "Device '%s' is not a terminal device (errno: %s)!\n", serial->device, strerror(errno) );
-        close( conn.fd );
+        close( conn->fd );
         return -1;
     }
 
@@ -200,16 +281,37 @@ int serial_open( const void *params )
     // Set local flags
     settings.c_lflag = 0;				// Other option: ICANON = enable canonical input
 
-    // Set maximum wait time on input - cf. Linux Serial Programming HowTo, non-canonical mode
+    // Non-canonical mode - cf. Linux Serial Programming HowTo
     // http://tldp.org/HOWTO/Serial-Programming-HOWTO/x115.html
-    settings.c_cc[VTIME] = 10;			// 0 means timer is not uses
+    // serial_read() waits for the first byte with poll(), so VTIME only
+    // limits the gap between bytes when waiting for more than one. Without
+    // it a read waiting for VMIN bytes could block forever.
+    vtime = ( opt->vtime_ms > SERIAL_VTIME_MAX_MS ? SERIAL_VTIME_MAX_MS : opt->vtime_ms + 99 ) / 100;
+    if ( opt->vmin > 0 && vtime == 0 ) vtime = 1;
+    settings.c_cc[VTIME] = (cc_t) vtime;
 
     // Set minimum bytes to read
-    settings.c_cc[VMIN]  = 0;			// 1 means wait until at least 1 character is received
+    settings.c_cc[VMIN]  = (cc_t) ( opt->vmin > 255 ? 255 : opt->vmin );
+
+    // Input and output speed; c_cflag alone is not enough for every driver
+    cfsetispeed( &settings, bitrate );
+    cfsetospeed( &settings, bitrate );
 
 	// Now clean the modem line and activate the settings for the port
-	tcflush( conn.fd, TCIFLUSH );
-	tcsetattr( conn.fd, TCSANOW, &settings );
+	tcflush( conn->fd, TCIFLUSH );
+	if ( tcsetattr( conn->fd, TCSANOW, &settings ) < 0 )
+	{
+		fprintf( stderr, "Failed to configure serial device '%s' (errno: %s)\n", serial->device, strerror(errno) );
+		close( conn->fd );
+		return -1;
+	}
+
+	conn->recv_timeout_ms = opt->recv_timeout_ms;
+	conn->low_latency_set = opt->low_latency && serial_set_low_latency( conn, true );
+
+	printf( "Serial options: %u baud, low latency %d, vmin %u, vtime %u ms, recv timeout %u ms\n",
+			serial->bitrate, conn->low_latency_set ? 1 : 0, (unsigned int) settings.c_cc[VMIN],
+			vtime * 100, conn->recv_timeout_ms );
 
 	return(0);
 }
@@ -217,36 +319,87 @@ int serial_open( const void *params )
 
 /**
  * Close serial device
+ *
+ * @param *ctx		Connection state (ser_conn_t)
  */
 
-void serial_close( void )
+void serial_close( void *ctx )
 {
-	close( conn.fd );
+	ser_conn_t *conn = (ser_conn_t *) ctx;
+
+	// Leave the adapter as we found it
+	if ( conn->low_latency_set ) serial_set_low_latency( conn, false );
+	conn->low_latency_set = false;
+
+	close( conn->fd );
 }
 
-int serial_get_bytes_count( void ) {
-    // to be implemented if needed
-    return -1;
+/**
+ * Get file descriptor, e.g. to wait for incoming data with poll/epoll
+ *
+ * @param *ctx		Connection state (ser_conn_t)
+ *
+ * @return Descriptor of the open device, -1 if not open
+ */
+
+int serial_get_fd( void *ctx )
+{
+	ser_conn_t *conn = (ser_conn_t *) ctx;
+	return conn->fd > 0 ? conn->fd : -1;
+}
+
+
+/**
+ * Get number of bytes waiting in the driver's input queue
+ *
+ * @param *ctx		Connection state (ser_conn_t)
+ *
+ * @return Number of bytes that can be read without blocking, -1 on error
+ */
+
+int serial_get_bytes_count( void *ctx )
+{
+	ser_conn_t *conn = (ser_conn_t *) ctx;
+	int count;
+
+	if ( conn->fd <= 0 ) return -1;
+	if ( ioctl( conn->fd, FIONREAD, &count ) < 0 ) return -1;
+	return count;
 }
 
 /**
  * Read from serial device
  *
+ * Waits up to the receive timeout for the first byte, then returns what
+ * has arrived, up to len bytes. With VMIN set, the read goes on until
+ * VMIN bytes are there or the line is idle for VTIME.
+ *
+ * @param *ctx		Connection state (ser_conn_t)
  * @param *buf		Pointer to receive buffer
  * @param len		Number of bytes wished to read
  *
- * @return Number of bytes read
+ * @return Number of bytes read, 0 on timeout, -1 on error (e.g. device unplugged)
  */
 
-int serial_read( unsigned char *buf, unsigned int len )
+int serial_read( void *ctx, unsigned char *buf, unsigned int len )
 {
+	ser_conn_t *conn = (ser_conn_t *) ctx;
+	struct pollfd pfd = { .fd = conn->fd, .events = POLLIN, .revents = 0 };
 	int res;
 
-	res = read( conn.fd, buf, len );
+	res = poll( &pfd, 1, conn->recv_timeout_ms > 0 ? (int) conn->recv_timeout_ms : -1 );
+	if ( res == 0 || ( res < 0 && errno == EINTR ) ) return 0;
+	if ( res < 0 || ( pfd.revents & ( POLLERR | POLLNVAL ) ) )
+	{
+		fprintf( stderr, "Failed to wait for serial device\n" );
+		return -1;
+	}
+
+	res = read( conn->fd, buf, len );
 	if ( res < 0 )
 	{
 		fprintf( stderr, "Failed to read from serial device\n" );
-		exit(1);
+		return -1;
 	}
 
 	return res;
@@ -256,14 +409,32 @@ int serial_read( unsigned char *buf, unsigned int len )
 /**
  * Write to serial device
  *
+ * @param *ctx		Connection state (ser_conn_t)
  * @param *buf		Pointer to buffer that holds data to be sent
  * @param len		Number of bytes to send
  *
  * @return Number of bytes written
  */
 
-int serial_write( unsigned char *buf, unsigned int len )
+int serial_write( void *ctx, unsigned char *buf, unsigned int len )
 {
-	return( write( conn.fd, (void *) buf, len ) );
+	ser_conn_t *conn = (ser_conn_t *) ctx;
+	return( write( conn->fd, (void *) buf, len ) );
 }
 
+
+/**
+ * Write to serial device from several buffers at once
+ *
+ * @param *ctx		Connection state (ser_conn_t)
+ * @param *iov		Buffers that hold the data to be sent
+ * @param iovcnt	Number of buffers
+ *
+ * @return Number of bytes written
+ */
+
+int serial_writev( void *ctx, const struct iovec *iov, unsigned int iovcnt )
+{
+	ser_conn_t *conn = (ser_conn_t *) ctx;
+	return( writev( conn->fd, iov, (int) iovcnt ) );
+}
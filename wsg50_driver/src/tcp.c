@@ -52,6 +52,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "wsg50/interface.h"
 #include "wsg50/tcp.h"
@@ -61,7 +63,10 @@
 // Macros
 //------------------------------------------------------------------------
 
-#define TCP_RCV_TIMEOUT_SEC					1
+#define TCP_RCV_TIMEOUT_MS					1000
+#define TCP_CONNECT_TIMEOUT_MS				1000	// So a reconnect attempt fails fast
+#define TCP_SND_TIMEOUT_SEC					1		// A stalled connection fails a send instead of blocking it
+#define TCP_RCVBUF							1024
 
 //------------------------------------------------------------------------
 // Typedefs, enums, structs
@@ -75,21 +80,26 @@
 const interface_t tcp =
 {
 	.name = "tcp",
+	.conn_size = sizeof( tcp_conn_t ),
 	.open = &tcp_open,
 	.close = &tcp_close,
 	.read = &tcp_read,
 	.write = &tcp_write,
-	.get_bytes_count = tcp_get_bytes_count
+	.get_bytes_count = tcp_get_bytes_count,
+	.writev = &tcp_writev,
+	.get_fd = &tcp_get_fd,
+	.get_rx_time = &tcp_get_rx_time
 };
 
-static tcp_conn_t conn;
-
-
 
 //------------------------------------------------------------------------
 // Local function prototypes
 //------------------------------------------------------------------------
 
+static void tcp_set_option( tcp_conn_t *conn, int level, int name, int val, const char *what );
+static int tcp_connect( tcp_conn_t *conn, unsigned int timeout_ms );
+static void tcp_report_options( tcp_conn_t *conn, const tcp_options_t *opt );
+
 
 //------------------------------------------------------------------------
 // Unit Testing
@@ -101,42 +111,187 @@ static tcp_conn_t conn;
 //------------------------------------------------------------------------
 
 
+/**
+ * Get the default socket options: small frames sent right away, the small
+ * receive buffer and timeouts used so far, everything else untouched
+ *
+ * @param *options		Options to fill in
+ */
+
+void tcp_options_default( tcp_options_t *options )
+{
+	memset( options, 0, sizeof( *options ) );
+	options->nodelay = true;
+	options->quickack = false;
+	options->rcvbuf = TCP_RCVBUF;
+	options->priority = -1;
+	options->dscp = -1;
+	options->busy_poll_us = 0;
+	options->connect_timeout_ms = TCP_CONNECT_TIMEOUT_MS;
+	options->recv_timeout_ms = TCP_RCV_TIMEOUT_MS;
+}
+
+
+/**
+ * Set an integer socket option, printing a warning if it is refused
+ */
+
+static void tcp_set_option( tcp_conn_t *conn, int level, int name, int val, const char *what )
+{
+	if ( setsockopt( conn->sock, level, name, (void *) &val, (socklen_t) sizeof( val ) ) < 0 )
+		fprintf( stderr, "Unable to set %s to %d: %s\n", what, val, strerror( errno ) );
+}
+
+
+/**
+ * Connect the socket, giving up after the timeout
+ *
+ * @param *conn			Connection state
+ * @param timeout_ms	Max. time to wait, 0: as long as the kernel tries
+ *
+ * @return 0 on success, -1 on error (errno set)
+ */
+
+static int tcp_connect( tcp_conn_t *conn, unsigned int timeout_ms )
+{
+	struct pollfd pfd = { .fd = conn->sock, .events = POLLOUT, .revents = 0 };
+	socklen_t len = sizeof( int );
+	int flags, res, err = 0;
+
+	if ( timeout_ms == 0 ) return connect( conn->sock, (struct sockaddr *) &conn->si_server, sizeof(conn->si_server) );
+
+	// Connect without blocking and wait until the socket gets writable
+	flags = fcntl( conn->sock, F_GETFL );
+	fcntl( conn->sock, F_SETFL, flags | O_NONBLOCK );
+
+	res = connect( conn->sock, (struct sockaddr *) &conn->si_server, sizeof(conn->si_server) );
+	if ( res < 0 && errno == EINPROGRESS )
+	{
+		do res = poll( &pfd, 1, (int) timeout_ms );
+		while ( res < 0 && errno == EINTR );
+
+		if ( res == 0 )
+		{
+			errno = ETIMEDOUT;
+			res = -1;
+		}
+		else if ( res > 0 )
+		{
+			getsockopt( conn->sock, SOL_SOCKET, SO_ERROR, (void *) &err, &len );
+			errno = err;
+			res = err ? -1 : 0;
+		}
+	}
+
+	fcntl( conn->sock, F_SETFL, flags );
+	return res;
+}
+
+
+/**
+ * Print the options in effect, as reported by the kernel
+ */
+
+static void tcp_report_options( tcp_conn_t *conn, const tcp_options_t *opt )
+{
+	int nodelay = 0, rcvbuf = 0, priority = 0, tos = 0, busy_poll = 0;
+	socklen_t len;
+
+	len = sizeof( int ); getsockopt( conn->sock, IPPROTO_TCP, TCP_NODELAY, (void *) &nodelay, &len );
+	len = sizeof( int ); getsockopt( conn->sock, SOL_SOCKET, SO_RCVBUF, (void *) &rcvbuf, &len );
+	len = sizeof( int ); getsockopt( conn->sock, SOL_SOCKET, SO_PRIORITY, (void *) &priority, &len );
+	len = sizeof( int ); getsockopt( conn->sock, IPPROTO_IP, IP_TOS, (void *) &tos, &len );
+#ifdef SO_BUSY_POLL
+	len = sizeof( int ); getsockopt( conn->sock, SOL_SOCKET, SO_BUSY_POLL, (void *) &busy_poll, &len );
+#endif
+
+	printf( "TCP options: nodelay %d, quickack %d, rcvbuf %d, priority %d, dscp %d, busy_poll %d us, "
+			"connect timeout %u ms, recv timeout %u ms\n", nodelay ? 1 : 0, conn->quickack ? 1 : 0, rcvbuf,
+			priority, tos >> 2, busy_poll, opt->connect_timeout_ms, opt->recv_timeout_ms );
+}
+
+
 /**
  * Open TCP socket
  *
+ * @param *ctx		Connection state (tcp_conn_t)
  * @param *params		Connection parameters
  *
  * @return 0 on success, else -1
  */
 
-int tcp_open( const void *params )
+int tcp_open( void *ctx, const void *params )
 {
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
 	int res;
 	tcp_params_t *tcp = (tcp_params_t *) params;
+	tcp_options_t defaults;
+	const tcp_options_t *opt = tcp->options;
+
+	if ( !opt )
+	{
+		tcp_options_default( &defaults );
+		opt = &defaults;
+	}
 
-	conn.server = tcp->addr;
+	conn->server = tcp->addr;
 
-	conn.sock = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
-	if( conn.sock < 0 )
+	conn->sock = socket( PF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if( conn->sock < 0 )
 	{
 		fprintf( stderr, "Cannot open TCP socket\n" );
 		return -1;
 	}
 
-    memset( (char *) &conn.si_server, 0, sizeof(conn.si_server) );
-    conn.si_server.sin_family = AF_INET;
-    conn.si_server.sin_port = htons( tcp->port );
-    conn.si_server.sin_addr.s_addr = tcp->addr;
+    memset( (char *) &conn->si_server, 0, sizeof(conn->si_server) );
+    conn->si_server.sin_family = AF_INET;
+    conn->si_server.sin_port = htons( tcp->port );
+    conn->si_server.sin_addr.s_addr = tcp->addr;
+
+
+    // Before connecting, so the window offered to the gripper matches
+    if ( opt->rcvbuf > 0 ) tcp_set_option( conn, SOL_SOCKET, SO_RCVBUF, opt->rcvbuf, "SO_RCVBUF" );
 
+    struct timeval timeout = { .tv_sec = opt->recv_timeout_ms / 1000, .tv_usec = ( opt->recv_timeout_ms % 1000 ) * 1000 };
+    setsockopt( conn->sock, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, (socklen_t) sizeof( struct timeval ) );
 
-	unsigned int val = 1024;
-    setsockopt( conn.sock, SOL_SOCKET, SO_RCVBUF, (void *) &val, (socklen_t) sizeof( val ) );
+    timeout.tv_sec = TCP_SND_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    setsockopt( conn->sock, SOL_SOCKET, SO_SNDTIMEO, (void *) &timeout, (socklen_t) sizeof( struct timeval ) );
 
-    struct timeval timeout = { .tv_sec = TCP_RCV_TIMEOUT_SEC, .tv_usec = 0 };
-    setsockopt( conn.sock, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, (socklen_t) sizeof( struct timeval ) );
+    // Send small messages immediately. Otherwise, the second of two commands
+    // sent back to back would wait for the acknowledgement of the first one.
+    tcp_set_option( conn, IPPROTO_TCP, TCP_NODELAY, opt->nodelay ? 1 : 0, "TCP_NODELAY" );
 
-    res = connect( conn.sock, (struct sockaddr *) &conn.si_server, sizeof(conn.si_server) );
-    if ( res < 0 ) return -1;
+    // IP_TOS also sets the priority, so SO_PRIORITY comes last
+    if ( opt->dscp >= 0 ) tcp_set_option( conn, IPPROTO_IP, IP_TOS, ( opt->dscp & 0x3f ) << 2, "IP_TOS" );
+    if ( opt->priority >= 0 ) tcp_set_option( conn, SOL_SOCKET, SO_PRIORITY, opt->priority, "SO_PRIORITY" );
+
+    // Poll the device queue instead of sleeping until the interrupt; may need CAP_NET_ADMIN
+#ifdef SO_BUSY_POLL
+    if ( opt->busy_poll_us > 0 ) tcp_set_option( conn, SOL_SOCKET, SO_BUSY_POLL, opt->busy_poll_us, "SO_BUSY_POLL" );
+#else
+    if ( opt->busy_poll_us > 0 ) fprintf( stderr, "SO_BUSY_POLL not supported\n" );
+#endif
+
+    // Let the kernel report when the data arrived, see tcp_get_rx_time()
+    conn->rx_time_valid = false;
+    tcp_set_option( conn, SOL_SOCKET, SO_TIMESTAMPNS, 1, "SO_TIMESTAMPNS" );
+
+    res = tcp_connect( conn, opt->connect_timeout_ms );
+    if ( res < 0 )
+    {
+    	fprintf( stderr, "TCP connect failed: %s\n", strerror( errno ) );
+    	close( conn->sock );
+    	conn->sock = 0;
+    	return -1;
+    }
+
+    // The kernel falls back to delayed acknowledgements, so this is set again after every read
+    conn->quickack = opt->quickack;
+    if ( conn->quickack ) tcp_set_option( conn, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK" );
+
+    tcp_report_options( conn, opt );
 
     return 0;
 }
@@ -145,42 +300,119 @@ int tcp_open( const void *params )
 /**
  * Close TCP socket
  *
+ * @param *ctx		Connection state (tcp_conn_t)
+ *
  * @return 0
  */
 
-void tcp_close( void )
+void tcp_close( void *ctx )
 {
-	close( conn.sock );
-	conn.sock = 0;
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
+	close( conn->sock );
+	conn->sock = 0;
 }
 
-int tcp_get_bytes_count( void ) {
+/**
+ * Get file descriptor, e.g. to wait for incoming data with poll/epoll
+ *
+ * @param *ctx		Connection state (tcp_conn_t)
+ *
+ * @return Descriptor of the open socket, -1 if not open
+ */
+
+int tcp_get_fd( void *ctx )
+{
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
+	return conn->sock > 0 ? conn->sock : -1;
+}
+
+
+/**
+ * Get the time the kernel received the data returned by the last read
+ *
+ * @param *ctx		Connection state (tcp_conn_t)
+ * @param *ts		Receive time (CLOCK_REALTIME)
+ *
+ * @return 0 on success, -1 if not available
+ */
+
+int tcp_get_rx_time( void *ctx, struct timespec *ts )
+{
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
+	if ( !conn->rx_time_valid ) return -1;
+	*ts = conn->rx_time;
+	return 0;
+}
+
+
+int tcp_get_bytes_count( void *ctx )
+{
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
 	int count;
-	if (ioctl(conn.sock, FIONREAD, &count) == -1) return -1;
+	if (ioctl(conn->sock, FIONREAD, &count) == -1) return -1;
 	return count;
 }
 
 /**
- * Read character from TCP socket
+ * Read from TCP socket
  *
- * @return Character read
+ * @param *ctx		Connection state (tcp_conn_t)
+ * @param *buf		Buffer for the data read
+ * @param len		Maximum number of bytes to read
+ *
+ * @return Number of bytes read, 0 on receive timeout, -1 if the
+ *         connection has been closed by the gripper or is broken
  */
 
-int tcp_read( unsigned char *buf, unsigned int len )
+int tcp_read( void *ctx, unsigned char *buf, unsigned int len )
 {
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
     int res;
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+    char control[CMSG_SPACE( sizeof( struct timespec ) )];
+    struct msghdr hdr;
+    struct cmsghdr *cmsg;
 
-    if ( conn.sock <= 0 || buf == NULL ) return -1;
+    if ( conn->sock <= 0 || buf == NULL ) return -1;
     if ( len == 0 ) return 0;
 
+    memset( &hdr, 0, sizeof( hdr ) );
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof( control );
+
 	// Read desired number of bytes
-	res = recv( conn.sock, buf, len, 0 );
+	res = recvmsg( conn->sock, &hdr, 0 );
 	if ( res < 0 )
 	{
-		// if (errno != EINTR) printf("Failed to read data from TCP socket: %s\n", strerror(errno));
-		close( conn.sock );
-		quit("Failed to read data from TCP socket");
+		// Nothing received within the receive timeout
+		if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) return 0;
+
+		// The connection is closed by whoever handles the broken link
+		fprintf( stderr, "Failed to read data from TCP socket: %s\n", strerror( errno ) );
+		return -1;
+	}
+	if ( res == 0 )
+	{
+		fprintf( stderr, "TCP connection closed by remote host\n" );
+		return -1;
+	}
 
+	if ( conn->quickack )
+	{
+		int val = 1;
+		setsockopt( conn->sock, IPPROTO_TCP, TCP_QUICKACK, (void *) &val, (socklen_t) sizeof( val ) );
+	}
+
+	conn->rx_time_valid = false;
+	for ( cmsg = CMSG_FIRSTHDR( &hdr ); cmsg; cmsg = CMSG_NXTHDR( &hdr, cmsg ) )
+	{
+		if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+		{
+			memcpy( &conn->rx_time, CMSG_DATA( cmsg ), sizeof( struct timespec ) );
+			conn->rx_time_valid = true;
+		}
 	}
 
     return res;
@@ -190,19 +422,22 @@ int tcp_read( unsigned char *buf, unsigned int len )
 /**
  * Write to TCP socket
  *
+ * @param *ctx		Connection state (tcp_conn_t)
  * @param *buf		Pointer to buffer that holds data to be sent
  * @param len		Number of bytes to send
  *
  * @return 0 if successful, -1 on failure
  */
 
-int tcp_write( unsigned char *buf, unsigned int len )
+int tcp_write( void *ctx, unsigned char *buf, unsigned int len )
 {
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
     int res;
 
-	if ( conn.sock <= 0 ) return( -1 );
+	if ( conn->sock <= 0 ) return( -1 );
 
-	res = send( conn.sock, buf, len, 0 );
+	// A broken connection must not raise SIGPIPE
+	res = send( conn->sock, buf, len, MSG_NOSIGNAL );
     if ( res >= 0 ) return( res );
     else
     {
@@ -212,6 +447,39 @@ int tcp_write( unsigned char *buf, unsigned int len )
 }
 
 
+/**
+ * Write to TCP socket from several buffers at once
+ *
+ * @param *ctx		Connection state (tcp_conn_t)
+ * @param *iov		Buffers that hold the data to be sent
+ * @param iovcnt	Number of buffers
+ *
+ * @return Number of bytes sent, -1 on failure
+ */
+
+int tcp_writev( void *ctx, const struct iovec *iov, unsigned int iovcnt )
+{
+	tcp_conn_t *conn = (tcp_conn_t *) ctx;
+	struct msghdr hdr;
+	int res;
+
+	if ( conn->sock <= 0 ) return( -1 );
+
+	// Same as writev(), but without SIGPIPE on a broken connection
+	memset( &hdr, 0, sizeof( hdr ) );
+	hdr.msg_iov = (struct iovec *) iov;
+	hdr.msg_iovlen = iovcnt;
+
+	res = sendmsg( conn->sock, &hdr, MSG_NOSIGNAL );
+	if ( res >= 0 ) return( res );
+	else
+	{
+		fprintf( stderr, "Failed to send data using TCP socket\n" );
+		return -1;
+	}
+}
+
+
 //------------------------------------------------------------------------
 // Test implementation
 //------------------------------------------------------------------------
@@ -48,9 +48,15 @@
 // Includes
 //------------------------------------------------------------------------
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE							// recvmmsg()
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
 
 #include "wsg50/interface.h"
 #include "wsg50/udp.h"
@@ -60,6 +66,9 @@
 // Macros
 //------------------------------------------------------------------------
 
+#define UDP_RCV_TIMEOUT_SEC					1
+#define UDP_RCV_BATCH						8		// Max. datagrams taken per read
+#define UDP_SOCKET_BUFSIZE					( 64 * 1024 )	// Kernel receive queue; a small datagram takes about 1 KB of it
 
 //------------------------------------------------------------------------
 // Typedefs, enums, structs
@@ -73,15 +82,17 @@
 const interface_t udp =
 {
 	.name = "udp",
+	.conn_size = sizeof( udp_conn_t ),
 	.open = &udp_open,
 	.close = &udp_close,
 	.read = &udp_read,
 	.write = &udp_write,
-    .get_bytes_count = udp_get_bytes_count
+    .get_bytes_count = udp_get_bytes_count,
+    .writev = &udp_writev,
+    .get_fd = &udp_get_fd,
+    .get_rx_time = &udp_get_rx_time
 };
 
-static udp_conn_t conn;
-
 
 //------------------------------------------------------------------------
 // Local function prototypes
@@ -95,45 +106,53 @@ static udp_conn_t conn;
 /**
  * Open UDP socket
  *
+ * @param *ctx		Connection state (udp_conn_t)
  * @param *params		Connection parameters
  *
  * @return 0 on success, else -1
  */
 
-int udp_open( const void *params )
+int udp_open( void *ctx, const void *params )
 {
+	udp_conn_t *conn = (udp_conn_t *) ctx;
 	udp_params_t *udp = (udp_params_t *) params;
 
-	conn.server = udp->addr;
+	conn->server = udp->addr;
 
-	conn.rcv_bufptr = 0;
-	conn.rcv_bufsize = UDP_RCV_BUFSIZE;
-	
-	conn.sock = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
-	if( conn.sock < 0 )
+	conn->sock = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if( conn->sock < 0 )
 	{
 		fprintf( stderr, "Cannot open UDP socket\n" );
 		return -1;
 	}
 
-    memset( (char *) &conn.si_server, 0, sizeof(conn.si_server) );
-    conn.si_server.sin_family = AF_INET;
-    conn.si_server.sin_port = htons( udp->remote_port );
-    conn.si_server.sin_addr.s_addr = udp->addr;
+    memset( (char *) &conn->si_server, 0, sizeof(conn->si_server) );
+    conn->si_server.sin_family = AF_INET;
+    conn->si_server.sin_port = htons( udp->remote_port );
+    conn->si_server.sin_addr.s_addr = udp->addr;
 
-    conn.si_listen.sin_family = AF_INET;
-    conn.si_listen.sin_addr.s_addr = htonl( INADDR_ANY );
-    conn.si_listen.sin_port = htons( udp->local_port );
+    conn->si_listen.sin_family = AF_INET;
+    conn->si_listen.sin_addr.s_addr = htonl( INADDR_ANY );
+    conn->si_listen.sin_port = htons( udp->local_port );
 
-	unsigned int val = UDP_RCV_BUFSIZE;
-    setsockopt( conn.sock, SOL_SOCKET, SO_RCVBUF, (void *) &val, (socklen_t) sizeof( val ) );
+    // Room for the automatic updates of all values queued while the reader is busy
+	unsigned int val = UDP_SOCKET_BUFSIZE;
+    setsockopt( conn->sock, SOL_SOCKET, SO_RCVBUF, (void *) &val, (socklen_t) sizeof( val ) );
 
-    struct timeval timeout = { .tv_sec = 10, .tv_usec = 0 };
-    setsockopt( conn.sock, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, (socklen_t) sizeof( struct timeval ) );
+    // A read waits this long for the first datagram
+    struct timeval timeout = { .tv_sec = UDP_RCV_TIMEOUT_SEC, .tv_usec = 0 };
+    setsockopt( conn->sock, SOL_SOCKET, SO_RCVTIMEO, (void *) &timeout, (socklen_t) sizeof( struct timeval ) );
 
-    if ( bind( conn.sock, (struct sockaddr *) &conn.si_listen, sizeof(conn.si_listen) ) < 0 )
+    // Let the kernel report when a datagram arrived, see udp_get_rx_time()
+    val = 1;
+    conn->rx_time_valid = false;
+    setsockopt( conn->sock, SOL_SOCKET, SO_TIMESTAMPNS, (void *) &val, (socklen_t) sizeof( val ) );
+
+    if ( bind( conn->sock, (struct sockaddr *) &conn->si_listen, sizeof(conn->si_listen) ) < 0 )
     {
     	fprintf( stderr, "Cannot bind port %d\n", udp->local_port );
+    	close( conn->sock );
+    	conn->sock = 0;
     	return -1;
     }
 
@@ -144,130 +163,219 @@ int udp_open( const void *params )
 /**
  * Close UDP socket
  *
+ * @param *ctx		Connection state (udp_conn_t)
+ *
  * @return 0
  */
 
-void udp_close( void )
+void udp_close( void *ctx )
 {
-	close( conn.sock );
-	conn.sock = 0;
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+	close( conn->sock );
+	conn->sock = 0;
 }
 
-int udp_get_bytes_count( void ) {
-    // to be implemented if needed
-    return -1;
+/**
+ * Get file descriptor, e.g. to wait for incoming data with poll/epoll
+ *
+ * @param *ctx		Connection state (udp_conn_t)
+ *
+ * @return Descriptor of the open socket, -1 if not open
+ */
+
+int udp_get_fd( void *ctx )
+{
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+	return conn->sock > 0 ? conn->sock : -1;
+}
+
+
+/**
+ * Get the time the kernel received the datagram the last read was taken from
+ *
+ * @param *ctx		Connection state (udp_conn_t)
+ * @param *ts		Receive time (CLOCK_REALTIME)
+ *
+ * @return 0 on success, -1 if not available
+ */
+
+int udp_get_rx_time( void *ctx, struct timespec *ts )
+{
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+	if ( !conn->rx_time_valid ) return -1;
+	*ts = conn->rx_time;
+	return 0;
+}
+
+
+/**
+ * Get the size of the next datagram, so that a read of this many bytes
+ * does not block
+ *
+ * @param *ctx		Connection state (udp_conn_t)
+ *
+ * @return Size of the next datagram, 0 if none is pending, -1 on error
+ */
+
+int udp_get_bytes_count( void *ctx )
+{
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+	int count;
+
+	if ( conn->sock <= 0 ) return -1;
+	if ( ioctl( conn->sock, FIONREAD, &count ) == -1 ) return -1;
+	return count;
 }
 
 /**
- * Read character from UDP socket
+ * Read datagrams from UDP socket
  *
- * Important note:
- * UDP works with datagrams and not with streams.
- * This means that recvfrom() gets the whole datagram
- * and dumps any data that exceeds the desired length!
- * This is why we check the size of an incoming datagram
- * before doing recvfrom() and read it out as a whole
- * into some buffer that is big enough to hold even large
- * datagrams.
- * If none-requested data is left in the buffer, subsequent
- * read calls will take the data from the buffer until it's
- * empty rather than getting new data from the net.
+ * UDP works with datagrams and not with streams: a datagram that does not
+ * fit into the buffer given to the kernel is cut off. Each datagram holds
+ * whole messages, so datagrams are received with a single recvmmsg() call
+ * straight into the caller's buffer, one slot of UDP_RCV_BUFSIZE bytes per
+ * datagram, and the gaps between them are closed afterwards. The caller
+ * then finds the messages back to back, as if read from a stream.
  *
+ * Waits up to UDP_RCV_TIMEOUT_SEC for the first datagram; datagrams
+ * behind it are only taken if they have arrived already. Datagrams from
+ * other hosts are dropped.
+ *
+ * @param *ctx		Connection state (udp_conn_t)
  * @param *buf		Pointer to input buffer
- * @param len		Number of bytes that should be read
+ * @param len		Size of buffer; should be at least UDP_RCV_BUFSIZE, or
+ * 					the size reported by udp_get_bytes_count()
  *
- * @return Number of characters read
+ * @return Number of bytes read, 0 if no datagram arrived
+ *         within UDP_RCV_TIMEOUT_SEC, -1 on error
  */
 
-int udp_read( unsigned char *buf, unsigned int len )
+int udp_read( void *ctx, unsigned char *buf, unsigned int len )
 {
-	fd_set readfds;
-	unsigned int bytes_left;
-    int res,
-       	incoming,
-    	packsize,
-    	slen = sizeof( conn.si_incoming );
-
-    if ( conn.sock <= 0 || buf == NULL )
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+	struct mmsghdr hdr[UDP_RCV_BATCH];
+	struct iovec iov[UDP_RCV_BATCH];
+	struct sockaddr_in from[UDP_RCV_BATCH];
+	char control[UDP_RCV_BATCH][CMSG_SPACE( sizeof( struct timespec ) )];
+	struct cmsghdr *cmsg;
+	unsigned int slots, i, size, total = 0;
+	int res;
+
+    if ( conn->sock <= 0 || buf == NULL )
     {
-    	fprintf( stderr, "Parameter error (sock=%d, buf=%p)\n", conn.sock, buf );
+    	fprintf( stderr, "Parameter error (sock=%d, buf=%p)\n", conn->sock, buf );
     	return -1;
     }
 
     if ( len == 0 ) return 0;
 
-    if ( conn.rcv_bufptr == 0 )
+    // One slot per datagram; a short buffer is a single slot
+    slots = len / UDP_RCV_BUFSIZE;
+    if ( slots == 0 ) slots = 1;
+    if ( slots > UDP_RCV_BATCH ) slots = UDP_RCV_BATCH;
+
+    memset( hdr, 0, sizeof( hdr[0] ) * slots );
+    for ( i = 0; i < slots; i++ )
     {
-    	conn.rcv_bufsize = UDP_RCV_BUFSIZE;
-
-    	// Wait for packet to arrive
-    	FD_ZERO( &readfds );
-    	FD_SET( conn.sock, &readfds );
-        res = select( conn.sock + 1, &readfds, NULL, NULL, NULL );
-        if ( res < 0 ) return -1;
-
-    	// Get size of packet pending
-        res = ioctl( conn.sock, FIONREAD, &packsize );
-        if ( res < 0 ) return -1;
-
-        // Check if buffer is big enough to hold datagram
-        if ( packsize > UDP_RCV_BUFSIZE )
-        {
-        	fprintf( stderr, "UDP buffer too small for incoming datagram" );
-        	return -1;
-        }
-
-        // Read packet non-blocking
-		incoming = recvfrom( conn.sock, conn.rcv_buf, packsize, MSG_DONTWAIT, (struct sockaddr *) &conn.si_incoming, (socklen_t *) &slen );
-		if ( incoming < 0 )
-		{
-			fprintf( stderr, "recvfrom() returned error (%d)\n", incoming );
-			return -1;
-		}
-		if ( conn.si_incoming.sin_addr.s_addr != conn.server )
-		{
-			fprintf( stderr, "Message from unknown server!\n" );
-			return -1;
-		}
-		
-		conn.rcv_bufsize = (unsigned int) incoming;
+    	iov[i].iov_base = &buf[i * UDP_RCV_BUFSIZE];
+    	iov[i].iov_len = slots == 1 ? len : UDP_RCV_BUFSIZE;
+    	hdr[i].msg_hdr.msg_name = &from[i];
+    	hdr[i].msg_hdr.msg_namelen = sizeof( from[i] );
+    	hdr[i].msg_hdr.msg_iov = &iov[i];
+    	hdr[i].msg_hdr.msg_iovlen = 1;
+    	hdr[i].msg_hdr.msg_control = control[i];
+    	hdr[i].msg_hdr.msg_controllen = sizeof( control[i] );
     }
 
-    bytes_left = conn.rcv_bufsize - conn.rcv_bufptr;
-    if ( len < bytes_left )
+    // Blocks until the first datagram arrives, then takes what is there
+    res = recvmmsg( conn->sock, hdr, slots, MSG_WAITFORONE, NULL );
+    if ( res < 0 )
     {
-    	memcpy( buf, &conn.rcv_buf[conn.rcv_bufptr], len );
-    	conn.rcv_bufptr += len;
-    	res = (int) len;
+    	if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) return 0;
+    	fprintf( stderr, "Failed to read from UDP socket: %s\n", strerror( errno ) );
+    	return -1;
     }
-    else
+
+    for ( i = 0; i < (unsigned int) res; i++ )
     {
-    	memcpy( buf, &conn.rcv_buf[conn.rcv_bufptr], len );
-    	conn.rcv_bufptr = 0;
-    	res = (int) bytes_left;
+    	size = hdr[i].msg_len;
+
+		if ( from[i].sin_addr.s_addr != conn->server )
+		{
+			fprintf( stderr, "Message from unknown server!\n" );
+			continue;
+		}
+		if ( hdr[i].msg_hdr.msg_flags & MSG_TRUNC )
+			fprintf( stderr, "UDP buffer too small for incoming datagram\n" );
+
+		// Close the gap to the datagram before
+		if ( total != i * UDP_RCV_BUFSIZE ) memmove( &buf[total], iov[i].iov_base, size );
+		total += size;
+
+		// The messages are stamped with the arrival of the last datagram
+		conn->rx_time_valid = false;
+		for ( cmsg = CMSG_FIRSTHDR( &hdr[i].msg_hdr ); cmsg; cmsg = CMSG_NXTHDR( &hdr[i].msg_hdr, cmsg ) )
+		{
+			if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+			{
+				memcpy( &conn->rx_time, CMSG_DATA( cmsg ), sizeof( struct timespec ) );
+				conn->rx_time_valid = true;
+			}
+		}
     }
 
-    return res;
+    return (int) total;
 }
 
 
 /**
  * Write to UDP socket
  *
+ * @param *ctx		Connection state (udp_conn_t)
  * @param *buf		Pointer to buffer that holds data to be sent
  * @param len		Number of bytes to send
  *
  * @return 0 if successful, -1 on failure
  */
 
-int udp_write( unsigned char *buf, unsigned int len )
+int udp_write( void *ctx, unsigned char *buf, unsigned int len )
 {
-    int res,
-    	slen = sizeof( conn.si_incoming );
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+    int res;
 
-	if ( conn.sock <= 0 ) return( -1 );
+	if ( conn->sock <= 0 ) return( -1 );
 
-	res = sendto( conn.sock, buf, len, 0, (struct sockaddr *) &conn.si_server, (socklen_t) slen );
+	res = sendto( conn->sock, buf, len, 0, (struct sockaddr *) &conn->si_server, (socklen_t) sizeof( conn->si_server ) );
     if ( res >= 0 ) return res;
     else return -1;
 }
+
+
+/**
+ * Write one datagram to UDP socket from several buffers
+ *
+ * @param *ctx		Connection state (udp_conn_t)
+ * @param *iov		Buffers that hold the data to be sent
+ * @param iovcnt	Number of buffers
+ *
+ * @return Number of bytes sent, -1 on failure
+ */
+
+int udp_writev( void *ctx, const struct iovec *iov, unsigned int iovcnt )
+{
+	udp_conn_t *conn = (udp_conn_t *) ctx;
+	struct msghdr hdr;
+	int res;
+
+	if ( conn->sock <= 0 ) return( -1 );
+
+	memset( &hdr, 0, sizeof( hdr ) );
+	hdr.msg_name = &conn->si_server;
+	hdr.msg_namelen = sizeof( conn->si_server );
+	hdr.msg_iov = (struct iovec *) iov;
+	hdr.msg_iovlen = iovcnt;
+
+	res = sendmsg( conn->sock, &hdr, 0 );
+	if ( res >= 0 ) return res;
+	else return -1;
+}
@@ -0,0 +1,96 @@
+//======================================================================
+/**
+ *  @file
+ *  checksum_bench.cpp
+ *
+ *  @section checksum_bench.cpp_general General file information
+ *
+ *  @brief
+ *  Micro-benchmark of the CRC16 implementations on typical message sizes.
+ *
+ *  Usage: checksum_bench [iterations]
+ *
+ *  Sizes 8..64 bytes are typical for status and command messages,
+ *  larger sizes for FMF finger data.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "wsg50/checksum.h"
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef unsigned short ( *crc_func_t ) ( unsigned char *, unsigned int, unsigned short );
+
+struct crc_variant
+{
+	const char *name;
+	crc_func_t func;
+};
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+static const crc_variant variants[] =
+{
+	{ "bytewise", &checksum_update_crc16_bytewise },
+	{ "slice4", &checksum_update_crc16_slice4 },
+	{ "slice8", &checksum_update_crc16_slice8 },
+	{ "default", &checksum_update_crc16 }
+};
+
+static const unsigned int sizes[] = { 8, 12, 16, 24, 32, 48, 64, 128, 256, 1024 };
+
+// Keeps the compiler from optimizing the loops away
+volatile unsigned short sink;
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+int main( int argc, char **argv )
+{
+	unsigned char data[1024];
+	unsigned int i, v, n, iterations = 2000000;
+
+	if ( argc > 1 ) iterations = (unsigned int) atoi( argv[1] );
+	for ( i = 0; i < sizeof( data ); i++ ) data[i] = (unsigned char) rand();
+
+	printf( "%8s", "bytes" );
+	for ( v = 0; v < sizeof( variants ) / sizeof( variants[0] ); v++ ) printf( " %12s", variants[v].name );
+	printf( "   [ns per call]\n" );
+
+	for ( n = 0; n < sizeof( sizes ) / sizeof( sizes[0] ); n++ )
+	{
+		// Scale iterations so each row takes about the same time
+		unsigned int iter = iterations * 8 / sizes[n] + 1;
+
+		printf( "%8u", sizes[n] );
+		for ( v = 0; v < sizeof( variants ) / sizeof( variants[0] ); v++ )
+		{
+			unsigned short crc = 0xffff;
+			auto start = std::chrono::steady_clock::now();
+			for ( i = 0; i < iter; i++ ) crc = variants[v].func( data, sizes[n], crc );
+			std::chrono::duration<double, std::nano> t = std::chrono::steady_clock::now() - start;
+			sink = crc;
+			printf( " %12.2f", t.count() / iter );
+		}
+		printf( "\n" );
+	}
+
+	return 0;
+}
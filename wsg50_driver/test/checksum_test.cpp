@@ -0,0 +1,92 @@
+//======================================================================
+/**
+ *  @file
+ *  checksum_test.cpp
+ *
+ *  @section checksum_test.cpp_general General file information
+ *
+ *  @brief
+ *  Checks the table-sliced CRC16 implementations against the
+ *  byte-wise reference on random data.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "wsg50/checksum.h"
+
+
+//------------------------------------------------------------------------
+// Tests
+//------------------------------------------------------------------------
+
+TEST( Checksum, Preamble )
+{
+	unsigned char preamble[3] = { 0xaa, 0xaa, 0xaa };
+
+	// Start value used by msg_receive()
+	EXPECT_EQ( 0x50f5, checksum_crc16( preamble, 3 ) );
+}
+
+TEST( Checksum, MessageWithChecksumIsZero )
+{
+	// Preamble, ID 0x21, 9 bytes payload
+	unsigned char msg[17] = { 0xaa, 0xaa, 0xaa, 0x21, 0x09, 0x00, 0x00, 0x00, 0x00, 0x48, 0x42, 0x00, 0x00, 0x20, 0x41 };
+	unsigned short crc = checksum_crc16( msg, 15 );
+
+	msg[15] = crc & 0xff;
+	msg[16] = crc >> 8;
+	EXPECT_EQ( 0, checksum_crc16( msg, 17 ) );
+	EXPECT_EQ( 0, checksum_update_crc16_slice8( msg, 17, 0xffff ) );
+}
+
+TEST( Checksum, SlicedMatchesBytewise )
+{
+	std::vector<unsigned char> data( 2048 );
+	unsigned int i, n;
+
+	srand( 42 );
+	for ( n = 0; n < 20000; n++ )
+	{
+		unsigned int size = rand() % ( n < 10000 ? 80 : (unsigned int) data.size() );
+		unsigned int offset = rand() % 8;
+		unsigned short crc = (unsigned short) rand();
+
+		if ( offset + size > data.size() ) size = data.size() - offset;
+		for ( i = 0; i < size; i++ ) data[offset + i] = (unsigned char) rand();
+
+		unsigned short expected = checksum_update_crc16_bytewise( &data[offset], size, crc );
+		ASSERT_EQ( expected, checksum_update_crc16_slice4( &data[offset], size, crc ) ) << "size " << size;
+		ASSERT_EQ( expected, checksum_update_crc16_slice8( &data[offset], size, crc ) ) << "size " << size;
+		ASSERT_EQ( expected, checksum_update_crc16( &data[offset], size, crc ) ) << "size " << size;
+	}
+}
+
+TEST( Checksum, SplitUpdatesMatchWhole )
+{
+	unsigned char data[100];
+	unsigned int i, split;
+
+	for ( i = 0; i < sizeof( data ); i++ ) data[i] = (unsigned char) ( i * 37 + 11 );
+
+	unsigned short whole = checksum_crc16( data, sizeof( data ) );
+	for ( split = 0; split <= sizeof( data ); split++ )
+	{
+		unsigned short crc = checksum_crc16( data, split );
+		EXPECT_EQ( whole, checksum_update_crc16( data + split, sizeof( data ) - split, crc ) );
+	}
+}
+
+int main( int argc, char **argv )
+{
+	testing::InitGoogleTest( &argc, argv );
+	return RUN_ALL_TESTS();
+}
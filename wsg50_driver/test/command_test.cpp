@@ -0,0 +1,83 @@
+//======================================================================
+/**
+ *  @file
+ *  command_test.cpp
+ *
+ *  @section command_test.cpp_general General file information
+ *
+ *  @brief
+ *  Checks the payload layout of the command descriptors against the
+ *  byte order of the WSG command set.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "wsg50/command.h"
+
+
+//------------------------------------------------------------------------
+// Tests
+//------------------------------------------------------------------------
+
+// Payload lengths of the WSG command set reference
+static_assert( cmd_homing::request_len == 1, "homing" );
+static_assert( cmd_move::request_len == 9, "move" );
+static_assert( cmd_stop::request_len == 0 && cmd_stop::response_len == 2, "stop" );
+static_assert( cmd_system_state::response_len == 6, "system state" );
+static_assert( cmd_system_info::response_len == 10, "system info" );
+static_assert( script_command<0xB0>::response_len == 23, "measure script" );
+static_assert( cmd_get_finger1_data::request_len == 0 && cmd_get_finger2_data::request_len == 0, "finger data" );
+
+// Only settings and queries may be sent again after a lost response
+static_assert( cmd_get_opening::idempotent && cmd_set_acceleration::idempotent, "queries, settings" );
+static_assert( cmd_get_finger1_data::idempotent && cmd_get_finger2_data::idempotent, "finger data" );
+static_assert( !cmd_move::idempotent && !cmd_stop::idempotent && !cmd_homing::idempotent, "actions" );
+
+TEST( Command, MoveIsLittleEndian )
+{
+	unsigned char payload[cmd_move::request_len];
+	float width = 42.5f, speed = 100.0f;
+	unsigned char expected[9];
+
+	expected[0] = 0x02;
+	memcpy( &expected[1], &width, 4 );
+	memcpy( &expected[5], &speed, 4 );
+
+	EXPECT_EQ( sizeof( payload ), cmd_move::encode( payload, 0x02, width, speed ) );
+	EXPECT_EQ( 0, memcmp( expected, payload, sizeof( payload ) ) );
+}
+
+TEST( Command, FieldsRoundTrip )
+{
+	typedef fields<uint8_t, uint16_t, uint32_t, float> f;
+	unsigned char buf[f::size];
+	uint8_t a;
+	uint16_t b;
+	uint32_t c;
+	float d;
+
+	f::put( buf, 0x12, 0x3456, 0x789abcde, -1.25f );
+	EXPECT_EQ( 0x56, buf[1] );
+	EXPECT_EQ( 0xde, buf[3] );
+	EXPECT_EQ( 0x78, buf[6] );
+
+	f::get( buf, a, b, c, d );
+	EXPECT_EQ( 0x12, a );
+	EXPECT_EQ( 0x3456, b );
+	EXPECT_EQ( 0x789abcdeu, c );
+	EXPECT_EQ( -1.25f, d );
+}
+
+int main( int argc, char **argv )
+{
+	testing::InitGoogleTest( &argc, argv );
+	return RUN_ALL_TESTS();
+}
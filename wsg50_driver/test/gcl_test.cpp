@@ -0,0 +1,162 @@
+//======================================================================
+/**
+ *  @file
+ *  gcl_test.cpp
+ *
+ *  @section gcl_test.cpp_general General file information
+ *
+ *  @brief
+ *  Checks that the GCL tokenizer puts lines together however the stream
+ *  is split, and that the parser takes the replies of the gripper apart.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "wsg50/gcl.h"
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+// Feeds data in chunks of the given size, returns all complete lines
+static std::vector<std::string> feed( gcl_tokenizer_t &t, const std::string &data, unsigned int chunk )
+{
+	std::vector<std::string> lines;
+	const char *line;
+	unsigned int len, space, n;
+
+	for ( size_t pos = 0; pos < data.size(); pos += n )
+	{
+		char *buf = gcl_tokenizer_space( &t, &space );
+		n = std::min( (unsigned int) ( data.size() - pos ), std::min( chunk, space ) );
+		memcpy( buf, data.data() + pos, n );
+		gcl_tokenizer_commit( &t, n );
+
+		while ( ( line = gcl_tokenizer_next( &t, &len ) ) )
+		{
+			EXPECT_EQ( strlen( line ), len );
+			lines.push_back( std::string( line, len ) );
+		}
+	}
+	return lines;
+}
+
+
+TEST( gcl, tokenizer_any_split )
+{
+	const std::string data = "ACK MOVE\r\n@POS=10.50\n\nFIN MOVE\n";
+
+	for ( unsigned int chunk = 1; chunk <= data.size(); chunk++ )
+	{
+		gcl_tokenizer_t t;
+		gcl_tokenizer_init( &t );
+
+		std::vector<std::string> lines = feed( t, data, chunk );
+		ASSERT_EQ( 3u, lines.size() ) << "chunk " << chunk;
+		EXPECT_EQ( "ACK MOVE", lines[0] );
+		EXPECT_EQ( "@POS=10.50", lines[1] );
+		EXPECT_EQ( "FIN MOVE", lines[2] );
+	}
+}
+
+
+TEST( gcl, tokenizer_long_stream_and_overlong_line )
+{
+	gcl_tokenizer_t t;
+	std::string data;
+	gcl_tokenizer_init( &t );
+
+	// Wraps the receive buffer several times
+	for ( int i = 0; i < 1000; i++ ) data += "@SPEED=" + std::to_string( i ) + "\n";
+	data += std::string( GCL_LINE_MAX * 3, 'x' ) + "\nFIN HOME\n";
+
+	std::vector<std::string> lines = feed( t, data, 700 );
+	ASSERT_EQ( 1001u, lines.size() );
+	EXPECT_EQ( "@SPEED=0", lines[0] );
+	EXPECT_EQ( "@SPEED=999", lines[999] );
+	EXPECT_EQ( "FIN HOME", lines[1000] );
+	EXPECT_EQ( 1ul, t.overlong );
+}
+
+
+TEST( gcl, parse_replies )
+{
+	gcl_line_t p;
+
+	ASSERT_EQ( 0, gcl_parse( "ACK MOVE", 8, &p ) );
+	EXPECT_EQ( GCL_LINE_ACK, p.type );
+	EXPECT_TRUE( gcl_name_is( &p, "MOVE" ) );
+	EXPECT_FALSE( gcl_name_is( &p, "MOV" ) );
+
+	ASSERT_EQ( 0, gcl_parse( "FIN GRIP", 8, &p ) );
+	EXPECT_EQ( GCL_LINE_FIN, p.type );
+	EXPECT_TRUE( gcl_name_is( &p, "GRIP" ) );
+	EXPECT_EQ( E_SUCCESS, p.status );
+
+	ASSERT_EQ( 0, gcl_parse( "ERR MOVE E_AXIS_BLOCKED", 23, &p ) );
+	EXPECT_EQ( GCL_LINE_ERR, p.type );
+	EXPECT_TRUE( gcl_name_is( &p, "MOVE" ) );
+	EXPECT_EQ( E_AXIS_BLOCKED, p.status );
+
+	// Numeric code without name
+	ASSERT_EQ( 0, gcl_parse( "ERR 16", 6, &p ) );
+	EXPECT_EQ( GCL_LINE_ERR, p.type );
+	EXPECT_EQ( 0u, p.name_len );
+	EXPECT_EQ( (status_t) 16, p.status );
+
+	ASSERT_EQ( 0, gcl_parse( "ERR FOO", 7, &p ) );
+	EXPECT_EQ( E_CMD_FAILED, p.status );
+}
+
+
+TEST( gcl, parse_values )
+{
+	gcl_line_t p;
+
+	ASSERT_EQ( 0, gcl_parse( "POS=10.50", 9, &p ) );
+	EXPECT_EQ( GCL_LINE_VALUE, p.type );
+	EXPECT_TRUE( gcl_name_is( &p, "POS" ) );
+	EXPECT_TRUE( p.has_number );
+	EXPECT_DOUBLE_EQ( 10.5, p.number );
+
+	ASSERT_EQ( 0, gcl_parse( "@GRIPSTATE=4", 12, &p ) );
+	EXPECT_EQ( GCL_LINE_UPDATE, p.type );
+	EXPECT_TRUE( gcl_name_is( &p, "GRIPSTATE" ) );
+	EXPECT_DOUBLE_EQ( 4.0, p.number );
+
+	ASSERT_EQ( 0, gcl_parse( "VERSION=abc", 11, &p ) );
+	EXPECT_FALSE( p.has_number );
+	EXPECT_STREQ( "abc", p.value );
+
+	EXPECT_EQ( -1, gcl_parse( "Welcome", 7, &p ) );
+	EXPECT_EQ( GCL_LINE_OTHER, p.type );
+	EXPECT_EQ( -1, gcl_parse( "=5", 2, &p ) );
+}
+
+
+TEST( gcl, status_names )
+{
+	EXPECT_EQ( E_SUCCESS, gcl_status_from_str( "E_SUCCESS", 9 ) );
+	EXPECT_EQ( E_TIMEOUT, gcl_status_from_str( "E_TIMEOUT", 9 ) );
+	EXPECT_EQ( E_CMD_FAILED, gcl_status_from_str( "E_TIME", 6 ) );
+	EXPECT_EQ( E_CMD_FAILED, gcl_status_from_str( "999", 3 ) );
+}
+
+int main( int argc, char **argv )
+{
+	testing::InitGoogleTest( &argc, argv );
+	return RUN_ALL_TESTS();
+}
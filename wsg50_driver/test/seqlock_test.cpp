@@ -0,0 +1,98 @@
+//======================================================================
+/**
+ *  @file
+ *  seqlock_test.cpp
+ *
+ *  @section seqlock_test.cpp_general General file information
+ *
+ *  @brief
+ *  Checks that readers of the sequence lock always see consistent
+ *  snapshots while several writers replace the value.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "wsg50/seqlock.h"
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// All fields are derived from n, so a torn read is easy to detect
+struct snapshot
+{
+	unsigned long n;
+	float position, speed;
+	bool moving;
+};
+
+snapshot make_snapshot( unsigned long n )
+{
+	return snapshot{ n, (float) n, (float) ( n * 2 ), ( n & 1 ) != 0 };
+}
+
+bool consistent( const snapshot &s )
+{
+	return s.position == (float) s.n && s.speed == (float) ( s.n * 2 ) && s.moving == ( ( s.n & 1 ) != 0 );
+}
+
+
+//------------------------------------------------------------------------
+// Tests
+//------------------------------------------------------------------------
+
+TEST( Seqlock, StoreLoad )
+{
+	seqlock<snapshot> state( make_snapshot( 3 ) );
+	unsigned long version = state.version();
+
+	EXPECT_EQ( 3u, state.load().n );
+
+	state.store( make_snapshot( 4 ) );
+	EXPECT_EQ( 4u, state.load().n );
+	EXPECT_TRUE( consistent( state.load() ) );
+	EXPECT_EQ( version + 1, state.version() );
+}
+
+TEST( Seqlock, ConcurrentWriters )
+{
+	const unsigned long count = 100000;
+	seqlock<snapshot> state( make_snapshot( 0 ) );
+	std::atomic<bool> done( false );
+	std::vector<std::thread> writers;
+
+	for ( unsigned long w = 0; w < 2; w++ )
+		writers.emplace_back( [&state, w, count] {
+			for ( unsigned long i = 0; i < count; i++ ) state.store( make_snapshot( 2 * i + w ) );
+		} );
+
+	bool torn = false;
+	std::thread reader( [&] {
+		while ( !done ) torn |= !consistent( state.load() );
+	} );
+
+	for ( std::thread &t : writers ) t.join();
+	done = true;
+	reader.join();
+
+	EXPECT_FALSE( torn );
+	EXPECT_TRUE( consistent( state.load() ) );
+	EXPECT_EQ( 2 * count + 1, state.version() );
+}
+
+int main( int argc, char **argv )
+{
+	testing::InitGoogleTest( &argc, argv );
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+//======================================================================
+/**
+ *  @file
+ *  spsc_ring_test.cpp
+ *
+ *  @section spsc_ring_test.cpp_general General file information
+ *
+ *  @brief
+ *  Checks ordering and overrun accounting of the lock-free sample ring,
+ *  also with a concurrent producer.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "wsg50/spsc_ring.h"
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+// Mixed field sizes, copied word by word by the ring
+struct sample
+{
+	unsigned long index;
+	float value;
+	unsigned char check;
+};
+
+
+//------------------------------------------------------------------------
+// Tests
+//------------------------------------------------------------------------
+
+TEST( SpscRing, InOrder )
+{
+	spsc_ring<sample, 8> ring;
+	sample s;
+
+	EXPECT_FALSE( ring.pop( &s ) );
+	for ( unsigned long i = 0; i < 5; i++ ) ring.push( sample{ i, i * 0.5f, (unsigned char) i } );
+
+	for ( unsigned long i = 0; i < 5; i++ )
+	{
+		ASSERT_TRUE( ring.pop( &s ) );
+		EXPECT_EQ( i, s.index );
+		EXPECT_EQ( i * 0.5f, s.value );
+	}
+	EXPECT_FALSE( ring.pop( &s ) );
+	EXPECT_EQ( 0u, ring.overruns() );
+}
+
+TEST( SpscRing, DropOldest )
+{
+	spsc_ring<sample, 8> ring;
+	sample s;
+
+	for ( unsigned long i = 0; i < 20; i++ ) ring.push( sample{ i, 0.0f, 0 } );
+
+	// The newest 8 survive
+	for ( unsigned long i = 12; i < 20; i++ )
+	{
+		ASSERT_TRUE( ring.pop( &s ) );
+		EXPECT_EQ( i, s.index );
+	}
+	EXPECT_FALSE( ring.pop( &s ) );
+	EXPECT_EQ( 12u, ring.overruns() );
+}
+
+TEST( SpscRing, ConcurrentProducer )
+{
+	const unsigned long count = 200000;
+	spsc_ring<sample, 64> ring;
+	unsigned long received = 0, next = 0;
+	bool torn = false, reordered = false;
+
+	std::thread producer( [&ring, count] {
+		for ( unsigned long i = 0; i < count; i++ ) ring.push( sample{ i, (float) i, (unsigned char) ( i * 7 ) } );
+	} );
+
+	sample s;
+	while ( next < count )
+	{
+		if ( !ring.pop( &s ) ) continue;
+
+		// Every sample is consistent, and none is delivered twice or out of order
+		torn |= s.value != (float) s.index || s.check != (unsigned char) ( s.index * 7 );
+		reordered |= s.index < next;
+		next = s.index + 1;
+		received++;
+	}
+	producer.join();
+
+	EXPECT_FALSE( torn );
+	EXPECT_FALSE( reordered );
+	EXPECT_EQ( count, received + ring.overruns() );
+}
+
+int main( int argc, char **argv )
+{
+	testing::InitGoogleTest( &argc, argv );
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,583 @@
+//======================================================================
+/**
+ *  @file
+ *  wsg50_bench.cpp
+ *
+ *  @section wsg50_bench.cpp_general General file information
+ *
+ *  @brief
+ *  Throughput and latency benchmark of the driver against wsg50_emulator
+ *  (or a real gripper).
+ *
+ *  Usage: wsg50_bench [-p tcp|udp|pty] [-m mode,...] [-d seconds] [-r rate]
+ *                     [-e emulator] [-a host:port] [-l latency_us]
+ *                     [-j jitter_us] [-c corrupt_rate] [-n min_rate]
+ *                     [-o tcp_option=value,... [-o ...]] [-R recording]
+ *                     [-t priority] [-C cpus] [-L]
+ *
+ *  Runs the traffic of each communication mode of the node for the given
+ *  time: polling (state, opening, acceleration and force per cycle),
+ *  script (measure-and-move round trips), script_stream (frames pushed by
+ *  the script), auto_update (opening, speed and force pushed by the
+ *  gripper), fingers (forces of both FMF fingers, as with finger_rate)
+ *  and stop (stops every 10 ms while another thread polls as fast as it
+ *  can, reporting the stop-to-wire latency of the priority lane too). In the streaming modes, the round trip time is taken from
+ *  state requests sent at 100 Hz meanwhile. A rate of 0 (default) polls as
+ *  fast as possible and lets the gripper push every millisecond.
+ *
+ *  With -o, the modes are run once per given set of TCP socket options
+ *  (nodelay, quickack, rcvbuf, priority, dscp, busy_poll, connect_timeout;
+ *  see tcp_options_t), reconnecting in between, e.g.
+ *  -o nodelay=1 -o nodelay=0 -o nodelay=1,quickack=1 compares the RTT.
+ *  With -R, the link traffic is recorded for wsg50_replay. -t, -C and -L
+ *  give the reader thread SCHED_FIFO priority and CPUs and lock the
+ *  memory, as the node's io_priority, io_cpus and lock_memory do.
+ *
+ *  Reports the achieved sample rate, the command round trip time and the
+ *  CPU time of this process per received frame. Exits with 1 if commands
+ *  failed or, with -n, if a mode stayed below min_rate samples per second.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wsg50/cmd.h"
+#include "wsg50/common.h"
+#include "wsg50/dispatcher.h"
+#include "wsg50/functions.h"
+#include "wsg50/metrics.h"
+#include "wsg50/msg.h"
+#include "wsg50/recorder.h"
+#include "wsg50/rt.h"
+#include "wsg50/tcp.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define BENCH_PORT				1500		// Port of the emulator, the driver uses the next one for UDP
+#define BENCH_PROBE_PERIOD_MS	10			// Round trip probes in the streaming modes
+#define BENCH_SERIAL_BITRATE	115200
+#define BENCH_MODES				6
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef std::chrono::steady_clock bench_clock;
+
+typedef struct
+{
+	const char *mode;
+	unsigned long samples, frames, failures;
+	double seconds, cpu;
+	std::vector<double> rtt;	// us
+} bench_result_t;
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+static const char * const mode_names[] = { "polling", "script", "script_stream", "auto_update", "fingers", "stop" };
+static double duration = 5.0, rate = 0.0;
+static std::atomic<unsigned long> pushed( 0 );
+extern char **environ;
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+static double cpu_time( void )
+{
+	struct rusage ru;
+	getrusage( RUSAGE_SELF, &ru );
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+static unsigned long frames_total( void )
+{
+	unsigned long n = 0;
+	for ( unsigned int id = 0; id < 256; id++ ) n += metrics_frames( cmd_selected()->link.metrics, (unsigned char) id );
+	return n;
+}
+
+static unsigned int period_ms( void )
+{
+	return rate > 0.0 ? (unsigned int) ( 1000.0 / rate + 0.5 ) : 1;
+}
+
+static void push_cb( const msg_t *msg, void * )
+{
+	gripper_response info;
+
+	// Count what the node would publish
+	if ( msg->id < 0x43 || msg->id > 0x45 )
+	{
+		if ( !script_stream_decode( msg->data, msg->len, info ) ) return;
+	}
+	else if ( msg->id != 0x43 )
+		return;
+	pushed++;
+}
+
+/**
+ * Time one state request
+ */
+
+static bool probe( bench_result_t &r )
+{
+	unsigned int flags;
+	bench_clock::time_point t0 = bench_clock::now();
+
+	if ( getSystemStateFlags( &flags ) != 0 )
+	{
+		r.failures++;
+		return false;
+	}
+	r.rtt.push_back( std::chrono::duration<double, std::micro>( bench_clock::now() - t0 ).count() );
+	return true;
+}
+
+/**
+ * Poll the state as fast as possible, so stops have to overtake
+ */
+
+static void load_loop( std::atomic<bool> *running )
+{
+	unsigned int flags;
+
+	while ( *running )
+	{
+		getSystemStateFlags( &flags );
+		getOpening();
+	}
+}
+
+/**
+ * Run one communication mode for the configured duration
+ */
+
+static bench_result_t run_mode( const char *mode )
+{
+	bench_result_t r;
+	bench_clock::time_point start, end, next;
+	bool streaming = strcmp( mode, "auto_update" ) == 0 || strcmp( mode, "script_stream" ) == 0;
+	unsigned long frames0, k = 0;
+	double cpu0;
+	std::atomic<bool> loading( false );
+	std::thread load;
+
+	r.mode = mode;
+	r.samples = r.failures = 0;
+	pushed = 0;
+
+	if ( strcmp( mode, "auto_update" ) == 0 )
+	{
+		for ( unsigned char id = 0x43; id <= 0x45; id++ ) dispatcher_subscribe( id, push_cb, NULL );
+		if ( setAutoUpdate( period_ms() ) != 0 ) r.failures++;
+	}
+	else if ( strcmp( mode, "script_stream" ) == 0 )
+	{
+		dispatcher_subscribe( 0xB4, push_cb, NULL );
+		if ( script_stream( period_ms() ) != 0 ) r.failures++;
+	}
+	else if ( strcmp( mode, "stop" ) == 0 )
+	{
+		loading = true;
+		load = std::thread( load_loop, &loading );
+	}
+
+	frames0 = frames_total();
+	cpu0 = cpu_time();
+	start = next = bench_clock::now();
+	end = start + std::chrono::microseconds( (long) ( duration * 1e6 ) );
+
+	while ( bench_clock::now() < end )
+	{
+		if ( streaming )
+		{
+			probe( r );
+			next += std::chrono::milliseconds( BENCH_PROBE_PERIOD_MS );
+		}
+		else if ( strcmp( mode, "stop" ) == 0 )
+		{
+			bench_clock::time_point t0 = bench_clock::now();
+
+			if ( stop() == 0 )
+			{
+				r.rtt.push_back( std::chrono::duration<double, std::micro>( bench_clock::now() - t0 ).count() );
+				r.samples++;
+			}
+			else
+				r.failures++;
+			next += std::chrono::milliseconds( BENCH_PROBE_PERIOD_MS );
+			std::this_thread::sleep_until( std::min( next, end ) );
+		}
+		else if ( strcmp( mode, "polling" ) == 0 )
+		{
+			// Same requests as timer_cb() of the node
+			bench_clock::time_point t0 = bench_clock::now();
+			bool ok = systemState() != NULL;
+			if ( ok ) r.rtt.push_back( std::chrono::duration<double, std::micro>( bench_clock::now() - t0 ).count() );
+			getOpening();
+			getAcceleration();
+			getForce();
+			if ( ok ) r.samples++;
+			else r.failures++;
+		}
+		else if ( strcmp( mode, "fingers" ) == 0 )
+		{
+			// Same requests as finger_loop() of the node
+			float f0, f1;
+			status_t status;
+			bench_clock::time_point t0 = bench_clock::now();
+
+			if ( getFingerForces( &f0, &f1, &status ) == 0 )
+			{
+				r.rtt.push_back( std::chrono::duration<double, std::micro>( bench_clock::now() - t0 ).count() );
+				r.samples++;
+			}
+			else
+				r.failures++;
+		}
+		else
+		{
+			// Measure only, with a position command now and then to keep the axis busy
+			gripper_response info;
+			unsigned char type = ( k % 50 == 0 ) ? 1 : 0;
+			float width = ( k / 50 ) % 2 ? 10.0f : 100.0f;
+			bench_clock::time_point t0 = bench_clock::now();
+
+			if ( script_measure_move( type, width, 100.0f, info ) )
+			{
+				r.rtt.push_back( std::chrono::duration<double, std::micro>( bench_clock::now() - t0 ).count() );
+				r.samples++;
+			}
+			else
+				r.failures++;
+			k++;
+		}
+
+		if ( streaming || rate > 0.0 )
+		{
+			if ( !streaming ) next += std::chrono::microseconds( (long) ( 1e6 / rate ) );
+			std::this_thread::sleep_until( std::min( next, end ) );
+		}
+	}
+
+	if ( load.joinable() )
+	{
+		loading = false;
+		load.join();
+	}
+
+	r.seconds = std::chrono::duration<double>( bench_clock::now() - start ).count();
+	r.cpu = cpu_time() - cpu0;
+	r.frames = frames_total() - frames0;
+
+	if ( strcmp( mode, "auto_update" ) == 0 )
+	{
+		if ( setAutoUpdate( 0 ) != 0 ) r.failures++;
+		r.samples = pushed;
+		for ( unsigned char id = 0x43; id <= 0x45; id++ ) dispatcher_unsubscribe( id );
+	}
+	else if ( strcmp( mode, "script_stream" ) == 0 )
+	{
+		if ( script_stream( 0 ) != 0 ) r.failures++;
+		r.samples = pushed;
+		dispatcher_unsubscribe( 0xB4 );
+	}
+
+	// Let late frames of the mode pass
+	usleep( 50000 );
+	return r;
+}
+
+static double percentile( std::vector<double> &v, double p )
+{
+	if ( v.empty() ) return 0.0;
+	std::sort( v.begin(), v.end() );
+	return v[(size_t) ( p * ( v.size() - 1 ) )];
+}
+
+/**
+ * Start the emulator and wait until it accepts connections
+ *
+ * @param *endpoint		Receives the endpoint printed by the emulator, e.g. the pty device
+ *
+ * @return Process ID, -1 on error
+ */
+
+static pid_t spawn_emulator( std::vector<std::string> args, std::string *endpoint )
+{
+	std::vector<char *> argv;
+	posix_spawn_file_actions_t fa;
+	int out[2];
+	pid_t pid;
+	char line[256];
+	FILE *f;
+
+	for ( size_t i = 0; i < args.size(); i++ ) argv.push_back( &args[i][0] );
+	argv.push_back( NULL );
+
+	if ( pipe( out ) != 0 ) return -1;
+	posix_spawn_file_actions_init( &fa );
+	posix_spawn_file_actions_adddup2( &fa, out[1], STDOUT_FILENO );
+	posix_spawn_file_actions_addclose( &fa, out[0] );
+	if ( posix_spawnp( &pid, argv[0], &fa, NULL, &argv[0], environ ) != 0 )
+	{
+		fprintf( stderr, "Unable to start %s\n", argv[0] );
+		posix_spawn_file_actions_destroy( &fa );
+		return -1;
+	}
+	posix_spawn_file_actions_destroy( &fa );
+	close( out[1] );
+
+	f = fdopen( out[0], "r" );
+	if ( !f || !fgets( line, sizeof( line ), f ) || strncmp( line, "READY ", 6 ) != 0 )
+	{
+		fprintf( stderr, "Emulator did not start\n" );
+		kill( pid, SIGTERM );
+		waitpid( pid, NULL, 0 );
+		return -1;
+	}
+	line[strcspn( line, "\n" )] = 0;
+	*endpoint = line + 6;
+	fclose( f );
+	return pid;
+}
+
+/**
+ * Parse a set of TCP options, e.g. "nodelay=0,rcvbuf=65536"
+ *
+ * @return true on success
+ */
+
+static bool parse_tcp_options( const std::string &spec, tcp_options_t *opt )
+{
+	size_t pos = 0;
+
+	tcp_options_default( opt );
+	while ( pos < spec.size() )
+	{
+		size_t comma = spec.find( ',', pos );
+		std::string item = spec.substr( pos, comma == std::string::npos ? std::string::npos : comma - pos );
+		size_t eq = item.find( '=' );
+		pos = comma == std::string::npos ? spec.size() : comma + 1;
+
+		if ( eq == std::string::npos ) return false;
+		std::string key = item.substr( 0, eq );
+		int val = atoi( item.c_str() + eq + 1 );
+
+		if ( key == "nodelay" ) opt->nodelay = val != 0;
+		else if ( key == "quickack" ) opt->quickack = val != 0;
+		else if ( key == "rcvbuf" ) opt->rcvbuf = val;
+		else if ( key == "priority" ) opt->priority = val;
+		else if ( key == "dscp" ) opt->dscp = val;
+		else if ( key == "busy_poll" ) opt->busy_poll_us = val;
+		else if ( key == "connect_timeout" ) opt->connect_timeout_ms = (unsigned int) val;
+		else return false;
+	}
+	return true;
+}
+
+static void usage( const char *name )
+{
+	fprintf( stderr, "Usage: %s [-p tcp|udp|pty] [-m mode,...] [-d seconds] [-r rate] [-e emulator] [-a host:port]\n"
+			 "          [-l latency_us] [-j jitter_us] [-c corrupt_rate] [-n min_rate]\n"
+			 "  -p  Interface (default tcp)\n"
+			 "  -m  Modes, any of polling,script,script_stream,auto_update,fingers,stop (default all)\n"
+			 "  -d  Duration per mode in s (default 5)\n"
+			 "  -r  Target sample rate in Hz, 0: as fast as possible (default)\n"
+			 "  -e  Emulator executable (default wsg50_emulator next to this program)\n"
+			 "  -a  Connect to this gripper instead of starting the emulator (tcp, udp)\n"
+			 "  -l, -j, -c  Latency, jitter and corruption rate of the emulator\n"
+			 "  -n  Fail if a mode achieves less than min_rate samples/s\n"
+			 "  -o  TCP options, e.g. nodelay=0,quickack=1,rcvbuf=65536,priority=6,dscp=46,busy_poll=50;\n"
+			 "      repeat to compare several sets\n"
+			 "  -R  Record the link traffic to this file\n"
+			 "  -t, -C  SCHED_FIFO priority and CPUs (e.g. 2-3) of the reader thread\n"
+			 "  -L  Lock the memory\n", name );
+}
+
+int main( int argc, char **argv )
+{
+	std::string protocol = "tcp", modes = "polling,script,script_stream,auto_update,fingers,stop", emulator, address, endpoint;
+	std::string latency = "0", jitter = "0", corrupt = "0", record;
+	recorder_t recorder;
+	bool recording = false, lock_memory = false;
+	rt_options_t rt;
+	std::vector<std::string> option_sets;
+	double min_rate = 0.0;
+	unsigned short port = BENCH_PORT;
+	pid_t pid = -1;
+	int c, res, rc = 0;
+
+	rt_options_default( &rt );
+	while ( ( c = getopt( argc, argv, "p:m:d:r:e:a:l:j:c:n:o:R:t:C:Lh" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'p': protocol = optarg; break;
+			case 'm': modes = optarg; break;
+			case 'd': duration = atof( optarg ); break;
+			case 'r': rate = atof( optarg ); break;
+			case 'e': emulator = optarg; break;
+			case 'a': address = optarg; break;
+			case 'l': latency = optarg; break;
+			case 'j': jitter = optarg; break;
+			case 'c': corrupt = optarg; break;
+			case 'n': min_rate = atof( optarg ); break;
+			case 'o': option_sets.push_back( optarg ); break;
+			case 'R': record = optarg; break;
+			case 't': rt.priority = atoi( optarg ); break;
+			case 'C': snprintf( rt.cpus, sizeof( rt.cpus ), "%s", optarg ); break;
+			case 'L': lock_memory = true; break;
+			default: usage( argv[0] ); return 1;
+		}
+	}
+	if ( protocol != "tcp" && protocol != "udp" && protocol != "pty" )
+	{
+		usage( argv[0] );
+		return 1;
+	}
+	if ( !option_sets.empty() && protocol != "tcp" )
+	{
+		fprintf( stderr, "-o only applies to tcp\n" );
+		return 1;
+	}
+	if ( option_sets.empty() ) option_sets.push_back( "" );
+	if ( lock_memory ) rt_lock_memory();
+	if ( rt_options_set( &rt ) )
+	{
+		rt.stack_prefault_kb = 64;
+		dispatcher_set_thread_options( &rt );
+	}
+	if ( !record.empty() )
+	{
+		recording = recorder_open( &recorder, record.c_str(), (size_t) 64 << 20 ) == 0;
+		if ( !recording ) return 1;
+		msg_set_recorder( &cmd_selected()->link, &recorder );
+	}
+
+	if ( address.empty() )
+	{
+		if ( emulator.empty() )
+		{
+			emulator = argv[0];
+			size_t slash = emulator.rfind( '/' );
+			emulator = ( slash == std::string::npos ? std::string( "" ) : emulator.substr( 0, slash + 1 ) ) + "wsg50_emulator";
+		}
+		pid = spawn_emulator( { emulator, "-p", protocol, "-P", std::to_string( port ), "-s",
+								"-l", latency, "-j", jitter, "-c", corrupt }, &endpoint );
+		if ( pid < 0 ) return 1;
+		address = "127.0.0.1";
+	}
+	else
+	{
+		size_t colon = address.rfind( ':' );
+		if ( colon != std::string::npos )
+		{
+			port = (unsigned short) atoi( address.substr( colon + 1 ).c_str() );
+			address = address.substr( 0, colon );
+		}
+	}
+
+	for ( size_t set = 0; set < option_sets.size() && rc == 0; set++ )
+	{
+		tcp_options_t options;
+
+		if ( !parse_tcp_options( option_sets[set], &options ) )
+		{
+			fprintf( stderr, "Invalid TCP options %s\n", option_sets[set].c_str() );
+			rc = 1;
+			break;
+		}
+		if ( option_sets.size() > 1 ) printf( "\n== TCP options: %s\n", option_sets[set].empty() ? "default" : option_sets[set].c_str() );
+
+		if ( protocol == "pty" ) res = cmd_connect_serial( endpoint.c_str(), BENCH_SERIAL_BITRATE );
+		else if ( protocol == "udp" ) res = cmd_connect_udp( port + 1, address.c_str(), port );
+		else res = cmd_connect_tcp_options( address.c_str(), port, &options );
+
+		if ( res != 0 || dispatcher_start() != 0 )
+		{
+			fprintf( stderr, "Unable to connect\n" );
+			rc = 1;
+			break;
+		}
+
+		std::vector<bench_result_t> results;
+		size_t pos = 0;
+
+		while ( pos <= modes.size() )
+		{
+			size_t comma = modes.find( ',', pos );
+			std::string mode = modes.substr( pos, comma == std::string::npos ? std::string::npos : comma - pos );
+			pos = comma == std::string::npos ? modes.size() + 1 : comma + 1;
+
+			const char * const *m = std::find( mode_names, mode_names + BENCH_MODES, mode );
+			if ( m != mode_names + BENCH_MODES ) results.push_back( run_mode( *m ) );
+			else if ( !mode.empty() ) fprintf( stderr, "Unknown mode %s\n", mode.c_str() );
+		}
+
+		printf( "%-14s %8s %10s %10s %10s %10s %8s %12s %6s\n", "mode", "samples", "rate[Hz]",
+				"rtt50[us]", "rtt99[us]", "rttmax[us]", "frames", "cpu/frm[us]", "fail" );
+		for ( size_t i = 0; i < results.size(); i++ )
+		{
+			bench_result_t &r = results[i];
+			double achieved = r.samples / r.seconds;
+
+			printf( "%-14s %8lu %10.1f %10.1f %10.1f %10.1f %8lu %12.2f %6lu\n", r.mode, r.samples, achieved,
+					percentile( r.rtt, 0.5 ), percentile( r.rtt, 0.99 ), percentile( r.rtt, 1.0 ), r.frames,
+					r.frames ? r.cpu * 1e6 / r.frames : 0.0, r.failures );
+
+			if ( r.failures && corrupt == "0" ) rc = 1;
+			if ( min_rate > 0.0 && achieved < min_rate ) rc = 1;
+		}
+		const metrics_t *m = cmd_selected()->link.metrics;
+		printf( "checksum errors: %lu, resync bytes: %lu\n", metrics_crc_errors( m ), metrics_resync_bytes( m ) );
+
+		metrics_summary_t stop_to_wire;
+		if ( metrics_urgent_summary( m, &stop_to_wire ) )
+			printf( "stop to wire: p50 %lu us, p99 %lu us, max %lu us (%lu stops)\n", stop_to_wire.p50_us,
+					stop_to_wire.p99_us, stop_to_wire.max_us, stop_to_wire.count );
+
+		dispatcher_stop();
+		cmd_disconnect();
+	}
+
+	if ( pid > 0 )
+	{
+		kill( pid, SIGTERM );
+		waitpid( pid, NULL, 0 );
+	}
+	if ( recording )
+	{
+		msg_set_recorder( &cmd_selected()->link, NULL );
+		recorder_close( &recorder );
+	}
+	return rc;
+}
@@ -0,0 +1,1207 @@
+//======================================================================
+/**
+ *  @file
+ *  wsg50_emulator.cpp
+ *
+ *  @section wsg50_emulator.cpp_general General file information
+ *
+ *  @brief
+ *  Software WSG50 for benchmarks and soak tests without a gripper.
+ *
+ *  Usage: wsg50_emulator [-p tcp|udp|pty] [-P port] [-l latency_us]
+ *                        [-j jitter_us] [-c corrupt_rate] [-s] [-g] [-r seed] [-v]
+ *
+ *  Speaks the binary protocol of msg.c (preamble, ID, 16 bit length,
+ *  CRC16) and simulates one axis: loop-back 0x06, disconnect 0x07, motion commands 0x20 - 0x26 with pending
+ *  and final status, settings 0x30 - 0x36, state 0x40 - 0x45 including
+ *  automatic updates and system info 0x50. With -s, the commands of
+ *  cmd_measure.lua (0xB0 - 0xB5) are answered as if the script was running.
+ *  With -g, it speaks the GCL text protocol instead: MOVE, GRIP, RELEASE,
+ *  HOME, STOP, FASTSTOP, FSACK, AUTOSEND and the queries POS?, SPEED?,
+ *  FORCE? and GRIPSTATE?.
+ *
+ *  Every frame sent is delayed by the latency plus a random jitter, without
+ *  reordering. With -c, that fraction of the frames sent gets one bit
+ *  flipped. Prints "READY <endpoint>" to stdout once a driver can connect;
+ *  with -p pty, the endpoint is the device to open.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "wsg50/checksum.h"
+#include "wsg50/common.h"
+#include "wsg50/msg.h"
+
+
+//------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------
+
+#define EMU_WIDTH_MAX			110.0f		// Stroke in mm
+#define EMU_SPEED_MAX			420.0f		// mm/s
+#define EMU_HOMING_SPEED		200.0f		// mm/s
+#define EMU_TICK_US				1000		// Simulation step
+#define EMU_PAYLOAD_MAX			1024		// Larger frames are dropped as garbage
+#define EMU_HEADER_LEN			( MSG_PREAMBLE_LEN + 3 )
+#define EMU_BATCH_MAX			32			// See cmd_measure.lua
+
+// Grasping states (response of command 0x41)
+#define GS_IDLE					0
+#define GS_GRASPING				1
+#define GS_HOLDING				4
+#define GS_RELEASING			5
+#define GS_POSITIONING			6
+
+
+//------------------------------------------------------------------------
+// Typedefs, enums, structs
+//------------------------------------------------------------------------
+
+typedef enum
+{
+	IF_TCP,
+	IF_UDP,
+	IF_PTY
+} emu_iface_t;
+
+// A frame waiting for its (delayed) transmission
+typedef struct
+{
+	double due;
+	std::vector<unsigned char> data;
+} emu_frame_t;
+
+// Automatic update of one of the values 0x43 - 0x45
+typedef struct
+{
+	unsigned int period_ms;		// 0: off
+	bool on_change;
+	double next;
+	float last;
+} emu_update_t;
+
+typedef struct
+{
+	// Axis
+	float pos, target, speed, vel;
+	float acc, force_limit, force;
+	float limit_minus, limit_plus;
+	bool limits;
+	bool referenced, moving, blocked, speed_mode;
+	bool fast_stop;				// Motions refused until acknowledged
+	unsigned char motion_id;	// Command waiting for the end of the motion, 0: none
+	unsigned char grasp_state;
+
+	// Automatic updates of 0x43, 0x44, 0x45
+	emu_update_t update[3];
+
+	// AUTOSEND of POS, SPEED, FORCE, GRIPSTATE in GCL mode
+	emu_update_t gcl_update[4];
+
+	// Measure script
+	unsigned int stream_period;
+	double stream_next;
+	unsigned int batch_count, batch_period, batch_n;
+	double batch_next, batch_t0;
+	std::vector<unsigned char> batch;
+	std::deque<std::vector<unsigned char> > script_queue;	// Commands received while a batch is taken
+} emu_state_t;
+
+
+//------------------------------------------------------------------------
+// Global variables
+//------------------------------------------------------------------------
+
+static emu_iface_t iface = IF_TCP;
+static unsigned short port = 1500;
+static double latency = 0.0, jitter = 0.0, corrupt_rate = 0.0;
+static bool script = false, gcl = false, verbose = false;
+
+static int listen_fd = -1, fd = -1, pty_slave = -1;
+static struct sockaddr_in peer;
+static bool have_peer = false;
+
+static std::mt19937 rng;
+static std::deque<emu_frame_t> tx_queue;
+static double tx_last_due = 0.0;
+static std::vector<unsigned char> rx_buf;
+
+static emu_state_t st;
+static volatile sig_atomic_t stop_requested = 0;
+
+static unsigned long frames_in = 0, frames_out = 0, frames_corrupted = 0, crc_errors = 0;
+
+
+//------------------------------------------------------------------------
+// Local function prototypes
+//------------------------------------------------------------------------
+
+static double now( void );
+static void reset_state( bool keep_axis );
+static void send_frame( unsigned char id, const unsigned char *payload, unsigned int len );
+static void handle_command( unsigned char id, const unsigned char *payload, unsigned int len );
+static void handle_gcl( const std::string &line );
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+static double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float get_float( const unsigned char *b )
+{
+	float f;
+	memcpy( &f, b, sizeof( float ) );
+	return f;
+}
+
+static void put_float( std::vector<unsigned char> &v, float f )
+{
+	unsigned char b[4];
+	memcpy( b, &f, sizeof( float ) );
+	v.insert( v.end(), b, b + 4 );
+}
+
+static void put_status( std::vector<unsigned char> &v, status_t status )
+{
+	v.push_back( lo( status ) );
+	v.push_back( hi( status ) );
+}
+
+static unsigned int state_flags( void )
+{
+	unsigned int flags = 0;
+
+	if ( st.referenced ) flags |= SF_REFERENCED;
+	if ( st.moving ) flags |= SF_MOVING;
+	else flags |= SF_AXIS_STOPPED;
+	if ( st.blocked ) flags |= st.vel < 0 ? SF_BLOCKED_MINUS : SF_BLOCKED_PLUS;
+	if ( !st.moving && fabsf( st.pos - st.target ) < 1e-3f ) flags |= SF_TARGET_POS_REACHED;
+	if ( script ) flags |= SF_SCRIPT_RUNNING;
+	if ( st.fast_stop ) flags |= SF_FAST_STOP;
+	return flags;
+}
+
+/**
+ * Reset the simulated gripper, e.g. for a new connection
+ *
+ * @param keep_axis		Keep position and settings, only stop updates and motions
+ */
+
+static void reset_state( bool keep_axis )
+{
+	if ( !keep_axis )
+	{
+		st.pos = st.target = EMU_WIDTH_MAX / 2;
+		st.acc = 5000.0f;
+		st.force_limit = 40.0f;
+		st.limit_minus = 0.0f;
+		st.limit_plus = EMU_WIDTH_MAX;
+		st.limits = false;
+		st.referenced = false;
+		st.fast_stop = false;
+	}
+	st.target = st.pos;
+	st.speed = st.vel = st.force = 0.0f;
+	st.moving = st.blocked = st.speed_mode = false;
+	st.motion_id = 0;
+	st.grasp_state = GS_IDLE;
+	memset( st.update, 0, sizeof( st.update ) );
+	memset( st.gcl_update, 0, sizeof( st.gcl_update ) );
+	st.stream_period = 0;
+	st.batch_count = 0;
+	st.script_queue.clear();
+}
+
+
+/////////////
+// I/O     //
+/////////////
+
+/**
+ * Queue a frame for transmission after the configured latency
+ */
+
+static void send_frame( unsigned char id, const unsigned char *payload, unsigned int len )
+{
+	emu_frame_t f;
+	unsigned short crc;
+	std::uniform_real_distribution<double> jit( 0.0, jitter );
+
+	f.data.resize( EMU_HEADER_LEN + len + 2 );
+	memset( &f.data[0], MSG_PREAMBLE_BYTE, MSG_PREAMBLE_LEN );
+	f.data[3] = id;
+	f.data[4] = lo( len );
+	f.data[5] = hi( len );
+	if ( len ) memcpy( &f.data[6], payload, len );
+	crc = checksum_crc16( &f.data[0], EMU_HEADER_LEN + len );
+	f.data[6 + len] = lo( crc );
+	f.data[7 + len] = hi( crc );
+
+	if ( corrupt_rate > 0.0 && std::uniform_real_distribution<double>( 0.0, 1.0 )( rng ) < corrupt_rate )
+	{
+		unsigned int bit = std::uniform_int_distribution<unsigned int>( 0, f.data.size() * 8 - 1 )( rng );
+		f.data[bit / 8] ^= (unsigned char) ( 1 << ( bit % 8 ) );
+		frames_corrupted++;
+	}
+
+	// A serial line or TCP stream does not reorder frames, so neither do we
+	f.due = now() + latency + ( jitter > 0.0 ? jit( rng ) : 0.0 );
+	if ( f.due < tx_last_due ) f.due = tx_last_due;
+	tx_last_due = f.due;
+	tx_queue.push_back( f );
+}
+
+static void send_frame( unsigned char id, const std::vector<unsigned char> &payload )
+{
+	send_frame( id, payload.empty() ? NULL : &payload[0], payload.size() );
+}
+
+/**
+ * Queue a GCL line; the line end is appended
+ */
+
+static void send_text( const char *fmt, ... ) __attribute__(( format( printf, 1, 2 ) ));
+static void send_text( const char *fmt, ... )
+{
+	emu_frame_t f;
+	char line[256];
+	va_list ap;
+	std::uniform_real_distribution<double> jit( 0.0, jitter );
+
+	va_start( ap, fmt );
+	vsnprintf( line, sizeof( line ) - 1, fmt, ap );
+	va_end( ap );
+	strcat( line, "\n" );
+	f.data.assign( line, line + strlen( line ) );
+
+	f.due = now() + latency + ( jitter > 0.0 ? jit( rng ) : 0.0 );
+	if ( f.due < tx_last_due ) f.due = tx_last_due;
+	tx_last_due = f.due;
+	tx_queue.push_back( f );
+}
+
+static const char * gcl_name( unsigned char id )
+{
+	return id == 0x20 ? "HOME" : id == 0x21 ? "MOVE" : id == 0x25 ? "GRIP" : id == 0x26 ? "RELEASE" : "?";
+}
+
+static const char * status_name( status_t status )
+{
+	static const char *names[] = STATUS_DESCRIPTORS;
+	return status <= E_FILE_EXISTS ? names[status] : "E_CMD_FAILED";
+}
+
+static void send_status( unsigned char id, status_t status )
+{
+	std::vector<unsigned char> v;
+
+	// In GCL, the end of a motion is reported by its name; the command was acknowledged already
+	if ( gcl )
+	{
+		if ( status == E_SUCCESS ) send_text( "FIN %s", gcl_name( id ) );
+		else if ( status != E_CMD_PENDING ) send_text( "ERR %s %s", gcl_name( id ), status_name( status ) );
+		return;
+	}
+	put_status( v, status );
+	send_frame( id, v );
+}
+
+static void send_float( unsigned char id, float f )
+{
+	std::vector<unsigned char> v;
+	put_status( v, E_SUCCESS );
+	put_float( v, f );
+	send_frame( id, v );
+}
+
+static void flush_tx( void )
+{
+	double t = now();
+
+	while ( !tx_queue.empty() && tx_queue.front().due <= t )
+	{
+		std::vector<unsigned char> &d = tx_queue.front().data;
+		ssize_t res = 0;
+
+		if ( fd >= 0 )
+		{
+			if ( iface == IF_UDP )
+			{
+				if ( have_peer ) res = sendto( fd, &d[0], d.size(), 0, (struct sockaddr *) &peer, sizeof( peer ) );
+			}
+			else
+			{
+				size_t done = 0;
+				while ( done < d.size() )
+				{
+					res = write( fd, &d[done], d.size() - done );
+					if ( res < 0 && errno == EINTR ) continue;
+					if ( res < 0 && errno == EAGAIN )
+					{
+						struct pollfd p = { fd, POLLOUT, 0 };
+						poll( &p, 1, 10 );
+						continue;
+					}
+					if ( res <= 0 ) break;
+					done += res;
+				}
+			}
+		}
+		if ( res >= 0 ) frames_out++;
+		tx_queue.pop_front();
+	}
+}
+
+/**
+ * Take complete frames from the receive buffer and process them
+ */
+
+static void parse_rx( void )
+{
+	size_t i = 0;
+
+	while ( rx_buf.size() - i >= EMU_HEADER_LEN + 2 )
+	{
+		// Resync on the preamble
+		if ( rx_buf[i] != MSG_PREAMBLE_BYTE || rx_buf[i + 1] != MSG_PREAMBLE_BYTE || rx_buf[i + 2] != MSG_PREAMBLE_BYTE )
+		{
+			i++;
+			continue;
+		}
+
+		unsigned int len = make_short( rx_buf[i + 4], rx_buf[i + 5] );
+		if ( len > EMU_PAYLOAD_MAX )
+		{
+			i++;
+			continue;
+		}
+		if ( rx_buf.size() - i < EMU_HEADER_LEN + len + 2 ) break;
+
+		unsigned char id = rx_buf[i + 3];
+		unsigned short crc = checksum_crc16( &rx_buf[i], EMU_HEADER_LEN + len );
+		if ( crc != make_short( rx_buf[i + EMU_HEADER_LEN + len], rx_buf[i + EMU_HEADER_LEN + len + 1] ) )
+		{
+			crc_errors++;
+			send_status( id, E_CHECKSUM_ERROR );
+			i++;
+			continue;
+		}
+
+		frames_in++;
+		handle_command( id, len ? &rx_buf[i + EMU_HEADER_LEN] : NULL, len );
+		i += EMU_HEADER_LEN + len + 2;
+	}
+
+	rx_buf.erase( rx_buf.begin(), rx_buf.begin() + i );
+}
+
+/**
+ * Take complete lines from the receive buffer and process them
+ */
+
+static void parse_gcl( void )
+{
+	std::vector<unsigned char>::iterator nl;
+
+	while ( ( nl = std::find( rx_buf.begin(), rx_buf.end(), '\n' ) ) != rx_buf.end() )
+	{
+		std::string line( rx_buf.begin(), nl );
+		rx_buf.erase( rx_buf.begin(), nl + 1 );
+		if ( !line.empty() && line[line.size() - 1] == '\r' ) line.erase( line.size() - 1 );
+		if ( line.empty() ) continue;
+
+		frames_in++;
+		handle_gcl( line );
+	}
+}
+
+static void close_connection( void )
+{
+	if ( iface == IF_TCP && fd >= 0 )
+	{
+		close( fd );
+		fd = -1;
+		if ( verbose ) fprintf( stderr, "Connection closed\n" );
+	}
+	rx_buf.clear();
+	tx_queue.clear();
+	tx_last_due = 0.0;
+	reset_state( true );
+}
+
+static int open_interface( void )
+{
+	struct sockaddr_in addr;
+	int on = 1;
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_ANY );
+	addr.sin_port = htons( port );
+
+	if ( iface == IF_TCP )
+	{
+		listen_fd = socket( AF_INET, SOCK_STREAM, 0 );
+		setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+		if ( listen_fd < 0 || bind( listen_fd, (struct sockaddr *) &addr, sizeof( addr ) ) != 0 || listen( listen_fd, 1 ) != 0 )
+		{
+			perror( "tcp" );
+			return -1;
+		}
+		printf( "READY tcp:%u\n", port );
+	}
+	else if ( iface == IF_UDP )
+	{
+		fd = socket( AF_INET, SOCK_DGRAM, 0 );
+		setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+		if ( fd < 0 || bind( fd, (struct sockaddr *) &addr, sizeof( addr ) ) != 0 )
+		{
+			perror( "udp" );
+			return -1;
+		}
+		printf( "READY udp:%u\n", port );
+	}
+	else
+	{
+		struct termios tio;
+
+		fd = posix_openpt( O_RDWR | O_NOCTTY | O_NONBLOCK );
+		if ( fd < 0 || grantpt( fd ) != 0 || unlockpt( fd ) != 0 )
+		{
+			perror( "pty" );
+			return -1;
+		}
+
+		// Keep the slave open ourselves, otherwise reading fails while no driver is connected
+		pty_slave = open( ptsname( fd ), O_RDWR | O_NOCTTY );
+		if ( pty_slave < 0 || tcgetattr( pty_slave, &tio ) != 0 )
+		{
+			perror( "pty" );
+			return -1;
+		}
+		cfmakeraw( &tio );
+		tcsetattr( pty_slave, TCSANOW, &tio );
+		printf( "READY %s\n", ptsname( fd ) );
+	}
+
+	fflush( stdout );
+	return 0;
+}
+
+static void read_input( void )
+{
+	unsigned char buf[4096];
+	ssize_t n;
+
+	if ( iface == IF_UDP )
+	{
+		socklen_t alen = sizeof( peer );
+		n = recvfrom( fd, buf, sizeof( buf ), MSG_DONTWAIT, (struct sockaddr *) &peer, &alen );
+		if ( n > 0 ) have_peer = true;
+	}
+	else
+		n = read( fd, buf, sizeof( buf ) );
+
+	if ( n > 0 )
+	{
+		rx_buf.insert( rx_buf.end(), buf, buf + n );
+		if ( gcl ) parse_gcl();
+		else parse_rx();
+	}
+	else if ( n == 0 || ( errno != EAGAIN && errno != EINTR ) )
+		close_connection();
+}
+
+
+/////////////////////
+// SIMULATION      //
+/////////////////////
+
+static void start_motion( unsigned char id, float target, float speed )
+{
+	// A new motion aborts the one in progress
+	if ( st.motion_id ) send_status( st.motion_id, E_CMD_ABORTED );
+
+	if ( st.limits ) target = fminf( fmaxf( target, st.limit_minus ), st.limit_plus );
+	st.target = fminf( fmaxf( target, 0.0f ), EMU_WIDTH_MAX );
+	st.speed = fminf( fabsf( speed ), EMU_SPEED_MAX );
+	st.speed_mode = false;
+	st.blocked = false;
+	st.force = 0.0f;
+	st.moving = st.pos != st.target && st.speed > 0.0f;
+	st.motion_id = id;
+
+	send_status( id, E_CMD_PENDING );
+	if ( !st.moving )
+	{
+		send_status( id, E_SUCCESS );
+		st.motion_id = 0;
+	}
+}
+
+static void stop_motion( status_t status )
+{
+	if ( st.motion_id ) send_status( st.motion_id, status );
+	st.motion_id = 0;
+	st.moving = st.speed_mode = false;
+	st.target = st.pos;
+	st.vel = 0.0f;
+}
+
+/**
+ * Advance the axis by dt seconds; the axis moves at constant speed
+ */
+
+static void step( double dt )
+{
+	if ( !st.moving )
+	{
+		st.vel = 0.0f;
+		return;
+	}
+
+	float d = st.target - st.pos;
+	float v = st.speed_mode ? st.vel : ( d > 0 ? st.speed : -st.speed );
+	float dx = v * (float) dt;
+
+	if ( !st.speed_mode && fabsf( dx ) >= fabsf( d ) )
+	{
+		st.pos = st.target;
+		st.moving = false;
+		st.vel = 0.0f;
+
+		if ( st.grasp_state == GS_GRASPING )
+		{
+			st.grasp_state = GS_HOLDING;
+			st.force = st.force_limit;
+			st.blocked = true;
+		}
+		else if ( st.grasp_state == GS_RELEASING || st.grasp_state == GS_POSITIONING )
+			st.grasp_state = GS_IDLE;
+
+		if ( st.motion_id == 0x20 ) st.referenced = true;
+		if ( st.motion_id ) send_status( st.motion_id, E_SUCCESS );
+		st.motion_id = 0;
+		return;
+	}
+
+	st.pos += dx;
+	st.vel = v;
+
+	// Velocity control runs into the end stops
+	if ( st.pos <= 0.0f || st.pos >= EMU_WIDTH_MAX )
+	{
+		st.pos = fminf( fmaxf( st.pos, 0.0f ), EMU_WIDTH_MAX );
+		st.blocked = true;
+		stop_motion( E_AXIS_BLOCKED );
+	}
+}
+
+static void put_measurement( std::vector<unsigned char> &v )
+{
+	// Only the lowest byte of the state is sent, see cmd_measure.lua
+	v.push_back( (unsigned char) ( state_flags() & 0xff ) );
+	put_float( v, st.pos );
+	put_float( v, st.vel );
+	put_float( v, st.force );
+	put_float( v, st.force / 2 );
+	put_float( v, st.force / 2 );
+}
+
+static float update_value( unsigned int i )
+{
+	return i == 0 ? st.pos : i == 1 ? st.vel : st.force;
+}
+
+// GRIPSTATE; a fast stop is reported as error until it is acknowledged
+static unsigned int gcl_grip_state( void )
+{
+	return st.fast_stop ? 7 : st.grasp_state;
+}
+
+/**
+ * Send due automatic updates, script frames and the results of batches
+ */
+
+static void run_periodic( double t )
+{
+	for ( unsigned int i = 0; i < 3; i++ )
+	{
+		emu_update_t &u = st.update[i];
+		if ( !u.period_ms || t < u.next ) continue;
+
+		u.next += u.period_ms / 1000.0;
+		if ( u.next < t ) u.next = t + u.period_ms / 1000.0;
+
+		float val = update_value( i );
+		if ( u.on_change && val == u.last ) continue;
+		u.last = val;
+		send_float( 0x43 + i, val );
+	}
+
+	for ( unsigned int i = 0; i < 4; i++ )
+	{
+		static const char *keys[] = { "POS", "SPEED", "FORCE", "GRIPSTATE" };
+		emu_update_t &u = st.gcl_update[i];
+		if ( !u.period_ms || t < u.next ) continue;
+
+		u.next += u.period_ms / 1000.0;
+		if ( u.next < t ) u.next = t + u.period_ms / 1000.0;
+
+		float val = i < 3 ? update_value( i ) : (float) gcl_grip_state();
+		if ( u.on_change && val == u.last ) continue;
+		u.last = val;
+		if ( i < 3 ) send_text( "@%s=%.2f", keys[i], val );
+		else send_text( "@%s=%u", keys[i], (unsigned int) val );
+	}
+
+	if ( st.stream_period && t >= st.stream_next && !st.batch_count )
+	{
+		std::vector<unsigned char> v;
+		st.stream_next = t + st.stream_period / 1000.0;
+		put_status( v, E_SUCCESS );
+		put_measurement( v );
+		send_frame( 0xB4, v );
+	}
+
+	if ( st.batch_count && t >= st.batch_next )
+	{
+		unsigned int dt = (unsigned int) lround( ( t - st.batch_t0 ) * 1000.0 );
+
+		st.batch.push_back( lo( dt ) );
+		st.batch.push_back( hi( dt ) );
+		put_measurement( st.batch );
+		st.batch_next += st.batch_period / 1000.0;
+
+		if ( ++st.batch_n == st.batch_count )
+		{
+			std::vector<unsigned char> v;
+			unsigned int t0 = (unsigned int) ( st.batch_t0 * 1000.0 );
+
+			put_status( v, E_SUCCESS );
+			v.push_back( (unsigned char) st.batch_n );
+			for ( unsigned int k = 0; k < 4; k++ ) v.push_back( (unsigned char) ( t0 >> ( 8 * k ) ) );
+			v.insert( v.end(), st.batch.begin(), st.batch.end() );
+			send_frame( 0xB3, v );
+			st.batch_count = 0;
+
+			// The script handles the commands that came in meanwhile
+			while ( !st.script_queue.empty() && !st.batch_count )
+			{
+				std::vector<unsigned char> c = st.script_queue.front();
+				st.script_queue.pop_front();
+				handle_command( c[0], c.size() > 1 ? &c[1] : NULL, c.size() - 1 );
+			}
+		}
+	}
+}
+
+
+//////////////////
+// COMMANDS     //
+//////////////////
+
+static void handle_script( unsigned char id, const unsigned char *payload, unsigned int len )
+{
+	std::vector<unsigned char> v;
+
+	if ( st.batch_count )
+	{
+		std::vector<unsigned char> c( len + 1 );
+		c[0] = id;
+		if ( len ) memcpy( &c[1], payload, len );
+		st.script_queue.push_back( c );
+		return;
+	}
+
+	if ( id == 0xB3 )
+	{
+		unsigned int period = len >= 3 ? make_short( payload[1], payload[2] ) : 0;
+		if ( len < 3 || payload[0] < 1 || payload[0] > EMU_BATCH_MAX || period == 0 )
+		{
+			send_status( id, E_RANGE_ERROR );
+			return;
+		}
+		st.batch_count = payload[0];
+		st.batch_period = period;
+		st.batch_n = 0;
+		st.batch_t0 = st.batch_next = now();
+		st.batch.clear();
+		return;
+	}
+
+	if ( id == 0xB4 )
+	{
+		if ( len < 2 )
+		{
+			send_status( id, E_NOT_ENOUGH_PARAMS );
+			return;
+		}
+		st.stream_period = make_short( payload[0], payload[1] );
+		st.stream_next = now() + st.stream_period / 1000.0;
+		send_status( id, E_SUCCESS );
+		return;
+	}
+
+	if ( len < 9 )
+	{
+		send_status( id, E_NOT_ENOUGH_PARAMS );
+		return;
+	}
+
+	if ( id == 0xB1 )
+	{
+		// Position control; the script does not wait for the end of the motion
+		if ( st.motion_id ) stop_motion( E_CMD_ABORTED );
+		st.target = fminf( fmaxf( get_float( &payload[1] ), 0.0f ), EMU_WIDTH_MAX );
+		st.speed = fminf( fabsf( get_float( &payload[5] ) ), EMU_SPEED_MAX );
+		st.speed_mode = false;
+		st.moving = st.pos != st.target && st.speed > 0.0f;
+	}
+	else if ( id == 0xB5 )
+	{
+		// Set-point; the script follows it without stopping the motion
+		st.target = fminf( fmaxf( get_float( &payload[1] ), 0.0f ), EMU_WIDTH_MAX );
+		st.speed = fminf( fabsf( get_float( &payload[5] ) ), EMU_SPEED_MAX );
+		st.speed_mode = false;
+		st.moving = st.pos != st.target && st.speed > 0.0f;
+	}
+	else if ( id == 0xB2 )
+	{
+		// Velocity control
+		if ( st.motion_id ) stop_motion( E_CMD_ABORTED );
+		st.vel = fminf( fmaxf( get_float( &payload[5] ), -EMU_SPEED_MAX ), EMU_SPEED_MAX );
+		st.speed_mode = st.moving = st.vel != 0.0f;
+		st.blocked = false;
+	}
+
+	put_status( v, E_SUCCESS );
+	put_measurement( v );
+	send_frame( id, v );
+}
+
+static void handle_command( unsigned char id, const unsigned char *payload, unsigned int len )
+{
+	std::vector<unsigned char> v;
+
+	if ( verbose ) fprintf( stderr, "Command 0x%02X, %u bytes\n", id, len );
+
+	if ( id >= 0xB0 && id <= 0xB5 )
+	{
+		if ( script ) handle_script( id, payload, len );
+		else send_status( id, E_CMD_UNKNOWN );
+		return;
+	}
+
+	switch ( id )
+	{
+		case 0x06:	// Loop-back
+			put_status( v, E_SUCCESS );
+			v.insert( v.end(), payload, payload + len );
+			send_frame( id, v );
+			break;
+
+		case 0x07:	// Announce disconnect
+			send_status( id, E_SUCCESS );
+			reset_state( true );
+			break;
+
+		case 0x20:	// Homing
+			if ( st.fast_stop )
+			{
+				send_status( id, E_ACCESS_DENIED );
+				break;
+			}
+			st.grasp_state = GS_POSITIONING;
+			start_motion( id, len >= 1 && payload[0] == 2 ? 0.0f : EMU_WIDTH_MAX, EMU_HOMING_SPEED );
+			break;
+
+		case 0x21:	// Move
+		case 0x25:	// Grasp
+		case 0x26:	// Release
+			if ( st.fast_stop )
+			{
+				send_status( id, E_ACCESS_DENIED );
+				break;
+			}
+			if ( len < ( id == 0x21 ? 9u : 8u ) )
+			{
+				send_status( id, E_NOT_ENOUGH_PARAMS );
+				break;
+			}
+			{
+				const unsigned char *p = id == 0x21 ? &payload[1] : payload;
+				st.grasp_state = id == 0x25 ? GS_GRASPING : id == 0x26 ? GS_RELEASING : GS_POSITIONING;
+				start_motion( id, get_float( p ), get_float( p + 4 ) );
+			}
+			break;
+
+		case 0x22:	// Stop
+			stop_motion( E_CMD_ABORTED );
+			send_status( id, E_SUCCESS );
+			break;
+
+		case 0x23:	// Fast stop
+			stop_motion( E_CMD_ABORTED );
+			st.fast_stop = true;
+			send_status( id, E_SUCCESS );
+			break;
+
+		case 0x24:	// Acknowledge fault
+			if ( len == 3 && memcmp( payload, "ack", 3 ) == 0 )
+			{
+				st.fast_stop = false;
+				send_status( id, E_SUCCESS );
+			}
+			else send_status( id, E_CMD_FORMAT_ERROR );
+			break;
+
+		case 0x30:	// Set acceleration
+		case 0x32:	// Set force limit
+			if ( len < 4 )
+			{
+				send_status( id, E_NOT_ENOUGH_PARAMS );
+				break;
+			}
+			( id == 0x30 ? st.acc : st.force_limit ) = get_float( payload );
+			send_status( id, E_SUCCESS );
+			break;
+
+		case 0x31:	// Get acceleration
+			send_float( id, st.acc );
+			break;
+
+		case 0x33:	// Get force limit
+			send_float( id, st.force_limit );
+			break;
+
+		case 0x34:	// Set soft limits
+			if ( len < 8 )
+			{
+				send_status( id, E_NOT_ENOUGH_PARAMS );
+				break;
+			}
+			st.limit_minus = get_float( payload );
+			st.limit_plus = get_float( payload + 4 );
+			st.limits = true;
+			send_status( id, E_SUCCESS );
+			break;
+
+		case 0x35:	// Get soft limits
+			if ( !st.limits )
+			{
+				send_status( id, E_NOT_AVAILABLE );
+				break;
+			}
+			put_status( v, E_SUCCESS );
+			put_float( v, st.limit_minus );
+			put_float( v, st.limit_plus );
+			send_frame( id, v );
+			break;
+
+		case 0x36:	// Clear soft limits
+			st.limits = false;
+			send_status( id, E_SUCCESS );
+			break;
+
+		case 0x40:	// System state
+		{
+			unsigned int flags = state_flags();
+			put_status( v, E_SUCCESS );
+			for ( unsigned int k = 0; k < 4; k++ ) v.push_back( (unsigned char) ( flags >> ( 8 * k ) ) );
+			send_frame( id, v );
+			break;
+		}
+
+		case 0x41:	// Grasping state
+			put_status( v, E_SUCCESS );
+			v.push_back( st.grasp_state );
+			send_frame( id, v );
+			break;
+
+		case 0x43:	// Opening width
+		case 0x44:	// Speed
+		case 0x45:	// Force
+		{
+			emu_update_t &u = st.update[id - 0x43];
+			if ( len >= 3 && ( payload[0] & 0x01 ) )
+			{
+				u.period_ms = make_short( payload[1], payload[2] );
+				u.on_change = ( payload[0] & 0x02 ) != 0;
+				u.next = now() + u.period_ms / 1000.0;
+			}
+			else
+				u.period_ms = 0;
+			u.last = update_value( id - 0x43 );
+			send_float( id, u.last );
+			break;
+		}
+
+		case 0x63:	// Finger 1 data
+		case 0x73:	// Finger 2 data: two FMF fingers sharing the grasping force
+			send_float( id, st.force / 2 );
+			break;
+
+		case 0x50:	// System information
+			put_status( v, E_SUCCESS );
+			v.push_back( 4 );			// WSG 50
+			v.push_back( 3 );			// Hardware revision
+			v.push_back( lo( 0x0411 ) );
+			v.push_back( hi( 0x0411 ) );
+			for ( unsigned int k = 0; k < 4; k++ ) v.push_back( (unsigned char) ( 12345 >> ( 8 * k ) ) );
+			send_frame( id, v );
+			break;
+
+		default:
+			send_status( id, E_CMD_UNKNOWN );
+			break;
+	}
+}
+
+
+/**
+ * Handle a GCL command line, e.g. "MOVE(10.0,50.0)" or "POS?"
+ */
+
+static void handle_gcl( const std::string &line )
+{
+	std::string name = line.substr( 0, line.find_first_of( "(?" ) );
+	std::vector<std::string> args;
+	std::vector<float> num;
+	size_t open = line.find( '(' ), close = line.rfind( ')' );
+
+	if ( verbose ) fprintf( stderr, "GCL %s\n", line.c_str() );
+
+	if ( open != std::string::npos && close != std::string::npos && close > open + 1 )
+	{
+		std::string list = line.substr( open + 1, close - open - 1 );
+		for ( size_t start = 0, comma; start <= list.size(); start = comma + 1 )
+		{
+			comma = list.find( ',', start );
+			if ( comma == std::string::npos ) comma = list.size();
+			args.push_back( list.substr( start, comma - start ) );
+			num.push_back( (float) atof( args.back().c_str() ) );
+		}
+	}
+
+	// Queries
+	if ( line[line.size() - 1] == '?' )
+	{
+		if ( name == "POS" ) send_text( "POS=%.2f", st.pos );
+		else if ( name == "SPEED" ) send_text( "SPEED=%.2f", st.vel );
+		else if ( name == "FORCE" ) send_text( "FORCE=%.2f", st.force );
+		else if ( name == "GRIPSTATE" ) send_text( "GRIPSTATE=%u", gcl_grip_state() );
+		else send_text( "ERR %s E_CMD_UNKNOWN", name.c_str() );
+		return;
+	}
+
+	if ( name == "MOVE" || name == "GRIP" || name == "RELEASE" || name == "HOME" )
+	{
+		unsigned int need = name == "MOVE" ? 1 : name == "GRIP" ? 3 : name == "RELEASE" ? 2 : 0;
+		unsigned char id = name == "MOVE" ? 0x21 : name == "GRIP" ? 0x25 : name == "RELEASE" ? 0x26 : 0x20;
+
+		if ( st.fast_stop )
+		{
+			send_text( "ERR %s E_ACCESS_DENIED", name.c_str() );
+			return;
+		}
+		if ( num.size() < need )
+		{
+			send_text( "ERR %s E_NOT_ENOUGH_PARAMS", name.c_str() );
+			return;
+		}
+
+		send_text( "ACK %s", name.c_str() );
+		if ( id == 0x21 )
+		{
+			st.grasp_state = GS_POSITIONING;
+			start_motion( id, num[0], num.size() > 1 ? num[1] : EMU_HOMING_SPEED );
+		}
+		else if ( id == 0x25 )
+		{
+			st.force_limit = num[0];
+			st.grasp_state = GS_GRASPING;
+			start_motion( id, num[1], num[2] );
+		}
+		else if ( id == 0x26 )
+		{
+			st.grasp_state = GS_RELEASING;
+			start_motion( id, st.pos + num[0], num[1] );
+		}
+		else
+		{
+			st.grasp_state = GS_POSITIONING;
+			start_motion( id, EMU_WIDTH_MAX, EMU_HOMING_SPEED );
+		}
+	}
+	else if ( name == "STOP" || name == "FASTSTOP" )
+	{
+		stop_motion( E_CMD_ABORTED );
+		if ( name == "FASTSTOP" ) st.fast_stop = true;
+		send_text( "ACK %s", name.c_str() );
+	}
+	else if ( name == "FSACK" )
+	{
+		st.fast_stop = false;
+		send_text( "ACK FSACK" );
+	}
+	else if ( name == "AUTOSEND" )
+	{
+		static const char *keys[] = { "\"POS\"", "\"SPEED\"", "\"FORCE\"", "\"GRIPSTATE\"" };
+		unsigned int i;
+
+		for ( i = 0; i < 4 && ( args.empty() || args[0] != keys[i] ); i++ );
+		if ( i == 4 || num.size() < 2 )
+		{
+			send_text( "ERR AUTOSEND E_INVALID_PARAMETER" );
+			return;
+		}
+
+		emu_update_t &u = st.gcl_update[i];
+		u.period_ms = (unsigned int) num[1];
+		u.on_change = num.size() > 2 && num[2] != 0.0f;
+		u.next = now() + u.period_ms / 1000.0;
+		u.last = NAN;
+		send_text( "ACK AUTOSEND" );
+	}
+	else
+		send_text( "ERR %s E_CMD_UNKNOWN", name.c_str() );
+}
+
+
+static void sig_handler( int )
+{
+	stop_requested = 1;
+}
+
+static void usage( const char *name )
+{
+	fprintf( stderr, "Usage: %s [-p tcp|udp|pty] [-P port] [-l latency_us] [-j jitter_us] [-c corrupt_rate] [-s] [-g] [-r seed] [-v]\n"
+			 "  -p  Interface (default tcp)\n"
+			 "  -P  TCP/UDP port (default 1500)\n"
+			 "  -l  Delay of every frame sent in us\n"
+			 "  -j  Additional random delay of up to jitter_us\n"
+			 "  -c  Fraction of frames sent with one bit flipped (0..1)\n"
+			 "  -s  Answer the commands of cmd_measure.lua\n"
+			 "  -g  Speak the GCL text protocol\n"
+			 "  -r  Seed of jitter and corruption\n"
+			 "  -v  Print every command\n", name );
+}
+
+int main( int argc, char **argv )
+{
+	int c;
+	unsigned int seed = 1;
+	double last;
+
+	while ( ( c = getopt( argc, argv, "p:P:l:j:c:sgr:vh" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 'p':
+				if ( strcmp( optarg, "tcp" ) == 0 ) iface = IF_TCP;
+				else if ( strcmp( optarg, "udp" ) == 0 ) iface = IF_UDP;
+				else if ( strcmp( optarg, "pty" ) == 0 ) iface = IF_PTY;
+				else { usage( argv[0] ); return 1; }
+				break;
+			case 'P': port = (unsigned short) atoi( optarg ); break;
+			case 'l': latency = atof( optarg ) * 1e-6; break;
+			case 'j': jitter = atof( optarg ) * 1e-6; break;
+			case 'c': corrupt_rate = atof( optarg ); break;
+			case 's': script = true; break;
+			case 'g': gcl = true; break;
+			case 'r': seed = (unsigned int) atoi( optarg ); break;
+			case 'v': verbose = true; break;
+			default: usage( argv[0] ); return 1;
+		}
+	}
+
+	rng.seed( seed );
+	reset_state( false );
+	signal( SIGINT, sig_handler );
+	signal( SIGTERM, sig_handler );
+	signal( SIGPIPE, SIG_IGN );
+
+	if ( open_interface() != 0 ) return 1;
+
+	last = now();
+	while ( !stop_requested )
+	{
+		struct pollfd p;
+		double t = now();
+		int timeout_us = EMU_TICK_US;
+
+		if ( !tx_queue.empty() )
+		{
+			double wait = ( tx_queue.front().due - t ) * 1e6;
+			if ( wait < timeout_us ) timeout_us = wait > 0 ? (int) wait : 0;
+		}
+
+		p.fd = fd >= 0 ? fd : listen_fd;
+		p.events = POLLIN;
+		p.revents = 0;
+
+		struct timespec ts = { 0, timeout_us * 1000L };
+		int res = ppoll( &p, 1, &ts, NULL );
+
+		if ( res > 0 && p.fd == listen_fd )
+		{
+			int on = 1;
+			fd = accept( listen_fd, NULL, NULL );
+			if ( fd >= 0 )
+			{
+				setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+				fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+				if ( verbose ) fprintf( stderr, "Connection accepted\n" );
+			}
+		}
+		else if ( res > 0 && ( p.revents & ( POLLIN | POLLHUP | POLLERR ) ) )
+			read_input();
+
+		t = now();
+		step( t - last );
+		last = t;
+		run_periodic( t );
+		flush_tx();
+	}
+
+	fprintf( stderr, "Frames received: %lu (checksum errors: %lu), sent: %lu (corrupted: %lu)\n",
+			 frames_in, crc_errors, frames_out, frames_corrupted );
+
+	if ( fd >= 0 ) close( fd );
+	if ( listen_fd >= 0 ) close( listen_fd );
+	if ( pty_slave >= 0 ) close( pty_slave );
+	return 0;
+}
@@ -0,0 +1,162 @@
+//======================================================================
+/**
+ *  @file
+ *  wsg50_replay.cpp
+ *
+ *  @section wsg50_replay.cpp_general General file information
+ *
+ *  @brief
+ *  Plays a recording of the link traffic (see recorder.h) back through
+ *  the driver's receive path, or dumps it.
+ *
+ *  Usage: wsg50_replay [-s speed] [-v] recording
+ *         wsg50_replay -d recording
+ *
+ *  The received data are fed to the dispatcher at the recorded times (-s 2:
+ *  twice as fast, -s 0: as fast as possible) until the end of the
+ *  recording. Reports the frames per command ID, checksum errors and
+ *  resync bytes, so a failure seen on the real gripper can be reproduced
+ *  and a fix of the parser checked against the same bytes. With -d, the
+ *  records are printed with their time, direction and data instead.
+ */
+//======================================================================
+
+
+//------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <thread>
+
+#include "wsg50/cmd.h"
+#include "wsg50/common.h"
+#include "wsg50/dispatcher.h"
+#include "wsg50/metrics.h"
+#include "wsg50/msg.h"
+#include "wsg50/recorder.h"
+#include "wsg50/replay.h"
+
+
+//------------------------------------------------------------------------
+// Function implementation
+//------------------------------------------------------------------------
+
+static double cpu_time( void )
+{
+	struct rusage ru;
+	getrusage( RUSAGE_SELF, &ru );
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+static void print_cb( const msg_t *msg, void * )
+{
+	printf( "frame 0x%02X, %u bytes, status %s\n", msg->id, msg->len,
+			msg->len >= 2 ? status_to_str( cmd_get_response_status( msg->data ) ) : "-" );
+}
+
+/**
+ * Print the records of a recording
+ *
+ * @return 0 on success, 1 if the recording cannot be read
+ */
+
+static int dump( const char *path )
+{
+	recorder_t file;
+	const recorder_record_t *r;
+	uint64_t i, t0 = 0, skipped = 0;
+	bool first = true;
+
+	if ( recorder_map( &file, path ) != 0 ) return 1;
+
+	printf( "%llu records of %llu in the file\n", (unsigned long long) file.hdr->count, (unsigned long long) file.hdr->capacity );
+	for ( i = recorder_first( &file ); i < file.hdr->count; i++ )
+	{
+		r = recorder_get( &file, i );
+		if ( !r )
+		{
+			skipped++;
+			continue;
+		}
+		if ( first ) t0 = r->t_ns;
+		first = false;
+
+		printf( "%12.6f %s %3u%s ", ( r->t_ns - t0 ) * 1e-9, r->dir == RECORDER_TX ? "TX" : "RX", r->len,
+				r->flags & RECORDER_MORE ? "+" : " " );
+		for ( unsigned int k = 0; k < r->len; k++ ) printf( "%02X", r->data[k] );
+		printf( "\n" );
+	}
+	if ( skipped ) printf( "%llu incomplete records skipped\n", (unsigned long long) skipped );
+
+	recorder_close( &file );
+	return 0;
+}
+
+static void usage( const char *name )
+{
+	fprintf( stderr, "Usage: %s [-s speed] [-v] recording\n"
+			 "       %s -d recording\n"
+			 "  -s  Speed factor, 0: as fast as possible (default 1)\n"
+			 "  -v  Print every frame\n"
+			 "  -d  Print the records instead of replaying them\n", name, name );
+}
+
+int main( int argc, char **argv )
+{
+	double speed = 1.0, cpu;
+	bool dump_only = false, verbose = false;
+	unsigned long frames = 0;
+	int c;
+
+	while ( ( c = getopt( argc, argv, "s:vdh" ) ) != -1 )
+	{
+		switch ( c )
+		{
+			case 's': speed = atof( optarg ); break;
+			case 'v': verbose = true; break;
+			case 'd': dump_only = true; break;
+			default: usage( argv[0] ); return 1;
+		}
+	}
+	if ( optind != argc - 1 )
+	{
+		usage( argv[0] );
+		return 1;
+	}
+	if ( dump_only ) return dump( argv[optind] );
+
+	auto start = std::chrono::steady_clock::now();
+	cpu = cpu_time();
+	if ( cmd_connect_replay( argv[optind], speed ) != 0 || dispatcher_start() != 0 )
+	{
+		fprintf( stderr, "Unable to replay %s\n", argv[optind] );
+		return 1;
+	}
+	// Frames are counted by the parser; the subscribers only print them
+	if ( verbose ) for ( unsigned int id = 0; id < 256; id++ ) dispatcher_subscribe( (unsigned char) id, print_cb, NULL );
+
+	while ( !replay_finished( cmd_selected()->link.conn ) ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+	dispatcher_stop();
+	cmd_disconnect();
+	cpu = cpu_time() - cpu;
+
+	const metrics_t *m = cmd_selected()->link.metrics;
+	printf( "%-6s %10s\n", "id", "frames" );
+	for ( unsigned int id = 0; id < 256; id++ )
+	{
+		unsigned long n = metrics_frames( m, (unsigned char) id );
+		if ( n ) printf( "0x%02X   %10lu\n", id, n );
+		frames += n;
+	}
+	printf( "frames: %lu, checksum errors: %lu, resync bytes: %lu\n", frames, metrics_crc_errors( m ), metrics_resync_bytes( m ) );
+	printf( "replayed in %.3f s, cpu/frame: %.2f us\n",
+			std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count(), frames ? cpu * 1e6 / frames : 0.0 );
+
+	return 0;
+}
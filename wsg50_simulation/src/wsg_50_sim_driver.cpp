@@ -28,104 +28,473 @@
  *
  * \author Marc Benetó (mbeneto@robotnik.es)
  * \brief WSG-50 sim driver.
+ *
+ * Offers the topics and services of the wsg50 node. The fingers follow a
+ * trapezoidal speed profile limited by the acceleration and speed set,
+ * advanced in fixed steps of step_size s by a single timer, so a motion
+ * takes the same steps however fast the simulation runs. With lockstep,
+ * the steps are driven by /clock instead, each clock message advancing
+ * the model to its time. The finger position is sent to the gazebo joint
+ * controllers once per cycle, and only if it changed.
  */
 
+#include <math.h>
+
+#include <condition_variable>
+#include <mutex>
+
 #include <ros/ros.h>
-#include <wsg50_common/Move.h>
-#include <wsg50_common/Incr.h>
+#include <ros/callback_queue.h>
+#include <rosgraph_msgs/Clock.h>
+#include <sensor_msgs/JointState.h>
+#include <std_msgs/Bool.h>
+#include <std_msgs/Float32.h>
 #include <std_msgs/Float64.h>
 #include <std_srvs/Empty.h>
+#include <wsg50_common/Cmd.h>
+#include <wsg50_common/Conf.h>
+#include <wsg50_common/ExecuteSequence.h>
+#include <wsg50_common/Incr.h>
+#include <wsg50_common/Move.h>
+#include <wsg50_common/Status.h>
 
 #define GRIPPER_MAX_OPEN 110.0
 #define GRIPPER_MIN_OPEN 0.0
 
+// Status codes of the gripper, see wsg50_driver/include/wsg50/common.h
+#define E_SUCCESS 0
+#define E_ALREADY_RUNNING 4
+#define E_ACCESS_DENIED 16
+#define E_CMD_ABORTED 19
+#define E_RANGE_ERROR 28
+#define E_AXIS_BLOCKED 29
+
+// Grasping states, as reported by the gripper
+#define GS_IDLE 0
+#define GS_GRASPING 1
+#define GS_HOLDING 4
+#define GS_RELEASING 5
+#define GS_POSITIONING 6
+
 using namespace std;
 
-ros::Publisher vel_pub_r_, vel_pub_l_;
-ros::ServiceClient moveSC;
-double currentOpenning;
+enum motion_t { MOTION_NONE, MOTION_POSITION, MOTION_SPEED, MOTION_BRAKE };
 
-void move(double width){
-	
-		double open = width / 2;
-		
-		std_msgs::Float64 lCommand, rCommand;
-		
-		rCommand.data = open/1000;
-		lCommand.data = rCommand.data * -1.0;
-		
-		vel_pub_r_.publish(rCommand);
-		vel_pub_l_.publish(lCommand);
-		
-		currentOpenning = width;
-	
+/** \brief State of the simulated axis; all distances in mm */
+struct axis_state
+{
+	double pos, vel;
+	double target, speed;			// Goal and max. speed of MOTION_POSITION; speed of MOTION_SPEED (signed)
+	double acc;						// mm/s^2
+	double force_limit, force;		// N
+	motion_t motion;
+	bool grasping;					// The motion ends in contact with the part
+	bool homed, target_reached, fast_stopped, stopped;
+	int grasp_state;
+	unsigned int started, finished;	// Motion services started and finished
+	int result;						// Status of the motion finished last
+};
+
+axis_state axis;
+std::mutex axis_lock;
+std::condition_variable axis_done;	// A motion finished
+
+double size_, step_size, homing_speed, object_width;
+double model_time = -1.0;			// Time the model was advanced to, s
+bool lockstep;
+
+ros::Publisher vel_pub_r_, vel_pub_l_, state_pub, joint_pub, moving_pub;
+double publish_period, next_publish, next_command;
+double last_command = -1.0;
+int moving_published = -1;
+sensor_msgs::JointState joint_msg;
+
+
+/** \brief Ends the motion of a service with the given status */
+void finish_motion(int status)
+{
+	axis.result = status;
+	axis.finished = axis.started;
+	axis_done.notify_all();
 }
 
-bool moveSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res)
+/** \brief Advances the axis by one step of dt s */
+void step_axis(double dt)
 {
-	if ( req.width >= 0.0 && req.width <= 110.0 ){
-  		ROS_INFO("Moving to %f position.", req.width);
-		move(req.width);
-		
-	}else if (req.width < 0.0 || req.width > 110.0){
-		ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - 110.0] ");
-		return false;
+	axis_state &a = axis;
+	double dv_max = a.acc * dt;
+
+	if (a.motion == MOTION_NONE) {
+		a.vel = 0.0;
+		return;
+	}
+
+	if (a.motion == MOTION_BRAKE || a.motion == MOTION_SPEED) {
+		double goal = a.motion == MOTION_SPEED ? a.speed : 0.0;
+		a.vel += std::max(-dv_max, std::min(dv_max, goal - a.vel));
+		a.pos += a.vel * dt;
+
+		if (a.pos <= GRIPPER_MIN_OPEN || a.pos >= size_) {
+			a.pos = std::max(GRIPPER_MIN_OPEN, std::min(size_, a.pos));
+			a.vel = 0.0;
+			a.motion = MOTION_NONE;
+			if (a.started != a.finished) finish_motion(E_AXIS_BLOCKED);
+		}
+		else if (a.motion == MOTION_BRAKE && a.vel == 0.0)
+			a.motion = MOTION_NONE;
+		return;
 	}
 
-	ROS_INFO("Target position reached.");
-  	return true;
+	// Trapezoidal profile: accelerate to the max. speed, brake to reach the target at rest
+	double d = a.target - a.pos;
+	double v_goal = std::min(a.speed, sqrt(2.0 * a.acc * fabs(d)));
+	a.vel += std::max(-dv_max, std::min(dv_max, (d > 0 ? v_goal : -v_goal) - a.vel));
+	double dx = a.vel * dt;
+
+	if (fabs(d) < 1e-6 || (dx * d > 0 && fabs(dx) >= fabs(d))) {
+		a.pos = a.target;
+		a.vel = 0.0;
+		a.motion = MOTION_NONE;
+		a.target_reached = true;
+		if (a.grasping) {
+			a.grasp_state = GS_HOLDING;
+			a.force = a.force_limit;
+			a.grasping = false;
+		}
+		else
+			a.grasp_state = GS_IDLE;
+		if (a.started != a.finished) finish_motion(E_SUCCESS);
+		return;
+	}
+	a.pos += dx;
 }
 
-bool moveIncrementallySrv(wsg50_common::Incr::Request &req, wsg50_common::Incr::Response &res)
+/** \brief Starts a motion to a width; called with axis_lock held
+ *  \return The status: E_SUCCESS, or why the motion was refused */
+int start_position(double width, double speed, bool grasp, int grasp_state)
 {
-				
-	if (req.direction == "open"){
-		
-		float nextWidth = currentOpenning + req.increment;
-		
-		if ( (currentOpenning < GRIPPER_MAX_OPEN) && nextWidth < GRIPPER_MAX_OPEN ){
-			move(nextWidth);
-		}else if( nextWidth >= GRIPPER_MAX_OPEN){
-			move(nextWidth);
-			currentOpenning = GRIPPER_MAX_OPEN;
+	if (axis.fast_stopped)
+		return E_ACCESS_DENIED;
+
+	axis.target = std::max(GRIPPER_MIN_OPEN, std::min(size_, width));
+	axis.speed = std::max(0.1, std::min(420.0, speed));
+	axis.motion = MOTION_POSITION;
+	axis.grasping = grasp;
+	axis.grasp_state = grasp_state;
+	axis.force = 0.0;
+	axis.stopped = false;
+	axis.target_reached = false;
+	return E_SUCCESS;
+}
+
+/** \brief Runs a motion to a width and waits until the model reaches it
+ *  \return The status of the motion */
+int run_motion(double width, double speed, bool grasp, int grasp_state)
+{
+	std::unique_lock<std::mutex> lock(axis_lock);
+
+	if (axis.started != axis.finished)
+		return E_ALREADY_RUNNING;
+	int status = start_position(width, speed, grasp, grasp_state);
+	if (status != E_SUCCESS)
+		return status;
+
+	unsigned int id = ++axis.started;
+	axis_done.wait(lock, [id] { return axis.finished == id || !ros::ok(); });
+	if (axis.finished != id)
+		return E_CMD_ABORTED;
+	return axis.result;
+}
+
+/** \brief Stops the motion; the axis brakes with its acceleration, unless fast */
+void stop_axis(bool fast)
+{
+	std::lock_guard<std::mutex> lock(axis_lock);
+
+	if (axis.started != axis.finished)
+		finish_motion(E_CMD_ABORTED);
+	axis.grasping = false;
+	axis.stopped = true;
+	if (axis.grasp_state != GS_HOLDING)
+		axis.grasp_state = GS_IDLE;
+
+	if (fast) {
+		axis.vel = 0.0;
+		axis.motion = MOTION_NONE;
+		axis.fast_stopped = true;
+	}
+	else if (axis.motion != MOTION_NONE)
+		axis.motion = MOTION_BRAKE;
+}
+
+/** \brief Text of the gripper state, as reported by the wsg50 node */
+const char *state_text(const axis_state &a)
+{
+	if (a.fast_stopped) return "| Fast Stop |";
+	if (a.motion != MOTION_NONE) return "| The Fingers are currently moving |";
+	if (a.grasp_state == GS_HOLDING) return "| Force Control Mode |";
+	if (a.stopped) return "| Axis Stopped |";
+	if (a.target_reached) return "| Target Pos reached |";
+	return a.homed ? "| Fingers Referenced |" : "";
+}
+
+/** \brief Publishes status, /joint_states and moving for a snapshot of the axis */
+void publish_state(const axis_state &a, const ros::Time &stamp)
+{
+	wsg50_common::Status status_msg;
+	status_msg.status = state_text(a);
+	status_msg.width = a.pos;
+	status_msg.speed = a.vel;
+	status_msg.acc = a.acc;
+	status_msg.force = a.force;
+	status_msg.force_finger0 = a.force / 2;
+	status_msg.force_finger1 = a.force / 2;
+	state_pub.publish(status_msg);
+
+	joint_msg.header.stamp = stamp;
+	joint_msg.position[0] = a.pos/2000.0;
+	joint_msg.velocity[0] = a.vel/1000.0;
+	joint_msg.effort[0] = a.force;
+	joint_pub.publish(joint_msg);
+
+	bool moving = a.motion != MOTION_NONE;
+	if (moving_published != (int)moving) {
+		std_msgs::Bool moving_msg;
+		moving_msg.data = moving;
+		moving_pub.publish(moving_msg);
+		moving_published = moving;
+	}
+}
+
+/** \brief Sends the finger position to the gazebo joint controllers */
+void publish_command(double width)
+{
+	std_msgs::Float64 lCommand, rCommand;
+
+	rCommand.data = width/2/1000;
+	lCommand.data = rCommand.data * -1.0;
+
+	vel_pub_r_.publish(rCommand);
+	vel_pub_l_.publish(lCommand);
+}
+
+/** \brief Advances the model in fixed steps to the given time, then publishes if due */
+void advance_to(double t)
+{
+	axis_state snapshot;
+	bool publish = false;
+
+	{
+		std::lock_guard<std::mutex> lock(axis_lock);
+
+		// Start, a jump back (e.g. the simulation was reset) or, in real time, a stall of more than a second
+		if (model_time < 0.0 || t < model_time - step_size || (!lockstep && t - model_time > 1.0)) {
+			if (model_time >= 0.0)
+				ROS_WARN("Time jumped from %.3f to %.3f s, model time follows", model_time, t);
+			model_time = t;
+			next_publish = next_command = t;
 		}
 
-	}else if (req.direction == "close"){
+		unsigned long n = (unsigned long)((t - model_time) / step_size + 1e-9);
+		for (unsigned long i = 0; i < n; i++)
+			step_axis(step_size);
+		model_time += n * step_size;
 
-		float nextWidth = currentOpenning - req.increment;
-		
-		if ( (currentOpenning > GRIPPER_MIN_OPEN) && nextWidth > GRIPPER_MIN_OPEN ){
-			move(nextWidth);
-		}else if( nextWidth <= GRIPPER_MIN_OPEN){
-			move(nextWidth);
-			currentOpenning = GRIPPER_MIN_OPEN;
+		if (model_time >= next_publish) {
+			next_publish += publish_period;
+			if (next_publish <= model_time)
+				next_publish = model_time + publish_period;
+			snapshot = axis;
+			publish = true;
+		}
+	}
+
+	if (publish) {
+		publish_state(snapshot, ros::Time(model_time));
+		if (snapshot.pos != last_command) {
+			publish_command(snapshot.pos);
+			last_command = snapshot.pos;
 		}
 	}
-	
 }
 
+void timer_cb(const ros::TimerEvent &ev)
+{
+	advance_to(ros::Time::now().toSec());
+}
+
+void clock_cb(const rosgraph_msgs::Clock::ConstPtr &msg)
+{
+	advance_to(msg->clock.toSec());
+}
+
+bool moveSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res)
+{
+	if (req.width < 0.0 || req.width > size_) {
+		ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %.1f] ", size_);
+		res.error = E_RANGE_ERROR;
+		return false;
+	}
+
+	ROS_INFO("Moving to %f position at %f mm/s.", req.width, req.speed);
+	res.error = run_motion(req.width, req.speed, false, GS_POSITIONING);
+	if (res.error == E_SUCCESS)
+		ROS_INFO("Target position reached.");
+	else
+		ROS_ERROR("Failed while moving : %d", res.error);
+	return true;
+}
+
+bool graspSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res)
+{
+	if (req.width < 0.0 || req.width > size_) {
+		ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %.1f] ", size_);
+		res.error = E_RANGE_ERROR;
+		return false;
+	}
+
+	// The fingers stop at object_width if a part is simulated, else at the nominal width
+	double contact = object_width >= 0.0 ? object_width : req.width;
+	ROS_INFO("Grasping object at %f with %f mm/s.", req.width, req.speed);
+	res.error = run_motion(contact, req.speed, true, GS_GRASPING);
+	if (res.error == E_SUCCESS)
+		ROS_INFO("Object grasped correctly.");
+	else
+		ROS_ERROR("Failed while grasping object : %d", res.error);
+	return true;
+}
+
+bool releaseSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Response &res)
+{
+	if (req.width < 0.0 || req.width > size_) {
+		ROS_ERROR("Imposible to move to this position. (Width values: [0.0 - %.1f] ", size_);
+		res.error = E_RANGE_ERROR;
+		return false;
+	}
+
+	res.error = run_motion(req.width, req.speed, false, GS_RELEASING);
+	if (res.error == E_SUCCESS)
+		ROS_INFO("Object released correctly.");
+	else
+		ROS_ERROR("Failed to release object : %d", res.error);
+	return true;
+}
+
+bool moveIncrementallySrv(wsg50_common::Incr::Request &req, wsg50_common::Incr::Response &res)
+{
+	double currentOpenning;
+	{
+		std::lock_guard<std::mutex> lock(axis_lock);
+		currentOpenning = axis.pos;
+	}
+
+	if (req.direction == "open")
+		res.error = run_motion(currentOpenning + req.increment, 20, false, GS_POSITIONING);
+	else if (req.direction == "close")
+		res.error = run_motion(currentOpenning - req.increment, 20, false, GS_POSITIONING);
+	return true;
+}
 
 bool homingSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
 {
 	ROS_INFO("Homing...");
-	
-	move(0.0);
-	
+
+	if (run_motion(size_, homing_speed, false, GS_POSITIONING) != E_SUCCESS) {
+		ROS_ERROR("Failed to reach home position");
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(axis_lock);
+	axis.homed = true;
 	ROS_INFO("Home position reached.");
 	return true;
 }
 
-bool graspSrv(wsg50_common::Move::Request &req, wsg50_common::Move::Request &res)
+bool stopSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
 {
-	ROS_INFO("Grasping...");
-	
-	// TODO: Increase finger force
-	move(0.0);
-	
-	ROS_INFO("Object grasped");
+	ROS_WARN("Stop!");
+	stop_axis(false);
+	return true;
+}
+
+bool fastStopSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
+{
+	ROS_WARN("Fast stop!");
+	stop_axis(true);
+	ROS_WARN("Fast stopped, acknowledge with ack to move again.");
+	return true;
+}
+
+bool ackSrv(std_srvs::Empty::Request &req, std_srvs::Empty::Request &res)
+{
+	std::lock_guard<std::mutex> lock(axis_lock);
+	axis.fast_stopped = false;
+	return true;
+}
+
+bool setAccSrv(wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
+{
+	std::lock_guard<std::mutex> lock(axis_lock);
+	axis.acc = std::max(100.0, std::min(5000.0, (double)req.val));
+	res.error = E_SUCCESS;
+	return true;
+}
+
+bool setForceSrv(wsg50_common::Conf::Request &req, wsg50_common::Conf::Response &res)
+{
+	std::lock_guard<std::mutex> lock(axis_lock);
+	axis.force_limit = std::max(5.0, std::min(80.0, (double)req.val));
+	if (axis.grasp_state == GS_HOLDING)
+		axis.force = axis.force_limit;
+	res.error = E_SUCCESS;
 	return true;
 }
 
+bool executeSequenceSrv(wsg50_common::ExecuteSequence::Request &req, wsg50_common::ExecuteSequence::Response &res)
+{
+	wsg50_common::Conf::Request conf;
+	wsg50_common::Conf::Response conf_res;
+
+	res.completed = 0;
+	res.error = E_SUCCESS;
+	for (const wsg50_common::Primitive &p : req.primitives) {
+		switch (p.type) {
+		case wsg50_common::Primitive::SET_ACCELERATION: conf.val = p.val; setAccSrv(conf, conf_res); break;
+		case wsg50_common::Primitive::SET_FORCE: conf.val = p.val; setForceSrv(conf, conf_res); break;
+		case wsg50_common::Primitive::MOVE: res.error = run_motion(p.width, p.speed, false, GS_POSITIONING); break;
+		case wsg50_common::Primitive::GRASP:
+			res.error = run_motion(object_width >= 0.0 ? object_width : p.width, p.speed, true, GS_GRASPING);
+			break;
+		case wsg50_common::Primitive::RELEASE: res.error = run_motion(p.width, p.speed, false, GS_RELEASING); break;
+		case wsg50_common::Primitive::HOMING: res.error = run_motion(size_, homing_speed, false, GS_POSITIONING); break;
+		default: res.error = E_RANGE_ERROR; break;
+		}
+		if (res.error != E_SUCCESS)
+			break;
+		res.completed++;
+	}
+	return true;
+}
+
+/** \brief Callback for goal_position topic: moves without waiting */
+void position_cb(const wsg50_common::Cmd::ConstPtr &msg)
+{
+	std::lock_guard<std::mutex> lock(axis_lock);
+	if (axis.started == axis.finished && start_position(msg->pos, msg->speed, false, GS_POSITIONING) != E_SUCCESS)
+		ROS_ERROR("Position goal refused: fast stop not acknowledged");
+}
+
+/** \brief Callback for goal_speed topic: positive values open the gripper */
+void speed_cb(const std_msgs::Float32::ConstPtr &msg)
+{
+	std::lock_guard<std::mutex> lock(axis_lock);
+	if (axis.started != axis.finished || axis.fast_stopped)
+		return;
+	axis.speed = std::max(-420.0, std::min(420.0, (double)msg->data));
+	axis.motion = MOTION_SPEED;
+	axis.stopped = false;
+}
+
 
 int main(int argc, char** argv){
 	
@@ -133,21 +502,77 @@ int main(int argc, char** argv){
 
 	ros::NodeHandle nh("~");
 	
-	std::string vel_pub_l_Topic, vel_pub_r_Topic;
+	std::string vel_pub_l_Topic, vel_pub_r_Topic, joint_name;
+	double rate, acceleration, grasping_force;
 	
 	nh.param<std::string>("vel_pub_l_Topic", vel_pub_l_Topic, "/wsg_50_gl/command");
 	nh.param<std::string>("vel_pub_r_Topic", vel_pub_r_Topic, "/wsg_50_gr/command");
-	
-    currentOpenning = 0.0;
-	
-	ros::ServiceServer moveSS = nh.advertiseService("move", moveSrv);
-	ros::ServiceServer moveIncrementallySS = nh.advertiseService("move_incrementally", moveIncrementallySrv);
-	ros::ServiceServer homingSS = nh.advertiseService("homing", homingSrv);
-	ros::ServiceServer graspSS = nh.advertiseService("grasp", graspSrv);
-	
+	nh.param<std::string>("joint_name", joint_name, "wsg50_finger_left_joint");
+	nh.param("size", size_, GRIPPER_MAX_OPEN);
+	nh.param("rate", rate, 50.0);
+	nh.param("step_size", step_size, 0.001);
+	nh.param("lockstep", lockstep, false);
+	nh.param("acceleration", acceleration, 1000.0);
+	nh.param("grasping_force", grasping_force, 40.0);
+	nh.param("homing_speed", homing_speed, 50.0);
+	nh.param("object_width", object_width, -1.0);
+
+	step_size = std::max(1e-5, step_size);
+	publish_period = 1.0 / std::max(1.0, rate);
+
+	axis.pos = GRIPPER_MIN_OPEN;
+	axis.acc = acceleration;
+	axis.force_limit = grasping_force;
+	axis.grasp_state = GS_IDLE;
+
+	joint_msg.name.assign(1, joint_name);
+	joint_msg.position.resize(1);
+	joint_msg.velocity.resize(1);
+	joint_msg.effort.resize(1);
+
+	// Motion services wait for the model, so they are served by threads of their own
+	ros::CallbackQueue srv_queue;
+	ros::NodeHandle nh_srv(nh);
+	nh_srv.setCallbackQueue(&srv_queue);
+
+	ros::ServiceServer moveSS = nh_srv.advertiseService("move", moveSrv);
+	ros::ServiceServer graspSS = nh_srv.advertiseService("grasp", graspSrv);
+	ros::ServiceServer releaseSS = nh_srv.advertiseService("release", releaseSrv);
+	ros::ServiceServer homingSS = nh_srv.advertiseService("homing", homingSrv);
+	ros::ServiceServer stopSS = nh_srv.advertiseService("stop", stopSrv);
+	ros::ServiceServer fastStopSS = nh_srv.advertiseService("fast_stop", fastStopSrv);
+	ros::ServiceServer ackSS = nh_srv.advertiseService("ack", ackSrv);
+	ros::ServiceServer moveIncrementallySS = nh_srv.advertiseService("move_incrementally", moveIncrementallySrv);
+	ros::ServiceServer setAccSS = nh_srv.advertiseService("set_acceleration", setAccSrv);
+	ros::ServiceServer setForceSS = nh_srv.advertiseService("set_force", setForceSrv);
+	ros::ServiceServer sequenceSS = nh_srv.advertiseService("execute_sequence", executeSequenceSrv);
+
+	ros::Subscriber positionSub = nh.subscribe("goal_position", 5, position_cb);
+	ros::Subscriber speedSub = nh.subscribe("goal_speed", 5, speed_cb);
+
 	vel_pub_l_ = nh.advertise<std_msgs::Float64>(vel_pub_l_Topic, 1000);
 	vel_pub_r_ = nh.advertise<std_msgs::Float64>(vel_pub_r_Topic, 1000);
-	
+	state_pub = nh.advertise<wsg50_common::Status>("status", 1000);
+	joint_pub = nh.advertise<sensor_msgs::JointState>("/joint_states", 10);
+	moving_pub = nh.advertise<std_msgs::Bool>("moving", 10);
+
+	// The model is only advanced from here: by each /clock message, or by a timer at the publishing rate
+	ros::Subscriber clockSub;
+	ros::Timer timer;
+	if (lockstep)
+		clockSub = nh.subscribe("/clock", 100, clock_cb, ros::TransportHints().tcpNoDelay());
+	else
+		timer = nh.createTimer(ros::Duration(publish_period), timer_cb);
+
+	ROS_INFO("Simulating %.0f mm gripper, steps of %.2f ms%s", size_, step_size * 1000, lockstep ? " driven by /clock" : "");
+
+	ros::AsyncSpinner srv_spinner(2, &srv_queue);
+	srv_spinner.start();
 	ros::spin();
-	
-} 
+
+	// Services still waiting for a motion give up
+	axis_done.notify_all();
+	srv_spinner.stop();
+
+	return 0;
+}